@@ -0,0 +1,333 @@
+#include "ofMain.h"
+#include "ofxEbbControl.h"
+#include "ofxEbbSimulator.h"
+#include "ofxEbbTermiosTransport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <new>
+
+// Headless benchmark: ofxEbbControl against a simulated EBB, either on a
+// pseudo-terminal (through ofSerial or termios) or plugged in directly as
+// the transport. Reports throughput, per-command latency (write to
+// reply, taken from the protocol trace) and heap allocations per command
+// on the calling thread.
+//
+//   example-benchmark [--count N] [--latency-us US] [--fifo DEPTH] [--time-scale S]
+//                     [--transport serial|termios|sim]
+
+//========================================================================
+// Allocation counter; only the benchmark thread is counted, so the
+// simulator's own allocations stay out of the numbers
+
+static thread_local uint64_t threadAllocations = 0;
+
+static void * countedAlloc(
+	size_t size) noexcept {
+	++threadAllocations;
+	return std::malloc(size ? size : 1);
+}
+
+// Kept out of line, so GCC doesn't see free() paired with operator new
+// at every inlined delete and warn (-Wmismatched-new-delete)
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static void countedFree(
+	void * p) noexcept {
+	std::free(p);
+}
+
+void * operator new(size_t size) {
+	if (void * p = countedAlloc(size)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void * operator new[](size_t size) {
+	if (void * p = countedAlloc(size)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void * operator new(size_t size, const std::nothrow_t &) noexcept {
+	return countedAlloc(size);
+}
+
+void * operator new[](size_t size, const std::nothrow_t &) noexcept {
+	return countedAlloc(size);
+}
+
+void operator delete(void * p) noexcept {
+	countedFree(p);
+}
+
+void operator delete[](void * p) noexcept {
+	countedFree(p);
+}
+
+void operator delete(void * p, size_t) noexcept {
+	countedFree(p);
+}
+
+void operator delete[](void * p, size_t) noexcept {
+	countedFree(p);
+}
+
+void operator delete(void * p, const std::nothrow_t &) noexcept {
+	countedFree(p);
+}
+
+void operator delete[](void * p, const std::nothrow_t &) noexcept {
+	countedFree(p);
+}
+
+//========================================================================
+
+struct BenchResult {
+	std::string name;
+	size_t commands = 0;
+	double seconds = 0.0;
+	std::vector<double> latencyUs;
+	uint64_t allocations = 0;
+};
+
+static double percentile(
+	std::vector<double> values,
+	double p) {
+	if (values.empty()) {
+		return 0.0;
+	}
+	std::sort(values.begin(), values.end());
+	const size_t index = std::min(values.size() - 1, static_cast<size_t>(p * (values.size() - 1) + 0.5));
+	return values[index];
+}
+
+// Pair each traced write with the next reply line in order; every command
+// used here answers with exactly one line
+static std::vector<double> traceLatencies(
+	ofxEbbControl & ebb) {
+	std::vector<double> out;
+	std::deque<std::chrono::steady_clock::time_point> sent;
+	ebb.forEachTraceRecord([&](const ofxEbbTraceRecord & r) {
+		if (r.kind == ofxEbbTraceKind::Tx) {
+			sent.push_back(r.time);
+		} else if (r.kind == ofxEbbTraceKind::Rx && !sent.empty()) {
+			out.push_back(std::chrono::duration<double, std::micro>(r.time - sent.front()).count());
+			sent.pop_front();
+		}
+	});
+	return out;
+}
+
+template <typename F>
+static BenchResult measure(
+	const std::string & name,
+	ofxEbbControl & ebb,
+	size_t commands,
+	bool fromTrace,
+	F && body) {
+	BenchResult result;
+	result.name = name;
+	result.commands = commands;
+	ebb.clearTrace();
+
+	const uint64_t allocationsBefore = threadAllocations;
+	const auto start = std::chrono::steady_clock::now();
+	body(result);
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.allocations = threadAllocations - allocationsBefore;
+
+	if (fromTrace) {
+		result.latencyUs = traceLatencies(ebb);
+	}
+	return result;
+}
+
+static BenchResult benchSync(
+	ofxEbbControl & ebb,
+	size_t count) {
+	return measure("sync QG", ebb, count, false, [&](BenchResult & r) {
+		r.latencyUs.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			const auto t0 = std::chrono::steady_clock::now();
+			ebb.sendCommand("QG");
+			r.latencyUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+		}
+	});
+}
+
+static BenchResult benchPipelined(
+	ofxEbbControl & ebb,
+	size_t count) {
+	const std::string command = "QG";
+	return measure("pipelined QG", ebb, count, true, [&](BenchResult &) {
+		for (size_t i = 0; i < count; ++i) {
+			ebb.enqueueCommand(command);
+		}
+		ebb.flushPipeline();
+	});
+}
+
+static BenchResult benchPlanned(
+	ofxEbbControl & ebb,
+	size_t count) {
+	// A circle dense enough that every vertex becomes its own move
+	std::vector<ofxEbbPoint> circle;
+	for (size_t i = 0; i < count; ++i) {
+		const double a = TWO_PI * i / count;
+		circle.push_back({ 40.0 + 30.0 * std::cos(a), 40.0 + 30.0 * std::sin(a) });
+	}
+	ebb.setPathBatching(false);
+	ebb.moveTo(circle[0].x, circle[0].y);
+	ebb.waitForCompletion();
+
+	// drawPolyline() returns once every command is acknowledged; waiting
+	// for the motion itself is left out of the numbers
+	BenchResult result = measure("planned LM", ebb, 0, true, [&](BenchResult &) {
+		ebb.drawPolyline(circle, true);
+	});
+	result.commands = result.latencyUs.size();
+	ebb.waitForCompletion();
+	return result;
+}
+
+static BenchResult benchJob(
+	ofxEbbControl & ebb,
+	size_t count) {
+	// The same circle, compiled beforehand and streamed from memory
+	ofxEbbJobCompiler compiler;
+	const auto start = ebb.getPlanner().getPositionSteps();
+	compiler.getPlanner().setPosition(start[0], start[1]);
+	std::vector<ofxEbbPoint> circle;
+	for (size_t i = 0; i < count; ++i) {
+		const double a = TWO_PI * i / count;
+		circle.push_back({ 40.0 + 30.0 * std::cos(a), 40.0 + 30.0 * std::sin(a) });
+	}
+	compiler.setPathBatching(false);
+	compiler.drawPolyline(circle, true);
+	ofxEbbJobFile job;
+	job.open(compiler.getWriter().bytes());
+
+	BenchResult result = measure("job LM", ebb, 0, true, [&](BenchResult &) {
+		ebb.runJob(job);
+	});
+	result.commands = result.latencyUs.size();
+	ebb.waitForCompletion();
+	return result;
+}
+
+static BenchResult benchToolpath(
+	ofxEbbControl & ebb,
+	size_t count) {
+	// The same circle again, planned on the stream's worker threads while
+	// it is sent
+	std::vector<std::vector<ofxEbbPoint>> strokes(1);
+	for (size_t i = 0; i <= count; ++i) {
+		const double a = TWO_PI * i / count;
+		strokes[0].push_back({ 40.0 + 30.0 * std::cos(a), 40.0 + 30.0 * std::sin(a) });
+	}
+	ofxEbbPolylineSource<std::vector<std::vector<ofxEbbPoint>>> source(strokes);
+
+	BenchResult result = measure("toolpath LM", ebb, 0, true, [&](BenchResult &) {
+		ebb.runToolpath(source);
+	});
+	result.commands = result.latencyUs.size();
+	ebb.waitForCompletion();
+	return result;
+}
+
+static void report(
+	const BenchResult & r) {
+	const size_t n = std::max<size_t>(1, r.commands);
+	std::printf("%-14s %8zu %12.0f %10.1f %10.1f %12.2f\n",
+		r.name.c_str(), r.commands, r.commands / std::max(1e-9, r.seconds),
+		percentile(r.latencyUs, 0.50), percentile(r.latencyUs, 0.99),
+		static_cast<double>(r.allocations) / n);
+}
+
+//========================================================================
+int main(int argc, char * argv[]) {
+	ofxEbbSimulatorSettings settings;
+	settings.motionTimeScale = 0.0;
+	size_t count = 2000;
+	std::string transportName = "serial";
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		const std::string flag = argv[i];
+		const double value = std::atof(argv[i + 1]);
+		if (flag == "--transport") {
+			transportName = argv[i + 1];
+		} else if (flag == "--count") {
+			count = static_cast<size_t>(std::max(1.0, value));
+		} else if (flag == "--latency-us") {
+			settings.latency = std::chrono::microseconds(static_cast<int64_t>(value));
+		} else if (flag == "--fifo") {
+			settings.fifoDepth = std::max(1, static_cast<int>(value));
+		} else if (flag == "--time-scale") {
+			settings.motionTimeScale = std::max(0.0, value);
+		} else {
+			std::fprintf(stderr, "Unknown option %s\n", flag.c_str());
+			return 1;
+		}
+	}
+
+	ofSetLogLevel(OF_LOG_WARNING);
+	if (ofxEbbProtocolLogging) {
+		std::printf("Note: protocol logging is compiled in; build with NDEBUG for representative numbers\n");
+	}
+
+	ofxEbbControl ebb;
+	ofxEbbSimulator simulator(settings);
+	std::string port = "simulator";
+	if (transportName == "sim") {
+		ebb.setTransport(std::make_unique<ofxEbbSimulatorTransport>(settings));
+	} else {
+		if (transportName == "termios") {
+			ebb.setTransport(std::make_unique<ofxEbbTermiosTransport>());
+		} else if (transportName != "serial") {
+			std::fprintf(stderr, "Unknown transport %s\n", transportName.c_str());
+			return 1;
+		}
+		if (!simulator.start()) {
+			std::fprintf(stderr, "Could not open a pseudo-terminal\n");
+			return 1;
+		}
+		port = simulator.getPortName();
+	}
+	if (!ebb.setup(port)) {
+		std::fprintf(stderr, "Could not open %s\n", port.c_str());
+		return 1;
+	}
+	ebb.setMotionFifoDepth(settings.fifoDepth);
+	// A board that finishes every move at once makes the host's timing
+	// model meaningless; measure the protocol alone
+	ebb.setFlowControl(settings.motionTimeScale > 0.0);
+	ebb.setTraceCapacity(4 * count + 64);
+
+	std::printf("Simulated EBB on %s (%s): latency %lld us, FIFO depth %d, motion time scale %.2f\n",
+		port.c_str(), transportName.c_str(), static_cast<long long>(settings.latency.count()),
+		settings.fifoDepth, settings.motionTimeScale);
+
+	// Warm up buffers and caches
+	benchSync(ebb, 100);
+	benchPipelined(ebb, 100);
+
+	ebb.resetStats();
+	std::printf("%-14s %8s %12s %10s %10s %12s\n", "mode", "cmds", "cmds/s", "p50 us", "p99 us", "allocs/cmd");
+	report(benchSync(ebb, count));
+	report(benchPipelined(ebb, count));
+	report(benchPlanned(ebb, count));
+	report(benchJob(ebb, count));
+	report(benchToolpath(ebb, count));
+	std::printf("\n%s", ebb.getStats().format().c_str());
+
+	ebb.close();
+	simulator.stop();
+	return 0;
+}
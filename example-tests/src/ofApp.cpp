@@ -12,14 +12,18 @@ void ofApp::setup() {
 	isConnected = false;
 	testRunning = false;
 	currentTest = -1;
+	lastCorrectionTime = 0;
 
-	// Find available serial ports
-	availablePorts = ebbControl.listDevices();
+	// Find candidate serial ports; the port the board was last found on
+	// is remembered between runs
+	availablePorts = discovery.listCandidates();
+	discovery.setCacheFile(ofToDataPath("ebb-ports.txt"));
 
 	addLogMessage("EBB Control Test Application");
 	addLogMessage("Press SPACE to connect to EBB");
 	addLogMessage("Press 'r' to run all tests");
 	addLogMessage("Press 1-7 to run individual tests");
+	addLogMessage("Press 'm' to queue a move without blocking");
 	addLogMessage("Available serial ports:");
 
 	if (availablePorts.empty()) {
@@ -33,6 +37,28 @@ void ofApp::setup() {
 
 //--------------------------------------------------------------
 void ofApp::update() {
+	// draw() shows predictPosition(), which needs no I/O. Once a second a
+	// QS goes through the I/O thread to check it against the board; the
+	// frame never waits for the reply.
+	if (isConnected && ebbControl.isThreadRunning()) {
+		if (!positionQuery.valid()) {
+			if (ofGetElapsedTimef() - lastCorrectionTime >= 1.0f) {
+				lastCorrectionTime = ofGetElapsedTimef();
+				// The callback runs on the I/O thread before the future is
+				// ready, so it can note when the reply arrived
+				positionQuery = ebbControl.sendCommandAsync("QS", [this](const ofxEbbControl::CommandResult &) {
+					positionReplyAt = std::chrono::steady_clock::now();
+				});
+			}
+		} else if (positionQuery.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			auto result = positionQuery.get();
+			std::array<int, 2> steps;
+			if (result.ok && ofxEbbReplyReader(result.response).read(steps) == steps.size()) {
+				ebbControl.correctPrediction(steps, positionReplyAt);
+			}
+		}
+	}
+
 	// If a test is running, check if it's time to proceed to the next step
 	if (testRunning && currentTest >= 0) {
 		float elapsedTime = ofGetElapsedTimef() - testStartTime;
@@ -56,6 +82,9 @@ void ofApp::draw() {
 		ofDrawCircle(20, 20, 10);
 		ofSetColor(255);
 		font.drawString("Connected to: " + portName, 40, 25);
+		// From the commands sent through ofxEbbControl, without a round trip
+		const auto predicted = ebbControl.predictPosition();
+		font.drawString("Position: " + ofToString(predicted.steps[0]) + ", " + ofToString(predicted.steps[1]) + (predicted.penDown ? " (pen down)" : ""), 400, 25);
 	} else {
 		ofSetColor(255, 0, 0);
 		ofDrawCircle(20, 20, 10);
@@ -113,28 +142,22 @@ bool ofApp::findAndConnect() {
 
 	addLogMessage("Searching for EBB device...");
 
-	// Try to connect to each port
-	for (const auto & port : availablePorts) {
-		addLogMessage("Trying port: " + port);
-		try {
-			if (ebbControl.setup(port)) {
-				// Try to get version to confirm it's an EBB
-				std::string version = ebbControl.getFirmwareVersion();
-				if (!version.empty()) {
-					portName = port;
-					isConnected = true;
-					addLogMessage("Connected to EBB on port: " + port);
-					addLogMessage("Firmware version: " + version);
-					return true;
-				} else {
-					addLogMessage("Connected but couldn't get firmware version");
-					ebbControl.close();
-				}
-			}
-		} catch (const std::exception & e) {
-			addLogMessage("Error connecting to " + port + ": " + e.what());
-			ebbControl.close();
+	// Tries the remembered port first, then probes every candidate at once
+	ofxEbbDeviceInfo info;
+	if (discovery.connect(ebbControl, "", &info)) {
+		portName = info.port;
+		isConnected = true;
+		addLogMessage("Connected to EBB on port: " + info.port);
+		addLogMessage("Firmware version: " + info.firmware);
+		if (!info.nickname.empty()) {
+			addLogMessage("Nickname: " + info.nickname);
 		}
+
+		// Hand the port to the background I/O thread
+		if (ebbControl.startThread()) {
+			addLogMessage("Background I/O thread started");
+		}
+		return true;
 	}
 
 	addLogMessage("Failed to find EBB device");
@@ -146,6 +169,12 @@ void ofApp::keyPressed(int key) {
 	if (key == ' ') {
 		// Connect to EBB
 		findAndConnect();
+	} else if (key == 'm' || key == 'M') {
+		if (isConnected) {
+			queueAsyncMove();
+		} else {
+			addLogMessage("Not connected to EBB");
+		}
 	} else if (key == 'r' || key == 'R') {
 		// Run all tests
 		if (isConnected && !testRunning) {
@@ -460,6 +489,23 @@ void ofApp::testQueryFunctions() {
 	}
 }
 
+//--------------------------------------------------------------
+void ofApp::queueAsyncMove() {
+	addLogMessage("Queueing move (1000, 1000) and back");
+
+	// Returns immediately; the draw loop keeps running while the board
+	// moves. The moves are recorded for predictPosition(); the raw EM isn't
+	// seen by the state cache, so that is dropped.
+	ebbControl.sendCommandAsync("EM,1,1");
+	ebbControl.invalidateState();
+	ebbControl.moveStepperStepsAsync(2000, 1000, 1000);
+	ebbControl.moveStepperStepsAsync(2000, -1000, -1000, [](const ofxEbbControl::CommandResult & result) {
+		if (!result.ok) {
+			ofLogError("ofApp") << "Async move failed: " << result.error;
+		}
+	});
+}
+
 //--------------------------------------------------------------
 void ofApp::runAllTests() {
 	if (!isConnected) {
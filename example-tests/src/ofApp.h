@@ -2,6 +2,7 @@
 
 #include "ofMain.h"
 #include "ofxEbbControl.h"
+#include "ofxEbbDiscovery.h"
 
 class ofApp : public ofBaseApp {
 
@@ -29,6 +30,7 @@ public:
 	bool isConnected;
 	std::string portName;
 	std::vector<std::string> availablePorts;
+	ofxEbbDiscovery discovery;
 
 	// Function to find and connect to EBB
 	bool findAndConnect();
@@ -43,6 +45,13 @@ public:
 	void testQueryFunctions();
 	void runAllTests();
 
+	// Non-blocking demo using the background I/O thread; draw() shows
+	// the predicted position, checked against an async QS now and then
+	void queueAsyncMove();
+	std::future<ofxEbbControl::CommandResult> positionQuery;
+	std::chrono::steady_clock::time_point positionReplyAt;
+	float lastCorrectionTime;
+
 	// UI elements
 	ofTrueTypeFont font;
 	std::vector<std::string> logMessages;
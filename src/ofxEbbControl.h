@@ -3,19 +3,43 @@
 
 // Use the full path for OpenFrameworks headers
 #include "ofLog.h"
-#include "ofSerial.h"
 #include "ofUtils.h"
+#include "ofxEbbDeviceState.h"
+#include "ofxEbbDoubleBuffer.h"
+#include "ofxEbbFlowControl.h"
+#include "ofxEbbJob.h"
+#include "ofxEbbPathBatcher.h"
+#include "ofxEbbPlanner.h"
+#include "ofxEbbPositionPredictor.h"
+#include "ofxEbbProtocol.h"
+#include "ofxEbbSampleStream.h"
+#include "ofxEbbSerialTransport.h"
+#include "ofxEbbServoModel.h"
+#include "ofxEbbSpscQueue.h"
+#include "ofxEbbStats.h"
+#include "ofxEbbToolpathStream.h"
+#include "ofxEbbTrace.h"
+#include "ofxEbbTravelOptimizer.h"
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <charconv>
 #include <chrono>
-#include <cstdarg>
+#include <cmath>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
+#include <functional>
+#include <future>
 #include <map>
-#include <sstream>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <utility>
 #include <vector>
 
 // Utility function for clamping values (in case ofClamp is not available)
@@ -26,7 +50,8 @@ T clampValue(const T & value, const T & min, const T & max) {
 
 /**
  * ofxEbbControl: OpenFrameworks-style addon for EiBotBoard/EggBot control.
- * Wraps serial commands to the EBB firmware using ofSerial.
+ * Wraps serial commands to the EBB firmware; bytes go through an
+ * ofxEbbTransport (ofSerial unless setTransport() picks another).
  */
 class ofxEbbControl {
 public:
@@ -78,332 +103,497 @@ public:
 	bool setup(
 		const std::string & portName,
 		int baud = DEFAULT_BAUD) {
+		stopThread();
 		serialPort = portName;
-		return serial.setup(portName, baud);
+		state.invalidate();
+		rxPending = 0;
+		rxTokenizer.reset();
+		return transport->open(portName, baud);
+	}
+
+	/**
+   * Replace the byte transport, e.g. with ofxEbbTermiosTransport or
+   * ofxEbbSimulatorTransport. Closes the current connection; call setup()
+   * afterwards to open the new one.
+   * @param next  New transport; null restores the ofSerial default.
+   */
+	void setTransport(
+		std::unique_ptr<ofxEbbTransport> next) {
+		close();
+		transport = next ? std::move(next) : std::make_unique<ofxEbbSerialTransport>();
+	}
+
+	ofxEbbTransport & getTransport() {
+		return *transport;
 	}
 
 	/**
    * Close the serial port if initialized.
+   * Stops sampling and the background I/O thread first if running.
    */
 	void close() {
-		if (serial.isInitialized()) {
-			serial.close();
+		if (sampleStream.isActive() && transport->isOpen()) {
+			try {
+				stopSampling();
+			} catch (const std::exception & e) {
+				ofLogWarning("ofxEbbControl") << "Could not stop sampling: " << e.what();
+			}
+		}
+		stopThread();
+		if (transport->isOpen()) {
+			transport->close();
 		}
 	}
 
 	//-- Low-Level Command I/O ---------------------------------------
 
 	/**
-   * Send a raw command to EBB, read a specified number of lines, or timeout.
+   * Send a raw command to EBB and wait for its reply, or timeout.
+   * The command is queued behind anything already in flight and its reply
+   * is matched by the protocol layer; nothing is drained or discarded.
    * This implementation handles the specific response patterns of the EBB controller.
    * @param cmd        Command string (without CR).
-   * @param numLines   Number of response lines to read (default 1).
-   * @param timeoutMs  Timeout in milliseconds (default 3000).
-   * @returns          Concatenated response lines separated by newlines.
+   * @param numLines   Unused; the reply layout is derived from the command.
+   * @param timeoutMs  Timeout in milliseconds, or AUTO_TIMEOUT (default)
+   *                   for the command's own deadline (see setReplyTimeout()).
+   * @returns          Post-processed reply, or the firmware error line.
    * @throws           runtime_error if timeout or communication error.
    */
 	std::string sendCommand(
 		const std::string & cmd,
-		int numLines = 1,
-		int timeoutMs = 3000) {
-		// First clear any existing data in the buffer
-		unsigned char buffer[256];
-		while (serial.available() > 0) {
-			serial.readBytes(buffer, std::min(256, serial.available()));
-		}
-
-		// Send the command with CR
-		std::string out = cmd + "\r";
-		ofLogNotice("ofxEbbControl") << "Sending: '" << cmd << "'";
-		serial.writeBytes(reinterpret_cast<const unsigned char *>(out.c_str()), out.size());
-
-		// Wait a tiny bit for the command to be processed
-		std::this_thread::sleep_for(std::chrono::milliseconds(10));
-
-		// Special handling for certain commands
-		// The 'V' command returns the version string without any OK
-		if (cmd == "V") {
-			// The V command returns the version string without any OK
-			std::string responseBuffer;
-			auto start = std::chrono::steady_clock::now();
-			bool receivedResponse = false;
-
-			// Give it some time to receive the complete version string
-			while (!receivedResponse) {
-				// Check for timeout
-				auto now = std::chrono::steady_clock::now();
-				if (std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() > timeoutMs) {
-					ofLogError("ofxEbbControl") << "Command '" << cmd << "' timed out after " << timeoutMs << "ms";
-					ofLogError("ofxEbbControl") << "Partial response: '" << responseBuffer << "'";
-					throw std::runtime_error("Command '" + cmd + "' timed out");
-				}
-
-				// Read available data
-				if (serial.available() > 0) {
-					unsigned char ch;
-					if (serial.readBytes(&ch, 1) > 0) {
-						responseBuffer.push_back(static_cast<char>(ch));
-					}
-				} else {
-					// No more data available and we've got some response
-					if (!responseBuffer.empty() && std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() > 100) {
-						receivedResponse = true; // We've waited long enough after receiving data
-					} else {
-						// Still waiting for data
-						std::this_thread::sleep_for(std::chrono::milliseconds(1));
-					}
-				}
-			}
+		int /*numLines*/ = 1,
+		int timeoutMs = AUTO_TIMEOUT) {
+		return transact(cmd, timeoutMs);
+	}
 
-			ofLogNotice("ofxEbbControl") << "Raw response: '" << responseBuffer << "'";
-			return responseBuffer;
+	/**
+   * Discard whatever is waiting in the receive buffer.
+   * Not needed in normal operation; ignored while replies are outstanding
+   * because it would separate them from their commands.
+   */
+	void drainSerialBuffer() {
+		if (ioThreadRunning || !pipelineInFlight.empty()) {
+			return;
 		}
-		// Special handling for the QG command which returns a hex value without OK
-		else if (cmd == "QG") {
-			std::string responseBuffer;
-			auto start = std::chrono::steady_clock::now();
+		while (readChunk() > 0) { }
+		rxTokenizer.reset();
+	}
 
-			// Read response until we get a complete hex value (usually 2 characters)
-			while (responseBuffer.length() < 2 || !isxdigit(responseBuffer[0]) || !isxdigit(responseBuffer[1])) {
-				// Check for timeout
-				auto now = std::chrono::steady_clock::now();
-				if (std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() > timeoutMs) {
-					ofLogError("ofxEbbControl") << "Command '" << cmd << "' timed out after " << timeoutMs << "ms";
-					ofLogError("ofxEbbControl") << "Partial response: '" << responseBuffer << "'";
-					throw std::runtime_error("Command '" + cmd + "' timed out");
-				}
+	/**
+   * Route lines that arrive while no command is waiting for a reply
+   * (e.g. data streamed after a T command). Called on the thread that is
+   * reading: the caller's thread, or the I/O thread while it runs.
+   * @param handler  Receives each line; null restores the default warning.
+   */
+	void setUnsolicitedLineHandler(
+		std::function<void(std::string_view)> handler) {
+		unsolicitedLineHandler = std::move(handler);
+	}
 
-				// Read available data
-				if (serial.available() > 0) {
-					unsigned char ch;
-					if (serial.readBytes(&ch, 1) > 0) {
-						if (ch != '\r' && ch != '\n') { // Skip CR/LF
-							responseBuffer.push_back(static_cast<char>(ch));
-						}
-					}
-				} else {
-					// Still waiting for data
-					std::this_thread::sleep_for(std::chrono::milliseconds(1));
-				}
+	//-- Pipelined Command I/O ---------------------------------------
 
-				// If we've collected some data but no more is coming, assume we're done
-				if (!responseBuffer.empty() && serial.available() == 0 && std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() > 100) {
-					break;
-				}
-			}
+	static constexpr int DEFAULT_PIPELINE_DEPTH = 8;
+	static constexpr int MAX_PIPELINE_DEPTH = 64;
+	static_assert(MAX_PIPELINE_DEPTH <= ofxEbbFlowControl::MAX_IN_FLIGHT, "The flow model has a slot for every command in flight");
+	static constexpr int ABANDONED_REPLY_GRACE_MS = 3000;
+	static constexpr int AUTO_TIMEOUT = -1; // Per-command deadlines, see setReplyTimeout()
 
-			ofLogNotice("ofxEbbControl") << "Raw response: '" << responseBuffer << "'";
-			return responseBuffer;
-		}
-		// Special handling for QM command which returns data in format "QM,a,b,c,d\r\n"
-		else if (cmd == "QM") {
-			std::string responseBuffer;
-			auto start = std::chrono::steady_clock::now();
-			bool responseComplete = false;
+	/**
+	 * Outcome of one command sent through the pipeline.
+	 * `response` is post-processed the same way sendCommand() does it;
+	 * `error` holds the firmware error line or a timeout message.
+	 */
+	struct CommandResult {
+		uint64_t id = 0;
+		std::string command;
+		std::string response;
+		bool ok = false;
+		std::string error;
+		bool pending = false; // Timed out, but was written and may still run
+	};
 
-			while (!responseComplete) {
-				// Check for timeout
-				auto now = std::chrono::steady_clock::now();
-				if (std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() > timeoutMs) {
-					ofLogError("ofxEbbControl") << "Command '" << cmd << "' timed out after " << timeoutMs << "ms";
-					ofLogError("ofxEbbControl") << "Partial response: '" << responseBuffer << "'";
-					throw std::runtime_error("Command '" + cmd + "' timed out");
-				}
+	/**
+	 * Set how many commands may be in flight (written but not yet
+	 * acknowledged) at once in pipelined mode. Safe to call while the I/O
+	 * thread is running; it uses the new window from its next pass.
+	 * @param depth  Window size (1-MAX_PIPELINE_DEPTH).
+	 */
+	void setPipelineDepth(int depth) {
+		pipelineDepth = clampValue(depth, 1, MAX_PIPELINE_DEPTH);
+	}
 
-				// Read available data
-				if (serial.available() > 0) {
-					unsigned char ch;
-					if (serial.readBytes(&ch, 1) > 0) {
-						responseBuffer.push_back(static_cast<char>(ch));
+	int getPipelineDepth() const {
+		return pipelineDepth;
+	}
 
-						// Look for "\r\n" or "\n" as end of QM response
-						if ((responseBuffer.length() >= 2 && responseBuffer[responseBuffer.length() - 2] == '\r' && responseBuffer[responseBuffer.length() - 1] == '\n') || (responseBuffer.length() >= 1 && responseBuffer[responseBuffer.length() - 1] == '\n')) {
-							responseComplete = true;
-						}
-					}
-				} else {
-					// No data available right now
+	/**
+	 * Number of pipelined commands written but not yet acknowledged.
+	 * Safe from any thread while the I/O thread runs.
+	 */
+	size_t getPipelineInFlight() const {
+		return pipelineInFlight.published();
+	}
 
-					// If we've already received "QM," and have at least 7 characters (QM,0,0,0,0)
-					// and there's been no data for a while, consider the response complete
-					if (responseBuffer.find("QM,") == 0 && responseBuffer.length() >= 7 && std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() > 100) {
-						responseComplete = true;
-					} else {
-						// Keep waiting for more data
-						std::this_thread::sleep_for(std::chrono::milliseconds(1));
-					}
-				}
-			}
+	/**
+	 * Queue a command for pipelined transmission.
+	 * The command is written as soon as the in-flight window has room;
+	 * replies that have already arrived are matched without blocking.
+	 * Like the blocking API, enqueueCommand(), flushPipeline() and
+	 * sendPipelined() are for one thread at a time, even while the I/O
+	 * thread runs; only sendCommandAsync() may be called from any thread.
+	 * @param cmd  Command string (without CR).
+	 */
+	void enqueueCommand(const std::string & cmd) {
+		if (ioThreadRunning) {
+			threadPipelineFutures.push_back(submitAsync(cmd, nullptr, true));
+			return;
+		}
 
-			// Clean up the response - remove CR/LF and trim whitespace
-			responseBuffer.erase(std::remove(responseBuffer.begin(), responseBuffer.end(), '\r'), responseBuffer.end());
-			responseBuffer.erase(std::remove(responseBuffer.begin(), responseBuffer.end(), '\n'), responseBuffer.end());
+		PipelineEntry entry;
+		entry.id = ++nextCommandId;
+		entry.command = cmd;
+		pipelineQueue.push_back(std::move(entry));
+		pumpPipeline();
+	}
 
-			ofLogNotice("ofxEbbControl") << "Raw response: '" << responseBuffer << "'";
-			return responseBuffer;
+	/**
+	 * Wait until every queued command is acknowledged or has failed.
+	 * @param timeoutMs  Maximum time without any progress before the
+	 *                   remaining commands are failed as timed out, or
+	 *                   AUTO_TIMEOUT (default) to fail them once the oldest
+	 *                   is past its own deadline.
+	 * @returns          Results in submission order; the pipeline is cleared.
+	 */
+	std::vector<CommandResult> flushPipeline(
+		int timeoutMs = AUTO_TIMEOUT) {
+		std::vector<CommandResult> results;
+		if (ioThreadRunning) {
+			for (auto & future : threadPipelineFutures) {
+				results.push_back(future.get());
+			}
+			threadPipelineFutures.clear();
+			return results;
 		}
 
-		// For all other commands, read the entire response into a buffer
-		std::string responseBuffer;
-		auto start = std::chrono::steady_clock::now();
-		bool foundOK = false;
+		waitPipelineIdle(timeoutMs);
+		results.swap(pipelineResults);
+		return results;
+	}
 
-		// Read response until we have the OK marker or timeout
-		while (!foundOK) {
-			// Check for timeout
-			auto now = std::chrono::steady_clock::now();
-			if (std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() > timeoutMs) {
-				ofLogError("ofxEbbControl") << "Command '" << cmd << "' timed out after " << timeoutMs << "ms";
-				ofLogError("ofxEbbControl") << "Partial response: '" << responseBuffer << "'";
-				throw std::runtime_error("Command '" + cmd + "' timed out");
-			}
-
-			// Read available data one byte at a time for more careful control
-			unsigned char ch;
-			if (serial.available() > 0) {
-				if (serial.readBytes(&ch, 1) > 0) {
-					responseBuffer.push_back(static_cast<char>(ch));
-
-					// Check for OK in the response
-					if (responseBuffer.size() >= 2) {
-						size_t pos = responseBuffer.find("OK");
-						if (pos != std::string::npos) {
-							foundOK = true;
-						}
-					}
-				}
-			} else {
-				// No data available, wait a tiny bit
-				std::this_thread::sleep_for(std::chrono::milliseconds(1));
-			}
+	/**
+	 * Send a batch of commands with up to getPipelineDepth() in flight.
+	 * @param cmds       Commands to send (without CR).
+	 * @param timeoutMs  Progress timeout, see flushPipeline().
+	 * @returns          One result per command, in order.
+	 */
+	std::vector<CommandResult> sendPipelined(
+		const std::vector<std::string> & cmds,
+		int timeoutMs = AUTO_TIMEOUT) {
+		for (const auto & cmd : cmds) {
+			enqueueCommand(cmd);
 		}
+		return flushPipeline(timeoutMs);
+	}
 
-		ofLogNotice("ofxEbbControl") << "Raw response: '" << responseBuffer << "'";
+	//-- Deadlines and Recovery --------------------------------------
 
-		// Process the response based on the command
-		if (cmd.substr(0, 2) == "QP") {
-			// QP returns pen status (0=down, 1=up)
-			// Format might be "0OK" or "1OK" with no separation
-			if (responseBuffer.find("0OK") != std::string::npos) {
-				return "0"; // Pen down
-			} else {
-				return "1"; // Pen up
-			}
-		} else if (cmd.substr(0, 2) == "QS") {
-			// QS returns step positions, typically "0,0OK"
-			std::string stepPos = responseBuffer;
-			size_t okPos = stepPos.find("OK");
-			if (okPos != std::string::npos) {
-				stepPos = stepPos.substr(0, okPos);
-			}
+	static constexpr int DEFAULT_REPLY_TIMEOUT_MS = 250;
+	static constexpr double MOTION_DEADLINE_SLACK = 1.25;
+	static constexpr int UNKNOWN_MOTION_MS = 3000; // HM, whose duration depends on the board
+	static constexpr int DEFAULT_JOB_RECOVERY = 2;
 
-			// Strip any non-numeric/comma characters
-			std::string cleaned;
-			for (char c : stepPos) {
-				if (isdigit(c) || c == ',' || c == '-') {
-					cleaned += c;
-				}
-			}
+	/**
+	 * How long the board may take to answer a command once nothing holds
+	 * its reply back (default DEFAULT_REPLY_TIMEOUT_MS). With AUTO_TIMEOUT,
+	 * the default everywhere, each command gets its own deadline when it
+	 * is written: a query gets this budget, a motion command also the
+	 * motion queued ahead of it (times MOTION_DEADLINE_SLACK), since the
+	 * board only answers once its FIFO takes the command. A lost reply is
+	 * noticed within this budget rather than after a blanket timeout.
+	 */
+	void setReplyTimeout(
+		int timeoutMs) {
+		replyTimeoutMs = std::max(1, timeoutMs);
+	}
 
-			return cleaned;
-		} else if (cmd.substr(0, 2) == "QT") {
-			// QT returns nickname
-			std::string nickname = responseBuffer;
-			size_t okPos = nickname.find("OK");
-			if (okPos != std::string::npos) {
-				nickname = nickname.substr(0, okPos);
-			}
+	int getReplyTimeout() const {
+		return replyTimeoutMs;
+	}
 
-			// Clean up the nickname
-			nickname.erase(std::remove_if(nickname.begin(), nickname.end(),
-							   [](unsigned char c) { return c == '\r' || c == '\n'; }),
-				nickname.end());
+	/**
+	 * Resync (see resync()) whenever a reply times out (on by default),
+	 * then send a query that timed out in a blocking call again up to
+	 * `queryRetries` times; async results report the timeout. Motion is
+	 * never resent, as whether the board ran it can't be told;
+	 * runJob() resumes from the last node instead (see setJobRecovery()).
+	 */
+	void setAutoResync(
+		bool enable,
+		int queryRetries = 1) {
+		autoResync = enable;
+		this->queryRetries = std::max(0, queryRetries);
+	}
 
-			if (nickname.empty()) {
-				return "EBB Controller";
-			}
+	bool getAutoResync() const {
+		return autoResync;
+	}
 
-			return nickname;
-		} else if (cmd.substr(0, 2) == "QB") {
-			// QB returns button status (0=not pressed, 1=pressed)
-			if (responseBuffer.find("1OK") != std::string::npos) {
-				return "1";
-			} else {
-				return "0";
+	/**
+	 * Get back in step with the board after a lost byte or reply: fail
+	 * everything in flight, end any half-received command line, send V
+	 * and discard whatever arrives ahead of its banner, then re-read the
+	 * FIFO state (QG). Commands not written yet are kept and sent after.
+	 * Usually a few milliseconds; a probe stuck behind queued motion
+	 * waits for that motion's deadline.
+	 * @returns False if the board didn't answer the probe.
+	 */
+	bool resync() {
+		if (!ioThreadRunning) {
+			return resyncPort(true);
+		}
+		// The I/O thread owns the port; have it resync between commands
+		// (callers asking at the same time share one resync)
+		std::shared_future<bool> done;
+		{
+			std::lock_guard<std::mutex> lock(ioWakeMutex);
+			if (!ioThreadRunning) {
+				return false;
 			}
-		} else if (cmd.substr(0, 2) == "QC") {
-			// QC returns current and voltage readings
-			std::string values = responseBuffer;
-			size_t okPos = values.find("OK");
-			if (okPos != std::string::npos) {
-				values = values.substr(0, okPos);
+			if (!resyncRequested) {
+				resyncDone = std::promise<bool>();
+				resyncResult = resyncDone.get_future().share();
+				resyncRequested = true;
 			}
+			done = resyncResult;
+		}
+		ioWake.notify_one();
+		return done.get();
+	}
 
-			// Clean up the response to just get the values
-			std::string cleaned;
-			for (char c : values) {
-				if (isdigit(c) || c == ',') {
-					cleaned += c;
-				}
-			}
+	/**
+	 * How many times runJob() picks up again after a failed command
+	 * (default DEFAULT_JOB_RECOVERY; 0 lets the first failure throw). Each
+	 * recovery resyncs, waits for queued motion to finish, forgets the
+	 * cached pen state and resumes from the last node both the board (QN)
+	 * and the host saw acknowledged, redrawing at most one batch.
+	 */
+	void setJobRecovery(
+		int attempts) {
+		jobRecovery = std::max(0, attempts);
+	}
 
-			return cleaned;
-		} else if (cmd.substr(0, 2) == "QR") {
-			// QR returns servo power status
-			if (responseBuffer.find("1OK") != std::string::npos) {
-				return "1";
-			} else {
-				return "0";
-			}
-		} else if (cmd.substr(0, 2) == "QN") {
-			// QN returns node count
-			std::string nodeCount = responseBuffer;
-			size_t okPos = nodeCount.find("OK");
-			if (okPos != std::string::npos) {
-				nodeCount = nodeCount.substr(0, okPos);
-			}
+	int getJobRecovery() const {
+		return jobRecovery;
+	}
 
-			// Clean up the node count
-			nodeCount.erase(std::remove_if(nodeCount.begin(), nodeCount.end(),
-								[](unsigned char c) { return !isdigit(c); }),
-				nodeCount.end());
+	//-- Background I/O Thread ---------------------------------------
 
-			return nodeCount;
-		} else if (responseBuffer == "OK" || responseBuffer.find("OK") != std::string::npos) {
-			// For commands that just return OK
-			return "OK";
+	static constexpr size_t DEFAULT_QUEUE_CAPACITY = 256;
+
+	using CommandCallback = std::function<void(const CommandResult &)>;
+
+	/**
+	 * Start a worker thread that owns the serial port.
+	 * Commands are handed over through lock-free rings; sendCommandAsync()
+	 * may be called from any thread (submissions take a short lock).
+	 * While the thread runs, the blocking API still works: each call is
+	 * queued and waits for its own result. The blocking API shares
+	 * per-instance buffers, so use it from one thread at a time.
+	 * @param queueCapacity  Slots in each submission ring.
+	 * @returns              False if the port is not open.
+	 */
+	bool startThread(
+		size_t queueCapacity = DEFAULT_QUEUE_CAPACITY) {
+		if (ioThreadRunning) {
+			return true;
+		}
+		if (!transport->isOpen()) {
+			ofLogError("ofxEbbControl") << "Cannot start I/O thread, port not open";
+			return false;
 		}
 
-		// For any other response, return as-is
-		return responseBuffer;
+		// Hand over a clean pipeline
+		waitPipelineIdle(AUTO_TIMEOUT);
+		pipelineResults.clear();
+
+		motionQueue.reset(new ofxEbbSpscQueue<AsyncRequest>(queueCapacity));
+		queryQueue.reset(new ofxEbbSpscQueue<AsyncRequest>(queueCapacity));
+		ioThreadRunning = true;
+		ioThread = std::thread(&ofxEbbControl::ioThreadLoop, this);
+		return true;
 	}
 
-	// Helper method to clear any data in the serial buffer
-	void drainSerialBuffer() {
-		unsigned char buffer[256];
-		while (serial.available() > 0) {
-			serial.readBytes(buffer, std::min(256, serial.available()));
+	/**
+	 * Stop the worker thread. Commands still queued or in flight are
+	 * completed with an error.
+	 */
+	void stopThread() {
+		if (!ioThreadRunning) {
+			return;
 		}
+		ioThreadRunning = false;
+		ioWake.notify_one();
+		if (ioThread.joinable()) {
+			ioThread.join();
+		}
+		threadPipelineFutures.clear();
+	}
+
+	bool isThreadRunning() const {
+		return ioThreadRunning;
+	}
+
+	/**
+	 * Queue a command on the I/O thread without waiting for it.
+	 * Queries (and ES) travel on their own lane and are written
+	 * ahead of motion that hasn't been sent yet, so status polling doesn't
+	 * sit behind a long motion backlog.
+	 * @param cmd       Command string (without CR).
+	 * @param callback  Optional; invoked on the I/O thread on completion.
+	 *                  It must not call blocking ofxEbbControl methods.
+	 * @param urgent    Send on the query lane ahead of queued motion even if
+	 *                  it is a motion command (e.g. a pen lift on abort).
+	 * @returns         Future for the result. If the thread is not running or
+	 *                  the ring is full it is already satisfied with an error.
+	 */
+	std::future<CommandResult> sendCommandAsync(
+		const std::string & cmd,
+		CommandCallback callback = nullptr,
+		bool urgent = false) {
+		return submitAsync(cmd, std::move(callback), false, urgent);
+	}
+
+	//-- Protocol Trace ----------------------------------------------
+
+	/**
+	 * Keep the last `records` commands and reply lines in a preallocated
+	 * ring (unlike the protocol log, this is available in release builds).
+	 * @param records  Ring size; 0 turns tracing off.
+	 */
+	void setTraceCapacity(
+		size_t records) {
+		trace.reserve(records);
+	}
+
+	/**
+	 * Log the trace records gathered since the previous dump whenever a
+	 * command fails or times out. On by default once a capacity is set.
+	 */
+	void setTraceDumpOnError(
+		bool enable) {
+		traceDumpOnError = enable;
+	}
+
+	/**
+	 * All retained trace records, oldest first, one per line.
+	 */
+	std::string getTrace() {
+		std::string out;
+		auto now = std::chrono::steady_clock::now();
+		trace.forEach([&](const ofxEbbTraceRecord & r) {
+			out += ofxEbbTraceRing::format(r, now);
+			out += '\n';
+		});
+		return out;
+	}
+
+	void clearTrace() {
+		trace.clear();
+	}
+
+	/**
+	 * Write the retained trace to the error log.
+	 */
+	void dumpTrace() {
+		dumpTraceRecords(false);
+	}
+
+	/**
+	 * Visit the retained records, oldest first, e.g. to derive timings.
+	 * @param visit  Called as visit(const ofxEbbTraceRecord &) under the
+	 *               trace lock; keep it short.
+	 */
+	template <typename F>
+	void forEachTraceRecord(
+		F && visit) {
+		trace.forEach(std::forward<F>(visit));
+	}
+
+	//-- Statistics --------------------------------------------------
+
+	/**
+	 * Counters since construction or the last resetStats(): commands and
+	 * errors per opcode, bytes each way, timeouts, late replies, time spent
+	 * waiting on flow control, and log-bucketed histograms of write -> first
+	 * reply byte and first byte -> complete reply.
+	 * Always on, lock-free, and safe to call from any thread (e.g. draw()).
+	 */
+	ofxEbbStats getStats() const {
+		return stats.snapshot();
+	}
+
+	/**
+	 * Zero the statistics. Safe to call from any thread.
+	 */
+	void resetStats() {
+		stats.reset();
 	}
 
 	//-- Public API Methods ------------------------------------------
 
+	/**
+   * Analog readings by channel (A), as filled in by getAnalogValues().
+   */
+	static constexpr int ANALOG_CHANNELS = 16;
+	struct AnalogValues {
+		std::array<uint16_t, ANALOG_CHANNELS> values {}; // 0-1023
+		uint16_t present = 0; // Bit per channel that was in the reply
+
+		bool has(
+			int channel) const {
+			return channel >= 0 && channel < ANALOG_CHANNELS && (present >> channel) & 1;
+		}
+	};
+
+	/**
+   * Read all enabled analog inputs into `out` without allocating, so it
+   * can be polled at a high rate.
+   * @returns False if the reply couldn't be parsed.
+   */
+	bool getAnalogValues(
+		AnalogValues & out) {
+		ofxEbbReplyReader reader(transact("A"));
+		if (!reader.skipPrefix("A")) {
+			return false;
+		}
+		out.present = 0;
+		int channel;
+		uint16_t value;
+		while (reader.next(channel)) {
+			if (!reader.next(value) || channel < 0 || channel >= ANALOG_CHANNELS) {
+				return false;
+			}
+			out.values[channel] = value;
+			out.present |= static_cast<uint16_t>(1u << channel);
+		}
+		return true;
+	}
+
 	/**
    * Retrieve all analog input readings.
    * @returns Map from channel number to value (0-1023).
    */
 	std::map<int, int> getAnalogValues() {
-		auto resp = sendCommand("A");
-		auto parts = split(resp, ',');
+		AnalogValues reading;
+		if (!getAnalogValues(reading)) {
+			throw std::runtime_error("Bad analog response");
+		}
 		std::map<int, int> values;
-
-		for (size_t i = 1; i < parts.size(); ++i) {
-			auto kv = split(parts[i], ':');
-			int channel = std::stoi(kv[0]);
-			int value = std::stoi(kv[1]);
-			values[channel] = value;
+		for (int channel = 0; channel < ANALOG_CHANNELS; ++channel) {
+			if (reading.has(channel)) {
+				values[channel] = reading.values[channel];
+			}
 		}
-
 		return values;
 	}
 
@@ -443,9 +633,11 @@ public:
 			assertByte(v);
 		}
 
-		auto cmd = "C," + join(tris, ',');
-		auto resp = sendCommand(cmd);
-		checkOk(resp);
+		commandBuffer.op("C");
+		for (auto v : tris) {
+			commandBuffer.arg(v);
+		}
+		sendFormatted();
 	}
 
 	/**
@@ -453,6 +645,8 @@ public:
    */
 	void clearStepPosition() {
 		checkOk(sendCommand("CS"));
+		planner.setPosition(0, 0);
+		predictor.reset(planner.getPositionSteps());
 	}
 
 	/**
@@ -478,13 +672,15 @@ public:
 	void enableMotors(
 		int m1Mode,
 		int m2Mode) {
-		// Store the configuration for future reference by getMotorConfig()
-		static std::array<int, 2> & lastKnownConfig = getLastKnownMotorConfig();
-		lastKnownConfig = { m1Mode, m2Mode };
+		if (stateCaching && state.motorModes.is({ m1Mode, m2Mode })) {
+			return;
+		}
 
-		auto cmd = "EM," + toStr(m1Mode) + "," + toStr(m2Mode);
-		auto resp = sendCommand(cmd);
-		checkOk(resp);
+		commandBuffer.op("EM").arg(m1Mode).arg(m2Mode);
+		sendFormatted();
+
+		// Remembered for getMotorConfig() and to skip repeats
+		state.motorModes.set({ m1Mode, m2Mode });
 	}
 
 	/**
@@ -501,33 +697,21 @@ public:
 		bool disableMotors = false) {
 		try {
 			auto cmd = disableMotors ? "ES,1" : "ES";
-			auto resp = sendCommand(cmd, 2);
-
-			// Extract the emergency stop data from the response
-			std::string stopData;
-			if (resp.find("OK") != std::string::npos) {
-				stopData = resp.substr(0, resp.find("OK"));
-			} else {
-				stopData = resp;
-			}
-
-			// Clean up and parse the values
-			std::string cleaned;
-			for (char c : stopData) {
-				if (isdigit(c) || c == ',' || c == '-') {
-					cleaned += c;
-				}
+			if (disableMotors) {
+				state.motorModes.set({ MOTOR_DISABLE, MOTOR_DISABLE });
 			}
-
-			auto vals = split(cleaned, ',');
-			if (vals.size() < 5) {
+			// Reply is already reduced to "interrupted,fifo1,fifo2,rem1,rem2"
+			std::array<int, 5> vals;
+			const bool parsed = ofxEbbReplyReader(transact(cmd)).read(vals) == vals.size();
+			forgetQueuedMotion();
+			if (!parsed) {
 				throw std::runtime_error("Invalid emergency stop response");
 			}
 
 			return StopInfo {
-				vals[0] == "1",
-				{ std::stoi(vals[1]), std::stoi(vals[2]) },
-				{ std::stoi(vals[3]), std::stoi(vals[4]) }
+				vals[0] == 1,
+				{ vals[1], vals[2] },
+				{ vals[3], vals[4] }
 			};
 		} catch (const std::exception & e) {
 			ofLogError("ofxEbbControl") << "Error in emergency stop: " << e.what();
@@ -535,6 +719,20 @@ public:
 		}
 	}
 
+	/**
+	 * Queued motion was thrown away (ES): empty the flow model and hold
+	 * the planner and prediction where the carriage is expected to be now.
+	 * emergencyStop() does this itself; call it after an ES sent some
+	 * other way, e.g. ofxEbbFleet::stopAll(). getStepPositions() reads
+	 * where the board really stopped.
+	 */
+	void forgetQueuedMotion() {
+		motionFlow.reset();
+		const auto stopped = predictor.predict(std::chrono::steady_clock::now()).steps;
+		planner.setPosition(stopped[0], stopped[1]);
+		predictor.reset(planner.getPositionSteps());
+	}
+
 	/**
    * Perform an absolute move relative to home.
    * @param stepFrequency  Step frequency in Hz (2-25000).
@@ -550,9 +748,13 @@ public:
 				"Frequency out of range");
 		}
 
-		auto cmd = "HM," + toStr(stepFrequency) + "," + toStr(pos1) + "," + toStr(pos2);
-		auto resp = sendCommand(cmd);
-		checkOk(resp);
+		commandBuffer.op("HM").arg(stepFrequency).arg(pos1).arg(pos2);
+		sendMotion(0.0);
+		// The axis with further to go runs at stepFrequency
+		const auto from = planner.getPositionSteps();
+		const int64_t longest = std::max(std::abs(pos1 - from[0]), std::abs(pos2 - from[1]));
+		planner.setPosition(pos1, pos2);
+		predictMotion(static_cast<double>(longest) / stepFrequency);
 	}
 
 	/**
@@ -560,15 +762,10 @@ public:
    * @returns Array of 5 port values.
    */
 	std::array<int, 5> getDigitalInputs() {
-		auto resp = sendCommand("I");
-		if (resp.empty() || resp[0] != 'I') {
-			throw std::runtime_error("Bad input response");
-		}
-
-		auto parts = split(resp, ',');
+		ofxEbbReplyReader reader(transact("I"));
 		std::array<int, 5> out;
-		for (int i = 0; i < 5; ++i) {
-			out[i] = std::stoi(parts[i + 1]);
+		if (!reader.skipPrefix("I") || reader.read(out) < out.size()) {
+			throw std::runtime_error("Bad input response");
 		}
 		return out;
 	}
@@ -586,9 +783,10 @@ public:
 		int64_t accel2,
 		bool clear2) {
 		int clearMask = (clear2 ? 2 : 0) | (clear1 ? 1 : 0);
-		auto cmd = "LM," + joinInt({ rate1, steps1, accel1, rate2, steps2, accel2, clearMask });
-		auto resp = sendCommand(cmd);
-		checkOk(resp);
+		commandBuffer.op("LM").arg(rate1).arg(steps1).arg(accel1).arg(rate2).arg(steps2).arg(accel2).arg(clearMask);
+		sendMotion(0.0);
+		planner.offsetPosition(steps1, steps2);
+		predictor.onLowLevelMove(0.0, { { rate1, rate2 } }, { { steps1, steps2 } }, { { accel1, accel2 } }, predictedPen());
 	}
 
 	/**
@@ -603,9 +801,9 @@ public:
 		int64_t accel2,
 		bool clear2) {
 		int clearMask = (clear2 ? 2 : 0) | (clear1 ? 1 : 0);
-		auto cmd = "LT," + joinInt({ intervals, rate1, accel1, rate2, accel2, clearMask });
-		auto resp = sendCommand(cmd);
-		checkOk(resp);
+		commandBuffer.op("LT").arg(intervals).arg(rate1).arg(accel1).arg(rate2).arg(accel2).arg(clearMask);
+		sendMotion(intervals / ofxEbbTickHz);
+		predictMotion(intervals / ofxEbbTickHz);
 	}
 
 	/**
@@ -617,12 +815,13 @@ public:
 			throw std::runtime_error("Memory address out of range");
 		}
 
-		auto resp = sendCommand("MR," + toStr(address));
-		auto parts = split(resp, ',');
-		if (parts[0] != "MR") {
+		commandBuffer.op("MR").arg(address);
+		ofxEbbReplyReader reader(transact(commandBuffer.view()));
+		int value;
+		if (!reader.skipPrefix("MR") || !reader.next(value)) {
 			throw std::runtime_error("Bad MR response");
 		}
-		return static_cast<uint8_t>(std::stoi(parts[1]));
+		return static_cast<uint8_t>(value);
 	}
 
 	/**
@@ -664,9 +863,11 @@ public:
 			assertByte(v);
 		}
 
-		auto cmd = "O," + join(outputs, ',');
-		auto resp = sendCommand(cmd);
-		checkOk(resp);
+		commandBuffer.op("O");
+		for (auto v : outputs) {
+			commandBuffer.arg(v);
+		}
+		sendFormatted();
 	}
 
 	/**
@@ -674,9 +875,11 @@ public:
    */
 	void configurePulse(
 		const std::array<int, 8> & params) {
-		auto cmd = "PC," + join(params, ',');
-		auto resp = sendCommand(cmd);
-		checkOk(resp);
+		commandBuffer.op("PC");
+		for (auto v : params) {
+			commandBuffer.arg(v);
+		}
+		sendFormatted();
 	}
 
 	/**
@@ -691,9 +894,8 @@ public:
 			throw std::runtime_error("Pin index out of range");
 		}
 
-		std::string cmd = stringize(
-			"PD,%c,%d,%d", port, pin, output ? 0 : 1);
-		checkOk(sendCommand(cmd));
+		commandBuffer.op("PD").arg(port).arg(pin).arg(output ? 0 : 1);
+		sendFormatted();
 	}
 
 	/**
@@ -717,14 +919,13 @@ public:
 			throw std::runtime_error("Pin index out of range");
 		}
 
-		std::string cmd = stringize(
-			"PI,%c,%d", port, pin);
-		auto resp = sendCommand(cmd);
-		auto parts = split(resp, ',');
-		if (parts[0] != "PI") {
+		commandBuffer.op("PI").arg(port).arg(pin);
+		ofxEbbReplyReader reader(transact(commandBuffer.view()));
+		int value;
+		if (!reader.skipPrefix("PI") || !reader.next(value)) {
 			throw std::runtime_error("Bad PI response");
 		}
-		return parts[1] == "1";
+		return value == 1;
 	}
 
 	/**
@@ -739,9 +940,8 @@ public:
 			throw std::runtime_error("Pin index out of range");
 		}
 
-		std::string cmd = stringize(
-			"PO,%c,%d,%d", port, pin, high ? 1 : 0);
-		checkOk(sendCommand(cmd));
+		commandBuffer.op("PO").arg(port).arg(pin).arg(high ? 1 : 0);
+		sendFormatted();
 	}
 
 	/**
@@ -752,12 +952,8 @@ public:
 		try {
 			auto resp = sendCommand("QB", 2);
 
-			// The QB command should return "0" or "1" followed by "OK"
-			if (resp.find("1") != std::string::npos) {
-				return true; // Button was pressed
-			} else {
-				return false; // Button was not pressed
-			}
+			// The QB command returns "1" if pressed since the last query
+			return resp == "1";
 		} catch (const std::exception & e) {
 			ofLogError("ofxEbbControl") << "Error checking button status: " << e.what();
 			return false;
@@ -774,32 +970,14 @@ public:
 	CurrentInfo getCurrentInfo(
 		bool oldBoard = false) {
 		try {
-			auto resp = sendCommand("QC", 2);
-
-			// Extract the current/voltage values from the response
-			std::string values;
-			if (resp.find("OK") != std::string::npos) {
-				// Get everything before "OK"
-				values = resp.substr(0, resp.find("OK"));
-			} else {
-				values = resp;
-			}
-
-			// Clean up and parse the values
-			std::string cleaned;
-			for (char c : values) {
-				if (isdigit(c) || c == ',') {
-					cleaned += c;
-				}
-			}
-
-			auto parts = split(cleaned, ',');
-			if (parts.size() < 2) {
+			// Reply is already reduced to "<RA0>,<V+>"
+			std::array<int, 2> parts;
+			if (ofxEbbReplyReader(transact("QC")).read(parts) < parts.size()) {
 				throw std::runtime_error("Invalid current info response");
 			}
 
-			double ra0 = 3.3 * std::stoi(parts[0]) / 1023.0;
-			double vp = 3.3 * std::stoi(parts[1]) / 1023.0;
+			double ra0 = 3.3 * parts[0] / 1023.0;
+			double vp = 3.3 * parts[1] / 1023.0;
 			double scale = oldBoard ? (1.0 / 11.0) : (1.0 / 9.2);
 
 			return {
@@ -816,46 +994,33 @@ public:
    * Query the EBB firmware version (QV).
    */
 	std::string getFirmwareVersion() {
+		if (stateCaching && state.firmware.known) {
+			return state.firmware.value;
+		}
 		std::string resp = sendCommand("V");
+		state.firmware.set(resp);
 		return resp;
 	}
 
 	/**
    * Query motor step mode config.
-   * Note: The QE command is only available in firmware v2.8.0 and newer.
-   * For compatibility, this implementation uses the last known values
-   * set with enableMotors().
+   * Returns the modes last set with enableMotors() when known; otherwise
+   * asks QE (firmware v2.8.0 and newer) and falls back to 16x microstepping.
    */
 	std::array<int, 2> getMotorConfig() {
+		if (state.motorModes.known) {
+			return state.motorModes.value;
+		}
 		try {
-			// Store the last used configuration to support all firmware versions
-			static std::array<int, 2> lastKnownConfig = { MOTOR_STEP_DIV16, MOTOR_STEP_DIV16 };
-
-			// Try to query the motor status using QM command
-			// This is more broadly supported than QE and can indicate if motors are enabled
-			auto resp = sendCommand("QM", 1, 1000); // Shorter timeout for better user experience
-			auto parts = split(resp, ',');
-
-			if (parts.size() >= 4) {
-				// QM returns motor status but not microstep mode
-				// We can at least detect if motors are enabled/disabled
-				bool motor1Enabled = parts[2] == "1";
-				bool motor2Enabled = parts[3] == "1";
-
-				// If motors are disabled, update our cached values
-				if (!motor1Enabled) {
-					lastKnownConfig[0] = MOTOR_DISABLE;
-				}
-				if (!motor2Enabled) {
-					lastKnownConfig[1] = MOTOR_DISABLE;
-				}
+			std::array<int, 2> modes;
+			if (parseMotorEnables(transact("QE", 1000), modes)) {
+				state.motorModes.set(modes);
+				return modes;
 			}
-
-			return lastKnownConfig;
 		} catch (const std::exception & e) {
-			// Return default values if there's an error
-			return { MOTOR_STEP_DIV16, MOTOR_STEP_DIV16 };
+			ofLogVerbose("ofxEbbControl") << "QE not available: " << e.what();
 		}
+		return { MOTOR_STEP_DIV16, MOTOR_STEP_DIV16 };
 	}
 
 	/**
@@ -873,43 +1038,24 @@ public:
 	};
 	GeneralStatus getGeneralStatus() {
 		auto resp = sendCommand("QG");
-		int statusByte = std::stoi(resp, nullptr, 16);
-
-		auto bitSet = [&](int b) {
-			return (statusByte & (1 << b)) != 0;
-		};
-
-		return {
-			bitSet(7), bitSet(6), bitSet(5), bitSet(4),
-			bitSet(3), bitSet(2), bitSet(1), !bitSet(0)
-		};
+		return generalStatusFromByte(std::stoi(resp, nullptr, 16));
 	}
 
 	/**
    * Query current layer value (QL).
    */
 	int getLayer() {
+		if (stateCaching && state.layer.known) {
+			return state.layer.value;
+		}
 		try {
-			auto resp = sendCommand("QL", 2);
-
-			// Extract layer value from response
-			std::string layerValue;
-			if (resp.find("OK") != std::string::npos) {
-				layerValue = resp.substr(0, resp.find("OK"));
-			} else {
-				layerValue = resp;
-			}
-
-			// Clean up and parse the value
-			layerValue.erase(std::remove_if(layerValue.begin(), layerValue.end(),
-								 [](unsigned char c) { return !isdigit(c); }),
-				layerValue.end());
-
-			if (layerValue.empty()) {
+			int layer = 0;
+			if (!ofxEbbReplyReader(transact("QL")).next(layer)) {
 				return 0;
 			}
 
-			return std::stoi(layerValue);
+			state.layer.set(layer);
+			return layer;
 		} catch (const std::exception & e) {
 			ofLogError("ofxEbbControl") << "Error getting layer: " << e.what();
 			return 0;
@@ -925,29 +1071,56 @@ public:
 		bool fifoEmpty;
 	};
 	MotorStatus getMotorStatus() {
-		auto resp = sendCommand("QM");
-		auto parts = split(resp, ',');
-		return {
-			std::stoi(parts[1]) > 0,
-			{ parts[2] == "1", parts[3] == "1" },
-			std::stoi(parts[4]) == 0
-		};
+		MotorStatus status;
+		if (!parseMotorStatus(transact("QM"), status)) {
+			throw std::runtime_error("Bad QM response");
+		}
+		return status;
 	}
 
 	/**
-   * Query pen state (QP).
-   * @returns True if pen is in down position (0), false if up (1).
-   */
-	bool isPenDown() {
-		try {
-			auto resp = sendCommand("QP", 2);
-
-			// Look for "0" or "1" in the response
-			if (resp.find("0") != std::string::npos && resp.find("OK") != std::string::npos) {
-				return true; // Pen is down (0)
-			} else {
-				return false; // Pen is up (1) or we couldn't determine
+	 * Parse a QM reply ("QM,<executing>,<motor1>,<motor2>,<fifo>") without
+	 * allocating.
+	 * @returns False if it isn't one.
+	 */
+	static bool parseMotorStatus(
+		std::string_view reply,
+		MotorStatus & out) {
+		if (reply.size() < 3 || reply.substr(0, 3) != "QM,") {
+			return false;
+		}
+		std::array<bool, 4> flags {};
+		size_t field = 0;
+		for (size_t i = 3; i < reply.size() && field < flags.size(); ++i) {
+			if (reply[i] == ',') {
+				++field;
+			} else if (reply[i] >= '1' && reply[i] <= '9') {
+				flags[field] = true;
 			}
+		}
+		if (field < flags.size() - 1) {
+			return false;
+		}
+		out.executing = flags[0];
+		out.moving = { flags[1], flags[2] };
+		out.fifoEmpty = !flags[3];
+		return true;
+	}
+
+	/**
+   * Query pen state (QP).
+   * @returns True if pen is in down position (0), false if up (1).
+   */
+	bool isPenDown() {
+		if (stateCaching && state.penDown.known) {
+			return state.penDown.value;
+		}
+		try {
+			auto resp = sendCommand("QP", 2);
+
+			// "0" is down; "1" or anything unexpected counts as up (safer)
+			state.penDown.set(resp == "0");
+			return state.penDown.value;
 		} catch (const std::exception & e) {
 			ofLogError("ofxEbbControl") << "Error querying pen state: " << e.what();
 			return false; // Default to assuming pen is up (safer)
@@ -962,11 +1135,7 @@ public:
 			auto resp = sendCommand("QR", 2);
 
 			// The QR command returns 0 or 1
-			if (resp.find("1") != std::string::npos) {
-				return true; // Servo power is on
-			} else {
-				return false; // Servo power is off
-			}
+			return resp == "1";
 		} catch (const std::exception & e) {
 			ofLogError("ofxEbbControl") << "Error querying servo power: " << e.what();
 			return false; // Default to off
@@ -978,30 +1147,13 @@ public:
    */
 	std::array<int, 2> getStepPositions() {
 		try {
-			auto resp = sendCommand("QS", 2);
-
-			// Extract the step positions from the response (format "0,0OK")
-			std::string stepPos;
-			if (resp.find("OK") != std::string::npos) {
-				stepPos = resp.substr(0, resp.find("OK"));
-			} else {
-				stepPos = resp;
-			}
-
-			// Clean up and parse values
-			std::string cleaned;
-			for (char c : stepPos) {
-				if (isdigit(c) || c == ',' || c == '-') {
-					cleaned += c;
-				}
-			}
-
-			auto values = split(cleaned, ',');
-			if (values.size() >= 2) {
-				return { std::stoi(values[0]), std::stoi(values[1]) };
-			} else {
+			// Reply is already reduced to "<motor1>,<motor2>"
+			std::array<int, 2> positions;
+			if (ofxEbbReplyReader(transact("QS")).read(positions) < positions.size()) {
 				return { 0, 0 };
 			}
+			predictor.correct({ { positions[0], positions[1] } });
+			return positions;
 		} catch (const std::exception & e) {
 			ofLogError("ofxEbbControl") << "Error querying step positions: " << e.what();
 			return { 0, 0 };
@@ -1010,10 +1162,15 @@ public:
 
 	/**
    * Query EBB nickname (QT).
+   * @param timeoutMs  Reply timeout in milliseconds, or AUTO_TIMEOUT.
    */
-	std::string getNickname() {
+	std::string getNickname(
+		int timeoutMs = AUTO_TIMEOUT) {
+		if (stateCaching && state.nickname.known) {
+			return state.nickname.value.empty() ? "EBB Controller" : state.nickname.value;
+		}
 		try {
-			auto resp = sendCommand("QT", 2);
+			auto resp = sendCommand("QT", 2, timeoutMs);
 
 			// Extract nickname from response
 			std::string nickname = resp;
@@ -1027,6 +1184,7 @@ public:
 							   [](unsigned char c) { return c == '\r' || c == '\n'; }),
 				nickname.end());
 
+			state.nickname.set(nickname);
 			if (nickname.empty()) {
 				return "EBB Controller";
 			}
@@ -1055,7 +1213,12 @@ public:
 
 			auto cmd = "ST," + truncated;
 			auto resp = sendCommand(cmd);
-			return resp == "OK";
+			if (resp != "OK") {
+				state.nickname.invalidate();
+				return false;
+			}
+			state.nickname.set(truncated);
+			return true;
 		} catch (const std::exception & e) {
 			ofLogError("ofxEbbControl") << "Error setting nickname: " << e.what();
 			return false;
@@ -1067,6 +1230,7 @@ public:
    */
 	void reboot() {
 		sendCommand("RB");
+		state.invalidate();
 		close();
 	}
 
@@ -1074,6 +1238,7 @@ public:
    * Reset EBB (R).
    */
 	void reset() {
+		state.invalidate();
 		auto resp = sendCommand("R");
 		checkOk(resp);
 	}
@@ -1093,10 +1258,10 @@ public:
 			throw std::runtime_error("Steps out of range");
 		}
 
-		auto cmd = "XM," + toStr(durationMs) + "," + toStr(stepsA) + "," + toStr(stepsB);
-
-		auto resp = sendCommand(cmd);
-		checkOk(resp);
+		commandBuffer.op("XM").arg(durationMs).arg(stepsA).arg(stepsB);
+		sendMotion(durationMs / 1000.0);
+		planner.offsetPosition(stepsA + stepsB, stepsA - stepsB);
+		predictMotion(durationMs / 1000.0);
 	}
 
 	/**
@@ -1120,15 +1285,22 @@ public:
    */
 	void togglePen(
 		int durationMs = -1) {
-		std::string cmd;
+		const auto start = servoStartTime();
+		if (durationMs < 0 && state.penDown.known) {
+			durationMs = penDelayMs(!state.penDown.value, start);
+		}
+		commandBuffer.op("TP");
 		if (durationMs >= 0) {
-			cmd = "TP," + toStr(durationMs);
+			commandBuffer.arg(durationMs);
+		}
+		sendMotion(std::max(0, durationMs) / 1000.0);
+		if (state.penDown.known) {
+			state.penDown.set(!state.penDown.value);
+			servoModel.onPenMove(state, state.penDown.value, start);
 		} else {
-			cmd = "TP";
+			servoModel.invalidate();
 		}
-
-		auto resp = sendCommand(cmd);
-		checkOk(resp);
+		predictMotion(std::max(0, durationMs) / 1000.0);
 	}
 
 	/**
@@ -1138,18 +1310,30 @@ public:
 		bool down,
 		int duration = -1,
 		int pin = -1) {
-		std::ostringstream os;
-		os << "SP," << (down ? PEN_DOWN : PEN_UP);
+		// Already there, and no explicit delay was asked for
+		if (stateCaching && duration < 0 && pin < 0 && state.penDown.is(down)) {
+			return;
+		}
+
+		const auto start = servoStartTime();
+		if (duration < 0 && pin < 0) {
+			duration = penDelayMs(down, start);
+		}
+		commandBuffer.op("SP").arg(down ? PEN_DOWN : PEN_UP);
 
 		if (duration >= 0) {
-			os << "," << duration;
+			commandBuffer.arg(duration);
 		}
 		if (pin >= 0) {
-			os << "," << pin;
+			commandBuffer.arg(pin);
 		}
 
-		auto resp = sendCommand(os.str());
-		checkOk(resp);
+		sendMotion(std::max(0, duration) / 1000.0);
+		if (pin < 0) {
+			state.penDown.set(down);
+			servoModel.onPenMove(state, down, start);
+		}
+		predictMotion(std::max(0, duration) / 1000.0);
 	}
 
 	/**
@@ -1172,6 +1356,10 @@ public:
 	void stepperAndServoModeConfigure(
 		int paramIndex,
 		int paramValue) {
+		if (stateCaching && paramIndex >= 0 && paramIndex < ofxEbbDeviceState::SERVO_CONFIG_SLOTS
+			&& state.servoConfig[paramIndex].is(paramValue)) {
+			return;
+		}
 		std::string cmd;
 
 		switch (paramIndex) {
@@ -1251,6 +1439,12 @@ public:
 
 		auto resp = sendCommand(cmd);
 		checkOk(resp);
+		state.servoConfig[paramIndex].set(paramValue);
+		if (paramIndex == ofxEbbServoModel::SC_RATE) {
+			// The firmware sets both rates from this one
+			state.servoConfig[ofxEbbServoModel::SC_RATE_UP].set(paramValue);
+			state.servoConfig[ofxEbbServoModel::SC_RATE_DOWN].set(paramValue);
+		}
 	}
 
 	/**
@@ -1258,14 +1452,7 @@ public:
    * @returns A vector of device paths that might be EBB controllers.
    */
 	std::vector<std::string> listDevices() {
-		std::vector<std::string> devices;
-		auto deviceList = serial.getDeviceList();
-
-		for (auto & device : deviceList) {
-			devices.push_back(device.getDevicePath());
-		}
-
-		return devices;
+		return transport->listDevices();
 	}
 
 	/**
@@ -1291,15 +1478,41 @@ public:
    */
 	bool moveStepperSteps(int durationMs, int steps1, int steps2) {
 		try {
-			std::string cmd = "SM," + toStr(durationMs) + "," + toStr(steps1) + "," + toStr(steps2);
-			auto resp = sendCommand(cmd);
-			return resp == "OK";
+			commandBuffer.op("SM").arg(durationMs).arg(steps1).arg(steps2);
+			sendMotion(durationMs / 1000.0);
+			planner.offsetPosition(steps1, steps2);
+			predictMotion(durationMs / 1000.0);
+			return true;
 		} catch (const std::exception & e) {
 			ofLogError("ofxEbbControl") << "Error in stepper move: " << e.what();
 			return false;
 		}
 	}
 
+	/**
+	 * Queue an SM on the I/O thread without waiting for it. Recorded for
+	 * the planner, flow model and predictPosition() like moveStepperSteps(),
+	 * so call it from the thread that uses the blocking API.
+	 * @param callback  Optional; see sendCommandAsync().
+	 * @returns         Future for the result; waits only while the
+	 *                  submission ring is full. Not recorded (and already
+	 *                  failed) if the I/O thread isn't running.
+	 */
+	std::future<CommandResult> moveStepperStepsAsync(
+		int durationMs,
+		int steps1,
+		int steps2,
+		CommandCallback callback = nullptr) {
+		commandBuffer.op("SM").arg(durationMs).arg(steps1).arg(steps2);
+		auto future = submitAsync(std::string(commandBuffer.view()), std::move(callback), true);
+		if (ioThreadRunning) {
+			motionFlow.onSent(durationMs / 1000.0);
+			planner.offsetPosition(steps1, steps2);
+			predictMotion(durationMs / 1000.0);
+		}
+		return future;
+	}
+
 	/**
    * Set servo power timeout.
    * @param durationMs Timeout in milliseconds (0 = no timeout).
@@ -1323,25 +1536,9 @@ public:
    */
 	uint32_t getNodeCount() {
 		try {
-			auto resp = sendCommand("QN", 2);
-			// Remove the "OK" from the response
-			if (resp.find("OK") != std::string::npos) {
-				resp = resp.substr(0, resp.find("OK"));
-			}
-
-			// Clean the string to contain only numbers
-			std::string cleaned;
-			for (char c : resp) {
-				if (isdigit(c)) {
-					cleaned += c;
-				}
-			}
-
-			if (cleaned.empty()) {
-				return 0;
-			}
-
-			return static_cast<uint32_t>(std::stoul(cleaned));
+			uint32_t count = 0;
+			ofxEbbReplyReader(transact("QN")).next(count);
+			return count;
 		} catch (const std::exception & e) {
 			ofLogError("ofxEbbControl") << "Error getting node count: " << e.what();
 			return 0;
@@ -1368,7 +1565,8 @@ public:
    * Set engraver state and power.
    * @param enable True to enable, false to disable.
    * @param power Power level (0-1023).
-   * @param useMotionQueue Whether to use motion queue for this command.
+   * @param useMotionQueue Whether to use motion queue for this command
+   *                       (it then takes a FIFO slot like a move).
    * @returns True if successful.
    */
 	bool setEngraver(bool enable, int power, bool useMotionQueue) {
@@ -1377,9 +1575,13 @@ public:
 				power = ofClamp(power, 0, 1023);
 			}
 
-			auto cmd = "SE," + toStr(enable ? 1 : 0) + "," + toStr(power) + "," + toStr(useMotionQueue ? 1 : 0);
-			auto resp = sendCommand(cmd);
-			return resp == "OK";
+			commandBuffer.op("SE").arg(enable).arg(power).arg(useMotionQueue);
+			if (useMotionQueue) {
+				sendMotion(0.0);
+			} else {
+				sendFormatted();
+			}
+			return true;
 		} catch (const std::exception & e) {
 			ofLogError("ofxEbbControl") << "Error setting engraver: " << e.what();
 			return false;
@@ -1396,17 +1598,31 @@ public:
    */
 	bool servoOutput(int position, int servoChannel, int rate = 0, int delay = 0) {
 		try {
-			std::string cmd = "S2," + toStr(position) + "," + toStr(servoChannel);
+			const bool pen = servoChannel == SERVO_CHANNEL_PEN;
+			const auto start = servoStartTime();
+			if (pen && penTiming && rate > 0 && delay <= 0) {
+				const double seconds = servoModel.travel(state, position, rate, start);
+				if (seconds >= 0.0) {
+					delay = static_cast<int>(std::ceil(seconds * 1000.0)) + penSettleMs;
+				}
+			}
+			commandBuffer.op("S2").arg(position).arg(servoChannel);
 
 			if (rate > 0) {
-				cmd += "," + toStr(rate);
+				commandBuffer.arg(rate);
 				if (delay > 0) {
-					cmd += "," + toStr(delay);
+					commandBuffer.arg(delay);
 				}
 			}
 
-			auto resp = sendCommand(cmd);
-			return resp == "OK";
+			sendMotion(std::max(0, delay) / 1000.0);
+			if (pen) {
+				// Pen servo moved to an arbitrary position
+				state.penDown.invalidate();
+				servoModel.onMove(state, position, rate, start);
+			}
+			predictMotion(std::max(0, delay) / 1000.0);
+			return true;
 		} catch (const std::exception & e) {
 			ofLogError("ofxEbbControl") << "Error in servo output: " << e.what();
 			return false;
@@ -1426,7 +1642,12 @@ public:
 
 			auto cmd = "SL," + toStr(layer);
 			auto resp = sendCommand(cmd);
-			return resp == "OK";
+			if (resp != "OK") {
+				state.layer.invalidate();
+				return false;
+			}
+			state.layer.set(layer);
+			return true;
 		} catch (const std::exception & e) {
 			ofLogError("ofxEbbControl") << "Error setting layer: " << e.what();
 			return false;
@@ -1438,181 +1659,2512 @@ public:
 		return stepsPerMm;
 	}
 
-private:
-	// Serial connection
-	ofSerial serial;
-	std::string serialPort;
-
-	// Configuration values
-	float stepsPerMm = 80.0f;
-
-	//-- Internal helpers -------------------------------------------
+	//-- Sampling Stream ---------------------------------------------
 
-	static void assertByte(int v) {
-		if (v < 0 || v > 255) {
-			throw std::runtime_error("Byte value must be 0-255");
+	/**
+	 * Stream input samples with the T command: the board sends an I
+	 * (digital) or A (analog) packet every `periodMs`, down to 1 ms, without
+	 * a query per sample. Packets are parsed as they are read, so while the
+	 * I/O thread runs they are collected in the background; otherwise call
+	 * pollSamples() regularly (e.g. from update()). Commands can still be
+	 * sent while streaming; an I or A query of the streamed kind is
+	 * answered by the next packet.
+	 * @param periodMs  Sample period, 1-65535 ms.
+	 * @param digital   I packets (ports A-E) if true, A packets otherwise.
+	 */
+	void startSampling(
+		int periodMs,
+		bool digital) {
+		if (periodMs < 1 || periodMs >= (1 << 16)) {
+			throw std::runtime_error("Sample period out of range");
+		}
+		// The ring can only be resized while nobody else reads the port
+		sampleStream.start(digital ? ofxEbbSampleKind::Digital : ofxEbbSampleKind::Analog, !ioThreadRunning);
+		commandBuffer.op("T").arg(periodMs).arg(digital ? MODE_DIGITAL : MODE_ANALOG);
+		try {
+			sendFormatted();
+		} catch (...) {
+			sampleStream.stop();
+			throw;
 		}
 	}
 
-	static void assertPort(char p) {
-		if (std::string("ABCDE").find(p) == std::string::npos) {
-			throw std::runtime_error("Port letter must be A-E");
+	/**
+	 * Stop streaming. Packets already in transit are counted as late and
+	 * dropped rather than mistaken for command replies.
+	 */
+	void stopSampling() {
+		if (!sampleStream.isActive()) {
+			return;
 		}
+		sampleStream.stop();
+		commandBuffer.op("T").arg(0).arg(sampleStream.kind() == ofxEbbSampleKind::Digital ? MODE_DIGITAL : MODE_ANALOG);
+		sendFormatted();
 	}
 
-	static void checkOk(const std::string & r) {
-		if (r != "OK") {
-			throw std::runtime_error("Unexpected response: " + r);
-		}
+	bool isSampling() const {
+		return sampleStream.isActive();
 	}
 
-	static void checkStatus(const std::vector<std::string> & lines) {
-		if (lines.size() < 2) {
-			throw std::runtime_error("Incomplete response, expected at least 2 lines");
-		}
+	/**
+	 * Samples buffered for popSample(); takes effect on the next
+	 * startSampling() made while the I/O thread is not running.
+	 */
+	void setSampleBufferCapacity(
+		size_t capacity) {
+		sampleStream.setCapacity(capacity);
+	}
 
-		if (lines[1] != "OK") {
-			std::string errorMsg = "Bad status response: " + lines[1];
-			if (!lines.empty()) {
-				errorMsg += " (data: " + lines[0] + ")";
-			}
-			throw std::runtime_error(errorMsg);
+	/**
+	 * Receive samples on the reading thread (the I/O thread while it runs)
+	 * instead of buffering them. Set it before startSampling().
+	 */
+	void setSampleCallback(
+		ofxEbbSampleStream::Callback callback) {
+		sampleStream.setCallback(std::move(callback));
+	}
+
+	/**
+	 * Read whatever has arrived on the port when the I/O thread isn't
+	 * running. Sends nothing.
+	 * @returns Samples waiting for popSample().
+	 */
+	size_t pollSamples() {
+		if (!ioThreadRunning && transport->isOpen()) {
+			pumpPipeline();
 		}
+		return sampleStream.available();
 	}
 
-	static std::string toStr(int v) {
-		return std::to_string(v);
+	/**
+	 * Take the oldest buffered sample. Call from one thread only.
+	 * @returns False if none is waiting.
+	 */
+	bool popSample(
+		ofxEbbSample & out) {
+		return sampleStream.pop(out);
 	}
-	static std::string toStr(bool b) {
-		return b ? "1" : "0";
+
+	/**
+	 * Received, overrun (ring full), malformed and late packet counts for
+	 * the current stream.
+	 */
+	ofxEbbSampleStats getSampleStats() const {
+		return sampleStream.getStats();
 	}
-	static std::string toStr(uint32_t v) {
-		return std::to_string(v);
+
+	//-- Device State Cache ------------------------------------------
+
+	/**
+	 * Answer pen, layer, nickname, firmware and motor mode queries from
+	 * what this instance last sent or read, and skip EM, SP and SC
+	 * commands that would not change anything (on by default).
+	 * Call invalidateState() if the board may have been changed by
+	 * something else (button, another program, power cycle).
+	 */
+	void setStateCaching(
+		bool enable) {
+		stateCaching = enable;
 	}
 
-	template <typename T>
-	static std::string join(
-		const std::vector<T> & vals,
-		char delim) {
-		std::ostringstream os;
-		for (size_t i = 0; i < vals.size(); ++i) {
-			if (i > 0)
-				os << delim;
-			os << vals[i];
-		}
-		return os.str();
+	bool getStateCaching() const {
+		return stateCaching;
 	}
 
-	template <typename T, size_t N>
-	static std::string join(
-		const std::array<T, N> & vals,
-		char delim) {
-		std::ostringstream os;
-		for (size_t i = 0; i < vals.size(); ++i) {
-			if (i > 0)
-				os << delim;
-			os << vals[i];
-		}
-		return os.str();
+	const ofxEbbDeviceState & getCachedState() const {
+		return state;
+	}
+
+	/**
+	 * Forget everything cached; the next query goes to the board.
+	 */
+	void invalidateState() {
+		state.invalidate();
+		servoModel.invalidate();
+	}
+
+	/**
+	 * Re-read pen state, layer, nickname, firmware and (where QE is
+	 * available) motor modes from the board. SC values can't be read back
+	 * and stay as they are.
+	 */
+	void refreshState() {
+		auto servoConfig = state.servoConfig;
+		state.invalidate();
+		state.servoConfig = servoConfig;
+		getFirmwareVersion();
+		isPenDown();
+		getLayer();
+		getNickname();
+		getMotorConfig();
+	}
+
+	//-- Pen Servo Timing --------------------------------------------
+
+	/**
+	 * Time SP and TP (and S2 on the pen channel) from the servo settings
+	 * sent through stepperAndServoModeConfigure(): SC 4/5 positions,
+	 * 10-12 rates and 8 channels. A pen command given no duration then
+	 * waits exactly as long as the servo takes to get there, counted from
+	 * when the board reaches it in its FIFO and from where the servo is
+	 * at that point, so the next move starts as the pen clears. On by
+	 * default; until the positions and rates are set it changes nothing.
+	 * @param automatic  Compute pen delays from the servo model.
+	 * @param settleMs   Added to every computed delay, for the pen to
+	 *                   stop bouncing.
+	 */
+	void setPenTiming(
+		bool automatic,
+		int settleMs = 0) {
+		penTiming = automatic;
+		penSettleMs = std::max(0, settleMs);
+	}
+
+	bool getPenTiming() const {
+		return penTiming;
+	}
+
+	/**
+	 * Delay, in ms, that SP would get raising or lowering the pen after
+	 * the motion queued so far, or -1 if it wouldn't get one.
+	 */
+	int getPenDelayMs(
+		bool down) const {
+		return penDelayMs(down, servoStartTime());
+	}
+
+	/**
+	 * Delay, in ms, for a pen move timed as a full swing between the up and
+	 * down positions, as runToolpath() uses; -1 if it wouldn't get one.
+	 */
+	int getPenSwingMs(
+		bool down) const {
+		return penSwingMs(down);
+	}
+
+	const ofxEbbServoModel & getServoModel() const {
+		return servoModel;
+	}
+
+	//-- Position Prediction -----------------------------------------
+
+	/**
+	 * Where the carriage and pen should be at `t` (by default now), worked
+	 * out from the motion commands sent so far without any I/O. Lock-free
+	 * and safe from any thread, so draw() can call it every frame instead
+	 * of getStepPositions(). Steps are motor steps as QS reports them.
+	 * Each getStepPositions() call corrects the prediction; see
+	 * setPositionCorrection() to have that happen while motion is sent.
+	 * Moves made through getPlanner() directly aren't seen.
+	 */
+	ofxEbbPredictedPosition predictPosition(
+		std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now()) const {
+		return predictor.predict(t);
+	}
+
+	/**
+	 * predictPosition() in mm. Reads the planner's steps/mm and
+	 * kinematics, so don't change those while another thread calls this.
+	 */
+	ofxEbbPoint predictPositionMm(
+		std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now()) const {
+		return planner.toMm(predictor.predict(t).steps);
+	}
+
+	/**
+	 * Query QS every `intervalMs` while motion is being sent, to keep
+	 * predictPosition() in step with the board (0, the default: only
+	 * explicit getStepPositions() calls correct it).
+	 */
+	void setPositionCorrection(
+		int intervalMs) {
+		positionCorrectionMs = std::max(0, intervalMs);
+		nextPositionCorrection = std::chrono::steady_clock::now();
+	}
+
+	/**
+	 * Fold in a QS reply read some other way, e.g. through
+	 * sendCommandAsync("QS"), as getStepPositions() does with its own.
+	 * Call from the thread that sends motion.
+	 * @param at  When the reply arrived.
+	 */
+	void correctPrediction(
+		const std::array<int, 2> & steps,
+		std::chrono::steady_clock::time_point at = std::chrono::steady_clock::now()) {
+		predictor.correct({ { steps[0], steps[1] } }, at);
 	}
 
-	static std::string joinInt(
-		const std::vector<int64_t> & vals) {
-		return join<int64_t>(vals, ',');
+	const ofxEbbPositionPredictor & getPositionPredictor() const {
+		return predictor;
 	}
 
-	static std::vector<std::string> split(
-		const std::string & s,
-		char delim) {
-		std::vector<std::string> out;
-		std::stringstream ss(s);
-		std::string item;
+	//-- State Snapshots ---------------------------------------------
+
+	static constexpr size_t SNAPSHOT_QUERIES = 6;
+
+	/**
+	 * Board state read in one burst by getSnapshot(). Fields whose query
+	 * failed are left zero and their bit in `answered` clear (bit order as
+	 * in snapshotQueries: QG, QM, QS, QP, QL, QN).
+	 */
+	struct Snapshot {
+		std::chrono::steady_clock::time_point time; // Burst written
+		std::chrono::steady_clock::time_point received; // Last reply matched
+		uint64_t sequence = 0; // Counts snapshots taken by this instance
+		uint8_t answered = 0;
+		GeneralStatus general {};
+		MotorStatus motors {};
+		std::array<int, 2> steps {};
+		bool penDown = false;
+		int layer = 0;
+		uint32_t nodeCount = 0;
+
+		bool complete() const {
+			return answered == (1 << SNAPSHOT_QUERIES) - 1;
+		}
+	};
 
-		while (std::getline(ss, item, delim)) {
-			// Handle CR+LF line endings by removing trailing CR
-			if (!item.empty() && item.back() == '\r') {
-				item.pop_back();
+	/**
+	 * Read QG, QM, QS, QP, QL and QN in one pipelined burst: all six are
+	 * written back to back and the replies matched as they come in, so the
+	 * whole snapshot costs about one round trip instead of six. The cache
+	 * is bypassed and then refreshed (pen, layer), QS corrects the
+	 * position predictor and QM the flow model, as the single getters do.
+	 * Without the I/O thread the snapshot is also what
+	 * getLatestSnapshot() returns next.
+	 */
+	Snapshot getSnapshot() {
+		if (ioThreadRunning) {
+			// Through the submission rings; replies come back as futures
+			Snapshot snapshot;
+			snapshot.time = std::chrono::steady_clock::now();
+			std::array<std::future<CommandResult>, SNAPSHOT_QUERIES> futures;
+			for (size_t i = 0; i < SNAPSHOT_QUERIES; ++i) {
+				futures[i] = submitAsync(std::string(snapshotQueries[i]), nullptr, true);
+			}
+			for (size_t i = 0; i < SNAPSHOT_QUERIES; ++i) {
+				const CommandResult result = futures[i].get();
+				if (result.ok) {
+					parseSnapshotReply(snapshot, i, result.response);
+				}
 			}
-			out.push_back(item);
+			snapshot.received = std::chrono::steady_clock::now();
+			snapshot.sequence = ++snapshotsTaken;
+			applySnapshot(snapshot);
+			return snapshot;
 		}
-		return out;
+
+		queueSnapshotBurst(false);
+		waitPipelineIdle(AUTO_TIMEOUT);
+		applySnapshot(snapshotBuilding);
+		return snapshotBuilding;
+	}
+
+	/**
+	 * Take a snapshot every `intervalMs` on the I/O thread, ahead of queued
+	 * motion, and publish it for getLatestSnapshot() (0 stops). Bursts
+	 * don't overlap; a board slower than the interval is read back to
+	 * back. Background snapshots leave the cache, predictor and flow model
+	 * alone, as those belong to the caller's thread.
+	 * @returns False if the I/O thread isn't running (see startThread()).
+	 */
+	bool setSnapshotInterval(
+		int intervalMs) {
+		if (!ioThreadRunning && intervalMs > 0) {
+			ofLogError("ofxEbbControl") << "Background snapshots need the I/O thread";
+			return false;
+		}
+		snapshotIntervalMs = std::max(0, intervalMs);
+		ioWake.notify_one();
+		return true;
+	}
+
+	int getSnapshotInterval() const {
+		return snapshotIntervalMs;
+	}
+
+	/**
+	 * The most recent published snapshot, without I/O or locks, from any
+	 * thread (e.g. draw()). Compare `sequence` to spot a new one.
+	 * @returns False (leaving `out` alone) if none was taken yet.
+	 */
+	bool getLatestSnapshot(
+		Snapshot & out) const {
+		return latestSnapshot.read(out);
+	}
+
+	//-- Motion Flow Control -----------------------------------------
+
+	static constexpr int MOTION_SLOT_TIMEOUT_MS = 3000;
+
+	/**
+	 * Hold motion commands back until the firmware FIFO has room for them
+	 * (on by default). The board delays its reply to a motion command while
+	 * its FIFO is full, which also stalls every query queued behind it;
+	 * with flow control on, moves are only written once a slot is free.
+	 * Covers the motion methods of this class and planned paths, not
+	 * raw sendCommand()/sendCommandAsync() traffic.
+	 */
+	void setFlowControl(
+		bool enable) {
+		flowControl = enable;
+	}
+
+	bool getFlowControl() const {
+		return flowControl;
 	}
 
-	static std::string stringize(
-		const char * fmt,
-		...) {
-		va_list args;
-		va_start(args, fmt);
+	/**
+	 * Commands the firmware FIFO holds behind the executing one
+	 * (1 on firmware 2.x).
+	 */
+	void setMotionFifoDepth(
+		int depth) {
+		motionFlow.setFifoDepth(depth);
+	}
 
-		// Get required buffer size
-		va_list args_copy;
-		va_copy(args_copy, args);
-		int size = std::vsnprintf(nullptr, 0, fmt, args_copy) + 1;
-		va_end(args_copy);
+	int getMotionFifoDepth() const {
+		return motionFlow.getFifoDepth();
+	}
 
-		// Format the string
-		std::vector<char> buf(size);
-		std::vsnprintf(buf.data(), size, fmt, args);
-		va_end(args);
+	/**
+	 * Motion commands queued or executing on the board, as tracked from
+	 * sent commands, their durations and status replies.
+	 */
+	size_t getQueuedMotionCount() {
+		return motionFlow.outstanding();
+	}
 
-		return std::string(buf.data());
+	ofxEbbFlowControl & getFlowModel() {
+		return motionFlow;
 	}
 
-	// Helper method to maintain motor configuration state across the class
-	static std::array<int, 2> & getLastKnownMotorConfig() {
-		static std::array<int, 2> lastKnownConfig = { MOTOR_STEP_DIV16, MOTOR_STEP_DIV16 };
-		return lastKnownConfig;
+	/**
+	 * Query QG and fold the FIFO and motor bits into the flow model.
+	 */
+	void syncMotionStatus() {
+		try {
+			auto status = getGeneralStatus();
+			motionFlow.onStatus(status.fifoEmpty, status.executing || status.motor1 || status.motor2);
+		} catch (const std::exception & e) {
+			ofLogError("ofxEbbControl") << "Error syncing motion status: " << e.what();
+			motionFlow.onStatusFailed();
+		}
 	}
 
+	static constexpr int COMPLETION_POLL_MS = 2;
+	static constexpr int COMPLETION_EARLY_WAKE_MS = 20;
+
 	/**
-	 * @brief Check if motors are currently moving or if a motion command is executing
-	 *
-	 * This is a convenience method that calls the QM (Query Motors) command
-	 * and returns true if either a motion command is executing or
-	 * any of the motors are moving.
-	 *
-	 * @return true if motors are moving or a motion command is executing
-	 * @return false if motors are not moving and no motion command is executing
+	 * Check if a motion command is executing or a motor is moving (QM).
+	 * @returns False if idle, or if the query failed.
 	 */
 	bool isMoving() {
 		try {
-			std::string response = sendCommand("QM");
+			auto status = getMotorStatus();
+			return status.executing || status.moving[0] || status.moving[1];
+		} catch (const std::exception & e) {
+			ofLogError("ofxEbbControl") << "Error in isMoving(): " << e.what();
+			return false;
+		}
+	}
 
-			// Expected format: QM,a,b,c,d where:
-			// a: 1 if command executing, 0 if not
-			// b: 1 if motor 1 is moving, 0 if not
-			// c: 1 if motor 2 is moving, 0 if not
-			// d: 1 if FIFO not empty, 0 if empty
+	/**
+	 * Block until all queued motion has finished.
+	 * Sleeps through the time the queued commands are expected to take,
+	 * then polls QM every pollIntervalMs until the FIFO is empty and the
+	 * motors have stopped.
+	 * @param timeoutMs       Give up after this long (< 0 waits forever).
+	 * @param pollIntervalMs  Poll interval once the estimate runs out.
+	 * @returns               True when idle, false on timeout.
+	 */
+	bool waitForCompletion(
+		int timeoutMs = -1,
+		int pollIntervalMs = COMPLETION_POLL_MS) {
+		auto now = std::chrono::steady_clock::now();
+		const bool bounded = timeoutMs >= 0;
+		const auto deadline = now + std::chrono::milliseconds(std::max(0, timeoutMs));
+
+		// Nothing is worth asking about until the model's estimate is
+		// nearly used up
+		auto wake = motionFlow.idleTime() - std::chrono::milliseconds(COMPLETION_EARLY_WAKE_MS);
+		if (bounded) {
+			wake = std::min(wake, deadline);
+		}
+		if (wake > now) {
+			idleUntil(wake);
+		}
 
-			if (response.find("QM,") != 0) {
-				ofLogError("ofxEbbControl") << "Invalid response to QM command: " << response;
-				return false;
+		while (true) {
+			MotorStatus status;
+			bool known = false;
+			try {
+				status = getMotorStatus();
+				known = true;
+			} catch (const std::exception & e) {
+				ofLogWarning("ofxEbbControl") << "waitForCompletion(): " << e.what();
 			}
 
-			// Split response by commas
-			std::vector<std::string> parts;
-			std::istringstream ss(response);
-			std::string part;
-
-			while (std::getline(ss, part, ',')) {
-				parts.push_back(part);
+			if (known) {
+				const bool moving = status.executing || status.moving[0] || status.moving[1];
+				motionFlow.onStatus(status.fifoEmpty, moving);
+				if (!moving && status.fifoEmpty) {
+					return true;
+				}
 			}
 
-			if (parts.size() < 4) {
-				ofLogError("ofxEbbControl") << "Invalid QM response format, expected at least 4 parts: " << response;
+			now = std::chrono::steady_clock::now();
+			if (bounded && now >= deadline) {
 				return false;
 			}
+			auto next = now + std::chrono::milliseconds(std::max(1, pollIntervalMs));
+			idleUntil(bounded ? std::min(next, deadline) : next);
+		}
+	}
 
-			// Check if command executing or any motor moving
-			bool cmdExecuting = (parts[1] == "1");
-			bool motor1Moving = (parts[2] == "1");
-			bool motor2Moving = (parts[3] == "1");
+	//-- Path Planning -----------------------------------------------
 
-			return cmdExecuting || motor1Moving || motor2Moving;
+	static constexpr int MOVE_BATCH_PER_DEPTH = 4;
 
-		} catch (const std::exception & e) {
-			ofLogError("ofxEbbControl") << "Error in isMoving(): " << e.what();
-			return false;
-		}
+	/**
+	 * Set the steps per mm calibration used by the planner
+	 * (80 for an AxiDraw at 16x microstepping).
+	 */
+	void setStepsPerMm(
+		float value) {
+		stepsPerMm = value;
+		planner.setStepsPerMm(value);
+	}
+
+	/**
+	 * Set how x/y in mm map onto the motors.
+	 */
+	void setKinematics(
+		ofxEbbKinematics kinematics) {
+		planner.setKinematics(kinematics);
+	}
+
+	/**
+	 * Speed and acceleration limits for pen-down drawing.
+	 */
+	void setMotionLimits(
+		const ofxEbbMotionLimits & limits) {
+		drawLimits = limits;
+	}
+
+	const ofxEbbMotionLimits & getMotionLimits() const {
+		return drawLimits;
+	}
+
+	/**
+	 * Speed and acceleration limits for pen-up travel.
+	 */
+	void setTravelLimits(
+		const ofxEbbMotionLimits & limits) {
+		travelLimits = limits;
+	}
+
+	const ofxEbbMotionLimits & getTravelLimits() const {
+		return travelLimits;
+	}
+
+	/**
+	 * The planner used by moveTo()/drawPolyline(). It tracks the position
+	 * of every move sent through this class (SM, XM, LM, HM, CS) but not
+	 * LT, so call getPlanner().setPosition() after timed moves.
+	 */
+	ofxEbbPlanner & getPlanner() {
+		return planner;
+	}
+
+	/**
+	 * Planned pen position in mm.
+	 */
+	ofxEbbPoint getPlannerPosition() const {
+		return planner.getPosition();
+	}
+
+	/**
+	 * Travel to a point with the travel limits; the pen is left as it is.
+	 * Requires firmware 2.7.0 or newer (LM).
+	 * @returns Planned motion time in seconds.
+	 */
+	double moveTo(
+		double x,
+		double y) {
+		ofxEbbPoint target { x, y };
+		return planAndSend(&target, 1, travelLimits);
+	}
+
+	/**
+	 * Draw a polyline: pen up, travel to the first point, pen down, draw
+	 * through the rest without stopping at vertices, pen up.
+	 * @param points  Vertices in mm.
+	 * @param closed  Also draw from the last point back to the first.
+	 * @returns       Planned motion time in seconds, without pen delays.
+	 */
+	double drawPolyline(
+		const std::vector<ofxEbbPoint> & points,
+		bool closed = false) {
+		if (points.empty()) {
+			return 0.0;
+		}
+
+		setPenState(false);
+		double duration = moveTo(points[0].x, points[0].y);
+		setPenState(true);
+
+		if (closed) {
+			pathScratch.assign(points.begin() + 1, points.end());
+			pathScratch.push_back(points[0]);
+			duration += planAndSend(pathScratch.data(), pathScratch.size(), drawLimits);
+		} else {
+			duration += planAndSend(points.data() + 1, points.size() - 1, drawLimits);
+		}
+
+		setPenState(false);
+		return duration;
+	}
+
+	/**
+	 * Draw a single line in mm.
+	 */
+	double drawLine(
+		double x1,
+		double y1,
+		double x2,
+		double y2) {
+		return drawPolyline({ { x1, y1 }, { x2, y2 } });
+	}
+
+	/**
+	 * Draw a closed polygon in mm.
+	 */
+	double drawPolygon(
+		const std::vector<ofxEbbPoint> & points) {
+		return drawPolyline(points, true);
+	}
+
+	/**
+	 * Draw several polylines, each like drawPolyline(). With travel
+	 * optimization on they are first reordered and reversed to cut pen-up
+	 * travel, and strokes that meet end to start are drawn as one without
+	 * lifting the pen.
+	 * @returns Planned motion time in seconds, without pen delays.
+	 */
+	double drawPolylines(
+		const std::vector<std::vector<ofxEbbPoint>> & paths) {
+		double duration = 0.0;
+		if (!travelOptimization) {
+			for (const auto & path : paths) {
+				duration += drawPolyline(path);
+			}
+			return duration;
+		}
+		ofxEbbTravelSettings settings = travelOptimizer.getSettings();
+		settings.start = planner.getPosition();
+		travelOptimizer.setSettings(settings);
+		travelPlan = travelOptimizer.optimize(paths);
+		ofxEbbTravelOptimizer::forEachChain(paths, travelPlan, [&](const std::vector<ofxEbbPoint> & chain) {
+			duration += drawPolyline(chain);
+		});
+		return duration;
+	}
+
+	/**
+	 * Optimize the stroke order of drawPolylines() (off by default).
+	 * @param enable    Turn the optimizer on or off.
+	 * @param settings  Time budget, threads, reversal and join tolerance;
+	 *                  the start point is taken from the planner.
+	 */
+	void setTravelOptimization(
+		bool enable,
+		const ofxEbbTravelSettings & settings = {}) {
+		travelOptimization = enable;
+		travelOptimizer.setSettings(settings);
+	}
+
+	/**
+	 * Order and travel saved by the last optimized drawPolylines().
+	 */
+	const ofxEbbTravelPlan & getTravelPlan() const {
+		return travelPlan;
+	}
+
+	/**
+	 * Snap planned paths to the step grid and merge collinear and
+	 * zero-step segments before planning (on by default).
+	 * @param enable     Turn batching on or off.
+	 * @param tolerance  Allowed deviation in motor steps when merging;
+	 *                   0 merges only exactly collinear segments.
+	 */
+	void setPathBatching(
+		bool enable,
+		double tolerance = 0.0) {
+		pathBatching = enable;
+		batcher.setTolerance(tolerance);
+	}
+
+	/**
+	 * Segments seen and commands saved by path batching so far.
+	 */
+	const ofxEbbBatchStats & getBatchStats() const {
+		return batchStats;
+	}
+
+	void resetBatchStats() {
+		batchStats = ofxEbbBatchStats();
+	}
+
+	/**
+	 * Stream planned LM moves through the command pipeline like
+	 * runToolpath(), without allocating (this flushes any commands
+	 * already queued with enqueueCommand()).
+	 * @throws std::runtime_error if a move is rejected or times out.
+	 */
+	void sendMoves(
+		const std::vector<ofxEbbLowLevelMove> & moves) {
+		beginStreamedMotion();
+		size_t pending = 0;
+		for (const auto & m : moves) {
+			reserveMotionSlot();
+			commandBuffer.op("LM").arg(m.rate[0]).arg(m.steps[0]).arg(m.accel[0]).arg(m.rate[1]).arg(m.steps[1]).arg(m.accel[1]);
+			streamMotion(commandBuffer.view(), pending);
+			motionFlow.onSent(m.duration);
+			predictor.onLowLevelMove(m.duration, m.rate, m.steps, m.accel, predictedPen());
+		}
+		finishStreamedMotion();
+	}
+
+	//-- Job Files ---------------------------------------------------
+
+	/**
+	 * Stream a compiled job (see ofxEbbJobCompiler) to the board. Records
+	 * are formatted straight from the mapped file and sent through the
+	 * pipeline under flow control; nothing is planned.
+	 * Job coordinates are relative to where the carriage is when the job
+	 * starts; resuming assumes that was step position 0 (as after
+	 * clearStepPosition(), or enabling the motors at home).
+	 * A failed command doesn't end the job: up to getJobRecovery() times
+	 * the board is resynced and the job resumed from the last node it
+	 * acknowledged (see setJobRecovery()).
+	 * @param job         Open job file.
+	 * @param resumeNode  Node count to pick up from, e.g. getNodeCount()
+	 *                    after an interrupted run (0 = from the start).
+	 *                    The pen is raised, the carriage travels from its
+	 *                    current position (QS) to where the job was at that
+	 *                    node, and pen, layer and node counter are restored
+	 *                    first. NI is counted when the board receives it,
+	 *                    which can be a FIFO's worth of motion ahead of the
+	 *                    pen; resume one node earlier to redraw the last path.
+	 * @returns           Motion time of the records sent, in seconds.
+	 * @throws            std::runtime_error if the job is malformed, doesn't
+	 *                    reach the node, or commands keep failing.
+	 */
+	double runJob(
+		const ofxEbbJobFile & job,
+		uint32_t resumeNode = 0) {
+		if (!job.isOpen()) {
+			throw std::runtime_error("Job file not open");
+		}
+		if (!job.findResume(resumeNode).found) {
+			throw std::runtime_error("Job has no node " + toStr(resumeNode));
+		}
+
+		JobProgress progress;
+		uint32_t node = resumeNode;
+		bool travel = resumeNode > 0;
+		for (int attempt = 0;; ++attempt) {
+			try {
+				runJobFrom(job, node, travel, progress);
+				break;
+			} catch (const std::runtime_error & e) {
+				if (attempt >= jobRecovery || !recoverJob(job, progress, node)) {
+					if (progress.engraver) {
+						setEngraver(false, 0, false);
+					}
+					throw;
+				}
+				ofLogWarning("ofxEbbControl") << "Job failed (" << e.what() << "), resuming from node " << node;
+				travel = true;
+			}
+		}
+
+		if (progress.malformed) {
+			throw std::runtime_error("Malformed job record at byte " + toStr(static_cast<uint32_t>(progress.malformedAt)));
+		}
+		return progress.duration;
+	}
+
+	//-- Raster Engraving --------------------------------------------
+
+	/**
+	 * Engrave a greyscale image (see ofxEbbJobCompiler::engraveRaster()).
+	 * Each row is run-length encoded into constant-power spans and burnt
+	 * as queued SE commands between LM moves, with an overscan at each end
+	 * and every other row reversed if bidirectional. The raster is compiled
+	 * into a job in memory with this control's planner, draw and travel
+	 * settings, starting from the current position, and streamed by
+	 * runJob(). That keeps the pipeline and the FIFO full, and after a lost
+	 * reply resumes from the last row the board counted (the node counter
+	 * is reset to 0 first). Like runJob(), resuming assumes the engraving
+	 * started at step position 0. The engraver is left off.
+	 * @returns Motion time in seconds.
+	 * @throws  std::runtime_error as runJob().
+	 */
+	double engraveRaster(
+		const ofxEbbRasterImage & image,
+		const ofxEbbRasterSettings & settings) {
+		ofxEbbJobCompiler compiler(planner.getStepsPerMm(), planner.getKinematics());
+		const auto start = planner.getPositionSteps();
+		compiler.getPlanner().setPosition(start[0], start[1]);
+		compiler.setMotionLimits(drawLimits);
+		compiler.setTravelLimits(travelLimits);
+		compiler.setNodeCount(0);
+		compiler.engraveRaster(image, settings);
+
+		ofxEbbJobFile job;
+		if (!job.open(compiler.getWriter().bytes())) {
+			throw std::runtime_error("Raster job: " + job.getError());
+		}
+		return runJob(job);
+	}
+
+	//-- Streaming Toolpaths -----------------------------------------
+
+	static constexpr int STREAM_POLL_US = 200;
+
+	/**
+	 * Plot a drawing straight from a path source (generated points,
+	 * ofPolylines or an SVG file) without loading it first. Points are
+	 * batched, planned and formatted on worker threads (see
+	 * ofxEbbToolpathStream) while this thread sends, so the first command
+	 * goes out as soon as the first chunk is planned and memory stays flat
+	 * however large the drawing is. Each stroke is drawn like
+	 * drawPolyline(), with the same kinematics, limits and path batching;
+	 * pen moves are timed for a full swing (see setPenTiming()).
+	 * Commands already queued with enqueueCommand() are flushed first.
+	 * @param source  Read on a worker thread until it is exhausted.
+	 * @returns       Motion time of the commands sent, in seconds.
+	 * @throws        std::runtime_error if the source or a command fails,
+	 *                or a command times out.
+	 */
+	double runToolpath(
+		ofxEbbPathSource & source) {
+		ofxEbbToolpathSettings settings;
+		settings.stepsPerMm = planner.getStepsPerMm();
+		settings.kinematics = planner.getKinematics();
+		settings.drawLimits = drawLimits;
+		settings.travelLimits = travelLimits;
+		settings.pathBatching = pathBatching;
+		settings.batchTolerance = batcher.getTolerance();
+		settings.penUpMs = penSwingMs(false);
+		settings.penDownMs = penSwingMs(true);
+
+		beginStreamedMotion();
+		ofxEbbToolpathStream stream(source, settings, planner.getPositionSteps());
+		stream.start();
+
+		ofxEbbStreamCommand command;
+		ofxEbbToolpathStream::PollResult result;
+		size_t pending = 0;
+		double duration = 0.0;
+		while ((result = stream.poll(command)) != ofxEbbToolpathStream::PollResult::Done) {
+			if (result == ofxEbbToolpathStream::PollResult::Failed) {
+				throw std::runtime_error("Toolpath stream failed: " + stream.getError());
+			}
+			if (result == ofxEbbToolpathStream::PollResult::Pending) {
+				idleUntil(std::chrono::steady_clock::now() + std::chrono::microseconds(STREAM_POLL_US));
+				continue;
+			}
+			const bool pen = command.pen >= 0;
+			if (pen && stateCaching && state.penDown.is(command.pen == 1)) {
+				continue;
+			}
+
+			reserveMotionSlot();
+			const auto start = servoStartTime();
+			streamMotion(command.view(), pending);
+			motionFlow.onSent(command.seconds);
+			planner.offsetPosition(command.steps[0], command.steps[1]);
+			if (pen) {
+				state.penDown.set(command.pen == 1);
+				servoModel.onPenMove(state, command.pen == 1, start);
+			}
+			predictMotion(command.seconds);
+			duration += command.seconds;
+		}
+		finishStreamedMotion();
+		batchStats += stream.getBatchStats();
+		return duration;
+	}
+
+private:
+	// Serial connection
+	std::unique_ptr<ofxEbbTransport> transport = std::make_unique<ofxEbbSerialTransport>();
+	std::string serialPort;
+
+	// Configuration values
+	float stepsPerMm = 80.0f;
+
+	// What this board is known to be set to
+	ofxEbbDeviceState state;
+	bool stateCaching = true;
+
+	// Pen servo timing
+	ofxEbbServoModel servoModel;
+	bool penTiming = true;
+	int penSettleMs = 0;
+
+	// Timeline of sent motion, for predictPosition()
+	ofxEbbPositionPredictor predictor;
+	int positionCorrectionMs = 0;
+	std::chrono::steady_clock::time_point nextPositionCorrection;
+
+	// Path planning
+	ofxEbbPlanner planner { 80.0 };
+	ofxEbbMotionLimits drawLimits;
+	ofxEbbMotionLimits travelLimits { 200.0, 2000.0, 2.0, 0.1 };
+	std::vector<ofxEbbLowLevelMove> plannedMoves;
+	std::vector<ofxEbbPoint> pathScratch;
+	ofxEbbPathBatcher batcher;
+	ofxEbbTravelOptimizer travelOptimizer;
+	ofxEbbTravelPlan travelPlan;
+	bool travelOptimization = false;
+
+	// Host-side model of the firmware motion FIFO
+	ofxEbbFlowControl motionFlow;
+	bool flowControl = true;
+	bool pathBatching = true;
+	ofxEbbBatchStats batchStats;
+	std::vector<ofxEbbPoint> batchedPath;
+
+	// Who receives the result of an outstanding command
+	enum class EntryOwner {
+		Batch, // enqueueCommand(); collected by flushPipeline()
+		Sync, // sendCommand() waiting for this id
+		Async, // I/O thread submission with promise/callback
+		Stream, // Streamed motion (sendMoves(), runToolpath()); only a failure is kept, in streamError
+		Snapshot // One query of a getSnapshot() burst, parsed in place
+	};
+
+	// Taken by whoever gets there first: the I/O thread as it writes the
+	// command, or a waiter giving up, which cancels it
+	using SendClaim = std::shared_ptr<std::atomic<bool>>;
+
+	struct PipelineEntry {
+		uint64_t id = 0;
+		std::string command;
+		const ofxEbbReplySpec * spec = &ofxEbbDefaultReplySpec;
+		int linesSeen = 0;
+		std::string raw;
+		EntryOwner owner = EntryOwner::Batch;
+		bool urgent = false; // Travels ahead of queued motion
+		uint32_t ackNode = 0; // Streamed job record: node count once it is acknowledged
+		std::chrono::steady_clock::time_point writtenAt;
+		std::chrono::steady_clock::time_point firstByteAt; // Start of the first reply line
+		std::chrono::steady_clock::time_point deadline; // Reply overdue after this (AUTO_TIMEOUT)
+
+		// The owner gave up (timeout); the late reply is still consumed here
+		// so it can't be mistaken for the next command's
+		bool abandoned = false;
+		std::chrono::steady_clock::time_point abandonedAt;
+
+		std::unique_ptr<std::promise<CommandResult>> promise;
+		CommandCallback callback;
+		SendClaim claim;
+
+		// Return a reused slot to its empty state; string capacity is kept
+		void clear() {
+			id = 0;
+			command.clear();
+			spec = &ofxEbbDefaultReplySpec;
+			linesSeen = 0;
+			raw.clear();
+			owner = EntryOwner::Batch;
+			urgent = false;
+			ackNode = 0;
+			abandoned = false;
+			promise.reset();
+			callback = nullptr;
+			claim.reset();
+		}
+	};
+
+	struct AsyncRequest {
+		std::string command;
+		std::unique_ptr<std::promise<CommandResult>> promise;
+		CommandCallback callback;
+		bool urgent = false;
+		SendClaim claim; // Only for waits with their own timeout
+	};
+
+	// Fixed ring of in-flight commands. Slots are reused in place, so
+	// entries built with emplace_back() don't allocate once warmed up.
+	// Used by whichever thread owns the port; only the published count
+	// may be read from others
+	class InFlightRing {
+	public:
+		bool empty() const { return count == 0; }
+		size_t size() const { return count; }
+		size_t published() const { return publishedCount.load(std::memory_order_relaxed); }
+
+		PipelineEntry & operator[](size_t i) { return slots[(head + i) % slots.size()]; }
+		const PipelineEntry & operator[](size_t i) const { return slots[(head + i) % slots.size()]; }
+		PipelineEntry & front() { return (*this)[0]; }
+		PipelineEntry & back() { return (*this)[count - 1]; }
+
+		PipelineEntry & emplace_back() {
+			if (count == slots.size()) {
+				throw std::logic_error("In-flight ring overflow");
+			}
+			PipelineEntry & entry = slots[(head + count) % slots.size()];
+			publishedCount.store(++count, std::memory_order_relaxed);
+			entry.clear();
+			return entry;
+		}
+
+		void push_back(
+			PipelineEntry && entry) {
+			emplace_back() = std::move(entry);
+		}
+
+		void pop_front() {
+			front().clear();
+			head = (head + 1) % slots.size();
+			publishedCount.store(--count, std::memory_order_relaxed);
+		}
+
+		void pop_back() {
+			back().clear();
+			publishedCount.store(--count, std::memory_order_relaxed);
+		}
+
+	private:
+		std::array<PipelineEntry, MAX_PIPELINE_DEPTH> slots;
+		size_t head = 0;
+		size_t count = 0;
+		std::atomic<size_t> publishedCount { 0 };
+	};
+
+	// Receive path: one reusable chunk buffer feeding a streaming tokenizer
+	static constexpr size_t RX_CHUNK_SIZE = 1024;
+	std::array<unsigned char, RX_CHUNK_SIZE> rxChunk;
+	size_t rxPending = 0; // Bytes in rxChunk read by waitForSerialData(), not yet consumed
+	ofxEbbLineTokenizer rxTokenizer;
+	std::chrono::steady_clock::time_point rxLineStart; // When the line being tokenized began arriving
+
+	// Pipelined command state
+	std::deque<PipelineEntry> pipelineQueue;
+	InFlightRing pipelineInFlight;
+	std::vector<CommandResult> pipelineResults;
+	std::atomic<int> pipelineDepth { DEFAULT_PIPELINE_DEPTH }; // Set by the app, read by the I/O thread
+	uint64_t pipelineProgress = 0;
+	uint64_t nextCommandId = 0;
+
+	// Reply deadlines (see setReplyTimeout())
+	int replyTimeoutMs = DEFAULT_REPLY_TIMEOUT_MS;
+	std::chrono::steady_clock::time_point motionBusyUntil; // Expected end of the motion written so far
+	std::chrono::steady_clock::time_point lastReplyDeadline;
+
+	// Link recovery (see setAutoResync())
+	bool autoResync = true;
+	int queryRetries = 1;
+	bool resyncing = false;
+	std::atomic<bool> resyncRequested { false }; // Set, with resyncDone, under ioWakeMutex
+	std::promise<bool> resyncDone;
+	std::shared_future<bool> resyncResult;
+	int jobRecovery = DEFAULT_JOB_RECOVERY;
+
+	// Result hand-off for the blocking sendCommand() path
+	std::string syncResponse;
+	bool syncOk = false;
+	uint64_t syncResultId = 0;
+
+	// First failure among the streamed motion commands (see streamMotion()),
+	// and the node count of the last job record acknowledged before it
+	std::string streamError;
+	uint32_t streamAckedNode = 0;
+
+	// Snapshot bursts (see getSnapshot()); the burst being read belongs to
+	// whichever thread owns the port
+	Snapshot snapshotBuilding;
+	size_t snapshotRemaining = 0;
+	std::string snapshotReply;
+	std::atomic<uint64_t> snapshotsTaken { 0 };
+	std::atomic<int> snapshotIntervalMs { 0 };
+	std::chrono::steady_clock::time_point nextSnapshotAt;
+	ofxEbbDoubleBuffer<Snapshot> latestSnapshot;
+
+	// Command formatting buffer, reused for every command
+	ofxEbbCommandBuffer commandBuffer;
+
+	std::function<void(std::string_view)> unsolicitedLineHandler;
+	ofxEbbSampleStream sampleStream;
+	std::chrono::steady_clock::time_point lastRxTime;
+
+	// Runtime protocol trace
+	ofxEbbTraceRing trace;
+	std::atomic<bool> traceDumpOnError { true };
+
+	ofxEbbStatsCollector stats;
+
+	// Background I/O thread state
+	std::thread ioThread;
+	std::atomic<bool> ioThreadRunning { false };
+	std::unique_ptr<ofxEbbSpscQueue<AsyncRequest>> motionQueue;
+	std::unique_ptr<ofxEbbSpscQueue<AsyncRequest>> queryQueue;
+	std::mutex ioWakeMutex;
+	std::mutex submitMutex;
+	std::condition_variable ioWake;
+	std::vector<std::future<CommandResult>> threadPipelineFutures; // enqueueCommand()'s thread only, not guarded by submitMutex
+
+	//-- Internal helpers -------------------------------------------
+
+	// Blocking send shared by sendCommand() and the formatted command
+	// helpers. The returned reference stays valid until the next command.
+	const std::string & transact(
+		std::string_view cmd,
+		int timeoutMs = AUTO_TIMEOUT) {
+		bool ok;
+		if (ioThreadRunning) {
+			// The I/O thread owns the port while it runs
+			CommandResult result = submitAndWait(std::string(cmd), timeoutMs);
+			ok = result.ok;
+			syncResponse = ok ? std::move(result.response) : std::move(result.error);
+		} else {
+			ok = sendAndWait(cmd, timeoutMs);
+		}
+
+		// Firmware errors are passed through unchanged for checkOk() to report
+		if (!ok && !ofxEbbLineTokenizer::isError(syncResponse)) {
+			throw std::runtime_error("Command '" + std::string(cmd) + "' failed: " + syncResponse);
+		}
+		return syncResponse;
+	}
+
+	// Send the command held in commandBuffer and require a bare OK
+	void sendFormatted() {
+		if (commandBuffer.overflowed()) {
+			throw std::runtime_error("Command too long: " + std::string(commandBuffer.view()));
+		}
+		checkOk(transact(commandBuffer.view()));
+	}
+
+	static void assertByte(int v) {
+		if (v < 0 || v > 255) {
+			throw std::runtime_error("Byte value must be 0-255");
+		}
+	}
+
+	static void assertPort(char p) {
+		if (std::string("ABCDE").find(p) == std::string::npos) {
+			throw std::runtime_error("Port letter must be A-E");
+		}
+	}
+
+	static void checkOk(const std::string & r) {
+		if (r != "OK") {
+			throw std::runtime_error("Unexpected response: " + r);
+		}
+	}
+
+	static void checkStatus(const std::vector<std::string> & lines) {
+		if (lines.size() < 2) {
+			throw std::runtime_error("Incomplete response, expected at least 2 lines");
+		}
+
+		if (lines[1] != "OK") {
+			std::string errorMsg = "Bad status response: " + lines[1];
+			if (!lines.empty()) {
+				errorMsg += " (data: " + lines[0] + ")";
+			}
+			throw std::runtime_error(errorMsg);
+		}
+	}
+
+	static std::string toStr(int v) {
+		return std::to_string(v);
+	}
+	static std::string toStr(bool b) {
+		return b ? "1" : "0";
+	}
+	static std::string toStr(uint32_t v) {
+		return std::to_string(v);
+	}
+
+	// Turn the data lines of a reply into the form sendCommand() returns.
+	// Writes into `out` so callers can reuse its capacity.
+	static void formatResponse(
+		const ofxEbbReplySpec & spec,
+		const std::string & data,
+		std::string & out) {
+		auto keep = [&](auto pred) {
+			out.clear();
+			for (char c : data) {
+				if (pred(static_cast<unsigned char>(c))) {
+					out += c;
+				}
+			}
+		};
+
+		switch (spec.format) {
+		case ofxEbbReplyFormat::None:
+			out.clear();
+			break;
+		case ofxEbbReplyFormat::Ok:
+			// For commands that just return OK
+			out.assign("OK");
+			break;
+		case ofxEbbReplyFormat::Flag:
+			// QP (0=down, 1=up), QB (1=pressed), QR (1=powered)
+			keep([](unsigned char c) { return c == '0' || c == '1'; });
+			out.resize(std::min<size_t>(out.size(), 1));
+			break;
+		case ofxEbbReplyFormat::Numbers:
+			// QS step positions, QC readings, ES stop data
+			keep([](unsigned char c) { return isdigit(c) || c == ',' || c == '-'; });
+			break;
+		case ofxEbbReplyFormat::Digits:
+			// QN node count, QL layer
+			keep([](unsigned char c) { return isdigit(c) != 0; });
+			break;
+		case ofxEbbReplyFormat::Text:
+			// QT nickname
+			out.assign(data.empty() ? "EBB Controller" : data);
+			break;
+		case ofxEbbReplyFormat::Line:
+		default:
+			// For any other response, return as-is
+			out.assign(data);
+			break;
+		}
+	}
+
+	//-- Serial wait helpers ----------------------------------------
+
+	// Milliseconds left until start + timeoutMs (never negative)
+	static int remainingMs(
+		std::chrono::steady_clock::time_point start,
+		int timeoutMs) {
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+		return static_cast<int>(std::max<int64_t>(0, timeoutMs - elapsed));
+	}
+
+	// Block until the port has bytes to read or timeoutMs expires.
+	// Returns true if data is available; the bytes wait in rxChunk for the
+	// next readChunk().
+	bool waitForSerialData(
+		int timeoutMs) {
+		if (rxPending > 0) {
+			return true;
+		}
+		size_t n = transport->read(rxChunk.data(), RX_CHUNK_SIZE, std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs));
+		if (n == 0) {
+			return false;
+		}
+		lastRxTime = std::chrono::steady_clock::now();
+		stats.onReceived(n);
+		rxPending = n;
+		return true;
+	}
+
+	// Read whatever is waiting (up to RX_CHUNK_SIZE) without blocking.
+	// Returns the number of bytes placed in rxChunk.
+	size_t readChunk() {
+		if (rxPending > 0) {
+			return std::exchange(rxPending, 0);
+		}
+		size_t n = transport->read(rxChunk.data(), RX_CHUNK_SIZE, std::chrono::steady_clock::time_point());
+		if (n > 0) {
+			lastRxTime = std::chrono::steady_clock::now();
+			stats.onReceived(n);
+		}
+		return n;
+	}
+
+	//-- Path planning internals ------------------------------------
+
+	double planAndSend(
+		const ofxEbbPoint * points,
+		size_t count,
+		const ofxEbbMotionLimits & limits) {
+		if (pathBatching) {
+			batchedPath.clear();
+			batchStats += batcher.process(planner, points, count, batchedPath);
+			points = batchedPath.data();
+			count = batchedPath.size();
+		}
+
+		plannedMoves.clear();
+		double duration = planner.plan(points, count, limits, plannedMoves);
+		sendMoves(plannedMoves);
+		return duration;
+	}
+
+	//-- Job file internals -----------------------------------------
+
+	void formatJobRecord(
+		const ofxEbbJobRecord & record) {
+		commandBuffer.op(record.name());
+		for (uint8_t i = 0; i < record.argc; ++i) {
+			commandBuffer.arg(record.args[i]);
+		}
+	}
+
+	// Keep the planner position and state cache in step with what a job
+	// record does on the board
+	void applyJobRecord(
+		const ofxEbbJobRecord & record) {
+		switch (record.op) {
+		case ofxEbbJobOp::LM:
+		case ofxEbbJobOp::SM: {
+			const auto steps = record.steps();
+			planner.offsetPosition(steps[0], steps[1]);
+			break;
+		}
+		case ofxEbbJobOp::SP:
+			if (record.argc < 3) {
+				state.penDown.set(record.args[0] == PEN_DOWN);
+			}
+			// Compiled with the job's own delays; where the servo ended up
+			// depends on timing the host didn't model
+			servoModel.invalidate();
+			break;
+		case ofxEbbJobOp::S2:
+			if (record.argc >= 2 && record.args[1] == SERVO_CHANNEL_PEN) {
+				state.penDown.invalidate();
+				servoModel.invalidate();
+			}
+			break;
+		case ofxEbbJobOp::SL:
+			state.layer.set(static_cast<int>(record.args[0]));
+			break;
+		default:
+			break;
+		}
+	}
+
+	// What runJob() got done, kept across recovery attempts
+	struct JobProgress {
+		double duration = 0.0;
+		uint32_t acked = 0; // Node count as of the last record acknowledged
+		bool engraver = false; // An SE was sent
+		bool malformed = false;
+		uint64_t malformedAt = 0;
+	};
+
+	// One pass of runJob() from `node`, optionally travelling there first
+	void runJobFrom(
+		const ofxEbbJobFile & job,
+		uint32_t node,
+		bool travel,
+		JobProgress & progress) {
+		const ofxEbbJobResume resume = job.findResume(node);
+		if (!resume.found) {
+			throw std::runtime_error("Job has no node " + toStr(node));
+		}
+		progress.acked = node;
+		if (travel) {
+			progress.duration += travelToResume(resume, node);
+		}
+
+		// Records are streamed straight from the mapped file; each carries
+		// the node count it leaves the board at, so a failure tells how far
+		// the board got
+		beginStreamedMotion();
+		streamAckedNode = node;
+		ofxEbbJobReader in = job.reader(resume.offset);
+		ofxEbbJobRecord record;
+		size_t pending = 0;
+		uint32_t sent = node;
+		try {
+			while (in.next(record)) {
+				const double seconds = record.durationUs / 1e6;
+				if (record.op == ofxEbbJobOp::SN) {
+					sent = record.argc ? static_cast<uint32_t>(record.args[0]) : 0;
+				} else if (record.op == ofxEbbJobOp::NI) {
+					++sent;
+				}
+				if (record.isMotion()) {
+					reserveMotionSlot();
+				}
+				formatJobRecord(record);
+				streamMotion(commandBuffer.view(), pending, sent);
+				if (record.isMotion()) {
+					motionFlow.onSent(seconds);
+				}
+				applyJobRecord(record);
+				if (record.isMotion()) {
+					predictJobRecord(record);
+				}
+				progress.engraver |= record.op == ofxEbbJobOp::SE;
+				progress.duration += seconds;
+			}
+			finishStreamedMotion();
+		} catch (const std::runtime_error &) {
+			progress.acked = streamAckedNode;
+			throw;
+		}
+		progress.acked = sent;
+
+		progress.malformed = in.failed();
+		progress.malformedAt = in.offset();
+	}
+
+	// Get back in step after a failed runJob() pass, let the motion the
+	// board took finish and pick the node to resume from: the lower of
+	// what the board counted and what the host saw acknowledged, as a
+	// command lost in flight may have left a path the board counted
+	// unfinished. The engraver follows the FIFO while it drains, then is
+	// switched off so it doesn't sit burning in one spot. False if the
+	// board can't be brought back.
+	bool recoverJob(
+		const ofxEbbJobFile & job,
+		const JobProgress & progress,
+		uint32_t & node) {
+		if (!resync()) {
+			return false;
+		}
+		const auto now = std::chrono::steady_clock::now();
+		const auto busy = std::chrono::duration_cast<std::chrono::milliseconds>(std::max(now, motionFlow.idleTime()) - now);
+		const bool idle = waitForCompletion(static_cast<int>(busy.count()) + MOTION_SLOT_TIMEOUT_MS);
+		if (progress.engraver) {
+			setEngraver(false, 0, false);
+		}
+		if (!idle) {
+			return false;
+		}
+
+		// A lost SP or SL may have left the board other than cached
+		state.penDown.invalidate();
+		state.layer.invalidate();
+		servoModel.invalidate();
+
+		uint32_t counted = 0;
+		try {
+			ofxEbbReplyReader(transact("QN")).next(counted);
+		} catch (const std::exception & e) {
+			ofLogError("ofxEbbControl") << "Error reading node count: " << e.what();
+			return false;
+		}
+		node = std::min(counted, progress.acked);
+		return job.findResume(node).found;
+	}
+
+	// Pen up (and engraver off), travel from the board's position to the
+	// resume point and put pen, engraver, layer and node counter back as
+	// they were there
+	double travelToResume(
+		const ofxEbbJobResume & resume,
+		uint32_t node) {
+		setPenState(false);
+		if (resume.hasEngraver) {
+			setEngraver(false, 0, false);
+		}
+		const auto current = getStepPositions();
+		planner.setPosition(current[0], current[1]);
+		predictor.reset(planner.getPositionSteps());
+		const ofxEbbPoint target = planner.toMm(resume.steps);
+		double duration = moveTo(target.x, target.y);
+
+		if (resume.layer >= 0) {
+			setLayer(resume.layer);
+		}
+		setNodeCount(node);
+		if (resume.hasPen) {
+			const double seconds = resume.pen.durationUs / 1e6;
+			formatJobRecord(resume.pen);
+			sendMotion(seconds);
+			applyJobRecord(resume.pen);
+			predictJobRecord(resume.pen);
+			duration += seconds;
+		}
+		if (resume.hasEngraver) {
+			formatJobRecord(resume.engraver);
+			if (resume.engraver.isMotion()) {
+				sendMotion(0.0);
+			} else {
+				sendFormatted();
+			}
+		}
+		return duration;
+	}
+
+	//-- Toolpath stream internals ----------------------------------
+
+	// Write one streamed command once the window has room. The entry is
+	// built in place in the ring, so nothing is allocated; its reply is
+	// matched later and only a failure is kept, in streamError.
+	void sendStreamed(
+		std::string_view cmd,
+		uint32_t ackNode = 0,
+		int timeoutMs = AUTO_TIMEOUT) {
+		ProgressWatch watch = watchProgress(timeoutMs);
+		pumpPipeline();
+		while (static_cast<int>(pipelineInFlight.size()) >= pipelineDepth) {
+			const int patience = patienceMs(watch);
+			if (patience <= 0) {
+				if (streamError.empty()) {
+					streamError = "Pipeline " + timeoutMessage(watch);
+				}
+				onPipelineStalled("Pipeline", watch, true, true);
+				return;
+			}
+			waitForSerialData(patience);
+			pumpPipeline();
+		}
+
+		PipelineEntry & entry = pipelineInFlight.emplace_back();
+		entry.id = ++nextCommandId;
+		entry.command.assign(cmd.data(), cmd.size());
+		entry.owner = EntryOwner::Stream;
+		entry.ackNode = ackNode;
+		writeEntry(entry);
+		if (entry.spec->format == ofxEbbReplyFormat::None) {
+			pipelineInFlight.pop_back();
+		}
+	}
+
+	// Start a run of streamed motion: collect whatever enqueueCommand()
+	// left queued and forget the last run's failure
+	void beginStreamedMotion() {
+		flushMotionBatch();
+		streamError.clear();
+	}
+
+	// Send one formatted motion command of a streamed run. With the I/O
+	// thread running it goes through the thread's ring instead, which
+	// hands back one future per command; those are collected in batches.
+	// `ackNode` becomes streamAckedNode once the command is acknowledged.
+	void streamMotion(
+		std::string_view cmd,
+		size_t & pending,
+		uint32_t ackNode = 0) {
+		if (ioThreadRunning) {
+			enqueueCommand(std::string(cmd));
+			if (++pending == static_cast<size_t>(pipelineDepth * MOVE_BATCH_PER_DEPTH)) {
+				flushMotionBatch();
+				streamAckedNode = ackNode;
+				pending = 0;
+			}
+			return;
+		}
+		sendStreamed(cmd, ackNode);
+		if (!streamError.empty()) {
+			abortPipeline(streamError, true);
+			throw std::runtime_error(streamError);
+		}
+	}
+
+	// Wait for the replies to a streamed run; throws its first failure
+	void finishStreamedMotion() {
+		if (ioThreadRunning) {
+			flushMotionBatch();
+			return;
+		}
+		waitPipelineIdle(AUTO_TIMEOUT);
+		if (!streamError.empty()) {
+			throw std::runtime_error(streamError);
+		}
+	}
+
+	//-- Servo timing internals -------------------------------------
+
+	// When a pen command sent now would start: after the queued motion
+	std::chrono::steady_clock::time_point servoStartTime() const {
+		return std::max(std::chrono::steady_clock::now(), motionFlow.idleTime());
+	}
+
+	// SP delay for a pen move starting at `start`, or -1 to send none
+	int penDelayMs(
+		bool down,
+		std::chrono::steady_clock::time_point start) const {
+		if (!penTiming || !ofxEbbServoModel::knows(state, down)) {
+			return -1;
+		}
+		return static_cast<int>(std::ceil(servoModel.penTravel(state, down, start) * 1000.0)) + penSettleMs;
+	}
+
+	// SP delay for a full swing, for strokes that alternate up and down
+	int penSwingMs(
+		bool down) const {
+		if (!penTiming || !ofxEbbServoModel::knows(state, down)) {
+			return -1;
+		}
+		const int distance = std::abs(ofxEbbServoModel::penPosition(state, true) - ofxEbbServoModel::penPosition(state, false));
+		const double seconds = ofxEbbServoModel::travelSeconds(state, distance, ofxEbbServoModel::penRate(state, down));
+		return static_cast<int>(std::ceil(seconds * 1000.0)) + penSettleMs;
+	}
+
+	//-- Position prediction internals ------------------------------
+
+	// Pen state for the predictor: 1 down, 0 up, -1 unknown
+	int predictedPen() const {
+		return state.penDown.known ? (state.penDown.value ? 1 : 0) : -1;
+	}
+
+	// Record the command just sent as a linear move to where the planner
+	// now is (or no move at all)
+	void predictMotion(
+		double seconds) {
+		predictor.onMove(seconds, planner.getPositionSteps(), predictedPen());
+	}
+
+	void predictJobRecord(
+		const ofxEbbJobRecord & record) {
+		const double seconds = record.durationUs / 1e6;
+		if (record.op == ofxEbbJobOp::LM && record.argc >= 6) {
+			predictor.onLowLevelMove(seconds, { { record.args[0], record.args[3] } }, record.steps(), { { record.args[2], record.args[5] } }, predictedPen());
+		} else {
+			predictMotion(seconds);
+		}
+	}
+
+	// QS now and then while motion is sent (see setPositionCorrection())
+	void correctPositionIfDue() {
+		if (positionCorrectionMs <= 0) {
+			return;
+		}
+		const auto now = std::chrono::steady_clock::now();
+		if (now < nextPositionCorrection) {
+			return;
+		}
+		nextPositionCorrection = now + std::chrono::milliseconds(positionCorrectionMs);
+		getStepPositions();
+	}
+
+	//-- Snapshot internals -----------------------------------------
+
+	static constexpr std::array<std::string_view, SNAPSHOT_QUERIES> snapshotQueries = { { "QG", "QM", "QS", "QP", "QL", "QN" } };
+
+	static size_t snapshotIndex(
+		std::string_view cmd) {
+		for (size_t i = 0; i < SNAPSHOT_QUERIES; ++i) {
+			if (ofxEbbOpcode(cmd) == ofxEbbOpcode(snapshotQueries[i])) {
+				return i;
+			}
+		}
+		return SNAPSHOT_QUERIES;
+	}
+
+	// Queue the six queries of a snapshot back to back; urgent ones go
+	// ahead of queued motion, like other queries on the I/O thread
+	void queueSnapshotBurst(
+		bool urgent) {
+		snapshotBuilding = Snapshot();
+		snapshotBuilding.time = std::chrono::steady_clock::now();
+		snapshotRemaining = SNAPSHOT_QUERIES;
+
+		auto it = pipelineQueue.begin();
+		while (urgent && it != pipelineQueue.end() && it->urgent) {
+			++it;
+		}
+		for (const auto query : snapshotQueries) {
+			PipelineEntry entry;
+			entry.id = ++nextCommandId;
+			entry.command.assign(query.data(), query.size());
+			entry.owner = EntryOwner::Snapshot;
+			entry.urgent = urgent;
+			it = std::next(pipelineQueue.insert(it, std::move(entry)));
+		}
+	}
+
+	// Fold one formatted reply into `snapshot`
+	static void parseSnapshotReply(
+		Snapshot & snapshot,
+		size_t index,
+		std::string_view reply) {
+		bool ok = false;
+		switch (index) {
+		case 0: {
+			int statusByte = 0;
+			ok = std::from_chars(reply.data(), reply.data() + reply.size(), statusByte, 16).ec == std::errc();
+			snapshot.general = generalStatusFromByte(statusByte);
+			break;
+		}
+		case 1:
+			ok = parseMotorStatus(reply, snapshot.motors);
+			break;
+		case 2:
+			ok = ofxEbbReplyReader(reply).read(snapshot.steps) == snapshot.steps.size();
+			break;
+		case 3:
+			ok = !reply.empty();
+			snapshot.penDown = reply == "0";
+			break;
+		case 4:
+			ok = ofxEbbReplyReader(reply).next(snapshot.layer);
+			break;
+		case 5:
+			ok = ofxEbbReplyReader(reply).next(snapshot.nodeCount);
+			break;
+		default:
+			break;
+		}
+		if (ok) {
+			snapshot.answered |= static_cast<uint8_t>(1 << index);
+		}
+	}
+
+	// The last reply of a burst is in (or its query failed): publish it
+	void finishSnapshot() {
+		snapshotBuilding.received = std::chrono::steady_clock::now();
+		snapshotBuilding.sequence = ++snapshotsTaken;
+		if (snapshotBuilding.answered) {
+			latestSnapshot.publish(snapshotBuilding);
+		}
+	}
+
+	// What the single getters would have learnt from the same replies
+	void applySnapshot(
+		const Snapshot & snapshot) {
+		if (snapshot.answered & (1 << 1)) {
+			const auto & m = snapshot.motors;
+			motionFlow.onStatus(m.fifoEmpty, m.executing || m.moving[0] || m.moving[1]);
+		}
+		if (snapshot.answered & (1 << 2)) {
+			predictor.correct({ { snapshot.steps[0], snapshot.steps[1] } }, snapshot.received);
+		}
+		if (snapshot.answered & (1 << 3)) {
+			state.penDown.set(snapshot.penDown);
+		}
+		if (snapshot.answered & (1 << 4)) {
+			state.layer.set(snapshot.layer);
+		}
+	}
+
+	//-- Flow control internals -------------------------------------
+
+	// Send the motion command in commandBuffer once the FIFO has room
+	void sendMotion(
+		double seconds) {
+		reserveMotionSlot();
+		sendFormatted();
+		motionFlow.onSent(seconds);
+	}
+
+	// Block until the flow model (confirmed by QG when its own estimate
+	// runs out) says one more motion command fits
+	void reserveMotionSlot() {
+		correctPositionIfDue();
+		if (!flowControl) {
+			return;
+		}
+
+		const auto timeout = std::chrono::milliseconds(MOTION_SLOT_TIMEOUT_MS);
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (true) {
+			auto now = std::chrono::steady_clock::now();
+			if (motionFlow.needsResync(now)) {
+				stats.onFlowResync();
+				syncMotionStatus();
+			}
+			if (motionFlow.hasRoom()) {
+				return;
+			}
+
+			// Give up only well after everything should have finished;
+			// status replies saying the board is still busy extend this
+			deadline = std::max(deadline, motionFlow.idleTime() + timeout);
+			if (now > deadline) {
+				throw std::runtime_error("Motion FIFO did not drain");
+			}
+
+			auto wake = motionFlow.nextSlotTime();
+			if (wake <= now) {
+				// The model expected a free slot by now; ask the board
+				stats.onFlowResync();
+				syncMotionStatus();
+				if (motionFlow.hasRoom()) {
+					return;
+				}
+				wake = now + std::chrono::milliseconds(1);
+			}
+			idleUntil(wake);
+			stats.onFlowWait(std::chrono::steady_clock::now() - now);
+		}
+	}
+
+	// Collect the pipelined motion sent so far. A full motion FIFO holds
+	// back each OK, which each command's deadline allows for.
+	void flushMotionBatch() {
+		for (const auto & result : flushPipeline(AUTO_TIMEOUT)) {
+			if (!result.ok) {
+				throw std::runtime_error("Move '" + result.command + "' failed: " + result.error);
+			}
+		}
+	}
+
+	// Sleep until `wake`, matching replies to pipelined commands meanwhile
+	void idleUntil(
+		std::chrono::steady_clock::time_point wake) {
+		if (ioThreadRunning) {
+			std::this_thread::sleep_until(wake);
+			return;
+		}
+		if (transport->skip(wake - std::chrono::steady_clock::now())) {
+			pumpPipeline(); // A dry run: no need to wait for real
+			return;
+		}
+		while (true) {
+			pumpPipeline();
+			auto left = std::chrono::duration_cast<std::chrono::milliseconds>(wake - std::chrono::steady_clock::now()).count();
+			if (left <= 0) {
+				return;
+			}
+			waitForSerialData(static_cast<int>(left));
+		}
+	}
+
+	//-- Trace internals --------------------------------------------
+
+	// Record a failure and, if enabled, log what led up to it
+	void traceError(
+		ofxEbbTraceKind kind,
+		std::string_view command) {
+		if (!trace.enabled()) {
+			return;
+		}
+		trace.record(kind, command);
+		if (traceDumpOnError) {
+			dumpTraceRecords(true);
+		}
+	}
+
+	void dumpTraceRecords(
+		bool onlyNew) {
+		auto now = std::chrono::steady_clock::now();
+		trace.forEach([&](const ofxEbbTraceRecord & r) {
+			ofLogError("ofxEbbControl") << "trace " << ofxEbbTraceRing::format(r, now);
+		},
+			onlyNew);
+	}
+
+	//-- Pipeline internals -----------------------------------------
+
+	// Write one command straight from its entry (CR appended in a reusable
+	// transmit buffer, so no temporary string is built)
+	void writeEntry(
+		PipelineEntry & entry) {
+		entry.spec = &ofxEbbFindReplySpec(entry.command);
+		if constexpr (ofxEbbProtocolLogging) {
+			ofLogNotice("ofxEbbControl") << "Sending: '" << entry.command << "'";
+		}
+		trace.record(ofxEbbTraceKind::Tx, entry.command);
+
+		// Command and terminator in one vectored write, no copy
+		const ofxEbbTransportBuffer line[] = {
+			{ entry.command.data(), entry.command.size() },
+			{ "\r", 1 }
+		};
+		if (!transport->write(line, 2)) {
+			ofLogError("ofxEbbControl") << "Write failed for '" << entry.command << "'";
+		}
+		entry.writtenAt = std::chrono::steady_clock::now();
+		entry.deadline = replyDeadline(entry.command, entry.writtenAt);
+		stats.onSent(ofxEbbOpcode(entry.command), entry.command.size() + 1);
+		++pipelineProgress;
+	}
+
+	// When the reply to `cmd`, written at `now`, is overdue. A motion
+	// command is answered once the FIFO takes it, so it also waits out the
+	// motion ahead of it; everything else answers within the budget.
+	// Replies come back in order, so no deadline is earlier than the last.
+	std::chrono::steady_clock::time_point replyDeadline(
+		std::string_view cmd,
+		std::chrono::steady_clock::time_point now) {
+		auto deadline = now + std::chrono::milliseconds(replyTimeoutMs);
+		if (ofxEbbIsMotionCommand(cmd)) {
+			const double seconds = ofxEbbMotionSeconds(cmd);
+			const auto start = std::max(now, motionBusyUntil);
+			deadline += std::chrono::duration_cast<std::chrono::steady_clock::duration>((start - now) * MOTION_DEADLINE_SLACK);
+			motionBusyUntil = start + (seconds < 0.0 ? std::chrono::milliseconds(UNKNOWN_MOTION_MS) : std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds)));
+		}
+		lastReplyDeadline = std::max(deadline, lastReplyDeadline);
+		return lastReplyDeadline;
+	}
+
+	// Milliseconds until the oldest command still waiting for a reply is
+	// overdue, at most `cap` (nothing waiting) and 0 once it is
+	int msUntilOverdue(
+		int cap) const {
+		for (size_t i = 0; i < pipelineInFlight.size(); ++i) {
+			if (!pipelineInFlight[i].abandoned) {
+				const auto left = pipelineInFlight[i].deadline - std::chrono::steady_clock::now();
+				if (left <= std::chrono::steady_clock::duration::zero()) {
+					return 0;
+				}
+				const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(left).count() + 1;
+				return static_cast<int>(std::min<int64_t>(ms, cap));
+			}
+		}
+		return cap;
+	}
+
+	// Tracks how long a wait for replies may go on: with AUTO_TIMEOUT until
+	// the oldest live command is overdue, otherwise until timeoutMs pass
+	// without a command being written or answered
+	struct ProgressWatch {
+		int timeoutMs;
+		uint64_t progress;
+		std::chrono::steady_clock::time_point since;
+	};
+
+	ProgressWatch watchProgress(
+		int timeoutMs) const {
+		return { timeoutMs, pipelineProgress, std::chrono::steady_clock::now() };
+	}
+
+	// Milliseconds the wait may still sleep; 0 once it has stalled
+	int patienceMs(
+		ProgressWatch & watch) {
+		if (watch.timeoutMs == AUTO_TIMEOUT) {
+			return msUntilOverdue(ABANDONED_REPLY_GRACE_MS);
+		}
+		if (pipelineProgress != watch.progress || !hasLiveInFlight()) {
+			watch.progress = pipelineProgress;
+			watch.since = std::chrono::steady_clock::now();
+		}
+		return remainingMs(watch.since, watch.timeoutMs);
+	}
+
+	// "timed out after ..." for a stalled wait, measured from when the
+	// oldest live command was written with AUTO_TIMEOUT
+	std::string timeoutMessage(
+		const ProgressWatch & watch) const {
+		int ms = watch.timeoutMs;
+		if (ms == AUTO_TIMEOUT) {
+			ms = 0;
+			for (size_t i = 0; i < pipelineInFlight.size(); ++i) {
+				if (!pipelineInFlight[i].abandoned) {
+					ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - pipelineInFlight[i].writtenAt).count());
+					break;
+				}
+			}
+		}
+		return "timed out after " + toStr(ms) + "ms";
+	}
+
+	// Write queued commands while the window allows, then match any
+	// replies that have already arrived
+	void pumpPipeline() {
+		while (!pipelineQueue.empty() && static_cast<int>(pipelineInFlight.size()) < pipelineDepth) {
+			PipelineEntry entry = std::move(pipelineQueue.front());
+			pipelineQueue.pop_front();
+			if (entry.claim && entry.claim->exchange(true)) {
+				deliverResult(entry, false, "Cancelled before it was sent");
+				continue;
+			}
+			writeEntry(entry);
+
+			// Commands that never answer are done once written
+			if (entry.spec->format == ofxEbbReplyFormat::None) {
+				deliverResult(entry, true, "");
+			} else {
+				pipelineInFlight.push_back(std::move(entry));
+			}
+		}
+
+		size_t n;
+		while ((n = readChunk()) > 0) {
+			// A line with nothing pending starts in this chunk; so does every
+			// line after the first one completed in it
+			if (rxTokenizer.partial().empty()) {
+				rxLineStart = lastRxTime;
+			}
+			rxTokenizer.feed(reinterpret_cast<const char *>(rxChunk.data()), n, [&](std::string_view line) {
+				handlePipelineLine(line);
+				rxLineStart = lastRxTime;
+			});
+		}
+
+		// An abandoned command whose reply never shows up would hold the
+		// window forever; let it go once the line has been quiet long enough
+		auto now = std::chrono::steady_clock::now();
+		while (!pipelineInFlight.empty() && pipelineInFlight.front().abandoned
+			&& now - std::max(pipelineInFlight.front().abandonedAt, lastRxTime) > std::chrono::milliseconds(ABANDONED_REPLY_GRACE_MS)) {
+			ofLogWarning("ofxEbbControl") << "No late reply for '" << pipelineInFlight.front().command << "', dropping it";
+			pipelineInFlight.pop_front();
+			++pipelineProgress;
+		}
+	}
+
+	// Match one reply line to the oldest in-flight command
+	void handlePipelineLine(
+		std::string_view line) {
+		trace.record(ofxEbbTraceKind::Rx, line);
+
+		// Streamed T packets look like I/A replies; they only answer a
+		// command if that command is an I or A query waiting for its line
+		if (sampleStream.claims(line)
+			&& (pipelineInFlight.empty() || pipelineInFlight.front().spec->op[0] != line[0]
+				|| pipelineInFlight.front().spec->op[1] != '\0')) {
+			sampleStream.onLine(line, lastRxTime);
+			return;
+		}
+
+		if (pipelineInFlight.empty()) {
+			stats.onUnsolicited();
+			if (unsolicitedLineHandler) {
+				unsolicitedLineHandler(line);
+			} else {
+				ofLogWarning("ofxEbbControl") << "Unexpected reply: '" << line << "'";
+			}
+			return;
+		}
+
+		PipelineEntry & entry = pipelineInFlight.front();
+		if (entry.linesSeen == 0 && entry.raw.empty()) {
+			entry.firstByteAt = std::max(rxLineStart, entry.writtenAt);
+		}
+		if (ofxEbbLineTokenizer::isError(line)) {
+			// Firmware error, e.g. "!8 Err: Unknown command"
+			completePipelineFront(false, line);
+		} else if (ofxEbbLineTokenizer::isOk(line)) {
+			// An early OK means the data line was empty
+			completePipelineFront(true, "");
+		} else {
+			if (!entry.raw.empty()) {
+				entry.raw += "\r\n";
+			}
+			entry.raw.append(line.data(), line.size());
+			if (++entry.linesSeen >= entry.spec->dataLines && !entry.spec->expectOk) {
+				completePipelineFront(true, "");
+			}
+		}
+	}
+
+	void completePipelineFront(
+		bool ok,
+		std::string_view error) {
+		PipelineEntry & entry = pipelineInFlight.front();
+
+		if (entry.abandoned) {
+			ofLogVerbose("ofxEbbControl") << "Discarding late reply for '" << entry.command << "'";
+			stats.onLateReply();
+		} else {
+			stats.onReply(entry.writtenAt, entry.firstByteAt, lastRxTime);
+			if (ok) {
+				if constexpr (ofxEbbProtocolLogging) {
+					ofLogNotice("ofxEbbControl") << "Raw response: '" << entry.raw << "'";
+				}
+			} else {
+				ofLogError("ofxEbbControl") << "Command '" << entry.command << "' failed: " << error;
+				stats.onError(ofxEbbOpcode(entry.command));
+				traceError(ofxEbbTraceKind::Error, entry.command);
+			}
+			deliverResult(entry, ok, error);
+		}
+
+		pipelineInFlight.pop_front();
+		++pipelineProgress;
+	}
+
+	// Hand the outcome to whoever owns the command. The blocking path
+	// formats into the reused syncResponse string instead of a new result.
+	void deliverResult(
+		PipelineEntry & entry,
+		bool ok,
+		std::string_view error) {
+		if (entry.owner == EntryOwner::Stream) {
+			if (!ok && streamError.empty()) {
+				streamError = "Command '" + entry.command + "' failed: " + std::string(error);
+			} else if (ok && streamError.empty()) {
+				streamAckedNode = entry.ackNode;
+			}
+			return;
+		}
+		if (entry.owner == EntryOwner::Snapshot) {
+			if (ok) {
+				formatResponse(*entry.spec, entry.raw, snapshotReply);
+				parseSnapshotReply(snapshotBuilding, snapshotIndex(entry.command), snapshotReply);
+			}
+			if (--snapshotRemaining == 0) {
+				finishSnapshot();
+			}
+			return;
+		}
+		if (entry.owner == EntryOwner::Sync) {
+			syncOk = ok;
+			if (ok) {
+				formatResponse(*entry.spec, entry.raw, syncResponse);
+			} else {
+				syncResponse.assign(error.data(), error.size());
+			}
+			syncResultId = entry.id;
+			return;
+		}
+
+		CommandResult result;
+		result.id = entry.id;
+		result.command = entry.command;
+		result.ok = ok;
+		result.error.assign(error.data(), error.size());
+		if (ok) {
+			formatResponse(*entry.spec, entry.raw, result.response);
+		}
+
+		if (entry.owner == EntryOwner::Batch) {
+			pipelineResults.push_back(std::move(result));
+		} else {
+			if (entry.callback) {
+				entry.callback(result);
+			}
+			entry.promise->set_value(std::move(result));
+		}
+	}
+
+	// Report a failure to the owner now but keep the entry in flight (as
+	// abandoned) so its reply, if it still arrives, is absorbed
+	void abandonInFlight(
+		PipelineEntry & entry,
+		const std::string & error) {
+		if (entry.abandoned) {
+			return;
+		}
+		deliverResult(entry, false, error);
+		entry.abandoned = true;
+		entry.abandonedAt = std::chrono::steady_clock::now();
+	}
+
+	bool hasLiveInFlight() const {
+		for (size_t i = 0; i < pipelineInFlight.size(); ++i) {
+			if (!pipelineInFlight[i].abandoned) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	enum class SyncOutcome {
+		Ok,
+		Failed, // Firmware error line
+		TimedOut
+	};
+
+	// Blocking path: send one command and wait for its reply, resyncing
+	// and resending a query if it times out (see setAutoResync()). The
+	// reply (or error) is left in syncResponse.
+	bool sendAndWait(
+		std::string_view cmd,
+		int timeoutMs) {
+		const int retries = ofxEbbFindReplySpec(cmd).priority ? queryRetries : 0;
+		for (int attempt = 0;; ++attempt) {
+			const SyncOutcome outcome = sendAndWaitOnce(cmd, timeoutMs);
+			if (outcome != SyncOutcome::TimedOut || !autoResync || resyncing) {
+				return outcome == SyncOutcome::Ok;
+			}
+			std::string error = syncResponse;
+			if (!resyncPort(true) || attempt >= retries) {
+				syncResponse = std::move(error);
+				return false;
+			}
+			stats.onRetry();
+			ofLogNotice("ofxEbbControl") << "Retrying '" << cmd << "'";
+		}
+	}
+
+	// Queue one command and pump until its own reply is matched.
+	// With a free window slot the command is built in place in the ring,
+	// so a warmed-up instance sends and matches it without allocating.
+	SyncOutcome sendAndWaitOnce(
+		std::string_view cmd,
+		int timeoutMs) {
+		const uint64_t id = ++nextCommandId;
+		if (pipelineQueue.empty() && static_cast<int>(pipelineInFlight.size()) < pipelineDepth) {
+			PipelineEntry & entry = pipelineInFlight.emplace_back();
+			entry.id = id;
+			entry.command.assign(cmd.data(), cmd.size());
+			entry.owner = EntryOwner::Sync;
+			writeEntry(entry);
+			if (entry.spec->format == ofxEbbReplyFormat::None) {
+				deliverResult(entry, true, "");
+				pipelineInFlight.pop_back();
+			}
+		} else {
+			PipelineEntry entry;
+			entry.id = id;
+			entry.command.assign(cmd.data(), cmd.size());
+			entry.owner = EntryOwner::Sync;
+			pipelineQueue.push_back(std::move(entry));
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		while (true) {
+			const uint64_t progress = pipelineProgress;
+			pumpPipeline();
+			if (syncResultId == id) {
+				return syncOk ? SyncOutcome::Ok : SyncOutcome::Failed;
+			}
+
+			// With AUTO_TIMEOUT this command, or one ahead of it, is overdue
+			const int remaining = timeoutMs == AUTO_TIMEOUT ? msUntilOverdue(ABANDONED_REPLY_GRACE_MS) : remainingMs(start, timeoutMs);
+			if (remaining <= 0) {
+				const int waited = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+				ofLogError("ofxEbbControl") << "Command '" << cmd << "' timed out after " << waited << "ms";
+				ofLogError("ofxEbbControl") << "Partial response: '" << rxTokenizer.partial() << "'";
+				traceError(ofxEbbTraceKind::Timeout, cmd);
+				stats.onTimeout(ofxEbbOpcode(cmd));
+				abandonCommand(id, "timed out after " + toStr(waited) + "ms");
+				return SyncOutcome::TimedOut;
+			}
+
+			// Sleep until data arrives, unless replies just made room for
+			// this command
+			if (pipelineProgress == progress) {
+				waitForSerialData(remaining);
+			}
+		}
+	}
+
+	// Give up on one command: drop it if unsent, abandon it if in flight
+	void abandonCommand(
+		uint64_t id,
+		const std::string & error) {
+		for (auto it = pipelineQueue.begin(); it != pipelineQueue.end(); ++it) {
+			if (it->id == id) {
+				deliverResult(*it, false, error);
+				pipelineQueue.erase(it);
+				return;
+			}
+		}
+		for (size_t i = 0; i < pipelineInFlight.size(); ++i) {
+			if (pipelineInFlight[i].id == id) {
+				abandonInFlight(pipelineInFlight[i], error);
+				return;
+			}
+		}
+	}
+
+	// Block until the pipeline is empty; fail whatever is left once the
+	// wait stalls (see ProgressWatch)
+	void waitPipelineIdle(
+		int timeoutMs) {
+		ProgressWatch watch = watchProgress(timeoutMs);
+		while (!pipelineQueue.empty() || hasLiveInFlight()) {
+			const uint64_t progress = pipelineProgress;
+			pumpPipeline();
+			const int patience = patienceMs(watch);
+			if (patience <= 0) {
+				onPipelineStalled("Pipeline", watch, true, true);
+				break;
+			}
+			// Replies may have made room for queued commands; write them first
+			if (pipelineProgress == progress) {
+				waitForSerialData(patience);
+			}
+		}
+	}
+
+	// Fail what a stalled wait was waiting for, then resync if enabled
+	void onPipelineStalled(
+		const char * what,
+		const ProgressWatch & watch,
+		bool includeQueued,
+		bool syncFlow) {
+		const std::string error = timeoutMessage(watch);
+		ofLogError("ofxEbbControl") << what << " " << error << " with "
+									<< pipelineInFlight.size() << " commands in flight";
+		traceError(ofxEbbTraceKind::Timeout, pipelineInFlight.empty() ? "pipeline" : pipelineInFlight.front().command);
+		countTimeouts();
+		abortPipeline(error, includeQueued);
+		if (autoResync && !resyncing) {
+			resyncPort(syncFlow);
+		}
+	}
+
+	// Count a timeout for every in-flight command still waiting
+	void countTimeouts() {
+		for (size_t i = 0; i < pipelineInFlight.size(); ++i) {
+			if (!pipelineInFlight[i].abandoned) {
+				stats.onTimeout(ofxEbbOpcode(pipelineInFlight[i].command));
+			}
+		}
+	}
+
+	// Fail every in-flight command (and optionally everything not yet
+	// written) with the given error. In-flight entries stay queued as
+	// abandoned so their late replies don't shift onto newer commands.
+	void abortPipeline(
+		const std::string & error,
+		bool includeQueued) {
+		for (size_t i = 0; i < pipelineInFlight.size(); ++i) {
+			abandonInFlight(pipelineInFlight[i], error);
+		}
+		while (includeQueued && !pipelineQueue.empty()) {
+			deliverResult(pipelineQueue.front(), false, "Not sent, pipeline aborted");
+			pipelineQueue.pop_front();
+		}
+	}
+
+	// See resync(). Runs on whichever thread owns the port; syncFlow
+	// re-reads QG into the flow model, which only the caller's thread may.
+	bool resyncPort(
+		bool syncFlow) {
+		if (resyncing) {
+			return false;
+		}
+		resyncing = true;
+		stats.onLinkResync();
+		const auto start = std::chrono::steady_clock::now();
+		ofLogWarning("ofxEbbControl") << "Resynchronizing with the board";
+		abortPipeline("No reply, link resynchronized", false);
+
+		// A bare CR ends a half-received command on the board. V is parsed
+		// after everything still owed a reply, so its banner marks where
+		// the line is back in step; a full FIFO can hold it back until the
+		// queued motion's deadline.
+		static constexpr std::string_view probe = "\rV\r";
+		trace.record(ofxEbbTraceKind::Tx, "V");
+		const ofxEbbTransportBuffer line[] = { { probe.data(), probe.size() } };
+		transport->write(line, 1);
+		stats.onSent(ofxEbbOpcode("V"), probe.size());
+		const auto deadline = std::max(start, lastReplyDeadline) + std::chrono::milliseconds(replyTimeoutMs);
+
+		// Every reply owed is consumed by then or won't come
+		auto forgetInFlight = [&] {
+			while (!pipelineInFlight.empty()) {
+				pipelineInFlight.pop_front();
+				++pipelineProgress;
+			}
+		};
+
+		rxTokenizer.reset();
+		bool found = false;
+		while (!found) {
+			size_t n;
+			while ((n = readChunk()) > 0) {
+				rxTokenizer.feed(reinterpret_cast<const char *>(rxChunk.data()), n, [&](std::string_view reply) {
+					if (found) {
+						handlePipelineLine(reply);
+						return;
+					}
+					trace.record(ofxEbbTraceKind::Rx, reply);
+					if (reply.find("EBB") != std::string_view::npos) {
+						found = true;
+						forgetInFlight();
+					} else {
+						stats.onLateReply();
+					}
+				});
+			}
+			const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if (found || left <= 0) {
+				break;
+			}
+			waitForSerialData(static_cast<int>(left) + 1);
+		}
+
+		forgetInFlight();
+		lastReplyDeadline = std::chrono::steady_clock::now();
+
+		if (found) {
+			ofLogNotice("ofxEbbControl") << "Back in step after "
+										 << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0 << "ms";
+			if (syncFlow) {
+				syncMotionStatus();
+			}
+		} else {
+			ofLogError("ofxEbbControl") << "No answer to the resync probe";
+			traceError(ofxEbbTraceKind::Timeout, "V");
+		}
+		resyncing = false;
+		return found;
+	}
+
+	//-- I/O thread internals ---------------------------------------
+
+	// Hand a command to the I/O thread. With waitForSpace the caller yields
+	// until the ring accepts it; otherwise a full ring fails immediately.
+	std::future<CommandResult> submitAsync(
+		const std::string & cmd,
+		CommandCallback callback,
+		bool waitForSpace,
+		bool urgent = false,
+		SendClaim claim = nullptr) {
+		AsyncRequest request;
+		request.command = cmd;
+		request.callback = std::move(callback);
+		request.claim = std::move(claim);
+		request.urgent = urgent || ofxEbbFindReplySpec(cmd).priority;
+		request.promise.reset(new std::promise<CommandResult>());
+		auto future = request.promise->get_future();
+
+		if (ioThreadRunning && std::this_thread::get_id() == ioThread.get_id()) {
+			throw std::logic_error("Blocking ofxEbbControl call from an I/O thread callback");
+		}
+
+		auto & queue = request.urgent ? queryQueue : motionQueue;
+		bool queued = false;
+
+		// The rings have a single producer slot each; serialize submitters
+		std::lock_guard<std::mutex> lock(submitMutex);
+		while (ioThreadRunning) {
+			if (queue->push(std::move(request))) {
+				queued = true;
+				break;
+			}
+			if (!waitForSpace) {
+				break;
+			}
+			std::this_thread::yield();
+		}
+
+		if (queued) {
+			ioWake.notify_one();
+		} else {
+			CommandResult result;
+			result.command = cmd;
+			result.error = ioThreadRunning ? "Submission queue full" : "I/O thread not running";
+			if (request.callback) {
+				request.callback(result);
+			}
+			request.promise->set_value(std::move(result));
+		}
+		return future;
+	}
+
+	// An explicit timeoutMs bounds the wait. A command still queued then
+	// is cancelled; one already written is reported as pending, as it may
+	// still run, and its late reply is dropped with the future.
+	CommandResult submitAndWait(
+		const std::string & cmd,
+		int timeoutMs = AUTO_TIMEOUT) {
+		if (timeoutMs == AUTO_TIMEOUT) {
+			return submitAsync(cmd, nullptr, true).get();
+		}
+		auto claim = std::make_shared<std::atomic<bool>>(false);
+		auto future = submitAsync(cmd, nullptr, true, false, claim);
+		if (future.wait_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(0, timeoutMs))) == std::future_status::ready) {
+			return future.get();
+		}
+		CommandResult result;
+		result.command = cmd;
+		result.pending = claim->exchange(true);
+		result.error = "timed out after " + toStr(timeoutMs) + "ms" + (result.pending ? ", still pending on the board" : ", cancelled before it was sent");
+		return result;
+	}
+
+	void ioThreadLoop() {
+		ProgressWatch watch = watchProgress(AUTO_TIMEOUT);
+		AsyncRequest request;
+
+		auto adopt = [&](AsyncRequest & req) {
+			PipelineEntry entry;
+			entry.id = ++nextCommandId;
+			entry.command = std::move(req.command);
+			entry.owner = EntryOwner::Async;
+			entry.urgent = req.urgent;
+			entry.promise = std::move(req.promise);
+			entry.callback = std::move(req.callback);
+			entry.claim = std::move(req.claim);
+			return entry;
+		};
+
+		while (ioThreadRunning) {
+			if (resyncRequested) {
+				const bool found = resyncPort(false);
+				std::lock_guard<std::mutex> lock(ioWakeMutex);
+				resyncRequested = false;
+				resyncDone.set_value(found);
+			}
+
+			// Background snapshots, one burst at a time
+			const int snapshotInterval = snapshotIntervalMs;
+			if (snapshotInterval > 0 && snapshotRemaining == 0) {
+				const auto now = std::chrono::steady_clock::now();
+				if (now >= nextSnapshotAt) {
+					queueSnapshotBurst(true);
+					nextSnapshotAt = now + std::chrono::milliseconds(snapshotInterval);
+				}
+			}
+
+			// Queries jump ahead of motion that has not been written yet;
+			// motion is only pulled in while the window has room
+			while (queryQueue->pop(request)) {
+				auto entry = adopt(request);
+				auto it = pipelineQueue.begin();
+				while (it != pipelineQueue.end() && it->urgent) {
+					++it;
+				}
+				pipelineQueue.insert(it, std::move(entry));
+			}
+			while (static_cast<int>(pipelineQueue.size() + pipelineInFlight.size()) < pipelineDepth && motionQueue->pop(request)) {
+				pipelineQueue.push_back(adopt(request));
+			}
+
+			pumpPipeline();
+			if (patienceMs(watch) <= 0) {
+				// Motion not written yet is kept; the flow model is the
+				// caller's, so QG is left to it
+				onPipelineStalled("I/O thread", watch, false, false);
+			}
+
+			if (pipelineInFlight.empty() && pipelineQueue.empty() && !sampleStream.isActive()) {
+				// Idle: sleep until a producer signals. The timeout bounds a
+				// wakeup lost between the emptiness check and the wait.
+				std::unique_lock<std::mutex> lock(ioWakeMutex);
+				ioWake.wait_for(lock, std::chrono::milliseconds(2), [&] {
+					return !ioThreadRunning || resyncRequested || !queryQueue->empty() || !motionQueue->empty();
+				});
+			} else {
+				// Short bound so new submissions are picked up promptly
+				waitForSerialData(1);
+			}
+		}
+
+		// Fail whatever is left so no future is left hanging
+		{
+			std::lock_guard<std::mutex> lock(ioWakeMutex);
+			if (resyncRequested) {
+				resyncRequested = false;
+				resyncDone.set_value(false);
+			}
+		}
+		abortPipeline("I/O thread stopped", true);
+		while (queryQueue->pop(request) || motionQueue->pop(request)) {
+			pipelineQueue.push_back(adopt(request));
+		}
+		abortPipeline("I/O thread stopped", true);
+	}
+
+	// Parse a QE reply ("[QE,]<m1>,<m2>", microstep divisors, 0 = off)
+	// into MOTOR_* modes
+	static bool parseMotorEnables(
+		std::string_view reply,
+		std::array<int, 2> & out) {
+		ofxEbbReplyReader reader(reply);
+		reader.skipPrefix("QE");
+		std::array<int, 2> values;
+		int extra;
+		if (reader.read(values) < values.size() || reader.next(extra)) {
+			return false;
+		}
+		for (int m = 0; m < 2; ++m) {
+			switch (values[m]) {
+			case 0: out[m] = MOTOR_DISABLE; break;
+			case 16: out[m] = MOTOR_STEP_DIV16; break;
+			case 8: out[m] = MOTOR_STEP_DIV8; break;
+			case 4: out[m] = MOTOR_STEP_DIV4; break;
+			case 2: out[m] = MOTOR_STEP_DIV2; break;
+			case 1: out[m] = MOTOR_STEP_DIV1; break;
+			default: return false;
+			}
+		}
+		return true;
+	}
+
+	// QG status byte into its flags
+	static GeneralStatus generalStatusFromByte(
+		int statusByte) {
+		auto bitSet = [&](int b) {
+			return (statusByte & (1 << b)) != 0;
+		};
+
+		return {
+			bitSet(7), bitSet(6), bitSet(5), bitSet(4),
+			bitSet(3), bitSet(2), bitSet(1), !bitSet(0)
+		};
 	}
 };
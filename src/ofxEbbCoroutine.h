@@ -0,0 +1,777 @@
+// ofxEbbCoroutine.h
+#pragma once
+
+#include "ofxEbbControl.h"
+
+#if !defined(__cpp_impl_coroutine) || !__has_include(<coroutine>)
+#error "ofxEbbCoroutine.h needs C++20 coroutines (build with -std=c++20)"
+#else
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Thrown from every await in coroutines cancelled with
+ * ofxEbbScheduler::cancelAll().
+ */
+class ofxEbbCancelled : public std::runtime_error {
+public:
+	ofxEbbCancelled()
+		: std::runtime_error("Cancelled") { }
+};
+
+// Where an ofxEbbTask keeps its result (internal)
+template <typename T>
+class ofxEbbTaskResult {
+public:
+	template <typename U>
+	void return_value(
+		U && v) {
+		value.emplace(std::forward<U>(v));
+	}
+
+	T take() {
+		return std::move(*value);
+	}
+
+private:
+	std::optional<T> value;
+};
+
+template <>
+class ofxEbbTaskResult<void> {
+public:
+	void return_void() { }
+	void take() { }
+};
+
+/**
+ * ofxEbbTask: a coroutine that returns a T. It starts when it is awaited
+ * and resumes its awaiter when it finishes, so a script can be split into
+ * tasks that call each other with co_await. Exceptions travel to the
+ * awaiter. Top-level tasks are started with ofxEbbScheduler::spawn().
+ */
+template <typename T = void>
+class ofxEbbTask {
+	struct FinalAwaiter {
+		bool await_ready() const noexcept {
+			return false;
+		}
+
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend(
+			std::coroutine_handle<Promise> h) noexcept {
+			auto next = h.promise().continuation;
+			return next ? next : std::noop_coroutine();
+		}
+
+		void await_resume() const noexcept { }
+	};
+
+public:
+	struct promise_type : ofxEbbTaskResult<T> {
+		std::coroutine_handle<> continuation;
+		std::exception_ptr error;
+
+		ofxEbbTask get_return_object() {
+			return ofxEbbTask(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+
+		std::suspend_always initial_suspend() noexcept {
+			return {};
+		}
+
+		FinalAwaiter final_suspend() noexcept {
+			return {};
+		}
+
+		void unhandled_exception() {
+			error = std::current_exception();
+		}
+	};
+
+	using Handle = std::coroutine_handle<promise_type>;
+
+	ofxEbbTask() = default;
+
+	ofxEbbTask(
+		ofxEbbTask && other) noexcept
+		: handle(std::exchange(other.handle, nullptr)) { }
+
+	ofxEbbTask & operator=(
+		ofxEbbTask && other) noexcept {
+		if (this != &other) {
+			reset();
+			handle = std::exchange(other.handle, nullptr);
+		}
+		return *this;
+	}
+
+	ofxEbbTask(const ofxEbbTask &) = delete;
+	ofxEbbTask & operator=(const ofxEbbTask &) = delete;
+
+	~ofxEbbTask() {
+		reset();
+	}
+
+	bool valid() const {
+		return static_cast<bool>(handle);
+	}
+
+	bool done() const {
+		return handle && handle.done();
+	}
+
+	auto operator co_await() noexcept {
+		struct Awaiter {
+			Handle handle;
+
+			bool await_ready() const noexcept {
+				return !handle || handle.done();
+			}
+
+			std::coroutine_handle<> await_suspend(
+				std::coroutine_handle<> awaiting) noexcept {
+				handle.promise().continuation = awaiting;
+				return handle;
+			}
+
+			T await_resume() {
+				if (!handle) {
+					throw std::logic_error("Awaiting an empty ofxEbbTask");
+				}
+				if (handle.promise().error) {
+					std::rethrow_exception(handle.promise().error);
+				}
+				return handle.promise().take();
+			}
+		};
+		return Awaiter { handle };
+	}
+
+private:
+	explicit ofxEbbTask(
+		Handle h)
+		: handle(h) { }
+
+	void reset() {
+		if (handle) {
+			handle.destroy();
+			handle = nullptr;
+		}
+	}
+
+	Handle handle;
+};
+
+/**
+ * ofxEbbScheduler: runs any number of coroutines on one thread. Call
+ * update() once a frame from ofApp::update(), or run() on a thread of its
+ * own; either resumes every coroutine whose command has completed or
+ * whose sleep has run out, and never blocks on the boards. Completions
+ * arrive from each board's I/O thread and are handed over under a short
+ * lock, so coroutines on several boards can share the thread. With
+ * update(), a coroutine waiting on a reply resumes at the next frame.
+ *
+ * update() and run() must be called from one thread at a time; spawn()
+ * and cancelAll() may be called from anywhere. Let every coroutine finish
+ * (or cancel them) before destroying the scheduler or the boards.
+ */
+class ofxEbbScheduler {
+public:
+	using Clock = std::chrono::steady_clock;
+	using DoneCallback = std::function<void(std::exception_ptr)>;
+
+	ofxEbbScheduler() = default;
+	ofxEbbScheduler(const ofxEbbScheduler &) = delete;
+	ofxEbbScheduler & operator=(const ofxEbbScheduler &) = delete;
+
+	~ofxEbbScheduler() {
+		if (live > 0) {
+			ofLogWarning("ofxEbbScheduler") << live.load() << " coroutine(s) still running at destruction";
+		}
+	}
+
+	/**
+	 * Start `task` on the scheduler thread at the next update().
+	 * @param onDone  Called on the scheduler thread when the task ends,
+	 *                with its exception or null. Without one, exceptions
+	 *                are logged.
+	 */
+	void spawn(
+		ofxEbbTask<> task,
+		DoneCallback onDone = nullptr) {
+		++live;
+		post(runRoot(this, std::move(task), std::move(onDone)).handle);
+	}
+
+	/**
+	 * Resume every coroutine that is ready to continue.
+	 * @returns Number of spawned coroutines still running.
+	 */
+	size_t update() {
+		const bool cancelling = cancelled;
+		const auto now = Clock::now();
+		while (!timers.empty() && (cancelling || timers.top().time <= now)) {
+			resuming.push_back(timers.top().handle);
+			timers.pop();
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			resuming.insert(resuming.end(), posted.begin(), posted.end());
+			posted.clear();
+		}
+
+		// Coroutines that yield again now wait for the next update()
+		std::vector<std::coroutine_handle<>> batch;
+		batch.swap(resuming);
+		for (auto h : batch) {
+			h.resume();
+		}
+		batch.clear();
+		if (resuming.empty()) {
+			resuming.swap(batch); // Keep the capacity
+		}
+		return live;
+	}
+
+	/**
+	 * Run coroutines on the calling thread until none are left, sleeping
+	 * in between until a command completes or a sleep runs out.
+	 */
+	void run() {
+		while (update() > 0) {
+			std::unique_lock<std::mutex> lock(mutex);
+			auto ready = [&] {
+				return !posted.empty() || (cancelled && !timers.empty());
+			};
+			if (timers.empty()) {
+				wake.wait(lock, ready);
+			} else {
+				wake.wait_until(lock, timers.top().time, ready);
+			}
+		}
+	}
+
+	/**
+	 * Resume every coroutine as soon as possible with ofxEbbCancelled
+	 * thrown from its current await. Commands already sent still complete
+	 * first. Coroutines spawned before none are left are cancelled too.
+	 */
+	void cancelAll() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (live == 0) {
+			return;
+		}
+		cancelled = true;
+		wake.notify_one();
+	}
+
+	bool isCancelling() const {
+		return cancelled;
+	}
+
+	size_t getLiveCount() const {
+		return live;
+	}
+
+	/**
+	 * Resume `h` on the scheduler thread; safe from any thread.
+	 */
+	void post(
+		std::coroutine_handle<> h) {
+		// Notify under the lock: once run() sees the handle the scheduler
+		// may return and be destroyed
+		std::lock_guard<std::mutex> lock(mutex);
+		posted.push_back(h);
+		wake.notify_one();
+	}
+
+	// Awaited by everything that suspends on this scheduler
+	void throwIfCancelled() const {
+		if (cancelled) {
+			throw ofxEbbCancelled();
+		}
+	}
+
+	class SleepAwaiter {
+	public:
+		SleepAwaiter(
+			ofxEbbScheduler & scheduler,
+			Clock::time_point until)
+			: scheduler(scheduler)
+			, until(until) { }
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+
+		void await_suspend(
+			std::coroutine_handle<> h) {
+			if (until <= Clock::now()) {
+				scheduler.post(h); // Still yield, to the next update()
+			} else {
+				scheduler.timers.push({ until, ++scheduler.timerSequence, h });
+			}
+		}
+
+		void await_resume() const {
+			scheduler.throwIfCancelled();
+		}
+
+	private:
+		ofxEbbScheduler & scheduler;
+		Clock::time_point until;
+	};
+
+	/**
+	 * co_await sleep(ms): resume after `ms` (0 yields to the next update()).
+	 */
+	SleepAwaiter sleep(
+		int ms) {
+		return SleepAwaiter(*this, Clock::now() + std::chrono::milliseconds(std::max(0, ms)));
+	}
+
+	SleepAwaiter sleepUntil(
+		Clock::time_point t) {
+		return SleepAwaiter(*this, t);
+	}
+
+private:
+	// Fire-and-forget frame around a spawned task; frees itself at the end
+	struct Root {
+		struct promise_type {
+			Root get_return_object() {
+				return Root { std::coroutine_handle<promise_type>::from_promise(*this) };
+			}
+
+			std::suspend_always initial_suspend() noexcept {
+				return {};
+			}
+
+			std::suspend_never final_suspend() noexcept {
+				return {};
+			}
+
+			void return_void() { }
+
+			void unhandled_exception() {
+				std::terminate();
+			}
+		};
+
+		std::coroutine_handle<promise_type> handle;
+	};
+
+	static Root runRoot(
+		ofxEbbScheduler * self,
+		ofxEbbTask<> task,
+		DoneCallback onDone) {
+		std::exception_ptr error;
+		try {
+			co_await task;
+		} catch (...) {
+			error = std::current_exception();
+		}
+
+		if (onDone) {
+			onDone(error);
+		} else if (error) {
+			try {
+				std::rethrow_exception(error);
+			} catch (const ofxEbbCancelled &) {
+			} catch (const std::exception & e) {
+				ofLogError("ofxEbbScheduler") << "Coroutine failed: " << e.what();
+			} catch (...) {
+				ofLogError("ofxEbbScheduler") << "Coroutine failed";
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(self->mutex);
+		if (--self->live == 0) {
+			self->cancelled = false;
+		}
+	}
+
+	struct Timer {
+		Clock::time_point time;
+		uint64_t sequence; // FIFO among equal times
+		std::coroutine_handle<> handle;
+
+		bool operator>(
+			const Timer & other) const {
+			return time != other.time ? time > other.time : sequence > other.sequence;
+		}
+	};
+
+	// Scheduler thread only
+	std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+	uint64_t timerSequence = 0;
+	std::vector<std::coroutine_handle<>> resuming;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<std::coroutine_handle<>> posted;
+	std::atomic<size_t> live { 0 };
+	std::atomic<bool> cancelled { false };
+};
+
+/**
+ * ofxEbbAsyncBoard: awaitable commands for one board, e.g.
+ *
+ *     ofxEbbTask<> plotLayers(ofxEbbAsyncBoard & board) {
+ *         co_await board.drawPolyline(layer1);
+ *         co_await board.waitForCompletion();
+ *         co_await board.buttonPressed(); // pen change
+ *         co_await board.drawPolyline(layer2);
+ *     }
+ *     scheduler.spawn(plotLayers(board));
+ *
+ * Commands go through the control's background I/O thread (start it with
+ * startThread() first), so awaiting one never blocks the scheduler. The
+ * operations that return a task throw std::runtime_error when the board
+ * rejects a command. Motion is planned with the control's planner and
+ * limits, whose position is kept up to date, but the cached pen and layer
+ * state is not; call invalidateState() before going back to the blocking
+ * API. Don't drive the same board from the blocking API while a
+ * coroutine is using it.
+ */
+class ofxEbbAsyncBoard {
+public:
+	using Clock = ofxEbbScheduler::Clock;
+	using CommandResult = ofxEbbControl::CommandResult;
+
+	static constexpr size_t MOTION_CHUNK = 32; // Commands in flight per await
+	static constexpr int BUTTON_POLL_MS = 50;
+
+	ofxEbbAsyncBoard(
+		ofxEbbControl & control,
+		ofxEbbScheduler & scheduler)
+		: control(control)
+		, scheduler(scheduler) { }
+
+	ofxEbbControl & getControl() {
+		return control;
+	}
+
+	ofxEbbScheduler & getScheduler() {
+		return scheduler;
+	}
+
+	class CommandAwaiter {
+	public:
+		CommandAwaiter(
+			ofxEbbAsyncBoard & board,
+			std::string command,
+			bool urgent)
+			: board(board)
+			, command(std::move(command))
+			, urgent(urgent) { }
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+
+		void await_suspend(
+			std::coroutine_handle<> h) {
+			board.control.sendCommandAsync(
+				command, [this, h](const CommandResult & r) {
+					result = r;
+					board.scheduler.post(h);
+				},
+				urgent);
+		}
+
+		CommandResult await_resume() {
+			board.scheduler.throwIfCancelled();
+			board.onCompleted(result);
+			return std::move(result);
+		}
+
+	private:
+		ofxEbbAsyncBoard & board;
+		std::string command;
+		bool urgent;
+		CommandResult result;
+	};
+
+	/**
+	 * co_await command(cmd): send any command and get its result; a
+	 * failure is reported in the result rather than thrown.
+	 * @param urgent  Write ahead of queued motion (see sendCommandAsync()).
+	 */
+	CommandAwaiter command(
+		std::string cmd,
+		bool urgent = false) {
+		return CommandAwaiter(*this, std::move(cmd), urgent);
+	}
+
+	/**
+	 * Send a command and return its response.
+	 * @throws std::runtime_error if it fails.
+	 */
+	ofxEbbTask<std::string> send(
+		std::string cmd) {
+		auto result = co_await command(std::move(cmd));
+		throwIfFailed(result);
+		co_return std::move(result.response);
+	}
+
+	/**
+	 * Send commands in order, up to MOTION_CHUNK in flight at a time.
+	 * @throws std::runtime_error at the first one that fails.
+	 */
+	ofxEbbTask<> sendAll(
+		std::vector<std::string> commands) {
+		for (size_t i = 0; i < commands.size(); i += MOTION_CHUNK) {
+			const size_t n = std::min(MOTION_CHUNK, commands.size() - i);
+			std::vector<CommandResult> results = co_await BatchAwaiter(*this, commands.data() + i, n);
+			for (const auto & result : results) {
+				throwIfFailed(result);
+			}
+		}
+	}
+
+	/**
+	 * Stepper move (SM). Completes when the board has queued it.
+	 */
+	ofxEbbTask<> move(
+		int durationMs,
+		int steps1,
+		int steps2) {
+		ofxEbbCommandBuffer cmd;
+		cmd.op("SM").arg(durationMs).arg(steps1).arg(steps2);
+		co_await send(std::string(cmd.view()));
+		control.getPlanner().offsetPosition(steps1, steps2);
+	}
+
+	/**
+	 * Raise or lower the pen (SP).
+	 * @param delayMs  Delay before the next motion; < 0 times a full
+	 *                 swing from the servo settings (see getPenSwingMs()).
+	 */
+	ofxEbbTask<> setPen(
+		bool down,
+		int delayMs = -1) {
+		if (delayMs < 0) {
+			delayMs = control.getPenSwingMs(down);
+		}
+		ofxEbbCommandBuffer cmd;
+		cmd.op("SP").arg(down ? ofxEbbControl::PEN_DOWN : ofxEbbControl::PEN_UP);
+		if (delayMs >= 0) {
+			cmd.arg(delayMs);
+		}
+		co_await send(std::string(cmd.view()));
+	}
+
+	/**
+	 * Travel to a point (mm) with the control's travel limits; the pen is
+	 * left as it is.
+	 * @returns Planned motion time in seconds.
+	 */
+	ofxEbbTask<double> moveTo(
+		double x,
+		double y) {
+		std::vector<ofxEbbPoint> target(1, ofxEbbPoint { x, y });
+		co_return co_await sendPlanned(std::move(target), control.getTravelLimits());
+	}
+
+	/**
+	 * Draw a polyline like ofxEbbControl::drawPolyline() (without path
+	 * batching): pen up, travel, pen down, draw, pen up.
+	 * @returns Planned motion time in seconds, without pen delays.
+	 */
+	ofxEbbTask<double> drawPolyline(
+		std::vector<ofxEbbPoint> points,
+		bool closed = false) {
+		if (points.empty()) {
+			co_return 0.0;
+		}
+		co_await setPen(false);
+		double duration = co_await moveTo(points[0].x, points[0].y);
+		co_await setPen(true);
+
+		if (closed) {
+			points.push_back(points[0]);
+		}
+		points.erase(points.begin());
+		duration += co_await sendPlanned(std::move(points), control.getMotionLimits());
+		co_await setPen(false);
+		co_return duration;
+	}
+
+	/**
+	 * Wait until all motion sent has finished: sleeps through the time
+	 * the motion sent from here is expected to take, then polls QM.
+	 * @param timeoutMs       Give up after this long (< 0 waits forever).
+	 * @param pollIntervalMs  Poll interval once the estimate runs out.
+	 * @returns               True when idle, false on timeout.
+	 */
+	ofxEbbTask<bool> waitForCompletion(
+		int timeoutMs = -1,
+		int pollIntervalMs = ofxEbbControl::COMPLETION_POLL_MS) {
+		auto now = Clock::now();
+		const bool bounded = timeoutMs >= 0;
+		const auto deadline = now + std::chrono::milliseconds(std::max(0, timeoutMs));
+
+		auto wake = busyUntil - std::chrono::milliseconds(ofxEbbControl::COMPLETION_EARLY_WAKE_MS);
+		if (bounded) {
+			wake = std::min(wake, deadline);
+		}
+		if (wake > now) {
+			co_await scheduler.sleepUntil(wake);
+		}
+
+		while (true) {
+			const auto result = co_await command("QM");
+			ofxEbbControl::MotorStatus status;
+			if (result.ok && ofxEbbControl::parseMotorStatus(result.response, status)) {
+				if (!status.executing && !status.moving[0] && !status.moving[1] && status.fifoEmpty) {
+					co_return true;
+				}
+			} else {
+				ofLogWarning("ofxEbbAsyncBoard") << "waitForCompletion(): " << (result.ok ? "Bad QM response" : result.error);
+			}
+
+			now = Clock::now();
+			if (bounded && now >= deadline) {
+				co_return false;
+			}
+			const auto next = now + std::chrono::milliseconds(std::max(1, pollIntervalMs));
+			co_await scheduler.sleepUntil(bounded ? std::min(next, deadline) : next);
+		}
+	}
+
+	/**
+	 * Wait for the button to be pressed (polls QB). A press from before
+	 * the call doesn't count.
+	 * @param timeoutMs  Give up after this long (< 0 waits forever).
+	 * @returns          True when pressed, false on timeout.
+	 */
+	ofxEbbTask<bool> buttonPressed(
+		int timeoutMs = -1,
+		int pollIntervalMs = BUTTON_POLL_MS) {
+		const bool bounded = timeoutMs >= 0;
+		const auto deadline = Clock::now() + std::chrono::milliseconds(std::max(0, timeoutMs));
+
+		// QB reports presses since it was last asked; clear the latch
+		co_await command("QB");
+		while (true) {
+			auto now = Clock::now();
+			if (bounded && now >= deadline) {
+				co_return false;
+			}
+			const auto next = now + std::chrono::milliseconds(std::max(1, pollIntervalMs));
+			co_await scheduler.sleepUntil(bounded ? std::min(next, deadline) : next);
+
+			const auto result = co_await command("QB");
+			if (result.ok && result.response == "1") {
+				co_return true;
+			}
+		}
+	}
+
+	ofxEbbScheduler::SleepAwaiter sleep(
+		int ms) {
+		return scheduler.sleep(ms);
+	}
+
+private:
+	// Several commands at once; resumes when the last one completes
+	class BatchAwaiter {
+	public:
+		BatchAwaiter(
+			ofxEbbAsyncBoard & board,
+			const std::string * commands,
+			size_t count)
+			: board(board)
+			, commands(commands)
+			, results(count)
+			, remaining(count) { }
+
+		bool await_ready() const noexcept {
+			return results.empty();
+		}
+
+		void await_suspend(
+			std::coroutine_handle<> h) {
+			for (size_t i = 0; i < results.size(); ++i) {
+				board.control.sendCommandAsync(commands[i], [this, h, i](const CommandResult & r) {
+					results[i] = r;
+					if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+						board.scheduler.post(h);
+					}
+				});
+			}
+		}
+
+		std::vector<CommandResult> await_resume() {
+			board.scheduler.throwIfCancelled();
+			for (const auto & result : results) {
+				board.onCompleted(result);
+			}
+			return std::move(results);
+		}
+
+	private:
+		ofxEbbAsyncBoard & board;
+		const std::string * commands;
+		std::vector<CommandResult> results;
+		std::atomic<size_t> remaining;
+	};
+
+	ofxEbbTask<double> sendPlanned(
+		std::vector<ofxEbbPoint> points,
+		ofxEbbMotionLimits limits) {
+		std::vector<ofxEbbLowLevelMove> moves;
+		const double duration = control.getPlanner().plan(points, limits, moves);
+
+		std::vector<std::string> commands;
+		commands.reserve(moves.size());
+		ofxEbbCommandBuffer cmd;
+		for (const auto & m : moves) {
+			cmd.op("LM").arg(m.rate[0]).arg(m.steps[0]).arg(m.accel[0]).arg(m.rate[1]).arg(m.steps[1]).arg(m.accel[1]);
+			commands.emplace_back(cmd.view());
+		}
+		co_await sendAll(std::move(commands));
+		co_return duration;
+	}
+
+	// Scheduler thread; extends the busy estimate by each queued move
+	void onCompleted(
+		const CommandResult & result) {
+		if (!result.ok || !ofxEbbIsMotionCommand(result.command)) {
+			return;
+		}
+		const double seconds = ofxEbbMotionSeconds(result.command);
+		if (seconds > 0.0) {
+			busyUntil = std::max(busyUntil, Clock::now())
+				+ std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+		}
+	}
+
+	static void throwIfFailed(
+		const CommandResult & result) {
+		if (!result.ok) {
+			throw std::runtime_error(result.command + ": " + result.error);
+		}
+	}
+
+	ofxEbbControl & control;
+	ofxEbbScheduler & scheduler;
+	Clock::time_point busyUntil;
+};
+
+#endif
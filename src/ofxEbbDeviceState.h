@@ -0,0 +1,58 @@
+// ofxEbbDeviceState.h
+#pragma once
+
+#include <array>
+#include <string>
+
+/**
+ * A cached value that is either known or not.
+ */
+template <typename T>
+struct ofxEbbCached {
+	T value {};
+	bool known = false;
+
+	void set(
+		const T & v) {
+		value = v;
+		known = true;
+	}
+
+	void invalidate() {
+		known = false;
+	}
+
+	// True if known and equal to `v`
+	bool is(
+		const T & v) const {
+		return known && value == v;
+	}
+};
+
+/**
+ * ofxEbbDeviceState: what one board is known to be set to, as far as the
+ * commands sent through its ofxEbbControl (or queried from it) tell.
+ * Anything that can change behind the host's back, such as the servo power
+ * timeout, is deliberately not kept here.
+ */
+struct ofxEbbDeviceState {
+	static constexpr int SERVO_CONFIG_SLOTS = 14; // SC parameter indices 0-13
+
+	ofxEbbCached<std::array<int, 2>> motorModes; // EM modes, MOTOR_DISABLE..MOTOR_STEP_DIV1
+	ofxEbbCached<bool> penDown;
+	std::array<ofxEbbCached<int>, SERVO_CONFIG_SLOTS> servoConfig; // SC values by index
+	ofxEbbCached<std::string> nickname;
+	ofxEbbCached<std::string> firmware;
+	ofxEbbCached<int> layer;
+
+	void invalidate() {
+		motorModes.invalidate();
+		penDown.invalidate();
+		for (auto & value : servoConfig) {
+			value.invalidate();
+		}
+		nickname.invalidate();
+		firmware.invalidate();
+		layer.invalidate();
+	}
+};
@@ -0,0 +1,389 @@
+// ofxEbbDiscovery.h
+#pragma once
+
+#include "ofxEbbControl.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <limits.h>
+#include <stdlib.h>
+#endif
+
+/**
+ * A serial port and, where the OS tells, the USB device behind it.
+ */
+struct ofxEbbPortInfo {
+	std::string port;
+	int vendorId = -1; // -1 if unknown
+	int productId = -1;
+
+	bool idsKnown() const {
+		return vendorId >= 0 && productId >= 0;
+	}
+};
+
+/**
+ * A port that answered like an EBB.
+ */
+struct ofxEbbDeviceInfo {
+	std::string port;
+	std::string firmware; // V banner
+	std::string nickname; // QT; empty if none is set
+};
+
+/**
+ * ofxEbbDiscovery: finds EBBs at startup without trying ports one by one.
+ * Candidate ports are narrowed down by USB vendor/product id where the OS
+ * reports them (Linux sysfs; elsewhere every port is a candidate), then
+ * all of them are probed at once with V and QT under a short deadline, so
+ * a port that never answers costs one timeout in total instead of one
+ * each. Nickname to port mappings seen along the way can be kept in a
+ * small text file; connect() tries the remembered port first and only
+ * falls back to a full probe if the board isn't there any more.
+ */
+class ofxEbbDiscovery {
+public:
+	static constexpr int EBB_VENDOR_ID = 0x04D8; // Microchip
+	static constexpr int EBB_PRODUCT_ID = 0xFD92; // EiBotBoard
+	static constexpr int DEFAULT_TIMEOUT_MS = 250;
+
+	using TransportFactory = std::function<std::unique_ptr<ofxEbbTransport>()>;
+
+	/**
+	 * @param factory  Makes the transport for each probe; null uses
+	 *                 ofxEbbSerialTransport.
+	 */
+	explicit ofxEbbDiscovery(
+		TransportFactory factory = nullptr)
+		: factory(factory ? std::move(factory) : [] { return std::make_unique<ofxEbbSerialTransport>(); }) { }
+
+	/**
+	 * How long each port gets to answer V (and QT).
+	 */
+	void setTimeout(
+		int timeoutMs) {
+		this->timeoutMs = std::max(1, timeoutMs);
+	}
+
+	int getTimeout() const {
+		return timeoutMs;
+	}
+
+	/**
+	 * Only probe ports whose USB ids are the EBB's (on by default). Ports
+	 * whose ids can't be read are probed anyway.
+	 */
+	void setUsbFilter(
+		bool enable) {
+		usbFilter = enable;
+	}
+
+	//-- Ports -------------------------------------------------------
+
+	/**
+	 * Every serial port the transport lists, with USB ids where known.
+	 */
+	std::vector<ofxEbbPortInfo> listPorts() const {
+		std::vector<ofxEbbPortInfo> out;
+		for (const auto & port : factory()->listDevices()) {
+			out.push_back(describePort(port));
+		}
+		return out;
+	}
+
+	/**
+	 * Ports worth probing: listPorts() after the USB filter.
+	 */
+	std::vector<std::string> listCandidates() const {
+		std::vector<std::string> out;
+		for (const auto & info : listPorts()) {
+			if (!usbFilter || !info.idsKnown()
+				|| (info.vendorId == EBB_VENDOR_ID && info.productId == EBB_PRODUCT_ID)) {
+				out.push_back(info.port);
+			}
+		}
+		return out;
+	}
+
+	/**
+	 * USB ids of the device behind a port, if the OS tells.
+	 */
+	static ofxEbbPortInfo describePort(
+		const std::string & port) {
+		ofxEbbPortInfo info;
+		info.port = port;
+#if defined(__linux__)
+		// /sys/class/tty/<name>/device is the USB interface; the device
+		// with the ids is one of its parents
+		const std::string name = port.substr(port.find_last_of('/') + 1);
+		char resolved[PATH_MAX];
+		if (!realpath(("/sys/class/tty/" + name + "/device").c_str(), resolved)) {
+			return info;
+		}
+		std::string dir = resolved;
+		for (int depth = 0; depth < 4 && dir.size() > 1; ++depth) {
+			const int vendor = readHex(dir + "/idVendor");
+			const int product = readHex(dir + "/idProduct");
+			if (vendor >= 0 && product >= 0) {
+				info.vendorId = vendor;
+				info.productId = product;
+				break;
+			}
+			dir = dir.substr(0, dir.find_last_of('/'));
+		}
+#endif
+		return info;
+	}
+
+	//-- Probing -----------------------------------------------------
+
+	/**
+	 * Probe ports in parallel and return the ones that answer like an
+	 * EBB, in the order given. Returns after at most about two timeouts
+	 * even if opening a port hangs; such a probe is left to finish on
+	 * its own. Nicknames found are remembered (see setCacheFile()).
+	 * @param ports  Ports to try; empty tries listCandidates().
+	 */
+	std::vector<ofxEbbDeviceInfo> probe(
+		std::vector<std::string> ports = {}) {
+		if (ports.empty()) {
+			ports = listCandidates();
+		}
+
+		// Shared with the probe threads, which may outlive this call
+		struct Results {
+			std::mutex mutex;
+			std::condition_variable done;
+			std::vector<std::unique_ptr<ofxEbbDeviceInfo>> found;
+			size_t remaining = 0;
+		};
+		auto results = std::make_shared<Results>();
+		results->found.resize(ports.size());
+		results->remaining = ports.size();
+
+		const int timeout = timeoutMs;
+		for (size_t i = 0; i < ports.size(); ++i) {
+			std::thread([results, i, port = ports[i], transport = factory(), timeout]() mutable {
+				ofxEbbControl control;
+				control.setTransport(std::move(transport));
+				auto info = std::make_unique<ofxEbbDeviceInfo>();
+				const bool ok = probePort(control, port, timeout, *info);
+				control.close();
+
+				std::lock_guard<std::mutex> lock(results->mutex);
+				if (ok) {
+					results->found[i] = std::move(info);
+				}
+				if (--results->remaining == 0) {
+					results->done.notify_all();
+				}
+			}).detach();
+		}
+
+		std::vector<ofxEbbDeviceInfo> out;
+		{
+			// V and QT each get the timeout; allow a little for opening
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(2 * timeout + 100);
+			std::unique_lock<std::mutex> lock(results->mutex);
+			results->done.wait_until(lock, deadline, [&] {
+				return results->remaining == 0;
+			});
+			for (auto & info : results->found) {
+				if (info) {
+					out.push_back(*info);
+				}
+			}
+		}
+
+		bool changed = false;
+		for (const auto & info : out) {
+			if (!info.nickname.empty()) {
+				changed |= remember(info.nickname, info.port);
+			}
+		}
+		if (changed) {
+			saveCache();
+		}
+		return out;
+	}
+
+	/**
+	 * Open `control` on a board: the one called `nickname`, or with an
+	 * empty nickname the one connected last (else the first found). The
+	 * remembered port is tried first on its own; if the board isn't
+	 * there, every candidate is probed.
+	 * @param control   Set up on the board's port on success; its own
+	 *                  transport is used.
+	 * @param nickname  QT nickname to look for, or empty for any board.
+	 * @param info      Filled in with what the board answered.
+	 * @returns         False if no matching board answered.
+	 */
+	bool connect(
+		ofxEbbControl & control,
+		const std::string & nickname = "",
+		ofxEbbDeviceInfo * info = nullptr) {
+		ofxEbbDeviceInfo found;
+		const std::string cached = getCachedPort(nickname);
+		bool ok = !cached.empty() && probePort(control, cached, timeoutMs, found)
+			&& (nickname.empty() || found.nickname == nickname);
+
+		if (!ok) {
+			control.close();
+			for (const auto & candidate : probe()) {
+				if ((nickname.empty() || candidate.nickname == nickname)
+					&& probePort(control, candidate.port, timeoutMs, found)) {
+					ok = true;
+					break;
+				}
+				control.close();
+			}
+		}
+		if (!ok) {
+			ofLogWarning("ofxEbbDiscovery") << "No EBB" << (nickname.empty() ? "" : " called '" + nickname + "'") << " found";
+			return false;
+		}
+
+		bool changed = remember("", found.port);
+		if (!found.nickname.empty()) {
+			changed |= remember(found.nickname, found.port);
+		}
+		if (changed) {
+			saveCache();
+		}
+		if (info) {
+			*info = found;
+		}
+		return true;
+	}
+
+	/**
+	 * Open `port` on `control` and check that an EBB answers.
+	 * @returns  False (with the port closed) if it doesn't.
+	 */
+	static bool probePort(
+		ofxEbbControl & control,
+		const std::string & port,
+		int timeoutMs,
+		ofxEbbDeviceInfo & info) {
+		if (!control.setup(port)) {
+			return false;
+		}
+		try {
+			info.firmware = control.sendCommand("V", 1, timeoutMs);
+		} catch (const std::exception &) {
+			control.close();
+			return false;
+		}
+		if (info.firmware.find("EBB") == std::string::npos) {
+			control.close();
+			return false;
+		}
+		info.port = port;
+		const std::string nickname = control.getNickname(timeoutMs);
+		info.nickname = nickname == "EBB Controller" ? "" : nickname;
+		return true;
+	}
+
+	//-- Port Cache --------------------------------------------------
+
+	/**
+	 * Keep nickname to port mappings in `path` (one "nickname<TAB>port"
+	 * line each; an empty nickname is the board connected last). Loads
+	 * the file now and rewrites it whenever a mapping changes.
+	 * @returns False if the file couldn't be read (e.g. on first run).
+	 */
+	bool setCacheFile(
+		const std::string & path) {
+		cachePath = path;
+		cache.clear();
+		std::ifstream in(path);
+		if (!in) {
+			return false;
+		}
+		std::string line;
+		while (std::getline(in, line)) {
+			const size_t tab = line.find('\t');
+			if (tab != std::string::npos && tab + 1 < line.size()) {
+				cache[line.substr(0, tab)] = line.substr(tab + 1);
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Port last seen for a nickname, or "" if none.
+	 */
+	std::string getCachedPort(
+		const std::string & nickname) const {
+		const auto it = cache.find(nickname);
+		return it == cache.end() ? std::string() : it->second;
+	}
+
+	const std::map<std::string, std::string> & getCache() const {
+		return cache;
+	}
+
+	void clearCache() {
+		cache.clear();
+		saveCache();
+	}
+
+private:
+	// True if this changed the cache
+	bool remember(
+		const std::string & nickname,
+		const std::string & port) {
+		auto & entry = cache[nickname];
+		if (entry == port) {
+			return false;
+		}
+		entry = port;
+		return true;
+	}
+
+	void saveCache() const {
+		if (cachePath.empty()) {
+			return;
+		}
+		std::ofstream out(cachePath, std::ios::trunc);
+		if (!out) {
+			ofLogWarning("ofxEbbDiscovery") << "Could not write " << cachePath;
+			return;
+		}
+		for (const auto & entry : cache) {
+			out << entry.first << '\t' << entry.second << '\n';
+		}
+	}
+
+#if defined(__linux__)
+	static int readHex(
+		const std::string & path) {
+		std::FILE * f = std::fopen(path.c_str(), "r");
+		if (!f) {
+			return -1;
+		}
+		unsigned value = 0;
+		const bool ok = std::fscanf(f, "%x", &value) == 1;
+		std::fclose(f);
+		return ok ? static_cast<int>(value) : -1;
+	}
+#endif
+
+	TransportFactory factory;
+	int timeoutMs = DEFAULT_TIMEOUT_MS;
+	bool usbFilter = true;
+	std::string cachePath;
+	std::map<std::string, std::string> cache;
+};
@@ -0,0 +1,91 @@
+// ofxEbbDoubleBuffer.h
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * ofxEbbDoubleBuffer: one value handed from a writer thread to any number
+ * of readers without locks. The writer fills whichever of the two slots
+ * readers are not pointed at, then flips the pointer; each slot carries a
+ * sequence number (a seqlock), so a reader that was overtaken by two
+ * publishes in a row sees the change and copies again instead of returning
+ * a torn value. Values are stored as relaxed atomic words, so T must be
+ * trivially copyable.
+ */
+template <typename T>
+class ofxEbbDoubleBuffer {
+	static_assert(std::is_trivially_copyable<T>::value, "ofxEbbDoubleBuffer needs a trivially copyable type");
+
+public:
+	/**
+	 * Writer side (one thread): make `value` the latest.
+	 */
+	void publish(
+		const T & value) {
+		const uint64_t n = published.load(std::memory_order_relaxed);
+		Slot & slot = slots[n & 1];
+		Words words {};
+		std::memcpy(words.data(), static_cast<const void *>(&value), sizeof(T));
+
+		slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < WORDS; ++i) {
+			slot.words[i].store(words[i], std::memory_order_relaxed);
+		}
+		slot.seq.store(2 * n + 2, std::memory_order_release);
+		published.store(n + 1, std::memory_order_release);
+	}
+
+	/**
+	 * Reader side (any thread): copy the latest value into `out`.
+	 * @returns False (leaving `out` alone) if nothing was published yet.
+	 */
+	bool read(
+		T & out) const {
+		while (true) {
+			const uint64_t n = published.load(std::memory_order_acquire);
+			if (n == 0) {
+				return false;
+			}
+			const Slot & slot = slots[(n - 1) & 1];
+			const uint64_t seq = 2 * (n - 1) + 2;
+			if (slot.seq.load(std::memory_order_acquire) != seq) {
+				continue; // Already being rewritten; a newer value is on its way
+			}
+			Words words;
+			for (size_t i = 0; i < WORDS; ++i) {
+				words[i] = slot.words[i].load(std::memory_order_relaxed);
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.seq.load(std::memory_order_relaxed) == seq) {
+				std::memcpy(static_cast<void *>(&out), words.data(), sizeof(T));
+				return true;
+			}
+		}
+	}
+
+	/**
+	 * Number of values published so far; changes whenever read() would
+	 * return something new.
+	 */
+	uint64_t version() const {
+		return published.load(std::memory_order_acquire);
+	}
+
+private:
+	static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	using Words = std::array<uint64_t, WORDS>;
+
+	struct Slot {
+		std::atomic<uint64_t> seq { 0 };
+		std::array<std::atomic<uint64_t>, WORDS> words {};
+	};
+
+	std::array<Slot, 2> slots;
+	std::atomic<uint64_t> published { 0 };
+};
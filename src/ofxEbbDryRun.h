@@ -0,0 +1,450 @@
+// ofxEbbDryRun.h
+#pragma once
+
+#include "ofxEbbControl.h"
+#include "ofxEbbSimulator.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * What a dry run assumes about the board and the link to it.
+ */
+struct ofxEbbEstimatorSettings {
+	std::chrono::microseconds latency { 1000 }; // From a command's arrival until its reply goes out
+	int fifoDepth = 1; // Motion commands queued behind the executing one
+	int pipelineDepth = ofxEbbControl::DEFAULT_PIPELINE_DEPTH;
+	std::chrono::microseconds hostTime { 20 }; // To build and write one command
+	double bytesPerSecond = 1e6; // Each way; 0 = no limit
+	double maxStepRate = 25000.0; // steps/s per motor; faster moves are counted, not refused
+	bool keepTimeline = true; // Record every FIFO command in ofxEbbEstimate::timeline
+	std::string firmware = ofxEbbSimulatorSettings().firmware;
+};
+
+/**
+ * One command through the motion FIFO. Times are seconds from the start
+ * of the estimate.
+ */
+struct ofxEbbTimelineEntry {
+	uint64_t command = 0; // Index among all commands the board parsed
+	char op[3] = {};
+	double parsed = 0.0; // Taken into the FIFO
+	double start = 0.0;
+	double end = 0.0;
+	double idleBefore = 0.0; // FIFO empty, waiting for this command
+};
+
+/**
+ * What limits a job's run time.
+ */
+enum class ofxEbbBottleneck {
+	None, // No motion
+	Motion, // The moves themselves: speed, acceleration and pen delays
+	Link, // Round trips: the FIFO runs dry waiting for the next command
+	Host, // Building and writing commands
+};
+
+/**
+ * Result of a dry run.
+ */
+struct ofxEbbEstimate {
+	double totalSeconds = 0.0; // Until the last motion finishes
+	double motionSeconds = 0.0; // Steppers running
+	double penSeconds = 0.0; // Pen and servo delays
+	double idleSeconds = 0.0; // FIFO empty between the first and the last motion
+	uint64_t idleGaps = 0;
+	double longestGap = 0.0;
+	uint64_t longestGapBefore = 0; // Command the longest gap waited for
+	double hostSeconds = 0.0; // Building and writing commands
+	double waitSeconds = 0.0; // Host blocked on replies
+	uint64_t commands = 0;
+	uint64_t motionCommands = 0;
+	uint64_t shortMoves = 0; // Shorter than one command's round trip
+	uint64_t stepRateWarnings = 0;
+	double peakStepRate = 0.0;
+	uint64_t bytesOut = 0;
+	uint64_t bytesIn = 0;
+	ofxEbbBottleneck bottleneck = ofxEbbBottleneck::None;
+	std::vector<ofxEbbTimelineEntry> timeline;
+
+	static const char * name(
+		ofxEbbBottleneck b) {
+		switch (b) {
+		case ofxEbbBottleneck::Motion:
+			return "motion";
+		case ofxEbbBottleneck::Link:
+			return "link";
+		case ofxEbbBottleneck::Host:
+			return "host";
+		default:
+			return "none";
+		}
+	}
+
+	std::string format() const {
+		std::string out;
+		char line[200];
+		std::snprintf(line, sizeof(line), "estimated %.2fs: %.2fs moving, %.2fs pen, %.2fs FIFO idle in %llu gaps\n",
+			totalSeconds, motionSeconds, penSeconds, idleSeconds, ull(idleGaps));
+		out += line;
+		std::snprintf(line, sizeof(line), "%llu cmds (%llu motion, %llu shorter than a round trip), %llu B out, %llu B in\n",
+			ull(commands), ull(motionCommands), ull(shortMoves), ull(bytesOut), ull(bytesIn));
+		out += line;
+		std::snprintf(line, sizeof(line), "host: %.2fs writing, %.2fs waiting for replies\n", hostSeconds, waitSeconds);
+		out += line;
+		if (stepRateWarnings > 0) {
+			std::snprintf(line, sizeof(line), "step rate: %llu moves too fast, peak %.0f steps/s\n",
+				ull(stepRateWarnings), peakStepRate);
+			out += line;
+		}
+		std::snprintf(line, sizeof(line), "bottleneck: %s", name(bottleneck));
+		out += line;
+		switch (bottleneck) {
+		case ofxEbbBottleneck::Motion:
+			out += " (raise speed or acceleration limits to go faster)\n";
+			break;
+		case ofxEbbBottleneck::Link:
+			std::snprintf(line, sizeof(line), " (longest gap %.1fms before command %llu; fewer, longer moves or a deeper pipeline help)\n",
+				longestGap * 1000.0, ull(longestGapBefore));
+			out += line;
+			break;
+		case ofxEbbBottleneck::Host:
+			out += " (commands are not being built fast enough; precompile a job)\n";
+			break;
+		default:
+			out += "\n";
+			break;
+		}
+		return out;
+	}
+
+private:
+	static unsigned long long ull(
+		uint64_t v) {
+		return static_cast<unsigned long long>(v);
+	}
+};
+
+/**
+ * ofxEbbDryRunTransport: an ofxEbbSimulatedBoard on a clock of its own.
+ * Writes cost hostTime plus wire time; a read that would wait instead
+ * moves the clock to the board's next reply, and idle waits in
+ * ofxEbbControl skip ahead (ofxEbbTransport::skip()). A job therefore runs
+ * as fast as the host can produce it, while the board sees the same
+ * timing as on hardware: FIFO depth, parsing held up by a full FIFO,
+ * reply latency and the duration of each SM, XM, HM, LM, LT, SP, TP and
+ * S2. Every command entering the FIFO is recorded into the estimate.
+ */
+class ofxEbbDryRunTransport : public ofxEbbTransport {
+public:
+	explicit ofxEbbDryRunTransport(
+		ofxEbbEstimatorSettings estimatorSettings = {})
+		: settings(std::move(estimatorSettings))
+		, board(boardSettings(settings)) {
+		board.setMotionListener([this](const ofxEbbSimulatedBoard::MotionEvent & event) {
+			onMotion(event);
+		});
+	}
+
+	bool open(
+		const std::string &,
+		int) override {
+		opened = true;
+		return true;
+	}
+
+	void close() override {
+		opened = false;
+	}
+
+	bool isOpen() const override {
+		return opened;
+	}
+
+	bool write(
+		const ofxEbbTransportBuffer * buffers,
+		size_t count) override {
+		if (!opened) {
+			return false;
+		}
+		size_t bytes = 0;
+		for (size_t i = 0; i < count; ++i) {
+			bytes += buffers[i].size;
+		}
+		estimate.hostSeconds += seconds(settings.hostTime);
+		now += settings.hostTime + wireTime(bytes);
+		estimate.bytesOut += bytes;
+		for (size_t i = 0; i < count; ++i) {
+			board.receive(buffers[i].data, buffers[i].size, now);
+		}
+		return true;
+	}
+
+	size_t read(
+		uint8_t * buffer,
+		size_t capacity,
+		Clock::time_point deadline) override {
+		if (!opened) {
+			return 0;
+		}
+		const bool wait = deadline > Clock::now();
+		while (pendingOffset >= pending.size()) {
+			pending.clear();
+			pendingOffset = 0;
+			if (board.transmit(pending, now) > 0) {
+				now += wireTime(pending.size());
+				estimate.bytesIn += pending.size();
+				break;
+			}
+			const auto next = board.nextEvent();
+			if (!wait || next == Clock::time_point::max()) {
+				return 0; // Nothing will ever come; the caller times out for real
+			}
+			estimate.waitSeconds += seconds(next - now);
+			now = next;
+		}
+		const size_t n = std::min(capacity, pending.size() - pendingOffset);
+		std::copy_n(pending.data() + pendingOffset, n, buffer);
+		pendingOffset += n;
+		return n;
+	}
+
+	bool skip(
+		Clock::duration wait) override {
+		if (wait > Clock::duration::zero()) {
+			now += wait;
+		}
+		return true;
+	}
+
+	/**
+	 * Let simulated time run until everything written so far has left the
+	 * FIFO, without polling the board for it.
+	 */
+	void drain() {
+		do {
+			now = std::max(now, lastEnd);
+			board.advance(now);
+		} while (lastEnd > now);
+	}
+
+	/**
+	 * Start a new estimate from the current clock, keeping the board as it is.
+	 */
+	void restart() {
+		estimate = {};
+		origin = now;
+		lastEnd = now;
+		moved = false;
+		firstCommand = board.getCommandCount();
+	}
+
+	/**
+	 * The estimate so far; complete once the FIFO has drained
+	 * (ofxEbbControl::waitForCompletion()).
+	 */
+	ofxEbbEstimate getEstimate() const {
+		ofxEbbEstimate e = estimate;
+		e.commands = board.getCommandCount() - firstCommand;
+		e.totalSeconds = seconds((moved ? lastEnd : now) - origin);
+		if (e.motionCommands == 0) {
+			e.bottleneck = ofxEbbBottleneck::None;
+		} else if (e.idleSeconds <= IDLE_SHARE * e.totalSeconds) {
+			e.bottleneck = ofxEbbBottleneck::Motion;
+		} else if (e.hostSeconds >= e.waitSeconds) {
+			e.bottleneck = ofxEbbBottleneck::Host;
+		} else {
+			e.bottleneck = ofxEbbBottleneck::Link;
+		}
+		return e;
+	}
+
+	/**
+	 * Seconds of simulated time since the transport was created.
+	 */
+	double getTime() const {
+		return seconds(now.time_since_epoch());
+	}
+
+	const ofxEbbEstimatorSettings & getSettings() const {
+		return settings;
+	}
+
+	ofxEbbSimulatedBoard & getBoard() {
+		return board;
+	}
+
+private:
+	// Up to this share of FIFO idle time, a job counts as motion bound
+	static constexpr double IDLE_SHARE = 0.05;
+
+	static ofxEbbSimulatorSettings boardSettings(
+		const ofxEbbEstimatorSettings & settings) {
+		ofxEbbSimulatorSettings s;
+		s.latency = settings.latency;
+		s.fifoDepth = settings.fifoDepth;
+		s.firmware = settings.firmware;
+		return s;
+	}
+
+	static double seconds(
+		Clock::duration d) {
+		return std::chrono::duration<double>(d).count();
+	}
+
+	Clock::duration wireTime(
+		size_t bytes) const {
+		if (settings.bytesPerSecond <= 0.0) {
+			return Clock::duration::zero();
+		}
+		return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(bytes / settings.bytesPerSecond));
+	}
+
+	// Fastest step rate of a move, in steps/s per motor
+	static double peakRate(
+		const ofxEbbSimulatedBoard::MotionEvent & event,
+		double duration) {
+		if (ofxEbbOpcode(event.command) == ofxEbbOpcode("LM")) {
+			std::array<int64_t, 6> a {};
+			ofxEbbReplyReader args(event.command.substr(std::min<size_t>(2, event.command.size())));
+			args.read(a);
+			return std::max(ofxEbbLmPeakRate(a[0], a[1], a[2]), ofxEbbLmPeakRate(a[3], a[4], a[5]));
+		}
+		if (duration <= 0.0) {
+			return 0.0;
+		}
+		return static_cast<double>(std::max(std::llabs(event.steps[0]), std::llabs(event.steps[1]))) / duration;
+	}
+
+	void onMotion(
+		const ofxEbbSimulatedBoard::MotionEvent & event) {
+		const double duration = seconds(event.end - event.start);
+		const double idle = moved ? seconds(event.start - lastEnd) : 0.0;
+		++estimate.motionCommands;
+		if (event.moves) {
+			estimate.motionSeconds += duration;
+			if (duration < seconds(settings.latency + settings.hostTime)) {
+				++estimate.shortMoves;
+			}
+			const double rate = peakRate(event, duration);
+			estimate.peakStepRate = std::max(estimate.peakStepRate, rate);
+			if (rate > settings.maxStepRate) {
+				++estimate.stepRateWarnings;
+			}
+		} else {
+			estimate.penSeconds += duration;
+		}
+		if (idle > 0.0) {
+			estimate.idleSeconds += idle;
+			++estimate.idleGaps;
+			if (idle > estimate.longestGap) {
+				estimate.longestGap = idle;
+				estimate.longestGapBefore = event.index;
+			}
+		}
+		if (settings.keepTimeline) {
+			ofxEbbTimelineEntry entry;
+			entry.command = event.index;
+			entry.op[0] = event.command.size() > 0 ? event.command[0] : '\0';
+			entry.op[1] = event.command.size() > 1 && event.command[1] != ',' ? event.command[1] : '\0';
+			entry.parsed = seconds(event.parsed - origin);
+			entry.start = seconds(event.start - origin);
+			entry.end = seconds(event.end - origin);
+			entry.idleBefore = idle;
+			estimate.timeline.push_back(entry);
+		}
+		lastEnd = std::max(lastEnd, event.end);
+		moved = true;
+	}
+
+	ofxEbbEstimatorSettings settings;
+	ofxEbbSimulatedBoard board;
+	std::string pending;
+	size_t pendingOffset = 0;
+	bool opened = false;
+
+	Clock::time_point now;
+	Clock::time_point origin;
+	Clock::time_point lastEnd;
+	bool moved = false;
+	uint64_t firstCommand = 0;
+	ofxEbbEstimate estimate;
+};
+
+/**
+ * ofxEbbDryRun: an ofxEbbControl on an ofxEbbDryRunTransport, to time a
+ * job or any sequence of control calls without a board. Drive
+ * getControl() exactly as the real one (motion limits, servo setup,
+ * drawPolyline(), runJob(), ...), then finish() for the estimate:
+ *
+ *     ofxEbbDryRun dry;
+ *     dry.getControl().setMotionLimits(limits);
+ *     dry.getControl().drawPolylines(paths);
+ *     ofLogNotice() << dry.finish().format();
+ *
+ * The control runs with flow control off, since its model of the FIFO
+ * keeps real time; the board holding back replies while its FIFO is full
+ * gives the same back pressure. Don't start the I/O thread on it.
+ */
+class ofxEbbDryRun {
+public:
+	explicit ofxEbbDryRun(
+		ofxEbbEstimatorSettings settings = {}) {
+		const int depth = settings.pipelineDepth;
+		auto next = std::make_unique<ofxEbbDryRunTransport>(std::move(settings));
+		link = next.get();
+		control.setTransport(std::move(next));
+		control.setup("dry-run");
+		control.setFlowControl(false);
+		control.setMotionFifoDepth(link->getSettings().fifoDepth);
+		control.setPipelineDepth(depth);
+		link->restart();
+	}
+
+	ofxEbbControl & getControl() {
+		return control;
+	}
+
+	ofxEbbDryRunTransport & getTransport() {
+		return *link;
+	}
+
+	/**
+	 * Wait (in simulated time) for queued motion to finish.
+	 * @returns The estimate since construction or the last restart().
+	 */
+	ofxEbbEstimate finish() {
+		link->drain();
+		control.waitForCompletion();
+		return link->getEstimate();
+	}
+
+	/**
+	 * Start a new estimate, e.g. after setting the board up.
+	 */
+	void restart() {
+		link->restart();
+	}
+
+	/**
+	 * Time a saved job, from the start to its last move.
+	 */
+	static ofxEbbEstimate estimate(
+		const ofxEbbJobFile & job,
+		ofxEbbEstimatorSettings settings = {}) {
+		ofxEbbDryRun dry(std::move(settings));
+		dry.getControl().runJob(job);
+		return dry.finish();
+	}
+
+private:
+	ofxEbbControl control;
+	ofxEbbDryRunTransport * link = nullptr;
+};
@@ -0,0 +1,415 @@
+// ofxEbbFleet.h
+#pragma once
+
+#include "ofxEbbControl.h"
+#include "ofxEbbDiscovery.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * ofxEbbFleet: drives several EBBs from one host.
+ * Each board gets its own ofxEbbControl with the background I/O thread
+ * running, so broadcasts reach every port at once. Jobs (functions that use
+ * a board's blocking API) run on a fixed pool of worker threads, one job
+ * per board at a time and in submission order, so a long job on one board
+ * never holds up another.
+ */
+class ofxEbbFleet {
+public:
+	static constexpr int DEFAULT_PROBE_TIMEOUT_MS = 500;
+	static constexpr int DEFAULT_BROADCAST_TIMEOUT_MS = 500;
+
+	using Job = std::function<void(ofxEbbControl &)>;
+
+	struct BoardInfo {
+		std::string port;
+		std::string nickname; // Falls back to the port if QT is empty
+		std::string firmware;
+	};
+
+	struct BroadcastResult {
+		std::string nickname;
+		ofxEbbControl::CommandResult result;
+	};
+
+	/**
+	 * @param workers  Job threads; 0 picks one per CPU core.
+	 */
+	explicit ofxEbbFleet(
+		size_t workers = 0) {
+		if (workers == 0) {
+			workers = std::max(1u, std::thread::hardware_concurrency());
+		}
+		for (size_t i = 0; i < workers; ++i) {
+			pool.emplace_back(&ofxEbbFleet::workerLoop, this);
+		}
+	}
+
+	ofxEbbFleet(const ofxEbbFleet &) = delete;
+	ofxEbbFleet & operator=(const ofxEbbFleet &) = delete;
+
+	~ofxEbbFleet() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto & worker : pool) {
+			worker.join();
+		}
+		close();
+	}
+
+	/**
+	 * Probe ports in parallel and add every one that answers like an EBB.
+	 * @param ports      Ports to try; empty tries every serial device
+	 *                   that could be an EBB by its USB ids (see
+	 *                   ofxEbbDiscovery::listCandidates()).
+	 * @param timeoutMs  How long each port gets to answer V.
+	 * @returns          Number of boards added.
+	 */
+	size_t discover(
+		std::vector<std::string> ports = {},
+		int timeoutMs = DEFAULT_PROBE_TIMEOUT_MS) {
+		if (ports.empty()) {
+			ports = ofxEbbDiscovery().listCandidates();
+		}
+
+		std::vector<std::unique_ptr<Board>> found(ports.size());
+		std::vector<std::thread> probes;
+		for (size_t i = 0; i < ports.size(); ++i) {
+			if (findPort(ports[i])) {
+				continue;
+			}
+			probes.emplace_back([&, i] {
+				found[i] = probe(ports[i], timeoutMs);
+			});
+		}
+		for (auto & t : probes) {
+			t.join();
+		}
+
+		size_t added = 0;
+		for (auto & board : found) {
+			if (board) {
+				addBoard(std::move(board));
+				++added;
+			}
+		}
+		return added;
+	}
+
+	/**
+	 * Add one board by port.
+	 * @returns False if nothing EBB-like answered.
+	 */
+	bool add(
+		const std::string & port,
+		int timeoutMs = DEFAULT_PROBE_TIMEOUT_MS) {
+		if (findPort(port)) {
+			return true;
+		}
+		auto board = probe(port, timeoutMs);
+		if (!board) {
+			return false;
+		}
+		addBoard(std::move(board));
+		return true;
+	}
+
+	size_t size() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return boards.size();
+	}
+
+	std::vector<BoardInfo> getBoards() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<BoardInfo> out;
+		for (const auto & board : boards) {
+			out.push_back(board->info);
+		}
+		return out;
+	}
+
+	/**
+	 * Board by nickname (or port).
+	 * @returns nullptr if unknown. Don't use its blocking API while jobs
+	 *          for it are queued.
+	 */
+	ofxEbbControl * get(
+		const std::string & nickname) {
+		Board * board = find(nickname);
+		return board ? board->control.get() : nullptr;
+	}
+
+	/**
+	 * Queue a job for one board.
+	 * @returns Future that completes (or rethrows) when the job has run;
+	 *          an unknown nickname throws std::runtime_error.
+	 */
+	std::future<void> dispatch(
+		const std::string & nickname,
+		Job job) {
+		Board * board = find(nickname);
+		if (!board) {
+			throw std::runtime_error("Unknown board '" + nickname + "'");
+		}
+		return enqueue(*board, std::move(job));
+	}
+
+	/**
+	 * Queue the same job for every board.
+	 */
+	std::vector<std::future<void>> dispatchAll(
+		const Job & job) {
+		std::vector<std::future<void>> futures;
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto & board : boards) {
+			futures.push_back(enqueueLocked(*board, job));
+		}
+		wake.notify_all();
+		return futures;
+	}
+
+	/**
+	 * Wait until every queued job has run.
+	 */
+	void waitIdle() {
+		std::unique_lock<std::mutex> lock(mutex);
+		idle.wait(lock, [&] {
+			return busyBoards == 0;
+		});
+	}
+
+	/**
+	 * Send one command to every board at once, bypassing queued jobs.
+	 * Each board's cached state is dropped (see invalidateState()) once
+	 * no job of its own is running, as the command may have changed it.
+	 * @param cmd        Command string (without CR).
+	 * @param timeoutMs  Replies not in by then are reported as timed out.
+	 * @param urgent     Write ahead of motion still queued on each board's
+	 *                   I/O thread (motion already in the board's FIFO
+	 *                   still runs first).
+	 */
+	std::vector<BroadcastResult> broadcast(
+		const std::string & cmd,
+		int timeoutMs = DEFAULT_BROADCAST_TIMEOUT_MS,
+		bool urgent = false) {
+		const bool stop = ofxEbbOpcode(cmd) == ofxEbbOpcode("ES");
+		std::vector<std::pair<Board *, std::future<ofxEbbControl::CommandResult>>> pending;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto & board : boards) {
+				pending.emplace_back(board.get(), board->control->sendCommandAsync(cmd, nullptr, urgent));
+				afterBroadcastLocked(*board, [stop](ofxEbbControl & control) {
+					control.invalidateState();
+					if (stop) {
+						control.forgetQueuedMotion();
+					}
+				});
+			}
+		}
+
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+		std::vector<BroadcastResult> results;
+		for (auto & p : pending) {
+			BroadcastResult r;
+			r.nickname = p.first->info.nickname;
+			if (p.second.wait_until(deadline) == std::future_status::ready) {
+				r.result = p.second.get();
+			} else {
+				r.result.command = cmd;
+				r.result.error = "timed out after " + std::to_string(timeoutMs) + "ms";
+			}
+			results.push_back(std::move(r));
+		}
+		return results;
+	}
+
+	/**
+	 * Raise every pen, ahead of motion not yet sent to the boards; each
+	 * board still finishes the motion in its FIFO first.
+	 */
+	std::vector<BroadcastResult> penUpAll(
+		int timeoutMs = DEFAULT_BROADCAST_TIMEOUT_MS) {
+		return broadcast("SP," + std::to_string(ofxEbbControl::PEN_UP), timeoutMs, true);
+	}
+
+	/**
+	 * Emergency stop (ES) on every board. Each control then forgets the
+	 * motion it had queued (see ofxEbbControl::forgetQueuedMotion()).
+	 */
+	std::vector<BroadcastResult> stopAll(
+		bool disableMotors = false,
+		int timeoutMs = DEFAULT_BROADCAST_TIMEOUT_MS) {
+		return broadcast(disableMotors ? "ES,1" : "ES", timeoutMs, true);
+	}
+
+	/**
+	 * Wait for queued jobs, then close every port.
+	 */
+	void close() {
+		waitIdle();
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto & board : boards) {
+			board->control->close();
+		}
+		boards.clear();
+	}
+
+private:
+	struct Board {
+		BoardInfo info;
+		std::unique_ptr<ofxEbbControl> control;
+		std::deque<std::packaged_task<void()>> jobs;
+		bool scheduled = false; // Queued on `ready` or running
+	};
+
+	std::unique_ptr<Board> probe(
+		const std::string & port,
+		int timeoutMs) {
+		auto board = std::make_unique<Board>();
+		board->control = std::make_unique<ofxEbbControl>();
+		ofxEbbControl & c = *board->control;
+		ofxEbbDeviceInfo device;
+		if (!ofxEbbDiscovery::probePort(c, port, timeoutMs, device)) {
+			return nullptr;
+		}
+
+		board->info.port = device.port;
+		board->info.firmware = device.firmware;
+		board->info.nickname = device.nickname.empty() ? port : device.nickname;
+		c.startThread();
+		return board;
+	}
+
+	void addBoard(
+		std::unique_ptr<Board> board) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const auto & other : boards) {
+			if (other->info.nickname == board->info.nickname) {
+				ofLogWarning("ofxEbbFleet") << "Nickname '" << board->info.nickname << "' is taken, using port " << board->info.port;
+				board->info.nickname = board->info.port;
+				break;
+			}
+		}
+		boards.push_back(std::move(board));
+	}
+
+	Board * find(
+		const std::string & key) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto & board : boards) {
+			if (board->info.nickname == key || board->info.port == key) {
+				return board.get();
+			}
+		}
+		return nullptr;
+	}
+
+	bool findPort(
+		const std::string & port) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto & board : boards) {
+			if (board->info.port == port) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::future<void> enqueue(
+		Board & board,
+		Job job) {
+		std::future<void> future;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			future = enqueueLocked(board, std::move(job));
+		}
+		wake.notify_one();
+		return future;
+	}
+
+	std::future<void> enqueueLocked(
+		Board & board,
+		Job job) {
+		ofxEbbControl * control = board.control.get();
+		std::packaged_task<void()> task([job = std::move(job), control] {
+			job(*control);
+		});
+		auto future = task.get_future();
+		board.jobs.push_back(std::move(task));
+		if (!board.scheduled) {
+			board.scheduled = true;
+			++busyBoards;
+			ready.push_back(&board);
+		}
+		return future;
+	}
+
+	// Bring a board's control up to date after a broadcast. Runs now if
+	// no job for it is running or queued, else right after the current one.
+	void afterBroadcastLocked(
+		Board & board,
+		const Job & fix) {
+		if (!board.scheduled) {
+			fix(*board.control);
+			return;
+		}
+		ofxEbbControl * control = board.control.get();
+		board.jobs.emplace_front([fix, control] {
+			fix(*control);
+		});
+	}
+
+	// Run the next job of a ready board; a board goes back on the ready
+	// list only after its current job finishes, which keeps its jobs in order
+	void workerLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			wake.wait(lock, [&] {
+				return stopping || !ready.empty();
+			});
+			if (ready.empty()) {
+				return;
+			}
+
+			Board * board = ready.front();
+			ready.pop_front();
+			auto task = std::move(board->jobs.front());
+			board->jobs.pop_front();
+
+			lock.unlock();
+			task();
+			lock.lock();
+
+			if (board->jobs.empty()) {
+				board->scheduled = false;
+				if (--busyBoards == 0) {
+					idle.notify_all();
+				}
+			} else {
+				ready.push_back(board);
+				wake.notify_one();
+			}
+		}
+	}
+
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::vector<std::unique_ptr<Board>> boards;
+	std::deque<Board *> ready;
+	size_t busyBoards = 0;
+	bool stopping = false;
+	std::vector<std::thread> pool;
+};
@@ -0,0 +1,233 @@
+// ofxEbbFlowControl.h
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * ofxEbbFlowControl: host-side model of the EBB motion FIFO.
+ * Every motion command that enters the FIFO is recorded with its expected
+ * duration; commands are assumed to run back to back, so the model knows
+ * how many are still queued or executing at any moment. Status replies
+ * (QG/QM FIFO and motor bits) correct the model when the board runs ahead
+ * of or behind it.
+ *
+ * The firmware holds back its reply to a motion command while the FIFO is
+ * full, which stalls everything behind it on the serial line. Sending only
+ * while hasRoom() is true keeps the FIFO full without ever hitting that.
+ *
+ * Command end times live in a fixed ring sized by setFifoDepth(), so
+ * recording a command never allocates.
+ */
+class ofxEbbFlowControl {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr int DEFAULT_FIFO_DEPTH = 1;
+	static constexpr int DEFAULT_MARGIN_MS = 3;
+	static constexpr int DEFAULT_RESYNC_MS = 100;
+	static constexpr size_t MAX_IN_FLIGHT = 64; // Sent but not yet in the FIFO (ofxEbbControl::MAX_PIPELINE_DEPTH)
+
+	ofxEbbFlowControl() {
+		resizeRing();
+	}
+
+	/**
+	 * Number of commands the firmware FIFO holds behind the one executing
+	 * (1 on firmware 2.x; larger FIFOs can be configured on 3.x).
+	 */
+	void setFifoDepth(
+		int depth) {
+		fifoDepth = std::max(1, depth);
+		resizeRing();
+	}
+
+	int getFifoDepth() const {
+		return fifoDepth;
+	}
+
+	/**
+	 * Extra time a command is assumed to still be running after its
+	 * predicted end, covering USB latency and timer rounding.
+	 */
+	void setMargin(
+		std::chrono::milliseconds value) {
+		margin = value;
+	}
+
+	/**
+	 * How often status should be polled while commands are outstanding.
+	 */
+	void setResyncInterval(
+		std::chrono::milliseconds value) {
+		resyncInterval = value;
+	}
+
+	void reset() {
+		head = 0;
+		count = 0;
+		sent = 0;
+		completed = 0;
+		lastStatus = Clock::time_point();
+	}
+
+	/**
+	 * Record a command written to the FIFO.
+	 * @param seconds  Expected run time (0 if unknown).
+	 */
+	void onSent(
+		double seconds,
+		Clock::time_point now = Clock::now()) {
+		update(now);
+		const Clock::time_point start = count == 0 ? now : std::max(now, back());
+		pushBack(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds)));
+		++sent;
+	}
+
+	/**
+	 * Fold in a status reply.
+	 * @param fifoEmpty  No command waiting behind the executing one.
+	 * @param moving     A command is executing (or a motor is moving).
+	 */
+	void onStatus(
+		bool fifoEmpty,
+		bool moving,
+		Clock::time_point now = Clock::now()) {
+		update(now);
+		lastStatus = now;
+		const size_t atLeast = fifoEmpty ? (moving ? 1 : 0) : 2;
+		const size_t atMost = fifoEmpty ? (moving ? 1 : 0) : count;
+
+		// Board is ahead of the model: the oldest ones are done
+		while (count > atMost) {
+			popFront();
+		}
+		// Board is behind the model (or ran commands it wasn't told about):
+		// hold placeholders that expire one margin later unless confirmed
+		while (count < atLeast) {
+			pushBack((count == 0 ? now : back()) + margin);
+			if (completed > 0) {
+				--completed;
+			} else {
+				++sent;
+			}
+		}
+	}
+
+	/**
+	 * A status query failed; rely on the model until the next resync.
+	 */
+	void onStatusFailed(
+		Clock::time_point now = Clock::now()) {
+		lastStatus = now;
+	}
+
+	/**
+	 * Commands still queued or executing according to the model.
+	 */
+	size_t outstanding(
+		Clock::time_point now = Clock::now()) {
+		update(now);
+		return count;
+	}
+
+	/**
+	 * True if one more motion command fits without blocking the parser.
+	 */
+	bool hasRoom(
+		Clock::time_point now = Clock::now()) {
+		return outstanding(now) < static_cast<size_t>(fifoDepth) + 1;
+	}
+
+	/**
+	 * When the model expects a FIFO slot to free up.
+	 */
+	Clock::time_point nextSlotTime() const {
+		const size_t capacity = static_cast<size_t>(fifoDepth) + 1;
+		if (count < capacity) {
+			return Clock::time_point();
+		}
+		return at(count - capacity) + margin;
+	}
+
+	/**
+	 * When the model expects all outstanding motion to have finished.
+	 */
+	Clock::time_point idleTime() const {
+		return count == 0 ? Clock::time_point() : back() + margin;
+	}
+
+	bool needsResync(
+		Clock::time_point now = Clock::now()) const {
+		return count != 0 && now - lastStatus >= resyncInterval;
+	}
+
+	uint64_t getSentCount() const {
+		return sent;
+	}
+
+	uint64_t getCompletedCount() const {
+		return completed;
+	}
+
+private:
+	void update(
+		Clock::time_point now) {
+		while (count != 0 && at(0) + margin <= now) {
+			popFront();
+		}
+	}
+
+	//-- End time ring, oldest first --------------------------------
+
+	Clock::time_point at(
+		size_t i) const {
+		return ends[(head + i) % ends.size()];
+	}
+
+	Clock::time_point back() const {
+		return at(count - 1);
+	}
+
+	// Only overflows with flow control off, when nothing waits for room;
+	// the oldest command is then taken as done
+	void pushBack(
+		Clock::time_point end) {
+		if (count == ends.size()) {
+			popFront();
+		}
+		ends[(head + count) % ends.size()] = end;
+		++count;
+	}
+
+	void popFront() {
+		head = (head + 1) % ends.size();
+		--count;
+		++completed;
+	}
+
+	// Room for a full FIFO, the executing command and a full pipeline
+	void resizeRing() {
+		std::vector<Clock::time_point> resized(static_cast<size_t>(fifoDepth) + 1 + MAX_IN_FLIGHT);
+		const size_t keep = std::min(count, resized.size());
+		for (size_t i = 0; i < keep; ++i) {
+			resized[i] = at(count - keep + i);
+		}
+		ends.swap(resized);
+		head = 0;
+		count = keep;
+	}
+
+	int fifoDepth = DEFAULT_FIFO_DEPTH;
+	Clock::duration margin = std::chrono::milliseconds(DEFAULT_MARGIN_MS);
+	Clock::duration resyncInterval = std::chrono::milliseconds(DEFAULT_RESYNC_MS);
+	std::vector<Clock::time_point> ends;
+	size_t head = 0;
+	size_t count = 0;
+	uint64_t sent = 0;
+	uint64_t completed = 0;
+	Clock::time_point lastStatus;
+};
@@ -0,0 +1,782 @@
+// ofxEbbJob.h
+#pragma once
+
+#include "ofxEbbMappedFile.h"
+#include "ofxEbbPathBatcher.h"
+#include "ofxEbbPlanner.h"
+#include "ofxEbbRaster.h"
+#include "ofxEbbTravelOptimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Commands a job file can hold: motion, pen/servo, engraver and the layer
+ * and node-count markers used to resume. New opcodes go at the end, so
+ * older jobs keep their meaning.
+ */
+enum class ofxEbbJobOp : uint8_t {
+	LM, // rate1, steps1, accel1, rate2, steps2, accel2[, clear]
+	SM, // durationMs, steps1, steps2
+	SP, // state[, durationMs[, pin]]
+	S2, // position, channel[, rate[, delay]]
+	SL, // layer
+	SN, // node count
+	NI, // (none)
+	SE, // state, power, useMotionQueue
+	Count
+};
+
+inline constexpr std::string_view ofxEbbJobOpNames[] = { "LM", "SM", "SP", "S2", "SL", "SN", "NI", "SE" };
+
+static_assert(std::size(ofxEbbJobOpNames) == static_cast<size_t>(ofxEbbJobOp::Count), "One name per job opcode");
+
+/**
+ * One decoded job record.
+ */
+struct ofxEbbJobRecord {
+	static constexpr size_t MAX_ARGS = 8;
+
+	ofxEbbJobOp op = ofxEbbJobOp::NI;
+	uint8_t argc = 0;
+	std::array<int64_t, MAX_ARGS> args {};
+	uint32_t durationUs = 0; // Expected motion time; 0 for markers
+
+	std::string_view name() const {
+		return ofxEbbJobOpNames[static_cast<size_t>(op)];
+	}
+
+	bool isMotion() const {
+		return op == ofxEbbJobOp::LM || op == ofxEbbJobOp::SM || op == ofxEbbJobOp::SP || op == ofxEbbJobOp::S2
+			|| (op == ofxEbbJobOp::SE && argc >= 3 && args[2] == 1);
+	}
+
+	// Motor steps this record moves by (LM and SM only)
+	std::array<int64_t, 2> steps() const {
+		if (op == ofxEbbJobOp::LM && argc >= 6) {
+			return { { args[1], args[4] } };
+		}
+		if (op == ofxEbbJobOp::SM && argc >= 3) {
+			return { { args[1], args[2] } };
+		}
+		return { { 0, 0 } };
+	}
+};
+
+/**
+ * Job file layout (little-endian):
+ *
+ *   "EBBJ"  u16 version  u16 flags  u32 records  u32 nodes
+ *   u64 data bytes  u64 total motion us
+ *   records...
+ *
+ * Each record is one opcode byte, one argument count byte, the arguments
+ * as zigzag LEB128 varints and the expected duration in microseconds as an
+ * LEB128 varint. A planned LM move takes about 20 bytes, less than half of
+ * its command text.
+ */
+struct ofxEbbJobHeader {
+	static constexpr size_t SIZE = 32;
+	static constexpr uint16_t VERSION = 1;
+
+	uint32_t records = 0;
+	uint32_t nodes = 0; // Node count at the end of the job
+	uint64_t dataBytes = 0;
+	uint64_t durationUs = 0;
+
+	void write(
+		uint8_t * out) const {
+		const char magic[4] = { 'E', 'B', 'B', 'J' };
+		std::copy(magic, magic + 4, out);
+		put(out + 4, VERSION, 2);
+		put(out + 6, 0, 2);
+		put(out + 8, records, 4);
+		put(out + 12, nodes, 4);
+		put(out + 16, dataBytes, 8);
+		put(out + 24, durationUs, 8);
+	}
+
+	bool read(
+		const uint8_t * in,
+		size_t size) {
+		if (size < SIZE || in[0] != 'E' || in[1] != 'B' || in[2] != 'B' || in[3] != 'J' || get(in + 4, 2) != VERSION) {
+			return false;
+		}
+		records = static_cast<uint32_t>(get(in + 8, 4));
+		nodes = static_cast<uint32_t>(get(in + 12, 4));
+		dataBytes = get(in + 16, 8);
+		durationUs = get(in + 24, 8);
+		return dataBytes <= size - SIZE;
+	}
+
+private:
+	static void put(
+		uint8_t * out,
+		uint64_t value,
+		int bytes) {
+		for (int i = 0; i < bytes; ++i) {
+			out[i] = static_cast<uint8_t>(value >> (8 * i));
+		}
+	}
+
+	static uint64_t get(
+		const uint8_t * in,
+		int bytes) {
+		uint64_t value = 0;
+		for (int i = 0; i < bytes; ++i) {
+			value |= static_cast<uint64_t>(in[i]) << (8 * i);
+		}
+		return value;
+	}
+};
+
+/**
+ * ofxEbbJobReader: decodes records from a byte range in place.
+ */
+class ofxEbbJobReader {
+public:
+	ofxEbbJobReader(
+		const uint8_t * begin,
+		const uint8_t * end)
+		: cursor(begin)
+		, start(begin)
+		, limit(end) { }
+
+	/**
+	 * Decode the next record.
+	 * @returns False at the end, or if the data is malformed (see failed()).
+	 */
+	bool next(
+		ofxEbbJobRecord & out) {
+		if (cursor == limit) {
+			return false;
+		}
+		if (limit - cursor < 2 || cursor[0] >= static_cast<uint8_t>(ofxEbbJobOp::Count)
+			|| cursor[1] > ofxEbbJobRecord::MAX_ARGS) {
+			return fail();
+		}
+		out.op = static_cast<ofxEbbJobOp>(cursor[0]);
+		out.argc = cursor[1];
+		cursor += 2;
+
+		uint64_t value;
+		for (uint8_t i = 0; i < out.argc; ++i) {
+			if (!varint(value)) {
+				return fail();
+			}
+			out.args[i] = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+		}
+		if (!varint(value) || value > UINT32_MAX) {
+			return fail();
+		}
+		out.durationUs = static_cast<uint32_t>(value);
+		return true;
+	}
+
+	// Byte offset of the next record from the start of the data
+	size_t offset() const {
+		return static_cast<size_t>(cursor - start);
+	}
+
+	bool failed() const {
+		return malformed;
+	}
+
+private:
+	bool varint(
+		uint64_t & out) {
+		out = 0;
+		for (int shift = 0; shift < 64 && cursor != limit; shift += 7) {
+			const uint8_t byte = *cursor++;
+			out |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool fail() {
+		malformed = true;
+		cursor = limit;
+		return false;
+	}
+
+	const uint8_t * cursor;
+	const uint8_t * start;
+	const uint8_t * limit;
+	bool malformed = false;
+};
+
+/**
+ * Where, and in what state, a job resumes from a node count.
+ */
+struct ofxEbbJobResume {
+	bool found = false;
+	size_t offset = 0; // Data offset of the first record to send
+	uint64_t record = 0; // Index of that record
+	std::array<int64_t, 2> steps { { 0, 0 } }; // Motor position there, from the job origin
+	bool hasPen = false; // Last SP (or S2 on the pen channel) before it
+	ofxEbbJobRecord pen;
+	bool hasEngraver = false; // Last SE before it
+	ofxEbbJobRecord engraver;
+	int layer = -1; // Last SL before it, -1 if none
+	uint64_t durationUs = 0; // Motion time skipped
+};
+
+/**
+ * ofxEbbJobFile: a compiled job, memory-mapped for streaming (see
+ * ofxEbbMappedFile).
+ */
+class ofxEbbJobFile {
+public:
+	static constexpr int PEN_SERVO_CHANNEL = 4;
+
+	ofxEbbJobFile() = default;
+	ofxEbbJobFile(const ofxEbbJobFile &) = delete;
+	ofxEbbJobFile & operator=(const ofxEbbJobFile &) = delete;
+
+	~ofxEbbJobFile() {
+		close();
+	}
+
+	/**
+	 * Map a job file.
+	 * @returns False if it can't be read or isn't a job; see getError().
+	 */
+	bool open(
+		const std::string & path) {
+		close();
+		if (!file.open(path)) {
+			error = file.getError();
+			return false;
+		}
+		return validate();
+	}
+
+	/**
+	 * Use an in-memory job, e.g. straight from ofxEbbJobWriter::bytes().
+	 */
+	bool open(
+		std::vector<uint8_t> data) {
+		close();
+		file.open(std::move(data));
+		return validate();
+	}
+
+	void close() {
+		file.close();
+		header = ofxEbbJobHeader();
+	}
+
+	bool isOpen() const {
+		return file.isOpen();
+	}
+
+	const std::string & getError() const {
+		return error;
+	}
+
+	const ofxEbbJobHeader & getHeader() const {
+		return header;
+	}
+
+	double getDuration() const {
+		return header.durationUs / 1e6;
+	}
+
+	/**
+	 * Reader over the records, starting `offset` bytes into the data.
+	 */
+	ofxEbbJobReader reader(
+		size_t offset = 0) const {
+		const uint8_t * data = file.isOpen() ? file.data() + ofxEbbJobHeader::SIZE : nullptr;
+		const uint8_t * end = data ? data + header.dataBytes : nullptr;
+		return ofxEbbJobReader(data ? std::min(data + offset, end) : nullptr, end);
+	}
+
+	/**
+	 * Find where to pick up once the node counter reads `node`: right after
+	 * the SN/NI record that brought it there, along with the position and
+	 * pen and layer state the job had at that point. Node 0 is the start.
+	 */
+	ofxEbbJobResume findResume(
+		uint32_t node) const {
+		ofxEbbJobResume resume;
+		if (node == 0) {
+			resume.found = isOpen();
+			return resume;
+		}
+
+		ofxEbbJobReader in = reader();
+		ofxEbbJobRecord record;
+		uint32_t counter = 0;
+		uint64_t index = 0;
+		while (in.next(record)) {
+			++index;
+			const auto steps = record.steps();
+			resume.steps[0] += steps[0];
+			resume.steps[1] += steps[1];
+			resume.durationUs += record.durationUs;
+
+			switch (record.op) {
+			case ofxEbbJobOp::SP:
+				resume.hasPen = true;
+				resume.pen = record;
+				break;
+			case ofxEbbJobOp::S2:
+				if (record.argc >= 2 && record.args[1] == PEN_SERVO_CHANNEL) {
+					resume.hasPen = true;
+					resume.pen = record;
+				}
+				break;
+			case ofxEbbJobOp::SE:
+				resume.hasEngraver = true;
+				resume.engraver = record;
+				break;
+			case ofxEbbJobOp::SL:
+				resume.layer = record.argc ? static_cast<int>(record.args[0]) : 0;
+				break;
+			case ofxEbbJobOp::SN:
+				counter = record.argc ? static_cast<uint32_t>(record.args[0]) : 0;
+				break;
+			case ofxEbbJobOp::NI:
+				++counter;
+				break;
+			default:
+				break;
+			}
+
+			if ((record.op == ofxEbbJobOp::SN || record.op == ofxEbbJobOp::NI) && counter == node) {
+				resume.found = true;
+				resume.offset = in.offset();
+				resume.record = index;
+				return resume;
+			}
+		}
+		return ofxEbbJobResume();
+	}
+
+private:
+	bool validate() {
+		if (!header.read(file.data(), file.size())) {
+			close();
+			return fail("Not an EBB job file");
+		}
+		error.clear();
+		return true;
+	}
+
+	bool fail(
+		std::string message) {
+		error = std::move(message);
+		return false;
+	}
+
+	ofxEbbMappedFile file;
+	ofxEbbJobHeader header;
+	std::string error;
+};
+
+/**
+ * ofxEbbJobWriter: encodes records into a job in memory.
+ */
+class ofxEbbJobWriter {
+public:
+	/**
+	 * Append one record.
+	 * @param seconds  Expected motion time (for flow control when streamed).
+	 */
+	void add(
+		ofxEbbJobOp op,
+		std::initializer_list<int64_t> args,
+		double seconds = 0.0) {
+		data.push_back(static_cast<uint8_t>(op));
+		data.push_back(static_cast<uint8_t>(std::min(args.size(), ofxEbbJobRecord::MAX_ARGS)));
+		size_t n = 0;
+		for (int64_t value : args) {
+			if (n++ == ofxEbbJobRecord::MAX_ARGS) {
+				break;
+			}
+			varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+		}
+		const uint64_t us = seconds > 0.0 ? static_cast<uint64_t>(seconds * 1e6 + 0.5) : 0;
+		varint(std::min<uint64_t>(us, UINT32_MAX));
+		header.durationUs += us;
+		++header.records;
+
+		if (op == ofxEbbJobOp::SN) {
+			header.nodes = args.size() ? static_cast<uint32_t>(*args.begin()) : 0;
+		} else if (op == ofxEbbJobOp::NI) {
+			++header.nodes;
+		}
+	}
+
+	void add(
+		const ofxEbbLowLevelMove & move) {
+		add(ofxEbbJobOp::LM, { move.rate[0], move.steps[0], move.accel[0], move.rate[1], move.steps[1], move.accel[1] }, move.duration);
+	}
+
+	size_t getRecordCount() const {
+		return header.records;
+	}
+
+	double getDuration() const {
+		return header.durationUs / 1e6;
+	}
+
+	void clear() {
+		data.clear();
+		header = ofxEbbJobHeader();
+	}
+
+	/**
+	 * The complete job file: header and records.
+	 */
+	std::vector<uint8_t> bytes() const {
+		std::vector<uint8_t> out(ofxEbbJobHeader::SIZE + data.size());
+		ofxEbbJobHeader h = header;
+		h.dataBytes = data.size();
+		h.write(out.data());
+		std::copy(data.begin(), data.end(), out.begin() + ofxEbbJobHeader::SIZE);
+		return out;
+	}
+
+	/**
+	 * Write the job to disk.
+	 */
+	bool save(
+		const std::string & path) const {
+		const auto out = bytes();
+		std::FILE * file = std::fopen(path.c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+		const bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+		return std::fclose(file) == 0 && ok;
+	}
+
+private:
+	void varint(
+		uint64_t value) {
+		while (value >= 0x80) {
+			data.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		data.push_back(static_cast<uint8_t>(value));
+	}
+
+	std::vector<uint8_t> data;
+	ofxEbbJobHeader header;
+};
+
+/**
+ * ofxEbbJobCompiler: plans drawing into a job instead of sending it.
+ * Mirrors ofxEbbControl's moveTo()/drawPolyline() (same planner, path
+ * batching and limits); positions are relative to where the job starts.
+ * With auto nodes on, every polyline ends with an NI so a stopped job can
+ * resume at path granularity.
+ */
+class ofxEbbJobCompiler {
+public:
+	explicit ofxEbbJobCompiler(
+		double stepsPerMm = 80.0,
+		ofxEbbKinematics kinematics = ofxEbbKinematics::Direct)
+		: planner(stepsPerMm, kinematics) { }
+
+	ofxEbbPlanner & getPlanner() {
+		return planner;
+	}
+
+	/**
+	 * Snap and merge paths before planning, as ofxEbbControl does (on by
+	 * default).
+	 */
+	void setPathBatching(
+		bool enable,
+		double tolerance = 0.0) {
+		pathBatching = enable;
+		batcher.setTolerance(tolerance);
+	}
+
+	void setMotionLimits(
+		const ofxEbbMotionLimits & limits) {
+		drawLimits = limits;
+	}
+
+	void setTravelLimits(
+		const ofxEbbMotionLimits & limits) {
+		travelLimits = limits;
+	}
+
+	/**
+	 * SP durations in ms for lifting and lowering; -1 leaves them to the
+	 * firmware defaults.
+	 */
+	void setPenDelays(
+		int upMs,
+		int downMs) {
+		penUpMs = upMs;
+		penDownMs = downMs;
+	}
+
+	void setAutoNodes(
+		bool enable) {
+		autoNodes = enable;
+	}
+
+	/**
+	 * Pen up or down (SP); nothing is recorded if it is already there.
+	 */
+	void setPenState(
+		bool down) {
+		if (penKnown && penDown == down) {
+			return;
+		}
+		const int ms = down ? penDownMs : penUpMs;
+		if (ms >= 0) {
+			writer.add(ofxEbbJobOp::SP, { down ? 0 : 1, ms }, ms / 1000.0);
+		} else {
+			writer.add(ofxEbbJobOp::SP, { down ? 0 : 1 });
+		}
+		penKnown = true;
+		penDown = down;
+	}
+
+	/**
+	 * Travel to a point in mm; the pen is left as it is.
+	 * @returns Planned motion time in seconds.
+	 */
+	double moveTo(
+		double x,
+		double y) {
+		ofxEbbPoint target { x, y };
+		return plan(&target, 1, travelLimits);
+	}
+
+	/**
+	 * Pen up, travel, pen down, draw, pen up (and NI with auto nodes).
+	 */
+	double drawPolyline(
+		const std::vector<ofxEbbPoint> & points,
+		bool closed = false) {
+		if (points.empty()) {
+			return 0.0;
+		}
+		setPenState(false);
+		double duration = moveTo(points[0].x, points[0].y);
+		setPenState(true);
+		scratch.assign(points.begin() + 1, points.end());
+		if (closed) {
+			scratch.push_back(points[0]);
+		}
+		duration += plan(scratch.data(), scratch.size(), drawLimits);
+		setPenState(false);
+		if (autoNodes) {
+			nextNode();
+		}
+		return duration;
+	}
+
+	/**
+	 * Several polylines, each like drawPolyline(), reordered first when
+	 * travel optimization is on (see ofxEbbControl::drawPolylines()).
+	 */
+	double drawPolylines(
+		const std::vector<std::vector<ofxEbbPoint>> & paths) {
+		double duration = 0.0;
+		if (!travelOptimization) {
+			for (const auto & path : paths) {
+				duration += drawPolyline(path);
+			}
+			return duration;
+		}
+		ofxEbbTravelSettings settings = travelOptimizer.getSettings();
+		settings.start = planner.getPosition();
+		travelOptimizer.setSettings(settings);
+		travelPlan = travelOptimizer.optimize(paths);
+		ofxEbbTravelOptimizer::forEachChain(paths, travelPlan, [&](const std::vector<ofxEbbPoint> & chain) {
+			duration += drawPolyline(chain);
+		});
+		return duration;
+	}
+
+	void setTravelOptimization(
+		bool enable,
+		const ofxEbbTravelSettings & settings = {}) {
+		travelOptimization = enable;
+		travelOptimizer.setSettings(settings);
+	}
+
+	const ofxEbbTravelPlan & getTravelPlan() const {
+		return travelPlan;
+	}
+
+	/**
+	 * Engraver on or off at `power` (SE, 0-1023), queued between the
+	 * moves around it unless `useMotionQueue` is false.
+	 */
+	void setEngraver(
+		bool enable,
+		int power,
+		bool useMotionQueue = true) {
+		writer.add(ofxEbbJobOp::SE, { enable ? 1 : 0, std::clamp(power, 0, ofxEbbRasterEncoder::MAX_POWER), useMotionQueue ? 1 : 0 });
+	}
+
+	/**
+	 * Engrave a greyscale image row by row (see ofxEbbRasterSettings).
+	 * Each row is run-length encoded into constant-power spans and burnt
+	 * at constant speed: queued SEs between LM moves that end exactly on
+	 * the span boundaries, so the power changes where the pixels do, with
+	 * an overscan at both ends to speed up and slow down in with the
+	 * engraver off. An overscan shorter than overscanFor() leaves the first
+	 * and last spans burnt while still ramping. Rows alternate direction
+	 * when bidirectional; blank rows and margins are skipped. The pen is
+	 * left as it is.
+	 * @returns Planned motion time in seconds.
+	 */
+	double engraveRaster(
+		const ofxEbbRasterImage & image,
+		const ofxEbbRasterSettings & settings) {
+		if (!image.pixels || settings.pixelSize <= 0.0 || settings.speed <= 0.0) {
+			return 0.0;
+		}
+		ofxEbbMotionLimits burn = drawLimits;
+		burn.maxSpeed = settings.speed;
+		burn.maxAccel = settings.accel > 0.0 ? settings.accel : drawLimits.maxAccel;
+		burn.minSpeed = std::min(burn.minSpeed, settings.speed);
+		burn.profile = ofxEbbVelocityProfile::Trapezoid;
+		const double overscan = ofxEbbRasterEncoder::overscanFor(settings);
+
+		double duration = 0.0;
+		size_t rowsBurnt = 0;
+		for (size_t y = 0; y < image.height; ++y) {
+			ofxEbbRasterEncoder::encodeRow(image.row(y), image.width, settings, rasterSpans);
+			if (rasterSpans.empty()) {
+				continue;
+			}
+			const bool forward = !settings.bidirectional || rowsBurnt++ % 2 == 0;
+			const double rowY = settings.origin.y + y * settings.lineSpacing;
+			const double left = settings.origin.x + (forward ? 0.0 : settings.reverseOffset);
+			const double dir = forward ? 1.0 : -1.0;
+			const size_t n = rasterSpans.size();
+			auto span = [&](size_t i) -> const ofxEbbRasterSpan & {
+				return rasterSpans[forward ? i : n - 1 - i];
+			};
+			auto edge = [&](size_t px) {
+				return left + px * settings.pixelSize;
+			};
+
+			// Vertices: the end of the run-up, the far end of each span in
+			// burning order, then the end of the run-out
+			rasterPoints.clear();
+			const double entry = edge(forward ? span(0).begin : span(0).end);
+			rasterPoints.push_back({ entry, rowY });
+			for (size_t i = 0; i < n; ++i) {
+				rasterPoints.push_back({ edge(forward ? span(i).end : span(i).begin), rowY });
+			}
+			rasterPoints.push_back({ rasterPoints.back().x + dir * overscan, rowY });
+
+			duration += moveTo(entry - dir * overscan, rowY);
+			rasterMoves.clear();
+			duration += planner.plan(rasterPoints.data(), rasterPoints.size(), burn, rasterMoves, rasterEnds);
+
+			size_t next = 0;
+			auto addMoves = [&](size_t end) {
+				for (; next < end; ++next) {
+					writer.add(rasterMoves[next]);
+				}
+			};
+			addMoves(rasterEnds[0]);
+			int power = 0;
+			for (size_t i = 0; i < n; ++i) {
+				if (span(i).power != power) {
+					power = span(i).power;
+					setEngraver(power > 0, power);
+				}
+				addMoves(rasterEnds[i + 1]);
+			}
+			if (power > 0) {
+				setEngraver(false, 0);
+			}
+			addMoves(rasterMoves.size());
+			if (settings.nodePerRow) {
+				nextNode();
+			}
+		}
+		return duration;
+	}
+
+	void setLayer(
+		int layer) {
+		writer.add(ofxEbbJobOp::SL, { layer });
+	}
+
+	void setNodeCount(
+		uint32_t value) {
+		writer.add(ofxEbbJobOp::SN, { value });
+	}
+
+	void nextNode() {
+		writer.add(ofxEbbJobOp::NI, {});
+	}
+
+	// For commands the helpers above don't cover
+	ofxEbbJobWriter & getWriter() {
+		return writer;
+	}
+
+	bool save(
+		const std::string & path) const {
+		return writer.save(path);
+	}
+
+private:
+	double plan(
+		const ofxEbbPoint * points,
+		size_t count,
+		const ofxEbbMotionLimits & limits) {
+		if (pathBatching) {
+			batched.clear();
+			batcher.process(planner, points, count, batched);
+			points = batched.data();
+			count = batched.size();
+		}
+		moves.clear();
+		const double duration = planner.plan(points, count, limits, moves);
+		for (const auto & move : moves) {
+			writer.add(move);
+		}
+		return duration;
+	}
+
+	ofxEbbPlanner planner;
+	ofxEbbPathBatcher batcher;
+	ofxEbbMotionLimits drawLimits;
+	ofxEbbMotionLimits travelLimits { 200.0, 2000.0, 2.0, 0.1 };
+	int penUpMs = -1;
+	int penDownMs = -1;
+	bool penKnown = false;
+	bool penDown = false;
+	bool autoNodes = true;
+	bool pathBatching = true;
+	bool travelOptimization = false;
+	ofxEbbTravelOptimizer travelOptimizer;
+	ofxEbbTravelPlan travelPlan;
+	std::vector<ofxEbbPoint> scratch;
+	std::vector<ofxEbbPoint> batched;
+	std::vector<ofxEbbLowLevelMove> moves;
+	std::vector<ofxEbbRasterSpan> rasterSpans;
+	std::vector<ofxEbbPoint> rasterPoints;
+	std::vector<ofxEbbLowLevelMove> rasterMoves;
+	std::vector<size_t> rasterEnds;
+	ofxEbbJobWriter writer;
+};
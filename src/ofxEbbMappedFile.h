@@ -0,0 +1,133 @@
+// ofxEbbMappedFile.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * ofxEbbMappedFile: read-only view of a whole file.
+ * On POSIX the file is mapped and paged in by the kernel as it is read
+ * front to back, so resident memory stays small however large it is; on
+ * Windows it is read into memory instead. Can also wrap a byte vector.
+ */
+class ofxEbbMappedFile {
+public:
+	ofxEbbMappedFile() = default;
+	ofxEbbMappedFile(const ofxEbbMappedFile &) = delete;
+	ofxEbbMappedFile & operator=(const ofxEbbMappedFile &) = delete;
+
+	~ofxEbbMappedFile() {
+		close();
+	}
+
+	/**
+	 * @returns False if the file can't be opened or is empty; see getError().
+	 */
+	bool open(
+		const std::string & path) {
+		close();
+#ifdef _WIN32
+		std::ifstream in(path, std::ios::binary);
+		if (!in) {
+			return fail("Cannot open " + path);
+		}
+		owned.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		if (owned.empty()) {
+			return fail("Cannot read " + path);
+		}
+		bytes = owned.data();
+		length = owned.size();
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return fail("Cannot open " + path);
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+			::close(fd);
+			return fail("Cannot read " + path);
+		}
+		void * map = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (map == MAP_FAILED) {
+			return fail("Cannot map " + path);
+		}
+		madvise(map, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+		mapped = map;
+		bytes = static_cast<const uint8_t *>(map);
+		length = static_cast<size_t>(info.st_size);
+#endif
+		error.clear();
+		return true;
+	}
+
+	/**
+	 * Take over an in-memory buffer instead of a file.
+	 */
+	void open(
+		std::vector<uint8_t> data) {
+		close();
+		owned = std::move(data);
+		bytes = owned.data();
+		length = owned.size();
+		error.clear();
+	}
+
+	void close() {
+#ifndef _WIN32
+		if (mapped) {
+			munmap(mapped, length);
+			mapped = nullptr;
+		}
+#endif
+		owned.clear();
+		bytes = nullptr;
+		length = 0;
+	}
+
+	bool isOpen() const {
+		return bytes != nullptr;
+	}
+
+	const uint8_t * data() const {
+		return bytes;
+	}
+
+	size_t size() const {
+		return length;
+	}
+
+	std::string_view text() const {
+		return std::string_view(reinterpret_cast<const char *>(bytes), length);
+	}
+
+	const std::string & getError() const {
+		return error;
+	}
+
+private:
+	bool fail(
+		std::string message) {
+		error = std::move(message);
+		return false;
+	}
+
+	const uint8_t * bytes = nullptr;
+	size_t length = 0;
+	void * mapped = nullptr;
+	std::vector<uint8_t> owned;
+	std::string error;
+};
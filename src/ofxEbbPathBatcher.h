@@ -0,0 +1,159 @@
+// ofxEbbPathBatcher.h
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ofxEbbPlanner.h"
+
+/**
+ * What ofxEbbPathBatcher did to a path.
+ */
+struct ofxEbbBatchStats {
+	size_t inputSegments = 0;
+	size_t zeroLength = 0; // Rounded to no motor steps
+	size_t merged = 0; // Folded into a collinear neighbour
+	size_t outputSegments = 0;
+
+	// Motion commands that no longer need to be sent (at least one each)
+	size_t saved() const {
+		return zeroLength + merged;
+	}
+
+	ofxEbbBatchStats & operator+=(
+		const ofxEbbBatchStats & other) {
+		inputSegments += other.inputSegments;
+		zeroLength += other.zeroLength;
+		merged += other.merged;
+		outputSegments += other.outputSegments;
+		return *this;
+	}
+};
+
+/**
+ * ofxEbbPathBatcher: squeezes dense polylines before they are planned.
+ * Vertices are snapped to the motor step grid (rounded from absolute
+ * positions, so the sub-step remainder is never lost), segments that round
+ * to zero steps are dropped and runs of collinear segments become one.
+ */
+class ofxEbbPathBatcher {
+public:
+	/**
+	 * Allowed deviation, in motor steps, of a dropped vertex from the
+	 * merged line. 0 only merges segments that are exactly collinear on the
+	 * step grid.
+	 */
+	void setTolerance(
+		double steps) {
+		tolerance = steps < 0.0 ? 0.0 : steps;
+	}
+
+	double getTolerance() const {
+		return tolerance;
+	}
+
+	/**
+	 * Batch a path that starts at the planner's current position.
+	 * @param planner  Supplies the kinematics, calibration and start point.
+	 * @param points   Vertices in mm.
+	 * @param count    Number of vertices.
+	 * @param out      Snapped vertices are appended here, ready for plan().
+	 * @returns        Statistics for this call.
+	 */
+	ofxEbbBatchStats process(
+		const ofxEbbPlanner & planner,
+		const ofxEbbPoint * points,
+		size_t count,
+		std::vector<ofxEbbPoint> & out) {
+		ofxEbbBatchStats stats;
+		Steps previous = planner.getPositionSteps();
+		Steps runStart = previous;
+		Steps runEnd = previous;
+		bool haveRun = false;
+		runInterior.clear();
+
+		for (size_t i = 0; i < count; ++i) {
+			const Steps target = planner.toSteps(points[i]);
+			++stats.inputSegments;
+			if (target == previous) {
+				++stats.zeroLength;
+				continue;
+			}
+
+			if (haveRun && canExtend(runStart, runEnd, target)) {
+				runInterior.push_back(runEnd);
+				runEnd = target;
+				++stats.merged;
+			} else {
+				if (haveRun) {
+					out.push_back(planner.toMm(runEnd));
+					++stats.outputSegments;
+					runStart = runEnd;
+					runInterior.clear();
+				}
+				runEnd = target;
+				haveRun = true;
+			}
+			previous = target;
+		}
+
+		if (haveRun) {
+			out.push_back(planner.toMm(runEnd));
+			++stats.outputSegments;
+		}
+		return stats;
+	}
+
+	ofxEbbBatchStats process(
+		const ofxEbbPlanner & planner,
+		const std::vector<ofxEbbPoint> & points,
+		std::vector<ofxEbbPoint> & out) {
+		return process(planner, points.data(), points.size(), out);
+	}
+
+private:
+	using Steps = std::array<int64_t, 2>;
+
+	// Can the run start->end be stretched to `next` without bending?
+	bool canExtend(
+		const Steps & start,
+		const Steps & end,
+		const Steps & next) const {
+		const int64_t ax = end[0] - start[0];
+		const int64_t ay = end[1] - start[1];
+		const int64_t bx = next[0] - end[0];
+		const int64_t by = next[1] - end[1];
+
+		// Never fold a reversal into a run
+		if (ax * bx + ay * by <= 0) {
+			return false;
+		}
+		if (tolerance <= 0.0) {
+			return ax * by - ay * bx == 0;
+		}
+
+		// Every vertex dropped so far, plus `end`, must stay within
+		// tolerance of the new line start->next
+		const double lx = static_cast<double>(next[0] - start[0]);
+		const double ly = static_cast<double>(next[1] - start[1]);
+		const double length = std::sqrt(lx * lx + ly * ly);
+		auto deviation = [&](const Steps & p) {
+			return std::fabs(lx * (p[1] - start[1]) - ly * (p[0] - start[0])) / length;
+		};
+		if (deviation(end) > tolerance) {
+			return false;
+		}
+		for (const auto & p : runInterior) {
+			if (deviation(p) > tolerance) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	double tolerance = 0.0;
+	std::vector<Steps> runInterior;
+};
@@ -0,0 +1,594 @@
+// ofxEbbPathSource.h
+#pragma once
+
+#include "ofxEbbMappedFile.h"
+#include "ofxEbbPlanner.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+/**
+ * ofxEbbPathSource: pulls a drawing one point at a time, so it never has
+ * to be in memory as a whole. Each stroke is drawn pen-down through its
+ * points; the pen is lifted between strokes.
+ */
+class ofxEbbPathSource {
+public:
+	virtual ~ofxEbbPathSource() = default;
+
+	/**
+	 * Produce the next point in mm.
+	 * @param point         Filled in.
+	 * @param startsStroke  Set if the point begins a new stroke.
+	 * @returns             False once the drawing is exhausted.
+	 */
+	virtual bool next(
+		ofxEbbPoint & point,
+		bool & startsStroke)
+		= 0;
+};
+
+/**
+ * ofxEbbPointSource: a path source backed by a callable with the same
+ * signature as next(), e.g. a generator that computes points on the fly.
+ */
+class ofxEbbPointSource : public ofxEbbPathSource {
+public:
+	using Generator = std::function<bool(ofxEbbPoint &, bool &)>;
+
+	explicit ofxEbbPointSource(
+		Generator generator)
+		: generate(std::move(generator)) { }
+
+	bool next(
+		ofxEbbPoint & point,
+		bool & startsStroke) override {
+		startsStroke = false;
+		return generate && generate(point, startsStroke);
+	}
+
+private:
+	Generator generate;
+};
+
+/**
+ * ofxEbbPolylineSource: walks an existing container of strokes, e.g.
+ * std::vector<ofPolyline> or std::vector<std::vector<ofxEbbPoint>>, without
+ * copying it. Strokes with an isClosed() that returns true are closed.
+ * The container must outlive the source.
+ */
+template <typename Container>
+class ofxEbbPolylineSource : public ofxEbbPathSource {
+public:
+	explicit ofxEbbPolylineSource(
+		const Container & strokes,
+		double scale = 1.0)
+		: strokes(strokes)
+		, scale(scale)
+		, stroke(std::begin(strokes)) {
+		enter();
+	}
+
+	bool next(
+		ofxEbbPoint & point,
+		bool & startsStroke) override {
+		while (stroke != std::end(strokes)) {
+			const auto & s = *stroke;
+			const size_t size = static_cast<size_t>(std::distance(std::begin(s), std::end(s)));
+			if (index < size || (closing && index == size && size > 1)) {
+				const auto & p = *std::next(std::begin(s), static_cast<std::ptrdiff_t>(index < size ? index : 0));
+				point = { p.x * scale, p.y * scale };
+				startsStroke = index == 0;
+				++index;
+				return true;
+			}
+			++stroke;
+			enter();
+		}
+		return false;
+	}
+
+private:
+	template <typename T, typename = void>
+	struct HasIsClosed : std::false_type { };
+	template <typename T>
+	struct HasIsClosed<T, std::void_t<decltype(std::declval<const T &>().isClosed())>> : std::true_type { };
+
+	void enter() {
+		index = 0;
+		closing = false;
+		if constexpr (HasIsClosed<typename std::decay<decltype(*std::begin(std::declval<const Container &>()))>::type>::value) {
+			if (stroke != std::end(strokes)) {
+				closing = stroke->isClosed();
+			}
+		}
+	}
+
+	const Container & strokes;
+	double scale;
+	decltype(std::begin(std::declval<const Container &>())) stroke;
+	size_t index = 0;
+	bool closing = false;
+};
+
+/**
+ * ofxEbbSvgSource: streams the shapes of an SVG file straight from a
+ * memory mapping, one point at a time.
+ * Reads <path>, <polyline>, <polygon>, <line> and <rect>. Curves (C/S/Q/T)
+ * are flattened into `curveSegments` lines; arcs (A) become a straight
+ * line to their end point. Transforms, viewBox and styles are ignored:
+ * user units are multiplied by `unitsToMm` (96 per inch by default).
+ */
+class ofxEbbSvgSource : public ofxEbbPathSource {
+public:
+	static constexpr double PX_TO_MM = 25.4 / 96.0;
+	static constexpr int MAX_CURVE_SEGMENTS = 64;
+
+	/**
+	 * @returns False if the file can't be read; see getError().
+	 */
+	bool open(
+		const std::string & path) {
+		if (!file.open(path)) {
+			return false;
+		}
+		rewind();
+		return true;
+	}
+
+	/**
+	 * Stream SVG text held elsewhere (it must outlive the source).
+	 */
+	void openText(
+		std::string_view svg) {
+		file.close();
+		external = svg;
+		rewind();
+	}
+
+	const std::string & getError() const {
+		return file.getError();
+	}
+
+	void setUnitsToMm(
+		double value) {
+		unitsToMm = value;
+	}
+
+	void setCurveSegments(
+		int segments) {
+		curveSegments = std::max(1, std::min(segments, MAX_CURVE_SEGMENTS));
+	}
+
+	void rewind() {
+		text = file.isOpen() ? file.text() : external;
+		pos = 0;
+		shape = Shape::None;
+		queued = 0;
+		queueIndex = 0;
+	}
+
+	bool next(
+		ofxEbbPoint & point,
+		bool & startsStroke) override {
+		while (true) {
+			if (queueIndex < queued) {
+				const Queued & q = queue[queueIndex++];
+				point = { q.x * unitsToMm, q.y * unitsToMm };
+				startsStroke = q.starts;
+				return true;
+			}
+			queued = 0;
+			queueIndex = 0;
+
+			if (shape == Shape::None && !nextElement()) {
+				return false;
+			}
+			if (!step()) {
+				shape = Shape::None;
+			}
+		}
+	}
+
+private:
+	enum class Shape {
+		None,
+		Points, // polyline / polygon "points"
+		Path // path "d"
+	};
+
+	struct Queued {
+		double x, y;
+		bool starts;
+	};
+
+	// Find the next supported element and set up its data
+	bool nextElement() {
+		while (true) {
+			size_t open = text.find('<', pos);
+			if (open == std::string_view::npos) {
+				pos = text.size();
+				return false;
+			}
+			size_t close = text.find('>', open);
+			if (close == std::string_view::npos) {
+				pos = text.size();
+				return false;
+			}
+			pos = close + 1;
+			const std::string_view tag = text.substr(open + 1, close - open - 1);
+			const std::string_view name = tag.substr(0, tag.find_first_of(" \t\r\n/"));
+
+			if (name == "path") {
+				data = attribute(tag, "d");
+				shape = Shape::Path;
+				command = 0;
+				current = start = control = { 0.0, 0.0 };
+			} else if (name == "polyline" || name == "polygon") {
+				data = attribute(tag, "points");
+				shape = Shape::Points;
+				closeShape = name == "polygon";
+				first = true;
+			} else if (name == "line") {
+				push(number(tag, "x1"), number(tag, "y1"), true);
+				push(number(tag, "x2"), number(tag, "y2"), false);
+				return true;
+			} else if (name == "rect") {
+				const double x = number(tag, "x"), y = number(tag, "y");
+				const double w = number(tag, "width"), h = number(tag, "height");
+				if (w > 0.0 && h > 0.0) {
+					push(x, y, true);
+					push(x + w, y, false);
+					push(x + w, y + h, false);
+					push(x, y + h, false);
+					push(x, y, false);
+					return true;
+				}
+				continue;
+			} else {
+				continue;
+			}
+			dataPos = 0;
+			return true;
+		}
+	}
+
+	// Advance the current element by one item; false when it is done
+	bool step() {
+		if (shape == Shape::Points) {
+			Vec p;
+			if (readNumber(p.x) && readNumber(p.y)) {
+				if (first) {
+					start = p;
+				}
+				push(p.x, p.y, first);
+				first = false;
+				return true;
+			}
+			if (closeShape && !first) {
+				push(start.x, start.y, false);
+			}
+			return false;
+		}
+		return shape == Shape::Path && stepPath();
+	}
+
+	bool stepPath() {
+		skipSeparators();
+		if (dataPos >= data.size()) {
+			return false;
+		}
+		const char c = data[dataPos];
+		if (std::isalpha(static_cast<unsigned char>(c))) {
+			command = c;
+			++dataPos;
+			if (command == 'Z' || command == 'z') {
+				lineTo(start, false);
+				current = control = start;
+				subpathOpen = false;
+				return true;
+			}
+		} else if (command == 0) {
+			return false;
+		}
+
+		const bool relative = std::islower(static_cast<unsigned char>(command)) != 0;
+		const Vec origin = relative ? current : Vec { 0.0, 0.0 };
+		auto point = [&](Vec & out) {
+			if (!readNumber(out.x) || !readNumber(out.y)) {
+				return false;
+			}
+			out.x += origin.x;
+			out.y += origin.y;
+			return true;
+		};
+
+		Vec p, c1, c2;
+		double v;
+		switch (command) {
+		case 'M':
+		case 'm':
+			if (!point(p)) {
+				return false;
+			}
+			current = start = control = p;
+			subpathOpen = true;
+			push(p.x, p.y, true);
+			// Further pairs are implicit line-tos
+			command = relative ? 'l' : 'L';
+			return true;
+		case 'L':
+		case 'l':
+			if (!point(p)) {
+				return false;
+			}
+			lineTo(p, true);
+			return true;
+		case 'H':
+		case 'h':
+			if (!readNumber(v)) {
+				return false;
+			}
+			lineTo({ relative ? current.x + v : v, current.y }, true);
+			return true;
+		case 'V':
+		case 'v':
+			if (!readNumber(v)) {
+				return false;
+			}
+			lineTo({ current.x, relative ? current.y + v : v }, true);
+			return true;
+		case 'C':
+		case 'c':
+			if (!point(c1) || !point(c2) || !point(p)) {
+				return false;
+			}
+			cubicTo(c1, c2, p);
+			return true;
+		case 'S':
+		case 's':
+			if (!point(c2) || !point(p)) {
+				return false;
+			}
+			cubicTo(reflect(), c2, p);
+			return true;
+		case 'Q':
+		case 'q':
+			if (!point(c1) || !point(p)) {
+				return false;
+			}
+			quadTo(c1, p);
+			return true;
+		case 'T':
+		case 't':
+			if (!point(p)) {
+				return false;
+			}
+			quadTo(reflect(), p);
+			return true;
+		case 'A':
+		case 'a': {
+			double rx, ry, rotation;
+			bool largeArc, sweep;
+			if (!readNumber(rx) || !readNumber(ry) || !readNumber(rotation) || !readFlag(largeArc)
+				|| !readFlag(sweep) || !point(p)) {
+				return false;
+			}
+			lineTo(p, true);
+			return true;
+		}
+		default:
+			// Unknown command: skip the rest of this path
+			return false;
+		}
+	}
+
+	struct Vec {
+		double x, y;
+	};
+
+	Vec reflect() const {
+		return { 2.0 * current.x - control.x, 2.0 * current.y - control.y };
+	}
+
+	void lineTo(
+		const Vec & p,
+		bool updateControl) {
+		if (!subpathOpen) {
+			// Drawing on after Z starts a new stroke at the subpath start
+			push(current.x, current.y, true);
+			subpathOpen = true;
+		}
+		push(p.x, p.y, false);
+		current = p;
+		if (updateControl) {
+			control = p;
+		}
+	}
+
+	void cubicTo(
+		const Vec & c1,
+		const Vec & c2,
+		const Vec & p) {
+		const Vec p0 = current;
+		for (int i = 1; i <= curveSegments; ++i) {
+			const double t = static_cast<double>(i) / curveSegments;
+			const double u = 1.0 - t;
+			const double a = u * u * u, b = 3.0 * u * u * t, c = 3.0 * u * t * t, d = t * t * t;
+			lineTo({ a * p0.x + b * c1.x + c * c2.x + d * p.x, a * p0.y + b * c1.y + c * c2.y + d * p.y }, false);
+		}
+		current = p;
+		control = c2;
+	}
+
+	void quadTo(
+		const Vec & c1,
+		const Vec & p) {
+		const Vec p0 = current;
+		for (int i = 1; i <= curveSegments; ++i) {
+			const double t = static_cast<double>(i) / curveSegments;
+			const double u = 1.0 - t;
+			lineTo({ u * u * p0.x + 2.0 * u * t * c1.x + t * t * p.x, u * u * p0.y + 2.0 * u * t * c1.y + t * t * p.y }, false);
+		}
+		current = p;
+		control = c1;
+	}
+
+	void push(
+		double x,
+		double y,
+		bool starts) {
+		if (queued < queue.size()) {
+			queue[queued++] = { x, y, starts };
+		}
+	}
+
+	void skipSeparators() {
+		while (dataPos < data.size() && (std::isspace(static_cast<unsigned char>(data[dataPos])) || data[dataPos] == ',')) {
+			++dataPos;
+		}
+	}
+
+	bool readNumber(
+		double & out) {
+		skipSeparators();
+		return parseNumber(data, dataPos, out);
+	}
+
+	// Arc flags are a single '0' or '1' and need no separator after them,
+	// so "a5 5 0 1010 0" reads as flags 1, 0 then the point (10, 0)
+	bool readFlag(
+		bool & out) {
+		skipSeparators();
+		if (dataPos >= data.size() || (data[dataPos] != '0' && data[dataPos] != '1')) {
+			return false;
+		}
+		out = data[dataPos++] == '1';
+		return true;
+	}
+
+	// Decimal number with optional sign, fraction and exponent. SVG allows
+	// numbers to run together ("1.5-2", ".5.5"), so parsing stops at the
+	// first character that can't continue the current one.
+	static bool parseNumber(
+		std::string_view s,
+		size_t & i,
+		double & out) {
+		size_t p = i;
+		double sign = 1.0;
+		if (p < s.size() && (s[p] == '+' || s[p] == '-')) {
+			sign = s[p] == '-' ? -1.0 : 1.0;
+			++p;
+		}
+		double value = 0.0;
+		bool digits = false;
+		while (p < s.size() && s[p] >= '0' && s[p] <= '9') {
+			value = value * 10.0 + (s[p++] - '0');
+			digits = true;
+		}
+		if (p < s.size() && s[p] == '.') {
+			++p;
+			double scale = 0.1;
+			while (p < s.size() && s[p] >= '0' && s[p] <= '9') {
+				value += (s[p++] - '0') * scale;
+				scale *= 0.1;
+				digits = true;
+			}
+		}
+		if (!digits) {
+			return false;
+		}
+		if (p < s.size() && (s[p] == 'e' || s[p] == 'E')) {
+			size_t e = p + 1;
+			int expSign = 1;
+			if (e < s.size() && (s[e] == '+' || s[e] == '-')) {
+				expSign = s[e] == '-' ? -1 : 1;
+				++e;
+			}
+			int exponent = 0;
+			bool expDigits = false;
+			while (e < s.size() && s[e] >= '0' && s[e] <= '9') {
+				exponent = std::min(exponent * 10 + (s[e++] - '0'), 400);
+				expDigits = true;
+			}
+			if (expDigits) {
+				value *= std::pow(10.0, expSign * exponent);
+				p = e;
+			}
+		}
+		out = sign * value;
+		i = p;
+		return true;
+	}
+
+	// Quoted value of `name` inside a tag, or empty
+	static std::string_view attribute(
+		std::string_view tag,
+		std::string_view name) {
+		size_t at = 0;
+		while ((at = tag.find(name, at)) != std::string_view::npos) {
+			const bool boundary = at > 0 && std::isspace(static_cast<unsigned char>(tag[at - 1]));
+			size_t p = at + name.size();
+			while (p < tag.size() && std::isspace(static_cast<unsigned char>(tag[p]))) {
+				++p;
+			}
+			if (boundary && p < tag.size() && tag[p] == '=') {
+				++p;
+				while (p < tag.size() && std::isspace(static_cast<unsigned char>(tag[p]))) {
+					++p;
+				}
+				if (p < tag.size() && (tag[p] == '"' || tag[p] == '\'')) {
+					const size_t end = tag.find(tag[p], p + 1);
+					if (end != std::string_view::npos) {
+						return tag.substr(p + 1, end - p - 1);
+					}
+				}
+				return {};
+			}
+			at += name.size();
+		}
+		return {};
+	}
+
+	static double number(
+		std::string_view tag,
+		std::string_view name) {
+		const std::string_view value = attribute(tag, name);
+		size_t i = 0;
+		double out = 0.0;
+		return parseNumber(value, i, out) ? out : 0.0;
+	}
+
+	ofxEbbMappedFile file;
+	std::string_view external;
+	std::string_view text;
+	size_t pos = 0;
+	double unitsToMm = PX_TO_MM;
+	int curveSegments = 16;
+
+	// Current element
+	Shape shape = Shape::None;
+	std::string_view data;
+	size_t dataPos = 0;
+	char command = 0;
+	Vec current { 0.0, 0.0 };
+	Vec start { 0.0, 0.0 };
+	Vec control { 0.0, 0.0 }; // Last control point, for S/T
+	bool subpathOpen = false;
+	bool closeShape = false;
+	bool first = true;
+
+	// Points produced by the last step, handed out one by one
+	std::array<Queued, MAX_CURVE_SEGMENTS + 1> queue;
+	size_t queued = 0;
+	size_t queueIndex = 0;
+};
@@ -0,0 +1,511 @@
+// ofxEbbPlanner.h
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ofxEbbProtocol.h"
+
+/**
+ * A point in millimetres.
+ */
+struct ofxEbbPoint {
+	double x = 0.0;
+	double y = 0.0;
+};
+
+enum class ofxEbbVelocityProfile : uint8_t {
+	Trapezoid, // Constant acceleration ramps
+	SCurve // Smoothstep ramps, split into several constant-accel LM moves
+};
+
+/**
+ * How pen coordinates map onto the two motors.
+ */
+enum class ofxEbbKinematics : uint8_t {
+	Direct, // motor1 = x, motor2 = y (EggBot)
+	Mixed // motor1 = x + y, motor2 = x - y (AxiDraw, same mapping as XM)
+};
+
+/**
+ * Speed and acceleration limits along the path.
+ */
+struct ofxEbbMotionLimits {
+	double maxSpeed = 100.0; // mm/s
+	double maxAccel = 1000.0; // mm/s^2
+	double minSpeed = 2.0; // mm/s at path ends and sharp corners
+	double cornerDeviation = 0.05; // mm, junction deviation for corner speeds
+	ofxEbbVelocityProfile profile = ofxEbbVelocityProfile::Trapezoid;
+	int sCurveSegments = 3; // LM moves per S-curve ramp
+};
+
+/**
+ * One LM (step-limited, accelerated) move in firmware register units.
+ */
+struct ofxEbbLowLevelMove {
+	std::array<int64_t, 2> rate { { 0, 0 } };
+	std::array<int64_t, 2> steps { { 0, 0 } };
+	std::array<int64_t, 2> accel { { 0, 0 } };
+	double duration = 0.0; // Seconds
+};
+
+/**
+ * ofxEbbPlanner: turns polylines in mm into acceleration-limited LM moves.
+ * Corner speeds come from a junction deviation model; a backward and a
+ * forward pass over the vertex speeds keep every segment reachable within
+ * maxAccel, so the pen only slows down where the path actually turns.
+ * Step targets are rounded from absolute positions, so rounding error never
+ * accumulates. The planner only does maths; it sends nothing.
+ */
+class ofxEbbPlanner {
+public:
+	static constexpr double MAX_STEP_RATE = 25000.0;
+
+	ofxEbbPlanner(
+		double stepsPerMm = 80.0,
+		ofxEbbKinematics kinematics = ofxEbbKinematics::Direct)
+		: stepsPerMm(stepsPerMm)
+		, kinematics(kinematics) { }
+
+	void setStepsPerMm(
+		double value) {
+		stepsPerMm = value;
+		positionMm = toMm(positionSteps);
+	}
+
+	double getStepsPerMm() const {
+		return stepsPerMm;
+	}
+
+	void setKinematics(
+		ofxEbbKinematics value) {
+		kinematics = value;
+		positionMm = toMm(positionSteps);
+	}
+
+	ofxEbbKinematics getKinematics() const {
+		return kinematics;
+	}
+
+	/**
+	 * Set the motor position the next plan starts from.
+	 */
+	void setPosition(
+		int64_t motor1,
+		int64_t motor2) {
+		positionSteps = { { motor1, motor2 } };
+		positionMm = toMm(positionSteps);
+	}
+
+	/**
+	 * Account for a move made outside the planner.
+	 */
+	void offsetPosition(
+		int64_t motor1,
+		int64_t motor2) {
+		setPosition(positionSteps[0] + motor1, positionSteps[1] + motor2);
+	}
+
+	std::array<int64_t, 2> getPositionSteps() const {
+		return positionSteps;
+	}
+
+	ofxEbbPoint getPosition() const {
+		return positionMm;
+	}
+
+	/**
+	 * Plan a path from the current position through `points`.
+	 * @param points  Vertices in mm.
+	 * @param count   Number of vertices.
+	 * @param limits  Speed and acceleration limits.
+	 * @param out     LM moves are appended here.
+	 * @returns       Planned motion time in seconds.
+	 */
+	double plan(
+		const ofxEbbPoint * points,
+		size_t count,
+		const ofxEbbMotionLimits & limits,
+		std::vector<ofxEbbLowLevelMove> & out) {
+		segments.clear();
+		buildSegments(points, count, limits, segments);
+		if (segments.empty()) {
+			return 0.0;
+		}
+		planSpeeds(segments, limits.minSpeed, limits, vertexSpeed);
+
+		double total = 0.0;
+		for (size_t i = 0; i < segments.size(); ++i) {
+			total += emitSegment(segments[i], vertexSpeed[i], vertexSpeed[i + 1], limits, out);
+		}
+		return total;
+	}
+
+	double plan(
+		const std::vector<ofxEbbPoint> & points,
+		const ofxEbbMotionLimits & limits,
+		std::vector<ofxEbbLowLevelMove> & out) {
+		return plan(points.data(), points.size(), limits, out);
+	}
+
+	/**
+	 * plan(), also telling which moves reach which vertex: moves
+	 * [vertexEnds[i - 1], vertexEnds[i]) run to vertex i (from out.size()
+	 * on entry for vertex 0), so other commands can be slotted in at the
+	 * vertices, e.g. to switch a laser at span boundaries. A vertex that
+	 * rounds to no steps gets an empty range.
+	 */
+	double plan(
+		const ofxEbbPoint * points,
+		size_t count,
+		const ofxEbbMotionLimits & limits,
+		std::vector<ofxEbbLowLevelMove> & out,
+		std::vector<size_t> & vertexEnds) {
+		const size_t first = out.size();
+		segments.clear();
+		buildSegments(points, count, limits, segments, &vertexEnds);
+		if (segments.empty()) {
+			vertexEnds.assign(count, first);
+			return 0.0;
+		}
+		planSpeeds(segments, limits.minSpeed, limits, vertexSpeed);
+
+		// vertexEnds holds segment counts so far; turn them into move counts
+		segmentEnds.clear();
+		double total = 0.0;
+		for (size_t i = 0; i < segments.size(); ++i) {
+			total += emitSegment(segments[i], vertexSpeed[i], vertexSpeed[i + 1], limits, out);
+			segmentEnds.push_back(out.size());
+		}
+		for (auto & end : vertexEnds) {
+			end = end ? segmentEnds[end - 1] : first;
+		}
+		return total;
+	}
+
+	static constexpr size_t MAX_LOOKAHEAD = 4096;
+
+	/**
+	 * Plan a path that arrives in pieces, e.g. from a stream. Segments are
+	 * held back until the path after them is longer than the braking
+	 * distance from maxSpeed; their exit speeds are then final, so the moves
+	 * are the same as planning the whole path at once. At most
+	 * MAX_LOOKAHEAD segments are held; beyond that they are committed early
+	 * (slower, never infeasible). Use the same limits for every piece of a
+	 * path and don't call plan() until it is finished.
+	 * @param points  Next vertices in mm.
+	 * @param count   Number of vertices.
+	 * @param limits  Speed and acceleration limits.
+	 * @param out     LM moves that are ready are appended here.
+	 * @param finish  Last piece: plan everything held back and stop at the end.
+	 * @returns       Motion time of the moves appended, in seconds.
+	 */
+	double planIncremental(
+		const ofxEbbPoint * points,
+		size_t count,
+		const ofxEbbMotionLimits & limits,
+		std::vector<ofxEbbLowLevelMove> & out,
+		bool finish) {
+		buildSegments(points, count, limits, heldSegments);
+		if (heldEntrySpeed < 0.0) {
+			heldEntrySpeed = limits.minSpeed;
+		}
+
+		double total = 0.0;
+		if (!heldSegments.empty()) {
+			planSpeeds(heldSegments, heldEntrySpeed, limits, heldSpeeds);
+
+			// Commit segments that end at least a braking distance before
+			// the end of what is known
+			size_t commit = heldSegments.size();
+			if (!finish) {
+				const double brake = limits.maxSpeed * limits.maxSpeed / (2.0 * rampAccel(limits));
+				double tail = 0.0;
+				while (commit > 0 && tail < brake) {
+					tail += heldSegments[--commit].length;
+				}
+				commit = std::max(commit, heldSegments.size() > MAX_LOOKAHEAD ? heldSegments.size() - MAX_LOOKAHEAD : 0);
+			}
+
+			for (size_t i = 0; i < commit; ++i) {
+				total += emitSegment(heldSegments[i], heldSpeeds[i], heldSpeeds[i + 1], limits, out);
+			}
+			if (commit > 0) {
+				heldEntrySpeed = heldSpeeds[commit];
+				heldSegments.erase(heldSegments.begin(), heldSegments.begin() + static_cast<std::ptrdiff_t>(commit));
+			}
+		}
+
+		if (finish) {
+			heldSegments.clear();
+			heldEntrySpeed = -1.0;
+		}
+		return total;
+	}
+
+	/**
+	 * Segments planIncremental() is still holding back.
+	 */
+	size_t getHeldSegments() const {
+		return heldSegments.size();
+	}
+
+	/**
+	 * Motor step targets for a point in mm.
+	 */
+	std::array<int64_t, 2> toSteps(
+		const ofxEbbPoint & p) const {
+		double a = p.x;
+		double b = p.y;
+		if (kinematics == ofxEbbKinematics::Mixed) {
+			a = p.x + p.y;
+			b = p.x - p.y;
+		}
+		return { { std::llround(a * stepsPerMm), std::llround(b * stepsPerMm) } };
+	}
+
+	/**
+	 * Point in mm for a motor position.
+	 */
+	ofxEbbPoint toMm(
+		const std::array<int64_t, 2> & steps) const {
+		const double a = steps[0] / stepsPerMm;
+		const double b = steps[1] / stepsPerMm;
+		if (kinematics == ofxEbbKinematics::Mixed) {
+			return { (a + b) * 0.5, (a - b) * 0.5 };
+		}
+		return { a, b };
+	}
+
+private:
+	struct Segment {
+		std::array<int64_t, 2> steps; // Motor steps for the whole segment
+		double length; // mm
+		double ux, uy; // Unit direction in mm space
+		double maxSpeed; // Limit from maxSpeed and the motor step rate
+	};
+
+	// Append the segments from the current position through `points`,
+	// optionally noting the segment count after each point
+	void buildSegments(
+		const ofxEbbPoint * points,
+		size_t count,
+		const ofxEbbMotionLimits & limits,
+		std::vector<Segment> & out,
+		std::vector<size_t> * segmentsAfter = nullptr) {
+		if (segmentsAfter) {
+			segmentsAfter->clear();
+		}
+		for (size_t i = 0; i < count; ++i) {
+			if (segmentsAfter && i > 0) {
+				segmentsAfter->push_back(out.size());
+			}
+			const ofxEbbPoint & p = points[i];
+			const auto target = toSteps(p);
+			const std::array<int64_t, 2> delta = { { target[0] - positionSteps[0], target[1] - positionSteps[1] } };
+			const double dx = p.x - positionMm.x;
+			const double dy = p.y - positionMm.y;
+			const double length = std::sqrt(dx * dx + dy * dy);
+
+			// Moves that round to no steps are dropped; their remainder is
+			// kept because targets are always rounded from absolute positions
+			if ((delta[0] == 0 && delta[1] == 0) || length <= 0.0) {
+				positionMm = p;
+				continue;
+			}
+
+			const double maxAxisSteps = static_cast<double>(std::max(std::llabs(delta[0]), std::llabs(delta[1])));
+			Segment seg;
+			seg.steps = delta;
+			seg.length = length;
+			seg.ux = dx / length;
+			seg.uy = dy / length;
+			seg.maxSpeed = std::min(limits.maxSpeed, MAX_STEP_RATE * length / maxAxisSteps);
+			out.push_back(seg);
+
+			positionSteps = target;
+			positionMm = p;
+		}
+		if (segmentsAfter && count > 0) {
+			segmentsAfter->push_back(out.size());
+		}
+	}
+
+	// Vertex speeds: junction limits, then backward and forward passes.
+	// The path starts at `entrySpeed` and ends at minSpeed.
+	void planSpeeds(
+		const std::vector<Segment> & segments,
+		double entrySpeed,
+		const ofxEbbMotionLimits & limits,
+		std::vector<double> & vertexSpeed) const {
+		const double accel = rampAccel(limits);
+		const size_t n = segments.size();
+		vertexSpeed.assign(n + 1, limits.minSpeed);
+		vertexSpeed[0] = entrySpeed;
+
+		for (size_t i = 1; i < n; ++i) {
+			const Segment & a = segments[i - 1];
+			const Segment & b = segments[i];
+			double limit = std::min(a.maxSpeed, b.maxSpeed);
+
+			// Junction deviation: speed at which a circle of radius r
+			// tangent to both segments, deviating `cornerDeviation` from
+			// the vertex, is reached at `accel`
+			const double cosTheta = -(a.ux * b.ux + a.uy * b.uy);
+			if (cosTheta > 0.999999) {
+				limit = limits.minSpeed;
+			} else if (cosTheta > -0.999999) {
+				const double sinHalf = std::sqrt(0.5 * (1.0 - cosTheta));
+				limit = std::min(limit, std::sqrt(accel * limits.cornerDeviation * sinHalf / (1.0 - sinHalf)));
+			}
+			vertexSpeed[i] = std::max(limits.minSpeed, limit);
+		}
+
+		for (size_t i = n; i-- > 0;) {
+			vertexSpeed[i] = std::min(vertexSpeed[i], std::sqrt(vertexSpeed[i + 1] * vertexSpeed[i + 1] + 2.0 * accel * segments[i].length));
+		}
+		for (size_t i = 0; i < n; ++i) {
+			vertexSpeed[i + 1] = std::min(vertexSpeed[i + 1], std::sqrt(vertexSpeed[i] * vertexSpeed[i] + 2.0 * accel * segments[i].length));
+		}
+	}
+
+	// S-curve ramps take 1.5x the time of a linear ramp at the same peak
+	// acceleration, so plan them with the average acceleration
+	static double rampAccel(
+		const ofxEbbMotionLimits & limits) {
+		return limits.profile == ofxEbbVelocityProfile::SCurve ? limits.maxAccel / 1.5 : limits.maxAccel;
+	}
+
+	double emitSegment(
+		const Segment & seg,
+		double v0,
+		double v1,
+		const ofxEbbMotionLimits & limits,
+		std::vector<ofxEbbLowLevelMove> & out) {
+		const double accel = rampAccel(limits);
+		v0 = std::min(v0, seg.maxSpeed);
+		v1 = std::min(v1, seg.maxSpeed);
+		const double peak = std::min(seg.maxSpeed, std::sqrt((2.0 * accel * seg.length + v0 * v0 + v1 * v1) * 0.5));
+		const double vc = std::max(peak, std::max(v0, v1));
+		const double accelDist = std::min(seg.length, std::max(0.0, (vc * vc - v0 * v0) / (2.0 * accel)));
+		const double decelDist = std::min(seg.length - accelDist, std::max(0.0, (vc * vc - v1 * v1) / (2.0 * accel)));
+		const double cruiseDist = seg.length - accelDist - decelDist;
+
+		SegmentCursor cursor { seg, 0.0, { { 0, 0 } }, 0.0 };
+		emitRamp(cursor, accelDist, v0, vc, limits, out);
+		emitPhase(cursor, cruiseDist, vc, vc, out);
+		emitRamp(cursor, decelDist, vc, v1, limits, out);
+		return cursor.time;
+	}
+
+	struct SegmentCursor {
+		const Segment & seg;
+		double distance; // mm covered so far
+		std::array<int64_t, 2> stepsDone;
+		double time;
+	};
+
+	void emitRamp(
+		SegmentCursor & cursor,
+		double distance,
+		double vStart,
+		double vEnd,
+		const ofxEbbMotionLimits & limits,
+		std::vector<ofxEbbLowLevelMove> & out) {
+		if (distance <= 0.0) {
+			return;
+		}
+		const int pieces = limits.profile == ofxEbbVelocityProfile::SCurve ? std::max(1, limits.sCurveSegments) : 1;
+		if (pieces == 1) {
+			emitPhase(cursor, distance, vStart, vEnd, out);
+			return;
+		}
+
+		// Sample v(u) = vStart + dv * smoothstep(u) at equal time steps; the
+		// pieces are linear in time, and by symmetry their distances add up
+		// to exactly (vStart + vEnd) / 2 * T
+		const double duration = 2.0 * distance / (vStart + vEnd);
+		const double dt = duration / pieces;
+		double previous = vStart;
+		for (int k = 1; k <= pieces; ++k) {
+			const double u = static_cast<double>(k) / pieces;
+			const double v = vStart + (vEnd - vStart) * u * u * (3.0 - 2.0 * u);
+			emitPhase(cursor, (previous + v) * 0.5 * dt, previous, v, out);
+			previous = v;
+		}
+	}
+
+	// One constant-acceleration LM covering `distance` mm of the segment
+	void emitPhase(
+		SegmentCursor & cursor,
+		double distance,
+		double vStart,
+		double vEnd,
+		std::vector<ofxEbbLowLevelMove> & out) {
+		if (distance <= 0.0 || vStart + vEnd <= 0.0) {
+			return;
+		}
+		const Segment & seg = cursor.seg;
+		const double duration = 2.0 * distance / (vStart + vEnd);
+		cursor.distance = std::min(seg.length, cursor.distance + distance);
+		cursor.time += duration;
+
+		// Steps for this phase come from the rounded cumulative fraction of
+		// the segment, so the segment always ends on its exact target
+		const double fraction = cursor.distance / seg.length;
+		const bool last = seg.length - cursor.distance <= 1e-9 * seg.length;
+		ofxEbbLowLevelMove move;
+		move.duration = duration;
+		bool any = false;
+		for (int axis = 0; axis < 2; ++axis) {
+			const int64_t target = last ? seg.steps[axis] : std::llround(seg.steps[axis] * fraction);
+			move.steps[axis] = target - cursor.stepsDone[axis];
+			cursor.stepsDone[axis] = target;
+			any = any || move.steps[axis] != 0;
+		}
+		if (!any) {
+			// Sub-step phase; its steps carry into the next one
+			return;
+		}
+
+		const double ticks = std::max(1.0, duration * ofxEbbTickHz);
+		for (int axis = 0; axis < 2; ++axis) {
+			const double n = static_cast<double>(std::llabs(move.steps[axis]));
+			if (n == 0.0) {
+				continue;
+			}
+			// Step rates follow the path speed scaled by this axis' share,
+			// then both ends are scaled so exactly n steps fit in `ticks`
+			double rate0 = vStart;
+			double rate1 = vEnd;
+			const double fit = 2.0 * n * ofxEbbRateOne / ((rate0 + rate1) * ticks);
+			rate0 = std::min(ofxEbbRateOne - 1.0, std::max(1.0, rate0 * fit));
+			rate1 = std::min(ofxEbbRateOne - 1.0, std::max(1.0, rate1 * fit));
+			move.rate[axis] = std::llround(rate0);
+			move.accel[axis] = std::llround((rate1 - rate0) / ticks);
+		}
+		// What the rounded registers take on the board, which can be a
+		// tick or two past the phase
+		move.duration = std::max(ofxEbbLmTicks(move.rate[0], move.steps[0], move.accel[0]), ofxEbbLmTicks(move.rate[1], move.steps[1], move.accel[1])) / ofxEbbTickHz;
+		out.push_back(move);
+	}
+
+	double stepsPerMm;
+	ofxEbbKinematics kinematics;
+	std::array<int64_t, 2> positionSteps { { 0, 0 } };
+	ofxEbbPoint positionMm;
+
+	// Scratch, reused between plans
+	std::vector<Segment> segments;
+	std::vector<double> vertexSpeed;
+	std::vector<size_t> segmentEnds;
+
+	// planIncremental() lookahead
+	std::vector<Segment> heldSegments;
+	std::vector<double> heldSpeeds;
+	double heldEntrySpeed = -1.0; // Below 0: start at minSpeed
+};
@@ -0,0 +1,402 @@
+// ofxEbbPositionPredictor.h
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+#include "ofxEbbProtocol.h"
+
+/**
+ * Where the carriage and pen are expected to be at some instant.
+ */
+struct ofxEbbPredictedPosition {
+	std::array<int64_t, 2> steps { { 0, 0 } }; // Motor steps, as QS reports them
+	bool penDown = false;
+	bool penKnown = false;
+	bool moving = false; // A recorded command is running at that instant
+};
+
+/**
+ * ofxEbbPositionPredictor: a timeline of the motion commands sent to the
+ * board, so the carriage position and pen state at any instant can be
+ * read without I/O. Each command is started after everything before it
+ * (as in ofxEbbFlowControl) and runs for its expected duration; LM moves
+ * keep their rates and accelerations and are stepped through exactly as
+ * the firmware ramps them, everything else is interpolated linearly.
+ *
+ * A real QS reply passed to correct() is matched against the recent
+ * timeline. While the board is moving, how far it runs behind becomes a
+ * lag applied to every later prediction; once it is at rest, any steps
+ * left over (lost, or moved behind the host's back) become an offset.
+ *
+ * One thread records; predict() is lock-free and can be called from any
+ * other thread at any rate. Commands live in a fixed ring in which each
+ * slot carries a sequence number (a seqlock per slot): readers never hold
+ * up the writer and skip a slot that is rewritten while they read it.
+ */
+class ofxEbbPositionPredictor {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr size_t CAPACITY = 1024; // Power of two
+	static constexpr size_t CORRECTION_SEARCH = 64; // Commands matched against a QS reply
+	static constexpr int CORRECTION_SAMPLES = 16; // Per command, before refining
+	static constexpr double MAX_LAG_SECONDS = 2.0;
+
+	ofxEbbPositionPredictor()
+		: slots(new Slot[CAPACITY]) { }
+
+	ofxEbbPositionPredictor(const ofxEbbPositionPredictor &) = delete;
+	ofxEbbPositionPredictor & operator=(const ofxEbbPositionPredictor &) = delete;
+
+	//-- Recording (one thread) --------------------------------------
+
+	/**
+	 * The step counters were set to `steps` (CS, or a new origin); forget
+	 * any correction.
+	 */
+	void reset(
+		const std::array<int64_t, 2> & steps,
+		Clock::time_point now = Clock::now()) {
+		offset[0].store(0, std::memory_order_relaxed);
+		offset[1].store(0, std::memory_order_relaxed);
+		onMove(0.0, steps, pen, now);
+	}
+
+	/**
+	 * Record a command that moves linearly to `target` (or not at all).
+	 * @param seconds  Expected run time.
+	 * @param target   Motor position at the end.
+	 * @param penState Pen after the command: 1 down, 0 up, -1 unknown.
+	 */
+	void onMove(
+		double seconds,
+		const std::array<int64_t, 2> & target,
+		int penState,
+		Clock::time_point now = Clock::now()) {
+		Segment s;
+		s.from = position;
+		s.steps = { { target[0] - position[0], target[1] - position[1] } };
+		push(s, seconds, penState, now);
+	}
+
+	/**
+	 * Record an LM move as the firmware runs it.
+	 * @param seconds  Expected run time; <= 0 works it out from the rates.
+	 */
+	void onLowLevelMove(
+		double seconds,
+		const std::array<int64_t, 2> & rate,
+		const std::array<int64_t, 2> & steps,
+		const std::array<int64_t, 2> & accel,
+		int penState,
+		Clock::time_point now = Clock::now()) {
+		Segment s;
+		s.from = position;
+		s.steps = steps;
+		s.rate = rate;
+		s.accel = accel;
+		s.flags = RAMP;
+		if (seconds <= 0.0) {
+			seconds = std::max(rampTicks(rate[0], steps[0], accel[0]), rampTicks(rate[1], steps[1], accel[1])) / ofxEbbTickHz;
+		}
+		push(s, seconds, penState, now);
+	}
+
+	/**
+	 * Fold in a position the board reported.
+	 * @param measured  QS reply.
+	 * @param at        When the board read it.
+	 */
+	void correct(
+		const std::array<int64_t, 2> & measured,
+		Clock::time_point at = Clock::now()) {
+		const int64_t atNs = toNs(at);
+		const int64_t lag = lagNs.load(std::memory_order_relaxed);
+		const std::array<int64_t, 2> target = {
+			{ measured[0] - offset[0].load(std::memory_order_relaxed),
+				measured[1] - offset[1].load(std::memory_order_relaxed) }
+		};
+		const uint64_t n = count.load(std::memory_order_relaxed);
+		if (n == 0) {
+			offset[0].store(measured[0] - position[0], std::memory_order_relaxed);
+			offset[1].store(measured[1] - position[1], std::memory_order_relaxed);
+			return;
+		}
+
+		// Closest point of the recent timeline, ties going to the time
+		// nearest to where the current lag puts the board
+		const int64_t expected = atNs - lag;
+		const int64_t oldest = atNs - static_cast<int64_t>(MAX_LAG_SECONDS * 1e9);
+		Match best;
+		for (uint64_t i = n; i-- > 0 && n - i <= std::min(CORRECTION_SEARCH, CAPACITY);) {
+			const Segment s = writerRead(i);
+			if (s.startNs + s.durationNs < oldest) {
+				break;
+			}
+			const int64_t step = std::max<int64_t>(1, s.durationNs / CORRECTION_SAMPLES);
+			int64_t bestT = -1;
+			for (int k = 0; k <= CORRECTION_SAMPLES; ++k) {
+				const int64_t t = s.startNs + std::min(s.durationNs, k * step);
+				if (consider(best, s, t, target, expected)) {
+					bestT = t;
+				}
+			}
+			// Refine around the best sample
+			if (bestT >= 0 && s.durationNs > CORRECTION_SAMPLES) {
+				const int64_t fine = std::max<int64_t>(1, 2 * step / CORRECTION_SAMPLES);
+				for (int64_t t = std::max(s.startNs, bestT - step); t <= std::min(s.startNs + s.durationNs, bestT + step); t += fine) {
+					consider(best, s, t, target, expected);
+				}
+			}
+		}
+		if (best.distance == std::numeric_limits<double>::max()) {
+			return;
+		}
+
+		if (best.timeNs < lastEndNs) {
+			// Still on its way: only the timing can be off
+			lagNs.store(atNs - best.timeNs, std::memory_order_relaxed);
+			return;
+		}
+		// At rest where the timeline ends (or finished early): any
+		// difference left is steps the host doesn't know about
+		offset[0].fetch_add(target[0] - best.position.steps[0], std::memory_order_relaxed);
+		offset[1].fetch_add(target[1] - best.position.steps[1], std::memory_order_relaxed);
+		lagNs.store(std::min<int64_t>(0, atNs - best.timeNs), std::memory_order_relaxed);
+	}
+
+	// Where the recorded commands leave the carriage, before correction
+	std::array<int64_t, 2> getPosition() const {
+		return position;
+	}
+
+	//-- Queries (any thread) ----------------------------------------
+
+	/**
+	 * Predicted position and pen state at `t` (by default now).
+	 */
+	ofxEbbPredictedPosition predict(
+		Clock::time_point t = Clock::now()) const {
+		const int64_t tNs = toNs(t) - lagNs.load(std::memory_order_relaxed);
+		ofxEbbPredictedPosition p;
+		const uint64_t n = count.load(std::memory_order_acquire);
+		Segment s;
+		Segment earliest;
+		bool any = false;
+		for (uint64_t i = n; i-- > 0 && n - i <= CAPACITY;) {
+			if (!read(i, s)) {
+				break;
+			}
+			if (s.startNs <= tNs) {
+				earliest = s;
+				any = true;
+				break;
+			}
+			// Before anything still in the ring, if nothing earlier turns up
+			earliest = s;
+			earliest.durationNs = 0;
+			earliest.steps = { { 0, 0 } };
+			any = true;
+		}
+		if (any) {
+			p = evaluate(earliest, tNs);
+		}
+		p.steps[0] += offset[0].load(std::memory_order_relaxed);
+		p.steps[1] += offset[1].load(std::memory_order_relaxed);
+		return p;
+	}
+
+	/**
+	 * How far the board was found to run behind the timeline.
+	 */
+	Clock::duration getLag() const {
+		return std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(lagNs.load(std::memory_order_relaxed)));
+	}
+
+	/**
+	 * Steps added to every prediction by correct().
+	 */
+	std::array<int64_t, 2> getCorrection() const {
+		return { { offset[0].load(std::memory_order_relaxed), offset[1].load(std::memory_order_relaxed) } };
+	}
+
+	// Ticks an LM axis takes to move `steps` from `rate` ramping by `accel`
+	static double rampTicks(
+		int64_t rate,
+		int64_t steps,
+		int64_t accel) {
+		return ofxEbbLmTicks(rate, steps, accel);
+	}
+
+private:
+	enum : int64_t {
+		RAMP = 1,
+		PEN_UP = 2,
+		PEN_DOWN = 4,
+	};
+
+	struct Segment {
+		int64_t startNs = 0;
+		int64_t durationNs = 0;
+		std::array<int64_t, 2> from { { 0, 0 } };
+		std::array<int64_t, 2> steps { { 0, 0 } };
+		std::array<int64_t, 2> rate { { 0, 0 } };
+		std::array<int64_t, 2> accel { { 0, 0 } };
+		int64_t flags = 0;
+	};
+
+	struct Slot {
+		std::atomic<uint64_t> seq { 0 };
+		std::atomic<int64_t> startNs { 0 };
+		std::atomic<int64_t> durationNs { 0 };
+		std::array<std::atomic<int64_t>, 2> from {};
+		std::array<std::atomic<int64_t>, 2> steps {};
+		std::array<std::atomic<int64_t>, 2> rate {};
+		std::array<std::atomic<int64_t>, 2> accel {};
+		std::atomic<int64_t> flags { 0 };
+	};
+
+	struct Match {
+		double distance = std::numeric_limits<double>::max();
+		int64_t skew = 0;
+		int64_t timeNs = 0;
+		ofxEbbPredictedPosition position;
+	};
+
+	static int64_t toNs(
+		Clock::time_point t) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+	}
+
+	void push(
+		Segment & s,
+		double seconds,
+		int penState,
+		Clock::time_point now) {
+		const int64_t nowNs = toNs(now);
+		if (nowNs > lastEndNs + lagNs.load(std::memory_order_relaxed)) {
+			// The board has run out of work; it starts this one as it arrives
+			lagNs.store(0, std::memory_order_relaxed);
+		}
+		s.startNs = std::max(nowNs, lastEndNs);
+		s.durationNs = static_cast<int64_t>(std::max(0.0, seconds) * 1e9);
+		pen = penState;
+		if (penState >= 0) {
+			s.flags |= penState ? PEN_DOWN : PEN_UP;
+		}
+		lastEndNs = s.startNs + s.durationNs;
+		position = { { s.from[0] + s.steps[0], s.from[1] + s.steps[1] } };
+
+		const uint64_t n = count.load(std::memory_order_relaxed);
+		Slot & slot = slots[n & (CAPACITY - 1)];
+		slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.startNs.store(s.startNs, std::memory_order_relaxed);
+		slot.durationNs.store(s.durationNs, std::memory_order_relaxed);
+		for (size_t i = 0; i < 2; ++i) {
+			slot.from[i].store(s.from[i], std::memory_order_relaxed);
+			slot.steps[i].store(s.steps[i], std::memory_order_relaxed);
+			slot.rate[i].store(s.rate[i], std::memory_order_relaxed);
+			slot.accel[i].store(s.accel[i], std::memory_order_relaxed);
+		}
+		slot.flags.store(s.flags, std::memory_order_relaxed);
+		slot.seq.store(2 * n + 2, std::memory_order_release);
+		count.store(n + 1, std::memory_order_release);
+	}
+
+	// Copy command `n` out of the ring; false if it has been overwritten
+	// or is being written
+	bool read(
+		uint64_t n,
+		Segment & s) const {
+		const Slot & slot = slots[n & (CAPACITY - 1)];
+		const uint64_t seq = 2 * n + 2;
+		if (slot.seq.load(std::memory_order_acquire) != seq) {
+			return false;
+		}
+		s.startNs = slot.startNs.load(std::memory_order_relaxed);
+		s.durationNs = slot.durationNs.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < 2; ++i) {
+			s.from[i] = slot.from[i].load(std::memory_order_relaxed);
+			s.steps[i] = slot.steps[i].load(std::memory_order_relaxed);
+			s.rate[i] = slot.rate[i].load(std::memory_order_relaxed);
+			s.accel[i] = slot.accel[i].load(std::memory_order_relaxed);
+		}
+		s.flags = slot.flags.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return slot.seq.load(std::memory_order_relaxed) == seq;
+	}
+
+	// The writer never races itself
+	Segment writerRead(
+		uint64_t n) const {
+		Segment s;
+		read(n, s);
+		return s;
+	}
+
+	static ofxEbbPredictedPosition evaluate(
+		const Segment & s,
+		int64_t tNs) {
+		ofxEbbPredictedPosition p;
+		p.penKnown = (s.flags & (PEN_UP | PEN_DOWN)) != 0;
+		p.penDown = (s.flags & PEN_DOWN) != 0;
+		const int64_t elapsed = std::max<int64_t>(0, tNs - s.startNs);
+		p.moving = elapsed < s.durationNs;
+		for (size_t i = 0; i < 2; ++i) {
+			const int64_t total = std::abs(s.steps[i]);
+			int64_t moved = total;
+			if (p.moving) {
+				if (s.flags & RAMP) {
+					const double k = std::floor(elapsed * 1e-9 * ofxEbbTickHz);
+					const double acc = k * s.rate[i] + s.accel[i] * k * (k - 1.0) * 0.5;
+					moved = static_cast<int64_t>(std::floor(std::max(0.0, acc) / ofxEbbRateOne));
+				} else {
+					moved = static_cast<int64_t>(static_cast<double>(total) * elapsed / s.durationNs);
+				}
+				moved = std::min(moved, total);
+			}
+			p.steps[i] = s.from[i] + (s.steps[i] < 0 ? -moved : moved);
+		}
+		return p;
+	}
+
+	// Keep (s, t) in `best` if it is closer to `target`
+	static bool consider(
+		Match & best,
+		const Segment & s,
+		int64_t t,
+		const std::array<int64_t, 2> & target,
+		int64_t expected) {
+		const ofxEbbPredictedPosition p = evaluate(s, t);
+		const double dx = static_cast<double>(p.steps[0] - target[0]);
+		const double dy = static_cast<double>(p.steps[1] - target[1]);
+		const double distance = dx * dx + dy * dy;
+		const int64_t skew = std::abs(t - expected);
+		if (distance < best.distance || (distance == best.distance && skew < best.skew)) {
+			best.distance = distance;
+			best.skew = skew;
+			best.timeNs = t;
+			best.position = p;
+			return true;
+		}
+		return false;
+	}
+
+	std::unique_ptr<Slot[]> slots;
+	std::atomic<uint64_t> count { 0 };
+	std::atomic<int64_t> lagNs { 0 };
+	std::array<std::atomic<int64_t>, 2> offset {};
+
+	// Writer only
+	std::array<int64_t, 2> position { { 0, 0 } };
+	int64_t lastEndNs = 0;
+	int pen = -1;
+};
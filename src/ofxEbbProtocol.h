@@ -0,0 +1,445 @@
+// ofxEbbProtocol.h
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * ofxEbbLineTokenizer: streaming splitter for EBB reply bytes.
+ * Bytes can be fed in any chunking; each complete line is handed to a
+ * callback in a single pass over the input. The firmware mixes "\r\n" and
+ * "\n\r" endings, so any run of CR/LF ends a line and empty lines are
+ * dropped. Lines live in a fixed buffer; anything past MAX_LINE is cut off.
+ */
+class ofxEbbLineTokenizer {
+public:
+	static constexpr size_t MAX_LINE = 256;
+
+	/**
+	 * Consume a chunk of received bytes.
+	 * @param data    Received bytes.
+	 * @param length  Number of bytes.
+	 * @param onLine  Called as onLine(std::string_view) for every completed
+	 *                line; the view is only valid during the call.
+	 */
+	template <typename F>
+	void feed(
+		const char * data,
+		size_t length,
+		F && onLine) {
+		for (size_t i = 0; i < length; ++i) {
+			const char ch = data[i];
+			if (ch == '\r' || ch == '\n') {
+				if (lineLength > 0) {
+					onLine(std::string_view(lineBuffer.data(), lineLength));
+					lineLength = 0;
+				}
+			} else if (lineLength < MAX_LINE) {
+				lineBuffer[lineLength++] = ch;
+			}
+		}
+	}
+
+	/**
+	 * Bytes of the line currently being received (no terminator seen yet).
+	 */
+	std::string_view partial() const {
+		return std::string_view(lineBuffer.data(), lineLength);
+	}
+
+	/**
+	 * Discard a partially received line.
+	 */
+	void reset() {
+		lineLength = 0;
+	}
+
+	// "OK" acknowledgement line
+	static bool isOk(
+		std::string_view line) {
+		return line.size() == 2 && line[0] == 'O' && line[1] == 'K';
+	}
+
+	// Firmware error line, e.g. "!8 Err: Unknown command 'XX:58'"
+	static bool isError(
+		std::string_view line) {
+		return !line.empty() && line[0] == '!';
+	}
+
+private:
+	std::array<char, MAX_LINE> lineBuffer {};
+	size_t lineLength = 0;
+};
+
+/**
+ * How a reply's data lines are turned into the string sendCommand() returns.
+ */
+enum class ofxEbbReplyFormat : uint8_t {
+	None, // No reply at all (the board resets)
+	Ok, // Bare "OK"
+	Line, // Single data line returned as-is
+	Flag, // "0" or "1"
+	Numbers, // Digits, ',' and '-' only
+	Digits, // Digits only
+	Text // Free text; empty becomes a default name
+};
+
+/**
+ * Reply layout of one EBB command: data lines, whether an "OK" follows,
+ * whether it may overtake queued motion, and how the data is formatted.
+ */
+struct ofxEbbReplySpec {
+	char op[3];
+	uint8_t dataLines;
+	bool expectOk;
+	bool priority;
+	ofxEbbReplyFormat format;
+};
+
+/**
+ * Reply specs for the EBB command set
+ * (see https://evil-mad.github.io/EggBot/ebb.html).
+ * Commands not listed are assumed to answer with a bare "OK".
+ */
+inline constexpr ofxEbbReplySpec ofxEbbReplySpecs[] = {
+	{ "A", 1, false, true, ofxEbbReplyFormat::Line },
+	{ "BL", 0, false, false, ofxEbbReplyFormat::None },
+	{ "ES", 1, true, true, ofxEbbReplyFormat::Numbers },
+	{ "I", 1, false, true, ofxEbbReplyFormat::Line },
+	{ "MR", 1, false, true, ofxEbbReplyFormat::Line },
+	{ "PI", 1, false, true, ofxEbbReplyFormat::Line },
+	{ "QB", 1, true, true, ofxEbbReplyFormat::Flag },
+	{ "QC", 1, true, true, ofxEbbReplyFormat::Numbers },
+	{ "QE", 1, true, true, ofxEbbReplyFormat::Line },
+	{ "QG", 1, false, true, ofxEbbReplyFormat::Line },
+	{ "QL", 1, true, true, ofxEbbReplyFormat::Digits },
+	{ "QM", 1, false, true, ofxEbbReplyFormat::Line },
+	{ "QN", 1, true, true, ofxEbbReplyFormat::Digits },
+	{ "QP", 1, true, true, ofxEbbReplyFormat::Flag },
+	{ "QR", 1, true, true, ofxEbbReplyFormat::Flag },
+	{ "QS", 1, true, true, ofxEbbReplyFormat::Numbers },
+	{ "QT", 1, true, true, ofxEbbReplyFormat::Text },
+	{ "RB", 0, false, false, ofxEbbReplyFormat::None },
+	{ "V", 1, false, true, ofxEbbReplyFormat::Line },
+};
+
+inline constexpr ofxEbbReplySpec ofxEbbDefaultReplySpec = { "", 0, true, false, ofxEbbReplyFormat::Ok };
+
+/**
+ * Opcode of a command line: its first one or two characters before the
+ * first comma, upper-cased and packed into 16 bits.
+ */
+constexpr uint16_t ofxEbbOpcode(
+	std::string_view cmd) {
+	auto upper = [](char c) {
+		return static_cast<uint16_t>(static_cast<unsigned char>((c >= 'a' && c <= 'z') ? c - 32 : c));
+	};
+	if (cmd.empty()) {
+		return 0;
+	}
+	uint16_t code = upper(cmd[0]) << 8;
+	if (cmd.size() > 1 && cmd[1] != ',') {
+		code |= upper(cmd[1]);
+	}
+	return code;
+}
+
+/**
+ * Look up the reply spec for a command line; no allocation.
+ */
+constexpr const ofxEbbReplySpec & ofxEbbFindReplySpec(
+	std::string_view cmd) {
+	const uint16_t code = ofxEbbOpcode(cmd);
+	for (const auto & spec : ofxEbbReplySpecs) {
+		if (code == ofxEbbOpcode(spec.op)) {
+			return spec;
+		}
+	}
+	return ofxEbbDefaultReplySpec;
+}
+
+static_assert(ofxEbbFindReplySpec("QM").format == ofxEbbReplyFormat::Line, "QM replies with one line");
+static_assert(ofxEbbFindReplySpec("sm,100,1,1").format == ofxEbbReplyFormat::Ok, "SM replies with OK");
+static_assert(ofxEbbFindReplySpec("QS").expectOk, "QS data is followed by OK");
+
+/**
+ * ofxEbbReplyReader: pulls numbers out of a reply line in place.
+ * Each next() skips to the next number and parses it with std::from_chars,
+ * so "A,00:0713,02:0241" or "-120,4500" read without copying, splitting or
+ * touching the heap. The reader only holds a view; the reply must outlive it.
+ */
+class ofxEbbReplyReader {
+public:
+	explicit ofxEbbReplyReader(
+		std::string_view reply)
+		: text(reply) { }
+
+	/**
+	 * Consume `prefix` (e.g. "MR") if the reply starts with it.
+	 * @returns False (and consumes nothing) otherwise.
+	 */
+	bool skipPrefix(
+		std::string_view prefix) {
+		if (text.substr(pos, prefix.size()) != prefix) {
+			return false;
+		}
+		pos += prefix.size();
+		return true;
+	}
+
+	/**
+	 * Parse the next number.
+	 * @returns False if there is none left or it doesn't fit in T.
+	 */
+	template <typename T>
+	bool next(
+		T & out) {
+		while (pos < text.size() && !startsNumber(pos)) {
+			++pos;
+		}
+		if (pos >= text.size()) {
+			return false;
+		}
+		auto result = std::from_chars(text.data() + pos, text.data() + text.size(), out);
+		if (result.ec != std::errc()) {
+			return false;
+		}
+		pos = static_cast<size_t>(result.ptr - text.data());
+		return true;
+	}
+
+	/**
+	 * Parse numbers into `out` until it is full or the reply runs out.
+	 * @returns Number of values read.
+	 */
+	template <typename T, size_t N>
+	size_t read(
+		std::array<T, N> & out) {
+		size_t count = 0;
+		while (count < N && next(out[count])) {
+			++count;
+		}
+		return count;
+	}
+
+	bool atEnd() const {
+		return pos >= text.size();
+	}
+
+private:
+	bool startsNumber(
+		size_t i) const {
+		const char c = text[i];
+		if (c >= '0' && c <= '9') {
+			return true;
+		}
+		return c == '-' && i + 1 < text.size() && text[i + 1] >= '0' && text[i + 1] <= '9';
+	}
+
+	std::string_view text;
+	size_t pos = 0;
+};
+
+/**
+ * True for commands that go through the firmware motion FIFO. The board
+ * holds back their reply, and parsing of everything behind them, until
+ * the FIFO has room. SE only goes there with its motion queue flag set
+ * ("SE,<state>,<power>,1").
+ */
+constexpr bool ofxEbbIsMotionCommand(
+	std::string_view cmd) {
+	switch (ofxEbbOpcode(cmd)) {
+	case ofxEbbOpcode("SE"): {
+		size_t commas = 0;
+		for (char c : cmd) {
+			commas += c == ',';
+		}
+		return commas == 3 && cmd.size() >= 2 && cmd.substr(cmd.size() - 2) == ",1";
+	}
+	case ofxEbbOpcode("SM"):
+	case ofxEbbOpcode("XM"):
+	case ofxEbbOpcode("LM"):
+	case ofxEbbOpcode("LT"):
+	case ofxEbbOpcode("HM"):
+	case ofxEbbOpcode("SP"):
+	case ofxEbbOpcode("TP"):
+	case ofxEbbOpcode("S2"):
+		return true;
+	default:
+		return false;
+	}
+}
+
+static_assert(ofxEbbIsMotionCommand("LM,1,2,3,4,5,6") && !ofxEbbIsMotionCommand("QM"), "LM is queued, QM is not");
+static_assert(ofxEbbIsMotionCommand("SE,1,512,1") && !ofxEbbIsMotionCommand("SE,1,512"), "SE is queued only when asked");
+
+// Motion timing: an LM/LT accumulator is advanced by `rate` every 40 us
+// ISR tick and steps when it passes 2^31; `accel` is added to `rate`
+// every tick
+inline constexpr double ofxEbbTickHz = 25000.0;
+inline constexpr double ofxEbbRateOne = 2147483648.0;
+
+/**
+ * Ticks an LM axis takes to move `steps` starting at `rate` and
+ * changing by `accel` every tick.
+ */
+inline double ofxEbbLmTicks(
+	int64_t rate,
+	int64_t steps,
+	int64_t accel) {
+	const double c = std::abs(static_cast<double>(steps)) * ofxEbbRateOne;
+	if (c == 0.0) {
+		return 0.0;
+	}
+	// rate * k + accel * k * (k - 1) / 2 = c
+	const double a = static_cast<double>(accel);
+	const double b = rate - a * 0.5;
+	if (a == 0.0) {
+		return rate > 0 ? std::ceil(c / rate) : 0.0;
+	}
+	const double disc = b * b + 2.0 * a * c;
+	if (disc < 0.0) {
+		// Decelerates to a stop first
+		return rate > 0 ? std::ceil(-rate / a) : 0.0;
+	}
+	return std::ceil((-b + std::sqrt(disc)) / a);
+}
+
+/**
+ * Fastest step rate (steps/s) an LM axis reaches: at its first or its
+ * last tick (see ofxEbbLmTicks()). 0 if it doesn't move.
+ */
+inline double ofxEbbLmPeakRate(
+	int64_t rate,
+	int64_t steps,
+	int64_t accel) {
+	const double ticks = ofxEbbLmTicks(rate, steps, accel);
+	if (ticks <= 0.0) {
+		return 0.0;
+	}
+	const double last = static_cast<double>(rate) + static_cast<double>(accel) * (ticks - 1.0);
+	return std::max(std::fabs(static_cast<double>(rate)), std::fabs(last)) * ofxEbbTickHz / ofxEbbRateOne;
+}
+
+/**
+ * Seconds a motion command keeps the FIFO busy, read from its own
+ * arguments: the SM/XM/SP/TP/S2 delay, the LM ramp or the LT interval
+ * count. 0 for commands outside the FIFO; -1 for HM, whose duration
+ * depends on where the motors are.
+ */
+inline double ofxEbbMotionSeconds(
+	std::string_view cmd) {
+	std::array<int64_t, 6> a {};
+	ofxEbbReplyReader args(cmd.substr(std::min<size_t>(2, cmd.size())));
+	const size_t n = args.read(a);
+	switch (ofxEbbOpcode(cmd)) {
+	case ofxEbbOpcode("SM"):
+	case ofxEbbOpcode("XM"):
+	case ofxEbbOpcode("TP"):
+		return n > 0 ? a[0] / 1000.0 : 0.0;
+	case ofxEbbOpcode("SP"):
+		return n > 1 ? a[1] / 1000.0 : 0.0;
+	case ofxEbbOpcode("S2"):
+		return n > 3 ? a[3] / 1000.0 : 0.0;
+	case ofxEbbOpcode("LM"):
+		return std::max(ofxEbbLmTicks(a[0], a[1], a[2]), ofxEbbLmTicks(a[3], a[4], a[5])) / ofxEbbTickHz;
+	case ofxEbbOpcode("LT"):
+		return n > 0 ? a[0] / ofxEbbTickHz : 0.0;
+	case ofxEbbOpcode("HM"):
+		return -1.0;
+	default:
+		return 0.0;
+	}
+}
+
+/**
+ * ofxEbbCommandBuffer: fixed-size builder for one command line.
+ * Integers are written with std::to_chars, so building e.g.
+ * "SM,1000,-200,300" touches no heap memory. Appends past CAPACITY set
+ * overflowed() instead of writing.
+ */
+class ofxEbbCommandBuffer {
+public:
+	static constexpr size_t CAPACITY = 192;
+
+	/**
+	 * Start a new command with the given opcode.
+	 */
+	ofxEbbCommandBuffer & op(
+		std::string_view opcode) {
+		length = 0;
+		overflow = false;
+		return text(opcode);
+	}
+
+	/**
+	 * Append ",<value>".
+	 */
+	template <typename T>
+	ofxEbbCommandBuffer & arg(
+		T value) {
+		put(',');
+		if (!overflow) {
+			auto result = std::to_chars(data.data() + length, data.data() + CAPACITY, value);
+			if (result.ec == std::errc()) {
+				length = static_cast<size_t>(result.ptr - data.data());
+			} else {
+				overflow = true;
+			}
+		}
+		return *this;
+	}
+
+	ofxEbbCommandBuffer & arg(
+		bool value) {
+		return arg(value ? 1 : 0);
+	}
+
+	ofxEbbCommandBuffer & arg(
+		char value) {
+		put(',');
+		put(value);
+		return *this;
+	}
+
+	/**
+	 * Append raw text (no separator).
+	 */
+	ofxEbbCommandBuffer & text(
+		std::string_view value) {
+		for (char c : value) {
+			put(c);
+		}
+		return *this;
+	}
+
+	/**
+	 * The command built so far, without CR.
+	 */
+	std::string_view view() const {
+		return std::string_view(data.data(), length);
+	}
+
+	bool overflowed() const {
+		return overflow;
+	}
+
+private:
+	void put(
+		char c) {
+		if (length < CAPACITY) {
+			data[length++] = c;
+		} else {
+			overflow = true;
+		}
+	}
+
+	std::array<char, CAPACITY> data {};
+	size_t length = 0;
+	bool overflow = false;
+};
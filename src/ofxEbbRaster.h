@@ -0,0 +1,119 @@
+// ofxEbbRaster.h
+#pragma once
+
+#include "ofxEbbPlanner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * An 8-bit greyscale image to engrave, borrowed from the caller (e.g.
+ * ofPixels::getData() of an OF_PIXELS_GRAY image).
+ */
+struct ofxEbbRasterImage {
+	const uint8_t * pixels = nullptr;
+	size_t width = 0;
+	size_t height = 0;
+	size_t stride = 0; // Bytes from one row to the next; 0 = width
+
+	const uint8_t * row(
+		size_t y) const {
+		return pixels + y * (stride ? stride : width);
+	}
+};
+
+/**
+ * How an image is laid out and burnt.
+ */
+struct ofxEbbRasterSettings {
+	ofxEbbPoint origin; // mm, left end of the first row
+	double pixelSize = 0.1; // mm per pixel along a row
+	double lineSpacing = 0.1; // mm between rows
+	double speed = 50.0; // mm/s while burning
+	double accel = 1000.0; // mm/s^2, in the overscan
+	double overscan = -1.0; // mm run past each end of a row; < 0 is just enough to reach speed
+	bool bidirectional = true; // Burn every other row right to left
+	double reverseOffset = 0.0; // mm added to x on right-to-left rows, to line them up with the others
+	bool invert = true; // Dark pixels burn (for black on white artwork)
+	int threshold = 0; // Intensities (0-255) at or below this are off
+	int minPower = 0; // SE power (0-1023) for the faintest intensity above threshold
+	int maxPower = 1023; // For full intensity
+	int powerLevels = 256; // Distinct powers; fewer merge more pixels into each span
+	bool nodePerRow = true; // NI after each row, to resume from
+};
+
+/**
+ * A run of pixels [begin, end) burnt at one SE power; 0 is off.
+ */
+struct ofxEbbRasterSpan {
+	size_t begin = 0;
+	size_t end = 0;
+	int power = 0;
+};
+
+/**
+ * ofxEbbRasterEncoder: turns image rows into constant-power spans, so a
+ * row costs one SE and one move per change of power instead of per pixel.
+ */
+class ofxEbbRasterEncoder {
+public:
+	static constexpr int MAX_POWER = 1023;
+
+	/**
+	 * SE power for a pixel value under `settings` (0 is off).
+	 */
+	static int power(
+		uint8_t value,
+		const ofxEbbRasterSettings & settings) {
+		const int intensity = settings.invert ? 255 - value : value;
+		if (intensity <= settings.threshold) {
+			return 0;
+		}
+		// Quantize first, so nearby greys share a power and merge
+		const int levels = std::clamp(settings.powerLevels, 2, 256);
+		const int level = static_cast<int>(std::lround(intensity * (levels - 1) / 255.0));
+		if (level == 0) {
+			return 0;
+		}
+		const int lo = std::clamp(settings.minPower, 0, MAX_POWER);
+		const int hi = std::clamp(settings.maxPower, lo, MAX_POWER);
+		return std::max(1, lo + static_cast<int>(std::lround((hi - lo) * static_cast<double>(level) / (levels - 1))));
+	}
+
+	/**
+	 * Run-length encode one row. Off pixels at either end are left out,
+	 * so an empty row gives no spans.
+	 */
+	static void encodeRow(
+		const uint8_t * row,
+		size_t width,
+		const ofxEbbRasterSettings & settings,
+		std::vector<ofxEbbRasterSpan> & out) {
+		out.clear();
+		for (size_t x = 0; x < width; ++x) {
+			const int p = power(row[x], settings);
+			if (!out.empty() && out.back().power == p && out.back().end == x) {
+				out.back().end = x + 1;
+			} else if (p > 0 || !out.empty()) {
+				out.push_back({ x, x + 1, p });
+			}
+		}
+		if (!out.empty() && out.back().power == 0) {
+			out.pop_back();
+		}
+	}
+
+	/**
+	 * Overscan that lets the carriage reach `speed` from rest at `accel`.
+	 */
+	static double overscanFor(
+		const ofxEbbRasterSettings & settings) {
+		if (settings.overscan >= 0.0) {
+			return settings.overscan;
+		}
+		return settings.accel > 0.0 ? settings.speed * settings.speed / (2.0 * settings.accel) : 0.0;
+	}
+};
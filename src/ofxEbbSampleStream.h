@@ -0,0 +1,234 @@
+// ofxEbbSampleStream.h
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+#include "ofxEbbProtocol.h"
+#include "ofxEbbSpscQueue.h"
+
+enum class ofxEbbSampleKind : uint8_t {
+	Digital, // "I" packets: ports A-E
+	Analog // "A" packets: enabled analog channels
+};
+
+/**
+ * One packet streamed by the T command.
+ */
+struct ofxEbbSample {
+	static constexpr int MAX_VALUES = 16;
+
+	std::chrono::steady_clock::time_point time; // When the host read it
+	uint32_t sequence = 0; // Counts every packet since the stream started
+	ofxEbbSampleKind kind = ofxEbbSampleKind::Digital;
+
+	// Digital: values[0..4] are ports A-E (0-255).
+	// Analog: values[channel] is 0-1023 for each channel in `present`.
+	std::array<uint16_t, MAX_VALUES> values {};
+	uint16_t present = 0;
+
+	bool has(
+		int index) const {
+		return index >= 0 && index < MAX_VALUES && (present >> index) & 1;
+	}
+};
+
+/**
+ * Packet counters of an ofxEbbSampleStream.
+ */
+struct ofxEbbSampleStats {
+	uint64_t received = 0; // Valid packets parsed
+	uint64_t overruns = 0; // Dropped because the ring was full
+	uint64_t malformed = 0; // Packet lines that didn't parse
+	uint64_t late = 0; // Arrived after the stream was stopped
+};
+
+/**
+ * ofxEbbSampleStream: parses T-command packets into timestamped samples.
+ * The thread reading the serial port is the producer: each packet is
+ * parsed in place and either handed to the callback (on that thread) or
+ * pushed into a preallocated lock-free ring that one consumer thread
+ * drains with pop(). Nothing is allocated per packet.
+ */
+class ofxEbbSampleStream {
+public:
+	using Callback = std::function<void(const ofxEbbSample &)>;
+
+	static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+	// True for lines shaped like a streamed packet ("I,..." or "A,...")
+	static bool isPacket(
+		std::string_view line) {
+		return line.size() > 2 && (line[0] == 'I' || line[0] == 'A') && line[1] == ',';
+	}
+
+	/**
+	 * Parse one packet line.
+	 * @returns False if it isn't a well-formed I or A packet.
+	 */
+	static bool parse(
+		std::string_view line,
+		ofxEbbSample & out) {
+		ofxEbbReplyReader reader(line);
+		out.present = 0;
+		if (reader.skipPrefix("I")) {
+			out.kind = ofxEbbSampleKind::Digital;
+			int port = 0;
+			uint16_t value;
+			while (reader.next(value)) {
+				if (port >= 5) {
+					return false;
+				}
+				out.values[port] = value;
+				out.present |= static_cast<uint16_t>(1u << port);
+				++port;
+			}
+			return port > 0;
+		}
+		if (reader.skipPrefix("A")) {
+			out.kind = ofxEbbSampleKind::Analog;
+			int channel;
+			uint16_t value;
+			while (reader.next(channel)) {
+				if (!reader.next(value) || channel < 0 || channel >= ofxEbbSample::MAX_VALUES) {
+					return false;
+				}
+				out.values[channel] = value;
+				out.present |= static_cast<uint16_t>(1u << channel);
+			}
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Ring size used by the next start() that has to create the ring.
+	 */
+	void setCapacity(
+		size_t capacity) {
+		requestedCapacity = capacity;
+	}
+
+	size_t capacity() const {
+		return ring ? ring->capacity() : 0;
+	}
+
+	/**
+	 * Set the callback before starting; while one is set, samples go to it
+	 * instead of the ring.
+	 */
+	void setCallback(
+		Callback cb) {
+		callback = std::move(cb);
+	}
+
+	/**
+	 * Begin accepting packets of one kind. Must not race with the producer
+	 * when the ring is (re)created, so the owner only resizes while nothing
+	 * is reading the port in the background.
+	 * @param resize  May the ring be reallocated to the requested capacity?
+	 */
+	void start(
+		ofxEbbSampleKind kind,
+		bool resize) {
+		if (!ring || (resize && ring->capacity() < requestedCapacity)) {
+			ring.reset(new ofxEbbSpscQueue<ofxEbbSample>(requestedCapacity));
+		}
+		streamKind = kind;
+		sequence = 0;
+		received.store(0, std::memory_order_relaxed);
+		overruns.store(0, std::memory_order_relaxed);
+		malformed.store(0, std::memory_order_relaxed);
+		late.store(0, std::memory_order_relaxed);
+		active.store(true, std::memory_order_release);
+	}
+
+	void stop() {
+		active.store(false, std::memory_order_release);
+	}
+
+	bool isActive() const {
+		return active.load(std::memory_order_acquire);
+	}
+
+	ofxEbbSampleKind kind() const {
+		return streamKind;
+	}
+
+	/**
+	 * True once a stream has been started; its packets (including ones
+	 * still in transit after stop()) belong here from then on.
+	 */
+	bool claims(
+		std::string_view line) const {
+		return ring && isPacket(line);
+	}
+
+	/**
+	 * Producer side: handle one packet line read from the port.
+	 */
+	void onLine(
+		std::string_view line,
+		std::chrono::steady_clock::time_point now) {
+		if (!isActive()) {
+			late.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		if (!parse(line, scratch) || scratch.kind != streamKind) {
+			malformed.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		scratch.time = now;
+		scratch.sequence = sequence++;
+		received.fetch_add(1, std::memory_order_relaxed);
+		if (callback) {
+			callback(scratch);
+		} else if (!ring->push(scratch)) {
+			overruns.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * Consumer side: take the oldest buffered sample.
+	 * @returns False if none is waiting.
+	 */
+	bool pop(
+		ofxEbbSample & out) {
+		return ring && ring->pop(out);
+	}
+
+	size_t available() const {
+		return ring ? ring->size() : 0;
+	}
+
+	ofxEbbSampleStats getStats() const {
+		ofxEbbSampleStats stats;
+		stats.received = received.load(std::memory_order_relaxed);
+		stats.overruns = overruns.load(std::memory_order_relaxed);
+		stats.malformed = malformed.load(std::memory_order_relaxed);
+		stats.late = late.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+private:
+	std::unique_ptr<ofxEbbSpscQueue<ofxEbbSample>> ring;
+	size_t requestedCapacity = DEFAULT_CAPACITY;
+	Callback callback;
+	ofxEbbSampleKind streamKind = ofxEbbSampleKind::Digital;
+	std::atomic<bool> active { false };
+
+	// Producer-only state
+	ofxEbbSample scratch;
+	uint32_t sequence = 0;
+
+	std::atomic<uint64_t> received { 0 };
+	std::atomic<uint64_t> overruns { 0 };
+	std::atomic<uint64_t> malformed { 0 };
+	std::atomic<uint64_t> late { 0 };
+};
@@ -0,0 +1,121 @@
+// ofxEbbSerialTransport.h
+#pragma once
+
+#include "ofSerial.h"
+#include "ofxEbbTransport.h"
+
+#include <algorithm>
+#include <thread>
+
+#ifndef TARGET_WIN32
+#include <poll.h>
+#endif
+
+/**
+ * ofxEbbSerialTransport: the default transport, built on ofSerial.
+ * Reads block on the port descriptor (poll() on POSIX) instead of polling
+ * available().
+ */
+class ofxEbbSerialTransport : public ofxEbbTransport {
+public:
+	bool open(
+		const std::string & port,
+		int baud) override {
+		return serial.setup(port, baud);
+	}
+
+	void close() override {
+		if (serial.isInitialized()) {
+			serial.close();
+		}
+	}
+
+	bool isOpen() const override {
+		return serial.isInitialized();
+	}
+
+	bool write(
+		const ofxEbbTransportBuffer * buffers,
+		size_t count) override {
+		for (size_t i = 0; i < count; ++i) {
+			const auto * bytes = reinterpret_cast<const unsigned char *>(buffers[i].data);
+			if (serial.writeBytes(bytes, buffers[i].size) != static_cast<long>(buffers[i].size)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	size_t read(
+		uint8_t * buffer,
+		size_t capacity,
+		Clock::time_point deadline) override {
+		if (!serial.isInitialized()) {
+			return 0;
+		}
+		int available = serial.available();
+		if (available <= 0) {
+			if (!waitReadable(deadline)) {
+				return 0;
+			}
+			available = serial.available();
+			if (available <= 0) {
+				return 0;
+			}
+		}
+		long n = serial.readBytes(buffer, std::min<size_t>(available, capacity));
+		return n > 0 ? static_cast<size_t>(n) : 0;
+	}
+
+	std::vector<std::string> listDevices() override {
+		std::vector<std::string> devices;
+		for (auto & device : serial.getDeviceList()) {
+			devices.push_back(device.getDevicePath());
+		}
+		return devices;
+	}
+
+private:
+	// ofSerial with access to the underlying descriptor
+	class Port : public ofSerial {
+	public:
+#ifndef TARGET_WIN32
+		int getDescriptor() const {
+			return bInited ? fd : -1;
+		}
+#endif
+	};
+
+	bool waitReadable(
+		Clock::time_point deadline) {
+		auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+		if (remaining <= 0) {
+			return false;
+		}
+#ifdef TARGET_WIN32
+		// ofSerial opens the port without overlapped I/O, so there is no
+		// waitable event; back off briefly instead
+		std::this_thread::sleep_for(std::chrono::microseconds(500));
+		return serial.available() > 0;
+#else
+		int fd = serial.getDescriptor();
+		if (fd < 0) {
+			return false;
+		}
+		pollfd pfd {};
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		if (::poll(&pfd, 1, static_cast<int>(remaining)) <= 0) {
+			return false;
+		}
+		if ((pfd.revents & POLLIN) == 0) {
+			// Hang-up or error: don't spin on a dead descriptor
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			return false;
+		}
+		return true;
+#endif
+	}
+
+	Port serial;
+};
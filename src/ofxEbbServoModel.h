@@ -0,0 +1,171 @@
+// ofxEbbServoModel.h
+#pragma once
+
+#include "ofxEbbDeviceState.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+/**
+ * ofxEbbServoModel: predicts when the pen servo gets where it was sent,
+ * from the SC values cached in ofxEbbDeviceState so SP and S2 can wait
+ * exactly as long as the servo travels instead of a fixed delay.
+ *
+ * The firmware moves the servo pulse `rate` units (83.3 ns each, the same
+ * units as the positions) once per RC cycle, which takes 3 ms for each of
+ * the SC,8 channels: 24 ms with the default 8. A rate of 0 jumps straight
+ * to the target. Between commands the position is interpolated from the
+ * last move, so a pen raised halfway through lowering is timed from where
+ * it actually is.
+ */
+class ofxEbbServoModel {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr int SC_UP_POSITION = 4; // servo_min
+	static constexpr int SC_DOWN_POSITION = 5; // servo_max
+	static constexpr int SC_CHANNELS = 8;
+	static constexpr int SC_RATE = 10; // sets both rates
+	static constexpr int SC_RATE_UP = 11;
+	static constexpr int SC_RATE_DOWN = 12;
+	static constexpr int DEFAULT_CHANNELS = 8;
+	static constexpr double CHANNEL_SECONDS = 0.003;
+
+	/**
+	 * True if the up and down positions and the rate towards `down` are
+	 * known, which is what timing a pen move needs.
+	 */
+	static bool knows(
+		const ofxEbbDeviceState & state,
+		bool down) {
+		return state.servoConfig[SC_UP_POSITION].known
+			&& state.servoConfig[SC_DOWN_POSITION].known
+			&& state.servoConfig[down ? SC_RATE_DOWN : SC_RATE_UP].known;
+	}
+
+	static int penPosition(
+		const ofxEbbDeviceState & state,
+		bool down) {
+		return state.servoConfig[down ? SC_DOWN_POSITION : SC_UP_POSITION].value;
+	}
+
+	static int penRate(
+		const ofxEbbDeviceState & state,
+		bool down) {
+		return state.servoConfig[down ? SC_RATE_DOWN : SC_RATE_UP].value;
+	}
+
+	// One RC cycle, the interval between servo steps
+	static double cycleSeconds(
+		const ofxEbbDeviceState & state) {
+		const auto & channels = state.servoConfig[SC_CHANNELS];
+		return CHANNEL_SECONDS * (channels.known ? channels.value : DEFAULT_CHANNELS);
+	}
+
+	// Seconds to move `distance` units at `rate` units per cycle
+	static double travelSeconds(
+		const ofxEbbDeviceState & state,
+		double distance,
+		int rate) {
+		if (rate <= 0 || distance <= 0.0) {
+			return 0.0;
+		}
+		return std::ceil(distance / rate) * cycleSeconds(state);
+	}
+
+	/**
+	 * Seconds from `start` until the pen is fully up or down. From an
+	 * unknown position the full swing between the two is assumed.
+	 * Requires knows(state, down).
+	 */
+	double penTravel(
+		const ofxEbbDeviceState & state,
+		bool down,
+		Clock::time_point start) const {
+		const int target = penPosition(state, down);
+		const double from = positionKnown ? positionAt(start) : penPosition(state, !down);
+		return travelSeconds(state, std::abs(target - from), penRate(state, down));
+	}
+
+	/**
+	 * Seconds from `start` until an S2 move to `target` at `rate` arrives,
+	 * or -1 if the current position isn't known.
+	 */
+	double travel(
+		const ofxEbbDeviceState & state,
+		int target,
+		int rate,
+		Clock::time_point start) const {
+		if (!positionKnown) {
+			return -1.0;
+		}
+		return travelSeconds(state, std::abs(target - positionAt(start)), rate);
+	}
+
+	/**
+	 * Record a move to `target` at `rate` that the board starts at `start`.
+	 */
+	void onMove(
+		const ofxEbbDeviceState & state,
+		int target,
+		int rate,
+		Clock::time_point start) {
+		moveFrom = positionKnown ? positionAt(start) : target;
+		moveTo = target;
+		moveRate = rate;
+		moveStart = start;
+		cycle = cycleSeconds(state);
+		positionKnown = true;
+	}
+
+	void onPenMove(
+		const ofxEbbDeviceState & state,
+		bool down,
+		Clock::time_point start) {
+		if (!knows(state, down)) {
+			invalidate();
+			return;
+		}
+		if (!positionKnown) {
+			// Time the first move as the full swing penTravel() assumed
+			positionKnown = true;
+			moveFrom = moveTo = penPosition(state, !down);
+			moveStart = start;
+			moveRate = 0;
+		}
+		onMove(state, penPosition(state, down), penRate(state, down), start);
+	}
+
+	// Forget where the servo is, e.g. after it was moved behind our back
+	void invalidate() {
+		positionKnown = false;
+	}
+
+	bool isPositionKnown() const {
+		return positionKnown;
+	}
+
+	// Modelled servo position at `t`
+	double positionAt(
+		Clock::time_point t) const {
+		if (moveRate <= 0) {
+			return moveTo;
+		}
+		if (t <= moveStart) {
+			return moveFrom;
+		}
+		const double elapsed = std::floor(std::chrono::duration<double>(t - moveStart).count() / cycle);
+		const double moved = std::min(std::abs(moveTo - moveFrom), elapsed * moveRate);
+		return moveFrom + (moveTo > moveFrom ? moved : -moved);
+	}
+
+private:
+	bool positionKnown = false;
+	double moveFrom = 0.0;
+	double moveTo = 0.0;
+	int moveRate = 0;
+	double cycle = CHANNEL_SECONDS * DEFAULT_CHANNELS;
+	Clock::time_point moveStart;
+};
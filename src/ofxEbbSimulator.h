@@ -0,0 +1,661 @@
+// ofxEbbSimulator.h
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "ofxEbbProtocol.h"
+#include "ofxEbbTransport.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Behaviour of an ofxEbbSimulatedBoard.
+ */
+struct ofxEbbSimulatorSettings {
+	std::chrono::microseconds latency { 1000 }; // From a command's arrival until its reply goes out
+	int fifoDepth = 1; // Motion commands queued behind the executing one
+	double motionTimeScale = 1.0; // Applied to motion durations; 0 completes every move at once
+	std::string firmware = "EBBv13_and_above EB Firmware Version 2.8.1";
+	std::string nickname;
+};
+
+/**
+ * ofxEbbSimulatedBoard: the EBB command parser and motion FIFO, without
+ * hardware. Bytes from the host go in through receive(), reply bytes come
+ * out of transmit() once they are due; time is always passed in, so the
+ * model is deterministic and needs no thread of its own.
+ *
+ * Replies follow the firmware formats: bare "OK", data followed by "OK"
+ * (QS, QP, QN, ...), single lines without OK (V banner, QG hex, "QM,..."),
+ * no reply for BL/RB, and "!8 Err: ..." for unknown commands. Like the
+ * firmware, parsing stops while a motion command waits for a FIFO slot, so
+ * everything behind it waits too.
+ */
+class ofxEbbSimulatedBoard {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit ofxEbbSimulatedBoard(
+		ofxEbbSimulatorSettings settings = {})
+		: config(std::move(settings)) {
+		nickname = config.nickname;
+	}
+
+	const ofxEbbSimulatorSettings & getSettings() const {
+		return config;
+	}
+
+	/**
+	 * Bytes written by the host.
+	 */
+	void receive(
+		const char * data,
+		size_t length,
+		Clock::time_point now) {
+		input.append(data, length);
+		advance(now);
+	}
+
+	/**
+	 * Append every reply byte that is due at `now` to `out`.
+	 * @returns Number of bytes appended.
+	 */
+	size_t transmit(
+		std::string & out,
+		Clock::time_point now) {
+		advance(now);
+		const size_t before = out.size();
+		while (!replies.empty() && replies.front().due <= now) {
+			out += replies.front().text;
+			replies.pop_front();
+		}
+		return out.size() - before;
+	}
+
+	/**
+	 * When transmit() or advance() next has something to do.
+	 */
+	Clock::time_point nextEvent() const {
+		Clock::time_point next = Clock::time_point::max();
+		if (!replies.empty()) {
+			next = std::min(next, replies.front().due);
+		}
+		if (!fifo.empty()) {
+			next = std::min(next, fifo.front().end);
+		}
+		if (samplePeriod.count() > 0) {
+			next = std::min(next, nextSample);
+		}
+		return next;
+	}
+
+	/**
+	 * Retire finished motion and parse input that was waiting for a slot.
+	 */
+	void advance(
+		Clock::time_point now) {
+		retire(now);
+		emitSamples(now);
+
+		size_t start = 0;
+		while (true) {
+			const size_t end = input.find_first_of("\r\n", start);
+			if (end == std::string::npos) {
+				break;
+			}
+			std::string_view command(input.data() + start, end - start);
+			if (!command.empty()) {
+				if (isFifoCommand(command) && fifoFull()) {
+					break;
+				}
+				execute(command, now);
+			}
+			start = end + 1;
+		}
+		input.erase(0, start);
+	}
+
+	uint64_t getCommandCount() const {
+		return commands;
+	}
+
+	std::array<int64_t, 2> getPosition() const {
+		return position;
+	}
+
+	bool isPenDown() const {
+		return penDown;
+	}
+
+	/**
+	 * A command as it enters the motion FIFO, with when it will run.
+	 */
+	struct MotionEvent {
+		std::string_view command;
+		uint64_t index; // getCommandCount() of the command
+		Clock::time_point parsed;
+		Clock::time_point start;
+		Clock::time_point end;
+		std::array<int64_t, 2> steps;
+		bool moves; // Steppers run (not just a pen or servo delay)
+	};
+
+	/**
+	 * Called for every command that enters the motion FIFO.
+	 */
+	void setMotionListener(
+		std::function<void(const MotionEvent &)> listener) {
+		motionListener = std::move(listener);
+	}
+
+private:
+	struct Reply {
+		Clock::time_point due;
+		std::string text;
+	};
+
+	struct Motion {
+		Clock::time_point start;
+		Clock::time_point end;
+		std::array<int64_t, 2> steps;
+		bool moves; // Steppers run (not just a pen or servo delay)
+	};
+
+	static bool isFifoCommand(
+		std::string_view command) {
+		return ofxEbbIsMotionCommand(command);
+	}
+
+	bool fifoFull() const {
+		return fifo.size() >= static_cast<size_t>(config.fifoDepth) + 1;
+	}
+
+	void retire(
+		Clock::time_point now) {
+		while (!fifo.empty() && fifo.front().end <= now) {
+			position[0] += fifo.front().steps[0];
+			position[1] += fifo.front().steps[1];
+			fifo.pop_front();
+		}
+	}
+
+	void reply(
+		std::string text,
+		Clock::time_point now) {
+		Clock::time_point due = now + config.latency;
+		if (!replies.empty()) {
+			due = std::max(due, replies.back().due);
+		}
+		replies.push_back({ due, std::move(text) });
+	}
+
+	void queueMotion(
+		double seconds,
+		std::array<int64_t, 2> steps,
+		bool moves,
+		Clock::time_point now) {
+		const Clock::time_point start = fifo.empty() ? now : std::max(now, fifo.back().end);
+		const auto duration = std::chrono::duration<double>(std::max(0.0, seconds) * config.motionTimeScale);
+		fifo.push_back({ start, start + std::chrono::duration_cast<Clock::duration>(duration), steps, moves });
+		if (motionListener) {
+			motionListener({ executing, commands, now, start, fifo.back().end, steps, moves });
+		}
+	}
+
+	template <size_t N>
+	static size_t readArgs(
+		std::string_view command,
+		std::array<int64_t, N> & args) {
+		ofxEbbReplyReader reader(command.substr(std::min<size_t>(2, command.size())));
+		return reader.read(args);
+	}
+
+	void execute(
+		std::string_view command,
+		Clock::time_point now) {
+		++commands;
+		executing = command;
+		std::array<int64_t, 8> a {};
+		const size_t n = readArgs(command, a);
+
+		switch (ofxEbbOpcode(command)) {
+		case ofxEbbOpcode("V"):
+			reply(config.firmware + "\r\n", now);
+			return;
+		case ofxEbbOpcode("QG"): {
+			int status = penDown ? 0x10 : 0;
+			if (!fifo.empty()) {
+				status |= 0x08;
+				if (fifo.front().moves) {
+					status |= (fifo.front().steps[0] != 0 ? 0x04 : 0) | (fifo.front().steps[1] != 0 ? 0x02 : 0);
+				}
+			}
+			if (fifo.size() > 1) {
+				status |= 0x01;
+			}
+			char hex[8];
+			std::snprintf(hex, sizeof(hex), "%02X\r\n", status);
+			reply(hex, now);
+			return;
+		}
+		case ofxEbbOpcode("QM"): {
+			const bool executing = !fifo.empty();
+			const bool m1 = executing && fifo.front().moves && fifo.front().steps[0] != 0;
+			const bool m2 = executing && fifo.front().moves && fifo.front().steps[1] != 0;
+			reply(std::string("QM,") + (executing ? "1" : "0") + "," + (m1 ? "1" : "0") + "," + (m2 ? "1" : "0") + "," + (fifo.size() > 1 ? "1" : "0") + "\n\r", now);
+			return;
+		}
+		case ofxEbbOpcode("QS"): {
+			const auto live = currentPosition(now);
+			reply(std::to_string(live[0]) + "," + std::to_string(live[1]) + "\n\rOK\r\n", now);
+			return;
+		}
+		case ofxEbbOpcode("QP"):
+			reply(std::string(penDown ? "0" : "1") + "\r\nOK\r\n", now);
+			return;
+		case ofxEbbOpcode("QN"):
+			reply(std::to_string(nodeCount) + "\r\nOK\r\n", now);
+			return;
+		case ofxEbbOpcode("QL"):
+			reply(std::to_string(layer) + "\r\nOK\r\n", now);
+			return;
+		case ofxEbbOpcode("QT"):
+			reply(nickname + "\r\nOK\r\n", now);
+			return;
+		case ofxEbbOpcode("QE"): {
+			static constexpr int divisors[] = { 0, 16, 8, 4, 2, 1 };
+			reply("QE," + std::to_string(divisors[motorModes[0]]) + "," + std::to_string(divisors[motorModes[1]]) + "\r\nOK\r\n", now);
+			return;
+		}
+		case ofxEbbOpcode("QB"):
+		case ofxEbbOpcode("QR"):
+			reply(std::string(ofxEbbOpcode(command) == ofxEbbOpcode("QR") ? "1" : "0") + "\r\nOK\r\n", now);
+			return;
+		case ofxEbbOpcode("QC"):
+			reply("0394,0300\r\nOK\r\n", now);
+			return;
+		case ofxEbbOpcode("A"):
+			reply(analogPacket(), now);
+			return;
+		case ofxEbbOpcode("I"):
+			reply("I,000,000,000,000,000\r\n", now);
+			return;
+		case ofxEbbOpcode("PI"):
+			reply("PI,0\r\n", now);
+			return;
+		case ofxEbbOpcode("MR"):
+			reply("MR,0\r\n", now);
+			return;
+		case ofxEbbOpcode("BL"):
+		case ofxEbbOpcode("RB"):
+			return;
+
+		case ofxEbbOpcode("SM"):
+			queueMotion(a[0] / 1000.0, { a[1], n > 2 ? a[2] : 0 }, true, now);
+			break;
+		case ofxEbbOpcode("XM"):
+			queueMotion(a[0] / 1000.0, { a[1] + a[2], a[1] - a[2] }, true, now);
+			break;
+		case ofxEbbOpcode("LM"): {
+			const double ticks = std::max(ofxEbbLmTicks(a[0], a[1], a[2]), ofxEbbLmTicks(a[3], a[4], a[5]));
+			queueMotion(ticks / ofxEbbTickHz, { a[1], a[4] }, true, now);
+			break;
+		}
+		case ofxEbbOpcode("LT"): {
+			const double ticks = static_cast<double>(a[0]);
+			auto covered = [&](int64_t rate, int64_t accel) {
+				return static_cast<int64_t>((rate * ticks + accel * ticks * ticks / 2.0) / ofxEbbRateOne);
+			};
+			queueMotion(ticks / ofxEbbTickHz, { covered(a[1], a[2]), covered(a[3], a[4]) }, true, now);
+			break;
+		}
+		case ofxEbbOpcode("HM"): {
+			const std::array<int64_t, 2> target = { n > 1 ? a[1] : 0, n > 2 ? a[2] : 0 };
+			const std::array<int64_t, 2> steps = { target[0] - pendingPosition(0), target[1] - pendingPosition(1) };
+			const double distance = static_cast<double>(std::max(std::llabs(steps[0]), std::llabs(steps[1])));
+			queueMotion(a[0] > 0 ? distance / a[0] : 0.0, steps, true, now);
+			break;
+		}
+		case ofxEbbOpcode("SP"):
+			penDown = a[0] == 0;
+			queueMotion(n > 1 ? a[1] / 1000.0 : 0.0, { 0, 0 }, false, now);
+			break;
+		case ofxEbbOpcode("TP"):
+			penDown = !penDown;
+			queueMotion(n > 0 ? a[0] / 1000.0 : 0.0, { 0, 0 }, false, now);
+			break;
+		case ofxEbbOpcode("S2"):
+			queueMotion(n > 3 ? a[3] / 1000.0 : 0.0, { 0, 0 }, false, now);
+			break;
+		case ofxEbbOpcode("ES"): {
+			const bool interrupted = !fifo.empty();
+			fifo.clear();
+			if (n > 0 && a[0] == 1) {
+				motorModes = { 0, 0 };
+			}
+			reply(std::string(interrupted ? "1" : "0") + ",0,0,0,0\r\nOK\r\n", now);
+			return;
+		}
+		case ofxEbbOpcode("EM"):
+			motorModes = { static_cast<int>(std::clamp<int64_t>(a[0], 0, 5)), static_cast<int>(std::clamp<int64_t>(n > 1 ? a[1] : 0, 0, 5)) };
+			break;
+		case ofxEbbOpcode("CS"):
+			position = { 0, 0 };
+			break;
+		case ofxEbbOpcode("SN"):
+			nodeCount = static_cast<uint32_t>(a[0]);
+			break;
+		case ofxEbbOpcode("NI"):
+			++nodeCount;
+			break;
+		case ofxEbbOpcode("ND"):
+			if (nodeCount > 0) {
+				--nodeCount;
+			}
+			break;
+		case ofxEbbOpcode("SL"):
+			layer = static_cast<int>(a[0]);
+			break;
+		case ofxEbbOpcode("ST"):
+			nickname = std::string(command.substr(std::min<size_t>(3, command.size())));
+			break;
+		case ofxEbbOpcode("T"):
+			samplePeriod = std::chrono::milliseconds(a[0]);
+			sampleAnalog = n > 1 && a[1] == 1;
+			nextSample = now + config.latency + samplePeriod;
+			break;
+		case ofxEbbOpcode("C"):
+		case ofxEbbOpcode("CU"):
+		case ofxEbbOpcode("MW"):
+		case ofxEbbOpcode("PC"):
+		case ofxEbbOpcode("PD"):
+		case ofxEbbOpcode("PO"):
+		case ofxEbbOpcode("R"):
+		case ofxEbbOpcode("SE"):
+			if (isFifoCommand(command)) {
+				queueMotion(0.0, { 0, 0 }, false, now);
+			}
+			break;
+		case ofxEbbOpcode("SC"):
+		case ofxEbbOpcode("SR"):
+			break;
+		default:
+			reply("!8 Err: Unknown command '" + std::string(command.substr(0, 2)) + "'\r\n", now);
+			return;
+		}
+		reply("OK\r\n", now);
+	}
+
+	// Position part-way through the executing move, interpolated linearly
+	std::array<int64_t, 2> currentPosition(
+		Clock::time_point now) const {
+		std::array<int64_t, 2> p = position;
+		if (!fifo.empty() && now > fifo.front().start && fifo.front().end > fifo.front().start) {
+			const auto & m = fifo.front();
+			const double f = std::min(1.0, std::chrono::duration<double>(now - m.start) / (m.end - m.start));
+			p[0] += static_cast<int64_t>(m.steps[0] * f);
+			p[1] += static_cast<int64_t>(m.steps[1] * f);
+		}
+		return p;
+	}
+
+	// Position once everything queued has run
+	int64_t pendingPosition(
+		int axis) const {
+		int64_t p = position[axis];
+		for (const auto & m : fifo) {
+			p += m.steps[axis];
+		}
+		return p;
+	}
+
+	std::string analogPacket() const {
+		return "A,00:0512,02:0256\r\n";
+	}
+
+	void emitSamples(
+		Clock::time_point now) {
+		if (samplePeriod.count() <= 0) {
+			return;
+		}
+		while (nextSample <= now) {
+			replies.push_back({ nextSample, sampleAnalog ? analogPacket() : "I,000,000,000,000,000\r\n" });
+			nextSample += samplePeriod;
+		}
+	}
+
+	ofxEbbSimulatorSettings config;
+	std::string input;
+	std::deque<Reply> replies;
+	std::deque<Motion> fifo;
+	uint64_t commands = 0;
+
+	std::array<int64_t, 2> position { 0, 0 };
+	std::array<int, 2> motorModes { 1, 1 };
+	bool penDown = false;
+	uint32_t nodeCount = 0;
+	int layer = 0;
+	std::string nickname;
+
+	std::chrono::milliseconds samplePeriod { 0 };
+	bool sampleAnalog = false;
+	Clock::time_point nextSample;
+
+	std::string_view executing; // Command being parsed, for the listener
+	std::function<void(const MotionEvent &)> motionListener;
+};
+
+/**
+ * ofxEbbSimulatorTransport: plugs an ofxEbbSimulatedBoard straight into
+ * ofxEbbControl::setTransport(), in process and on every platform. The
+ * board advances whenever it is read, on whichever thread does the I/O.
+ */
+class ofxEbbSimulatorTransport : public ofxEbbTransport {
+public:
+	explicit ofxEbbSimulatorTransport(
+		ofxEbbSimulatorSettings settings = {})
+		: board(std::move(settings)) { }
+
+	bool open(
+		const std::string &,
+		int) override {
+		opened = true;
+		return true;
+	}
+
+	void close() override {
+		opened = false;
+	}
+
+	bool isOpen() const override {
+		return opened;
+	}
+
+	bool write(
+		const ofxEbbTransportBuffer * buffers,
+		size_t count) override {
+		if (!opened) {
+			return false;
+		}
+		const auto now = Clock::now();
+		for (size_t i = 0; i < count; ++i) {
+			board.receive(buffers[i].data, buffers[i].size, now);
+		}
+		return true;
+	}
+
+	size_t read(
+		uint8_t * buffer,
+		size_t capacity,
+		Clock::time_point deadline) override {
+		if (!opened) {
+			return 0;
+		}
+		while (pendingOffset >= pending.size()) {
+			pending.clear();
+			pendingOffset = 0;
+			auto now = Clock::now();
+			if (board.transmit(pending, now) > 0) {
+				break;
+			}
+			const auto next = std::min(deadline, board.nextEvent());
+			if (next <= now) {
+				if (deadline <= now) {
+					return 0;
+				}
+				continue;
+			}
+			std::this_thread::sleep_until(next);
+		}
+		const size_t n = std::min(capacity, pending.size() - pendingOffset);
+		std::copy_n(pending.data() + pendingOffset, n, buffer);
+		pendingOffset += n;
+		return n;
+	}
+
+	ofxEbbSimulatedBoard & getBoard() {
+		return board;
+	}
+
+private:
+	ofxEbbSimulatedBoard board;
+	std::string pending;
+	size_t pendingOffset = 0;
+	bool opened = false;
+};
+
+#if !defined(_WIN32)
+
+/**
+ * ofxEbbSimulator: runs an ofxEbbSimulatedBoard behind a pseudo-terminal,
+ * so ofxEbbControl can open getPortName() like a real serial port
+ * (POSIX only).
+ */
+class ofxEbbSimulator {
+public:
+	explicit ofxEbbSimulator(
+		ofxEbbSimulatorSettings settings = {})
+		: board(std::move(settings)) { }
+
+	ofxEbbSimulator(const ofxEbbSimulator &) = delete;
+	ofxEbbSimulator & operator=(const ofxEbbSimulator &) = delete;
+
+	~ofxEbbSimulator() {
+		stop();
+	}
+
+	/**
+	 * Create the pseudo-terminal and start answering.
+	 * @returns False if no pseudo-terminal could be opened.
+	 */
+	bool start() {
+		if (running) {
+			return true;
+		}
+		master = posix_openpt(O_RDWR | O_NOCTTY);
+		if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+			stop();
+			return false;
+		}
+		const char * name = ptsname(master);
+		if (!name) {
+			stop();
+			return false;
+		}
+		portName = name;
+		fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+		running = true;
+		worker = std::thread(&ofxEbbSimulator::run, this);
+		return true;
+	}
+
+	void stop() {
+		running = false;
+		if (worker.joinable()) {
+			worker.join();
+		}
+		if (master >= 0) {
+			::close(master);
+			master = -1;
+		}
+	}
+
+	/**
+	 * Device path to pass to ofxEbbControl::setup().
+	 */
+	const std::string & getPortName() const {
+		return portName;
+	}
+
+	/**
+	 * Commands the board has parsed so far.
+	 */
+	uint64_t getCommandCount() const {
+		return commandCount.load(std::memory_order_relaxed);
+	}
+
+private:
+	void run() {
+		using Clock = ofxEbbSimulatedBoard::Clock;
+		std::array<char, 4096> buffer;
+		std::string out;
+		while (running) {
+			// poll() only has millisecond resolution: sleep in it while the
+			// next event is at least that far off, spin for the rest so
+			// sub-millisecond latencies hold
+			const auto wait = board.nextEvent() - Clock::now();
+			if (wait >= std::chrono::milliseconds(1)) {
+				const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(wait).count();
+				pollfd pfd { master, POLLIN, 0 };
+				if (poll(&pfd, 1, static_cast<int>(std::min<int64_t>(ms, 5))) > 0 && (pfd.revents & (POLLHUP | POLLERR))) {
+					// Nobody has the port open; don't spin
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			}
+
+			ssize_t n;
+			while ((n = ::read(master, buffer.data(), buffer.size())) > 0) {
+				board.receive(buffer.data(), static_cast<size_t>(n), Clock::now());
+			}
+
+			out.clear();
+			board.transmit(out, Clock::now());
+			size_t written = 0;
+			while (written < out.size() && running) {
+				n = ::write(master, out.data() + written, out.size() - written);
+				if (n > 0) {
+					written += static_cast<size_t>(n);
+				} else {
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+				}
+			}
+			commandCount.store(board.getCommandCount(), std::memory_order_relaxed);
+		}
+	}
+
+	ofxEbbSimulatedBoard board;
+	int master = -1;
+	std::string portName;
+	std::atomic<bool> running { false };
+	std::atomic<uint64_t> commandCount { 0 };
+	std::thread worker;
+};
+
+#endif
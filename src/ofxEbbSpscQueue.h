@@ -0,0 +1,94 @@
+// ofxEbbSpscQueue.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * ofxEbbSpscQueue: bounded lock-free single-producer/single-consumer ring.
+ * Exactly one thread may call push() and exactly one other thread may call
+ * pop(); no locks are taken and no memory is allocated after construction.
+ * Capacity is rounded up to a power of two.
+ */
+template <typename T>
+class ofxEbbSpscQueue {
+public:
+	/**
+	 * @param capacity  Minimum number of elements the ring can hold.
+	 */
+	explicit ofxEbbSpscQueue(
+		size_t capacity = 256) {
+		size_t size = 2;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		slots.reset(new T[size]);
+		mask = size - 1;
+	}
+
+	ofxEbbSpscQueue(const ofxEbbSpscQueue &) = delete;
+	ofxEbbSpscQueue & operator=(const ofxEbbSpscQueue &) = delete;
+
+	/**
+	 * Producer side: append an element.
+	 * @returns False (and leaves `value` untouched) if the ring is full.
+	 */
+	bool push(
+		T && value) {
+		const size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) > mask) {
+			return false;
+		}
+		slots[t & mask] = std::move(value);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool push(
+		const T & value) {
+		T copy = value;
+		return push(std::move(copy));
+	}
+
+	/**
+	 * Consumer side: remove the oldest element.
+	 * @returns False if the ring is empty.
+	 */
+	bool pop(
+		T & out) {
+		const size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		out = std::move(slots[h & mask]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Approximate fill level; exact only when called from the consumer
+	 * or producer while the other side is idle.
+	 */
+	size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	bool empty() const {
+		return size() == 0;
+	}
+
+	size_t capacity() const {
+		return mask + 1;
+	}
+
+private:
+	std::unique_ptr<T[]> slots;
+	size_t mask = 0;
+
+	// Head and tail on separate cache lines so producer and consumer
+	// don't false-share
+	alignas(64) std::atomic<size_t> head { 0 };
+	alignas(64) std::atomic<size_t> tail { 0 };
+};
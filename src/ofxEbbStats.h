@@ -0,0 +1,411 @@
+// ofxEbbStats.h
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Copy of a latency histogram in microseconds. Buckets are log-spaced with
+ * four per power of two (each at most 25% wide): 0-3 us get one bucket
+ * each, then [4,5) [5,6) [6,7) [7,8) [8,10) ... The last bucket also
+ * takes everything past ~16 s.
+ */
+struct ofxEbbHistogramSnapshot {
+	static constexpr size_t SUB_BUCKETS = 4;
+	static constexpr size_t BUCKETS = 92;
+
+	std::array<uint64_t, BUCKETS> buckets {};
+	uint64_t count = 0;
+	uint64_t sumMicros = 0;
+	uint64_t maxMicros = 0;
+
+	static constexpr size_t bucketOf(
+		uint64_t us) {
+		if (us < SUB_BUCKETS) {
+			return static_cast<size_t>(us);
+		}
+		size_t octave = 0; // floor(log2(us)) - 2
+		for (uint64_t v = us >> 3; v > 0; v >>= 1) {
+			++octave;
+		}
+		const size_t i = SUB_BUCKETS + octave * SUB_BUCKETS + ((us >> octave) & (SUB_BUCKETS - 1));
+		return std::min(i, BUCKETS - 1);
+	}
+
+	static constexpr uint64_t bucketLow(
+		size_t i) {
+		if (i < SUB_BUCKETS) {
+			return i;
+		}
+		const size_t octave = (i - SUB_BUCKETS) / SUB_BUCKETS;
+		return (SUB_BUCKETS + (i - SUB_BUCKETS) % SUB_BUCKETS) << octave;
+	}
+
+	static constexpr uint64_t bucketHigh(
+		size_t i) {
+		return bucketLow(i + 1);
+	}
+
+	double meanMicros() const {
+		return count ? static_cast<double>(sumMicros) / count : 0.0;
+	}
+
+	/**
+	 * Estimate a percentile from the buckets (middle of the bucket it
+	 * falls in; never more than maxMicros).
+	 * @param p  0-1.
+	 */
+	double percentileMicros(
+		double p) const {
+		if (count == 0) {
+			return 0.0;
+		}
+		const uint64_t rank = static_cast<uint64_t>(p * (count - 1)) + 1;
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BUCKETS; ++i) {
+			seen += buckets[i];
+			if (seen >= rank) {
+				const double mid = 0.5 * (bucketLow(i) + bucketHigh(i));
+				return std::min(mid, static_cast<double>(maxMicros));
+			}
+		}
+		return static_cast<double>(maxMicros);
+	}
+};
+
+static_assert(ofxEbbHistogramSnapshot::bucketOf(7) == 7 && ofxEbbHistogramSnapshot::bucketOf(8) == 8, "1 us buckets below 8 us");
+static_assert(ofxEbbHistogramSnapshot::bucketLow(ofxEbbHistogramSnapshot::bucketOf(300)) == 256, "300 us falls in [256, 320)");
+
+/**
+ * Counters for one opcode.
+ */
+struct ofxEbbOpcodeStats {
+	char op[3] = {}; // Empty for opcodes that didn't fit the table
+	uint64_t sent = 0;
+	uint64_t errors = 0; // Firmware error replies
+	uint64_t timeouts = 0;
+};
+
+/**
+ * Snapshot returned by ofxEbbControl::getStats().
+ */
+struct ofxEbbStats {
+	std::chrono::steady_clock::duration elapsed {}; // Since construction or resetStats()
+
+	uint64_t commandsSent = 0;
+	uint64_t bytesOut = 0;
+	uint64_t bytesIn = 0;
+	uint64_t errors = 0;
+	uint64_t timeouts = 0;
+	uint64_t lateReplies = 0; // Replies absorbed after their command timed out
+	uint64_t unsolicitedLines = 0; // Lines no command was waiting for
+	uint64_t flowResyncs = 0; // QG queries made because the FIFO model ran out
+	uint64_t linkResyncs = 0; // Recoveries from a timed-out reply (ofxEbbControl::resync())
+	uint64_t retries = 0; // Queries sent again after a resync
+	std::chrono::microseconds flowWait {}; // Time motion spent waiting for FIFO room
+
+	// Command written -> first byte of its reply. In a pipeline this
+	// includes waiting for the board to answer the commands ahead of it.
+	ofxEbbHistogramSnapshot writeToFirstByte;
+	// First byte -> reply complete (OK, error or last data line)
+	ofxEbbHistogramSnapshot firstByteToDone;
+
+	std::vector<ofxEbbOpcodeStats> opcodes; // Opcodes seen, in no particular order
+
+	/**
+	 * Counters for one opcode, or null if it was never sent.
+	 */
+	const ofxEbbOpcodeStats * find(
+		std::string_view op) const {
+		for (const auto & s : opcodes) {
+			if (op == s.op) {
+				return &s;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Multi-line summary for logs or an on-screen overlay.
+	 */
+	std::string format() const {
+		std::string out;
+		char line[160];
+		const double seconds = std::chrono::duration<double>(elapsed).count();
+		std::snprintf(line, sizeof(line), "%llu cmds in %.1fs, %llu B out, %llu B in, %llu errors, %llu timeouts, %llu late\n",
+			ull(commandsSent), seconds, ull(bytesOut), ull(bytesIn), ull(errors), ull(timeouts), ull(lateReplies));
+		out += line;
+		std::snprintf(line, sizeof(line), "flow control: %.1fms waiting, %llu resyncs\n",
+			flowWait.count() / 1000.0, ull(flowResyncs));
+		out += line;
+		if (linkResyncs || retries) {
+			std::snprintf(line, sizeof(line), "recovery: %llu link resyncs, %llu queries retried\n",
+				ull(linkResyncs), ull(retries));
+			out += line;
+		}
+		auto histogram = [&](const char * name, const ofxEbbHistogramSnapshot & h) {
+			std::snprintf(line, sizeof(line), "%s: mean %.0fus p50 %.0fus p99 %.0fus max %lluus\n",
+				name, h.meanMicros(), h.percentileMicros(0.5), h.percentileMicros(0.99), ull(h.maxMicros));
+			out += line;
+		};
+		histogram("write->first byte", writeToFirstByte);
+		histogram("first byte->done", firstByteToDone);
+		for (const auto & s : opcodes) {
+			std::snprintf(line, sizeof(line), "  %-2s %10llu sent %6llu err %6llu tmo\n",
+				s.op[0] ? s.op : "?", ull(s.sent), ull(s.errors), ull(s.timeouts));
+			out += line;
+		}
+		return out;
+	}
+
+private:
+	static unsigned long long ull(
+		uint64_t v) {
+		return static_cast<unsigned long long>(v);
+	}
+};
+
+/**
+ * ofxEbbStatsCollector: the live counters behind ofxEbbStats.
+ * Updated by whichever thread owns the port, read by any other (e.g. the
+ * draw thread) through snapshot() or reset(). Every counter is a relaxed
+ * atomic, so recording costs a few uncontended increments and never locks
+ * or allocates; a snapshot taken mid-update may be one event apart between
+ * counters.
+ */
+class ofxEbbStatsCollector {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// Distinct opcodes tracked individually; the rest share one slot
+	static constexpr size_t OPCODE_SLOTS = 48;
+
+	ofxEbbStatsCollector() {
+		reset();
+	}
+
+	void onSent(
+		uint16_t opcode,
+		size_t bytes) {
+		add(commandsSent);
+		add(bytesOut, bytes);
+		add(slot(opcode).sent);
+	}
+
+	void onReceived(
+		size_t bytes) {
+		add(bytesIn, bytes);
+	}
+
+	void onError(
+		uint16_t opcode) {
+		add(errors);
+		add(slot(opcode).errors);
+	}
+
+	void onTimeout(
+		uint16_t opcode) {
+		add(timeouts);
+		add(slot(opcode).timeouts);
+	}
+
+	void onLateReply() {
+		add(lateReplies);
+	}
+
+	void onUnsolicited() {
+		add(unsolicitedLines);
+	}
+
+	void onFlowResync() {
+		add(flowResyncs);
+	}
+
+	void onLinkResync() {
+		add(linkResyncs);
+	}
+
+	void onRetry() {
+		add(retries);
+	}
+
+	void onFlowWait(
+		Clock::duration waited) {
+		add(flowWaitMicros, micros(waited));
+	}
+
+	/**
+	 * Record the timing of one completed reply.
+	 */
+	void onReply(
+		Clock::time_point written,
+		Clock::time_point firstByte,
+		Clock::time_point done) {
+		writeToFirstByte.record(micros(firstByte - written));
+		firstByteToDone.record(micros(done - firstByte));
+	}
+
+	/**
+	 * Zero every counter. Opcode slots stay assigned.
+	 */
+	void reset() {
+		for (auto * counter : { &commandsSent, &bytesOut, &bytesIn, &errors, &timeouts,
+				 &lateReplies, &unsolicitedLines, &flowResyncs, &linkResyncs, &retries, &flowWaitMicros }) {
+			counter->store(0, std::memory_order_relaxed);
+		}
+		writeToFirstByte.reset();
+		firstByteToDone.reset();
+		for (auto & s : slots) {
+			s.sent.store(0, std::memory_order_relaxed);
+			s.errors.store(0, std::memory_order_relaxed);
+			s.timeouts.store(0, std::memory_order_relaxed);
+		}
+		since.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+	}
+
+	ofxEbbStats snapshot() const {
+		ofxEbbStats out;
+		out.elapsed = Clock::now().time_since_epoch() - Clock::duration(since.load(std::memory_order_relaxed));
+		out.commandsSent = load(commandsSent);
+		out.bytesOut = load(bytesOut);
+		out.bytesIn = load(bytesIn);
+		out.errors = load(errors);
+		out.timeouts = load(timeouts);
+		out.lateReplies = load(lateReplies);
+		out.unsolicitedLines = load(unsolicitedLines);
+		out.flowResyncs = load(flowResyncs);
+		out.linkResyncs = load(linkResyncs);
+		out.retries = load(retries);
+		out.flowWait = std::chrono::microseconds(load(flowWaitMicros));
+		writeToFirstByte.copyTo(out.writeToFirstByte);
+		firstByteToDone.copyTo(out.firstByteToDone);
+
+		for (size_t i = 0; i <= OPCODE_SLOTS; ++i) {
+			const Slot & s = slots[i];
+			const uint16_t code = s.code.load(std::memory_order_acquire);
+			if (i < OPCODE_SLOTS && code == 0) {
+				continue;
+			}
+			ofxEbbOpcodeStats op;
+			op.op[0] = static_cast<char>(code >> 8);
+			op.op[1] = static_cast<char>(code & 0xff);
+			op.sent = load(s.sent);
+			op.errors = load(s.errors);
+			op.timeouts = load(s.timeouts);
+			if (op.sent || op.errors || op.timeouts) {
+				out.opcodes.push_back(op);
+			}
+		}
+		return out;
+	}
+
+private:
+	using Counter = std::atomic<uint64_t>;
+
+	class Histogram {
+	public:
+		void record(
+			uint64_t us) {
+			add(buckets[ofxEbbHistogramSnapshot::bucketOf(us)]);
+			add(count);
+			add(sum, us);
+			if (us > max.load(std::memory_order_relaxed)) {
+				max.store(us, std::memory_order_relaxed);
+			}
+		}
+
+		void reset() {
+			for (auto & b : buckets) {
+				b.store(0, std::memory_order_relaxed);
+			}
+			count.store(0, std::memory_order_relaxed);
+			sum.store(0, std::memory_order_relaxed);
+			max.store(0, std::memory_order_relaxed);
+		}
+
+		void copyTo(
+			ofxEbbHistogramSnapshot & out) const {
+			for (size_t i = 0; i < buckets.size(); ++i) {
+				out.buckets[i] = load(buckets[i]);
+			}
+			out.count = load(count);
+			out.sumMicros = load(sum);
+			out.maxMicros = load(max);
+		}
+
+	private:
+		std::array<Counter, ofxEbbHistogramSnapshot::BUCKETS> buckets;
+		Counter count;
+		Counter sum;
+		Counter max;
+	};
+
+	struct Slot {
+		std::atomic<uint16_t> code { 0 };
+		Counter sent { 0 };
+		Counter errors { 0 };
+		Counter timeouts { 0 };
+	};
+
+	// Only the writing thread claims slots, so a plain linear probe
+	// is enough; the release store publishes the code to snapshot()
+	Slot & slot(
+		uint16_t opcode) {
+		if (opcode == 0) {
+			return slots[OPCODE_SLOTS];
+		}
+		size_t i = opcode % OPCODE_SLOTS;
+		for (size_t probe = 0; probe < OPCODE_SLOTS; ++probe, i = (i + 1) % OPCODE_SLOTS) {
+			const uint16_t code = slots[i].code.load(std::memory_order_relaxed);
+			if (code == opcode) {
+				return slots[i];
+			}
+			if (code == 0) {
+				slots[i].code.store(opcode, std::memory_order_release);
+				return slots[i];
+			}
+		}
+		return slots[OPCODE_SLOTS];
+	}
+
+	static void add(
+		Counter & counter,
+		uint64_t n = 1) {
+		counter.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	static uint64_t load(
+		const Counter & counter) {
+		return counter.load(std::memory_order_relaxed);
+	}
+
+	static uint64_t micros(
+		Clock::duration d) {
+		const auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+		return us > 0 ? static_cast<uint64_t>(us) : 0;
+	}
+
+	Counter commandsSent;
+	Counter bytesOut;
+	Counter bytesIn;
+	Counter errors;
+	Counter timeouts;
+	Counter lateReplies;
+	Counter unsolicitedLines;
+	Counter flowResyncs;
+	Counter linkResyncs;
+	Counter retries;
+	Counter flowWaitMicros;
+	Histogram writeToFirstByte;
+	Histogram firstByteToDone;
+	std::array<Slot, OPCODE_SLOTS + 1> slots; // Last one: everything else
+	std::atomic<Clock::rep> since { 0 };
+};
@@ -0,0 +1,195 @@
+// ofxEbbTermiosTransport.h
+#pragma once
+
+#include "ofxEbbTransport.h"
+
+#if !defined(_WIN32)
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <unistd.h>
+
+/**
+ * ofxEbbTermiosTransport: talks to the port descriptor directly (POSIX).
+ * Raw mode with VMIN = 0 / VTIME = 0 so read() never blocks in the driver,
+ * poll() for deadlines, and writev() so a command and its CR go out in a
+ * single system call.
+ */
+class ofxEbbTermiosTransport : public ofxEbbTransport {
+public:
+	~ofxEbbTermiosTransport() override {
+		close();
+	}
+
+	bool open(
+		const std::string & port,
+		int baud) override {
+		close();
+		fd = ::open(port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+		if (fd < 0) {
+			return false;
+		}
+
+		termios options {};
+		if (tcgetattr(fd, &options) == 0) {
+			saved = options;
+			restore = true;
+			cfmakeraw(&options);
+			options.c_cflag |= CLOCAL | CREAD;
+			options.c_cc[VMIN] = 0;
+			options.c_cc[VTIME] = 0;
+			// USB CDC ignores the line speed, but real UARTs (and some
+			// drivers) still want a valid one
+			const speed_t speed = toSpeed(baud);
+			cfsetispeed(&options, speed);
+			cfsetospeed(&options, speed);
+			tcsetattr(fd, TCSANOW, &options);
+			tcflush(fd, TCIOFLUSH);
+		}
+		return true;
+	}
+
+	void close() override {
+		if (fd < 0) {
+			return;
+		}
+		if (restore) {
+			tcsetattr(fd, TCSANOW, &saved);
+			restore = false;
+		}
+		::close(fd);
+		fd = -1;
+	}
+
+	bool isOpen() const override {
+		return fd >= 0;
+	}
+
+	bool write(
+		const ofxEbbTransportBuffer * buffers,
+		size_t count) override {
+		static constexpr size_t MAX_BUFFERS = 8;
+		if (fd < 0) {
+			return false;
+		}
+
+		std::array<iovec, MAX_BUFFERS> iov;
+		size_t pending = 0;
+		for (size_t i = 0; i < count; i += MAX_BUFFERS) {
+			const size_t n = std::min(MAX_BUFFERS, count - i);
+			for (size_t j = 0; j < n; ++j) {
+				iov[j].iov_base = const_cast<char *>(buffers[i + j].data);
+				iov[j].iov_len = buffers[i + j].size;
+				pending += buffers[i + j].size;
+			}
+
+			size_t first = 0;
+			while (first < n) {
+				ssize_t written = ::writev(fd, iov.data() + first, static_cast<int>(n - first));
+				if (written < 0) {
+					if (errno == EAGAIN || errno == EINTR) {
+						waitWritable();
+						continue;
+					}
+					return false;
+				}
+				pending -= static_cast<size_t>(written);
+				// Skip what went out; resume mid-buffer after a short write
+				while (first < n && static_cast<size_t>(written) >= iov[first].iov_len) {
+					written -= static_cast<ssize_t>(iov[first].iov_len);
+					++first;
+				}
+				if (first < n) {
+					iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + written;
+					iov[first].iov_len -= static_cast<size_t>(written);
+				}
+			}
+		}
+		return pending == 0;
+	}
+
+	size_t read(
+		uint8_t * buffer,
+		size_t capacity,
+		Clock::time_point deadline) override {
+		if (fd < 0) {
+			return 0;
+		}
+		while (true) {
+			ssize_t n = ::read(fd, buffer, capacity);
+			if (n > 0) {
+				return static_cast<size_t>(n);
+			}
+			if (n < 0 && errno != EAGAIN && errno != EINTR) {
+				return 0;
+			}
+
+			auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+			if (remaining <= 0) {
+				return 0;
+			}
+			pollfd pfd { fd, POLLIN, 0 };
+			if (::poll(&pfd, 1, static_cast<int>(remaining)) <= 0) {
+				return 0;
+			}
+			if ((pfd.revents & POLLIN) == 0) {
+				// Hang-up or error: nothing will arrive
+				return 0;
+			}
+		}
+	}
+
+	/**
+	 * Serial devices under /dev that look like USB CDC ports.
+	 */
+	std::vector<std::string> listDevices() override {
+		std::vector<std::string> devices;
+		DIR * dir = opendir("/dev");
+		if (!dir) {
+			return devices;
+		}
+		static constexpr std::string_view prefixes[] = { "ttyACM", "ttyUSB", "cu.usbmodem", "tty.usbmodem" };
+		while (dirent * entry = readdir(dir)) {
+			std::string_view name(entry->d_name);
+			for (auto prefix : prefixes) {
+				if (name.substr(0, prefix.size()) == prefix) {
+					devices.push_back("/dev/" + std::string(name));
+					break;
+				}
+			}
+		}
+		closedir(dir);
+		std::sort(devices.begin(), devices.end());
+		return devices;
+	}
+
+private:
+	void waitWritable() {
+		pollfd pfd { fd, POLLOUT, 0 };
+		::poll(&pfd, 1, 10);
+	}
+
+	static speed_t toSpeed(
+		int baud) {
+		switch (baud) {
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 230400: return B230400;
+		default: return B115200;
+		}
+	}
+
+	int fd = -1;
+	termios saved {};
+	bool restore = false;
+};
+
+#endif
@@ -0,0 +1,502 @@
+// ofxEbbToolpathStream.h
+#pragma once
+
+#include "ofxEbbPathBatcher.h"
+#include "ofxEbbPathSource.h"
+#include "ofxEbbPlanner.h"
+#include "ofxEbbProtocol.h"
+#include "ofxEbbSpscQueue.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed-size batch of work passed between toolpath stream stages.
+ */
+template <typename T>
+struct ofxEbbStreamChunk {
+	static constexpr size_t CAPACITY = 256;
+
+	std::array<T, CAPACITY> items;
+	size_t count = 0;
+	bool startsStroke = false; // items[0] is the first point of a stroke
+	bool endsStroke = false; // The stroke finishes with this chunk
+	bool last = false; // Nothing follows
+
+	bool full() const {
+		return count == CAPACITY;
+	}
+};
+
+/**
+ * One planned step of a streamed toolpath: an LM move or a pen change.
+ */
+struct ofxEbbStreamMotion {
+	ofxEbbLowLevelMove move;
+	bool isPen = false;
+	bool penDown = false;
+};
+
+/**
+ * One formatted command, ready to write.
+ */
+struct ofxEbbStreamCommand {
+	static constexpr size_t MAX_LENGTH = 96;
+
+	std::array<char, MAX_LENGTH> text;
+	uint8_t length = 0;
+	double seconds = 0.0; // Motion time
+	std::array<int64_t, 2> steps { { 0, 0 } };
+	int8_t pen = -1; // 0 = up, 1 = down, -1 = not a pen command
+
+	std::string_view view() const {
+		return std::string_view(text.data(), length);
+	}
+};
+
+/**
+ * How ofxEbbToolpathStream turns points into commands.
+ */
+struct ofxEbbToolpathSettings {
+	double stepsPerMm = 80.0;
+	ofxEbbKinematics kinematics = ofxEbbKinematics::Direct;
+	ofxEbbMotionLimits drawLimits;
+	ofxEbbMotionLimits travelLimits { 200.0, 2000.0, 2.0, 0.1 };
+	bool pathBatching = true;
+	double batchTolerance = 0.0; // Motor steps, see ofxEbbPathBatcher
+	int penUpMs = -1; // SP delay; -1 leaves it to the firmware
+	int penDownMs = -1;
+	size_t queueChunks = 8; // Chunks buffered between two stages
+};
+
+/**
+ * What a toolpath stream has done so far.
+ */
+struct ofxEbbToolpathStreamStats {
+	uint64_t points = 0;
+	uint64_t strokes = 0;
+	uint64_t moves = 0;
+	uint64_t commands = 0;
+	double seconds = 0.0; // Motion time of the commands produced
+};
+
+/**
+ * ofxEbbToolpathStream: turns a drawing of any size into EBB commands
+ * with memory that doesn't grow with it. Three worker threads each handle
+ * one stage, passing fixed-size chunks through bounded queues:
+ *   ingest: pull points from the source, snap and merge them (batcher)
+ *   plan:   pen up, travel, pen down, then plan each stroke incrementally
+ *   format: write each move or pen change as a command line
+ * The consumer takes the commands with poll(). A full queue holds the
+ * stage before it back, so the drawing is read only as fast as it is sent,
+ * and the first commands are ready as soon as the first chunk is planned.
+ * Batching merges runs only within a chunk; a run crossing a chunk
+ * boundary becomes two moves.
+ */
+class ofxEbbToolpathStream {
+public:
+	using StrokeChunk = ofxEbbStreamChunk<ofxEbbPoint>;
+	using MotionChunk = ofxEbbStreamChunk<ofxEbbStreamMotion>;
+	using CommandChunk = ofxEbbStreamChunk<ofxEbbStreamCommand>;
+
+	static constexpr int PEN_DOWN = 0;
+	static constexpr int PEN_UP = 1;
+
+	enum class PollResult {
+		Ready, // A command was returned
+		Pending, // The next command isn't ready yet
+		Done, // Every command has been returned
+		Failed // A stage failed; see getError()
+	};
+
+	/**
+	 * @param source      Read on the ingest thread until it is exhausted;
+	 *                    it must outlive the stream.
+	 * @param settings    Planning and formatting parameters.
+	 * @param startSteps  Motor position the first travel move starts from.
+	 */
+	ofxEbbToolpathStream(
+		ofxEbbPathSource & source,
+		const ofxEbbToolpathSettings & settings,
+		const std::array<int64_t, 2> & startSteps = { { 0, 0 } })
+		: source(source)
+		, settings(settings)
+		, startSteps(startSteps)
+		, strokes(settings.queueChunks)
+		, motions(settings.queueChunks)
+		, commands(settings.queueChunks) { }
+
+	ofxEbbToolpathStream(const ofxEbbToolpathStream &) = delete;
+	ofxEbbToolpathStream & operator=(const ofxEbbToolpathStream &) = delete;
+
+	~ofxEbbToolpathStream() {
+		cancel();
+	}
+
+	/**
+	 * Start the stage threads.
+	 */
+	void start() {
+		if (started) {
+			return;
+		}
+		started = true;
+		ingestThread = std::thread(&ofxEbbToolpathStream::ingestLoop, this);
+		planThread = std::thread(&ofxEbbToolpathStream::planLoop, this);
+		formatThread = std::thread(&ofxEbbToolpathStream::formatLoop, this);
+	}
+
+	/**
+	 * Stop the stages and wait for them; poll() reports Failed afterwards
+	 * unless the stream had already finished.
+	 */
+	void cancel() {
+		cancelled = true;
+		for (auto * t : { &ingestThread, &planThread, &formatThread }) {
+			if (t->joinable()) {
+				t->join();
+			}
+		}
+	}
+
+	/**
+	 * Consumer side: take the next command. Call from one thread only.
+	 */
+	PollResult poll(
+		ofxEbbStreamCommand & out) {
+		while (true) {
+			if (current < chunk.count) {
+				out = chunk.items[current++];
+				return PollResult::Ready;
+			}
+			if (chunk.last) {
+				return PollResult::Done;
+			}
+			if (failed) {
+				return PollResult::Failed;
+			}
+			if (!commands.pop(chunk)) {
+				return cancelled ? PollResult::Failed : PollResult::Pending;
+			}
+			current = 0;
+		}
+	}
+
+	/**
+	 * Why the stream failed, if it did.
+	 */
+	std::string getError() const {
+		std::lock_guard<std::mutex> lock(errorMutex);
+		return error;
+	}
+
+	/**
+	 * Progress counters; updated as the stages run.
+	 */
+	ofxEbbToolpathStreamStats getStats() const {
+		ofxEbbToolpathStreamStats s;
+		s.points = points.load(std::memory_order_relaxed);
+		s.strokes = strokeCount.load(std::memory_order_relaxed);
+		s.moves = moves.load(std::memory_order_relaxed);
+		s.commands = commandCount.load(std::memory_order_relaxed);
+		s.seconds = microseconds.load(std::memory_order_relaxed) / 1e6;
+		return s;
+	}
+
+	/**
+	 * Batching statistics; complete once poll() has returned Done.
+	 */
+	const ofxEbbBatchStats & getBatchStats() const {
+		return batchStats;
+	}
+
+private:
+	//-- Stages ------------------------------------------------------
+
+	void ingestLoop() {
+		runStage([this] {
+			ofxEbbPlanner tracker(settings.stepsPerMm, settings.kinematics);
+			tracker.setPosition(startSteps[0], startSteps[1]);
+			ofxEbbPathBatcher batcher;
+			batcher.setTolerance(settings.batchTolerance);
+
+			std::vector<ofxEbbPoint> raw;
+			std::vector<ofxEbbPoint> batched;
+			raw.reserve(StrokeChunk::CAPACITY);
+			batched.reserve(StrokeChunk::CAPACITY);
+			StrokeChunk out;
+			bool inStroke = false;
+
+			// Snap and merge the raw points into `out`, sending it on
+			// when it is full or the stroke ends
+			auto flush = [&](bool endsStroke) {
+				const ofxEbbPoint * p = raw.data();
+				size_t n = raw.size();
+				if (out.startsStroke && out.count == 0 && n > 0) {
+					// The travel target is never merged away
+					const auto steps = tracker.toSteps(*p);
+					tracker.setPosition(steps[0], steps[1]);
+					out.items[out.count++] = settings.pathBatching ? tracker.toMm(steps) : *p;
+					++p;
+					--n;
+				}
+				if (settings.pathBatching) {
+					batched.clear();
+					batchStats += batcher.process(tracker, p, n, batched);
+					p = batched.data();
+					n = batched.size();
+					if (n > 0) {
+						const auto steps = tracker.toSteps(p[n - 1]);
+						tracker.setPosition(steps[0], steps[1]);
+					}
+				}
+				for (size_t i = 0; i < n; ++i) {
+					if (out.full()) {
+						send(strokes, out);
+						out = StrokeChunk();
+					}
+					out.items[out.count++] = p[i];
+				}
+				raw.clear();
+				if (endsStroke) {
+					out.endsStroke = true;
+					send(strokes, out);
+					out = StrokeChunk();
+				}
+			};
+
+			ofxEbbPoint point;
+			bool startsStroke = false;
+			while (!cancelled && source.next(point, startsStroke)) {
+				if (startsStroke || !inStroke) {
+					if (inStroke) {
+						flush(true);
+					}
+					inStroke = true;
+					out.startsStroke = true;
+					strokeCount.fetch_add(1, std::memory_order_relaxed);
+				}
+				raw.push_back(point);
+				points.fetch_add(1, std::memory_order_relaxed);
+				if (raw.size() == StrokeChunk::CAPACITY) {
+					flush(false);
+				}
+			}
+			if (inStroke) {
+				flush(true);
+			}
+			out.last = true;
+			send(strokes, out);
+		});
+	}
+
+	void planLoop() {
+		runStage([this] {
+			ofxEbbPlanner planner(settings.stepsPerMm, settings.kinematics);
+			planner.setPosition(startSteps[0], startSteps[1]);
+			std::vector<ofxEbbLowLevelMove> planned;
+			MotionChunk out;
+			StrokeChunk in;
+			bool penDown = false;
+			bool penKnown = false;
+
+			auto emit = [&](const ofxEbbStreamMotion & m) {
+				if (out.full()) {
+					send(motions, out);
+					out = MotionChunk();
+				}
+				out.items[out.count++] = m;
+			};
+			auto pen = [&](bool down) {
+				if (penKnown && penDown == down) {
+					return;
+				}
+				ofxEbbStreamMotion m;
+				m.isPen = true;
+				m.penDown = down;
+				emit(m);
+				penKnown = true;
+				penDown = down;
+			};
+			auto emitPlanned = [&] {
+				for (const auto & move : planned) {
+					ofxEbbStreamMotion m;
+					m.move = move;
+					emit(m);
+				}
+				moves.fetch_add(planned.size(), std::memory_order_relaxed);
+				planned.clear();
+			};
+
+			while (true) {
+				receive(strokes, in);
+				const ofxEbbPoint * p = in.items.data();
+				size_t n = in.count;
+				if (in.startsStroke && n > 0) {
+					pen(false);
+					planner.plan(p, 1, settings.travelLimits, planned);
+					emitPlanned();
+					pen(true);
+					++p;
+					--n;
+				}
+				planner.planIncremental(p, n, settings.drawLimits, planned, in.endsStroke);
+				emitPlanned();
+				if (in.endsStroke) {
+					pen(false);
+				}
+				if (in.last) {
+					pen(false);
+					out.last = true;
+					send(motions, out);
+					return;
+				}
+			}
+		});
+	}
+
+	void formatLoop() {
+		runStage([this] {
+			ofxEbbCommandBuffer buffer;
+			MotionChunk in;
+			CommandChunk out;
+			while (true) {
+				receive(motions, in);
+				for (size_t i = 0; i < in.count; ++i) {
+					const ofxEbbStreamMotion & m = in.items[i];
+					ofxEbbStreamCommand & c = out.items[out.count++];
+					c = ofxEbbStreamCommand();
+					if (m.isPen) {
+						const int ms = m.penDown ? settings.penDownMs : settings.penUpMs;
+						buffer.op("SP").arg(m.penDown ? PEN_DOWN : PEN_UP);
+						if (ms >= 0) {
+							buffer.arg(ms);
+						}
+						c.seconds = std::max(0, ms) / 1000.0;
+						c.pen = m.penDown ? 1 : 0;
+					} else {
+						const auto & mv = m.move;
+						buffer.op("LM").arg(mv.rate[0]).arg(mv.steps[0]).arg(mv.accel[0]).arg(mv.rate[1]).arg(mv.steps[1]).arg(mv.accel[1]);
+						c.seconds = mv.duration;
+						c.steps = mv.steps;
+					}
+					const std::string_view text = buffer.view();
+					c.length = static_cast<uint8_t>(std::min(text.size(), c.text.size()));
+					std::memcpy(c.text.data(), text.data(), c.length);
+					microseconds.fetch_add(static_cast<uint64_t>(c.seconds * 1e6), std::memory_order_relaxed);
+
+					if (out.full()) {
+						commandCount.fetch_add(out.count, std::memory_order_relaxed);
+						send(commands, out);
+						out = CommandChunk();
+					}
+				}
+				if (in.last) {
+					commandCount.fetch_add(out.count, std::memory_order_relaxed);
+					out.last = true;
+					send(commands, out);
+					return;
+				}
+			}
+		});
+	}
+
+	//-- Stage helpers -----------------------------------------------
+
+	// Run a stage body, turning an exception or cancellation into a
+	// stopped stream
+	template <typename F>
+	void runStage(
+		F && body) {
+		try {
+			body();
+		} catch (const Cancelled &) {
+		} catch (const std::exception & e) {
+			fail(e.what());
+		}
+	}
+
+	struct Cancelled { };
+
+	void fail(
+		const std::string & message) {
+		{
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (error.empty()) {
+				error = message;
+			}
+		}
+		failed = true;
+		cancelled = true;
+	}
+
+	// Push a chunk, backing off while the next stage is behind
+	template <typename T>
+	void send(
+		ofxEbbSpscQueue<T> & queue,
+		T & value) {
+		for (int spins = 0; !queue.push(std::move(value)); ++spins) {
+			backoff(spins);
+		}
+	}
+
+	// Pop a chunk, backing off while the previous stage is behind
+	template <typename T>
+	void receive(
+		ofxEbbSpscQueue<T> & queue,
+		T & value) {
+		for (int spins = 0; !queue.pop(value); ++spins) {
+			backoff(spins);
+		}
+	}
+
+	void backoff(
+		int spins) {
+		if (cancelled) {
+			throw Cancelled();
+		}
+		if (spins < 64) {
+			std::this_thread::yield();
+		} else {
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	}
+
+	ofxEbbPathSource & source;
+	ofxEbbToolpathSettings settings;
+	std::array<int64_t, 2> startSteps;
+
+	ofxEbbSpscQueue<StrokeChunk> strokes;
+	ofxEbbSpscQueue<MotionChunk> motions;
+	ofxEbbSpscQueue<CommandChunk> commands;
+
+	std::thread ingestThread;
+	std::thread planThread;
+	std::thread formatThread;
+	bool started = false;
+	std::atomic<bool> cancelled { false };
+	std::atomic<bool> failed { false };
+	mutable std::mutex errorMutex;
+	std::string error;
+
+	// Consumer state
+	CommandChunk chunk;
+	size_t current = 0;
+
+	std::atomic<uint64_t> points { 0 };
+	std::atomic<uint64_t> strokeCount { 0 };
+	std::atomic<uint64_t> moves { 0 };
+	std::atomic<uint64_t> commandCount { 0 };
+	std::atomic<uint64_t> microseconds { 0 };
+	ofxEbbBatchStats batchStats; // Written by the ingest stage only
+};
@@ -0,0 +1,148 @@
+// ofxEbbTrace.h
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Compile-time switch for the per-command protocol log ("Sending: ..." /
+ * "Raw response: ..."). Defaults to on in debug builds and off when NDEBUG
+ * is defined; define OFXEBB_PROTOCOL_LOG to 0 or 1 to force it. When off,
+ * the log statements are not compiled in at all.
+ */
+#ifndef OFXEBB_PROTOCOL_LOG
+#ifdef NDEBUG
+#define OFXEBB_PROTOCOL_LOG 0
+#else
+#define OFXEBB_PROTOCOL_LOG 1
+#endif
+#endif
+
+inline constexpr bool ofxEbbProtocolLogging = OFXEBB_PROTOCOL_LOG != 0;
+
+enum class ofxEbbTraceKind : uint8_t {
+	Tx, // Command written
+	Rx, // Reply line received
+	Error, // Firmware error or failed command
+	Timeout // Command or pipeline timed out
+};
+
+/**
+ * One trace entry. Text past MAX_TEXT is cut off.
+ */
+struct ofxEbbTraceRecord {
+	static constexpr size_t MAX_TEXT = 62;
+
+	std::chrono::steady_clock::time_point time;
+	ofxEbbTraceKind kind = ofxEbbTraceKind::Tx;
+	uint8_t length = 0;
+	char text[MAX_TEXT];
+
+	std::string_view view() const {
+		return std::string_view(text, length);
+	}
+};
+
+/**
+ * ofxEbbTraceRing: runtime protocol trace kept in a preallocated ring.
+ * Recording copies into a fixed slot, so it is cheap enough to leave on in
+ * release builds; the oldest records are overwritten once the ring is full.
+ * Disabled (capacity 0) until reserve() is called. Thread-safe.
+ */
+class ofxEbbTraceRing {
+public:
+	/**
+	 * Allocate room for `capacity` records and clear the trace.
+	 * @param capacity  Number of records; 0 disables tracing.
+	 */
+	void reserve(
+		size_t capacity) {
+		std::lock_guard<std::mutex> lock(mutex);
+		records.assign(capacity, ofxEbbTraceRecord());
+		total = 0;
+		dumped = 0;
+		active = capacity > 0;
+	}
+
+	bool enabled() const {
+		return active;
+	}
+
+	size_t capacity() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return records.size();
+	}
+
+	/**
+	 * Append a record; does nothing while disabled. Never allocates.
+	 */
+	void record(
+		ofxEbbTraceKind kind,
+		std::string_view text) {
+		if (!active) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		if (records.empty()) {
+			return;
+		}
+		ofxEbbTraceRecord & r = records[total % records.size()];
+		r.time = std::chrono::steady_clock::now();
+		r.kind = kind;
+		r.length = static_cast<uint8_t>(std::min(text.size(), ofxEbbTraceRecord::MAX_TEXT));
+		std::copy(text.begin(), text.begin() + r.length, r.text);
+		++total;
+	}
+
+	/**
+	 * Visit the retained records, oldest first.
+	 * @param onlyNew  Skip records already visited with onlyNew set.
+	 */
+	template <typename F>
+	void forEach(
+		F && visit,
+		bool onlyNew = false) {
+		std::lock_guard<std::mutex> lock(mutex);
+		const uint64_t oldest = total > records.size() ? total - records.size() : 0;
+		const uint64_t first = onlyNew ? std::max(oldest, dumped) : oldest;
+		for (uint64_t i = first; i < total; ++i) {
+			visit(records[i % records.size()]);
+		}
+		if (onlyNew) {
+			dumped = total;
+		}
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lock(mutex);
+		total = 0;
+		dumped = 0;
+	}
+
+	/**
+	 * Format a record as "<ms before ref> <kind> <text>".
+	 */
+	static std::string format(
+		const ofxEbbTraceRecord & r,
+		std::chrono::steady_clock::time_point ref) {
+		static const char * kinds[] = { "TX ", "RX ", "ERR", "TMO" };
+		double ms = std::chrono::duration<double, std::milli>(ref - r.time).count();
+		char prefix[32];
+		std::snprintf(prefix, sizeof(prefix), "-%9.3fms %s ", ms, kinds[static_cast<int>(r.kind)]);
+		return std::string(prefix) + std::string(r.view());
+	}
+
+private:
+	mutable std::mutex mutex;
+	std::vector<ofxEbbTraceRecord> records;
+	uint64_t total = 0;
+	uint64_t dumped = 0;
+	std::atomic<bool> active { false };
+};
@@ -0,0 +1,88 @@
+// ofxEbbTransport.h
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * One piece of a vectored write.
+ */
+struct ofxEbbTransportBuffer {
+	const char * data;
+	size_t size;
+};
+
+/**
+ * ofxEbbTransport: byte pipe between ofxEbbControl and a board.
+ * ofxEbbControl only ever uses a transport from one thread at a time (the
+ * caller's, or the I/O thread while it runs), so implementations need no
+ * locking of their own.
+ */
+class ofxEbbTransport {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	virtual ~ofxEbbTransport() = default;
+
+	/**
+	 * Open the connection.
+	 * @param port  Device path or whatever else names the board.
+	 * @param baud  Line speed, where it applies.
+	 */
+	virtual bool open(
+		const std::string & port,
+		int baud)
+		= 0;
+
+	virtual void close() = 0;
+
+	virtual bool isOpen() const = 0;
+
+	/**
+	 * Write the buffers back to back, as one command line.
+	 * @returns False if not everything could be written.
+	 */
+	virtual bool write(
+		const ofxEbbTransportBuffer * buffers,
+		size_t count)
+		= 0;
+
+	bool write(
+		std::string_view data) {
+		const ofxEbbTransportBuffer buffer { data.data(), data.size() };
+		return write(&buffer, 1);
+	}
+
+	/**
+	 * Read whatever has arrived, up to `capacity` bytes, waiting until
+	 * `deadline` for the first one. A deadline in the past only takes what
+	 * is already there.
+	 * @returns Bytes read; 0 on timeout or error.
+	 */
+	virtual size_t read(
+		uint8_t * buffer,
+		size_t capacity,
+		Clock::time_point deadline)
+		= 0;
+
+	/**
+	 * Let `wait` pass with nothing to send. A transport that keeps its own
+	 * clock (ofxEbbDryRunTransport) moves it on and returns true; real ones
+	 * return false and the caller sleeps.
+	 */
+	virtual bool skip(
+		Clock::duration) {
+		return false;
+	}
+
+	/**
+	 * Ports this transport could open.
+	 */
+	virtual std::vector<std::string> listDevices() {
+		return {};
+	}
+};
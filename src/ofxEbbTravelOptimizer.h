@@ -0,0 +1,752 @@
+// ofxEbbTravelOptimizer.h
+#pragma once
+
+#include "ofxEbbPlanner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * Options for ofxEbbTravelOptimizer.
+ */
+struct ofxEbbTravelSettings {
+	double timeBudgetMs = 500.0; // For improving the seed tour, which always completes
+	int threads = 0; // 0 = one per hardware thread
+	bool allowReverse = true; // Strokes may be drawn end to start
+	double joinTolerance = 0.01; // mm; strokes that meet this closely are drawn as one (< 0: never)
+	int neighbours = 8; // Candidate endpoints considered per endpoint
+	ofxEbbPoint start; // Pen position before the first stroke
+};
+
+/**
+ * One stroke of an optimized drawing order.
+ */
+struct ofxEbbTravelStep {
+	uint32_t index = 0; // Into the strokes given to optimize()
+	bool reversed = false; // Draw it from its last point to its first
+	bool joinsPrevious = false; // Starts where the previous one ends; the pen stays down
+};
+
+/**
+ * Drawing order found by ofxEbbTravelOptimizer, with pen-up travel in mm
+ * (the return from the last stroke isn't counted).
+ */
+struct ofxEbbTravelPlan {
+	std::vector<ofxEbbTravelStep> steps; // Empty strokes are left out
+	double travelBefore = 0.0; // In the order given
+	double travelSeed = 0.0; // After the nearest-neighbour pass
+	double travelAfter = 0.0;
+	size_t joined = 0; // Pen lifts saved by joining strokes
+	size_t improvements = 0; // 2-opt and Or-opt moves applied
+	int threads = 0;
+	bool converged = false; // No improving move left within the time budget
+	double elapsedMs = 0.0;
+};
+
+/**
+ * ofxEbbTravelOptimizer: reorders (and optionally reverses) strokes to cut
+ * the pen-up travel between them. A nearest-neighbour tour is built with a
+ * uniform grid over the stroke endpoints, then improved with 2-opt and
+ * Or-opt moves drawn from each endpoint's nearest neighbours, so work per
+ * pass grows linearly with the number of strokes.
+ * The improvement runs on all cores: the tour is cut into one window per
+ * thread, each thread improves its own window, and the cut points shift
+ * between rounds so strokes can move across them. It stops when a full
+ * round finds nothing or the time budget runs out.
+ */
+class ofxEbbTravelOptimizer {
+public:
+	explicit ofxEbbTravelOptimizer(
+		const ofxEbbTravelSettings & settings = {})
+		: settings(settings) { }
+
+	void setSettings(
+		const ofxEbbTravelSettings & value) {
+		settings = value;
+	}
+
+	const ofxEbbTravelSettings & getSettings() const {
+		return settings;
+	}
+
+	/**
+	 * Optimize the order of strokes given by their end points.
+	 * @param starts  First point of each stroke.
+	 * @param ends    Last point of each stroke.
+	 * @param count   Number of strokes.
+	 */
+	ofxEbbTravelPlan optimize(
+		const ofxEbbPoint * starts,
+		const ofxEbbPoint * ends,
+		size_t count) {
+		const auto began = Clock::now();
+		ofxEbbTravelPlan plan;
+		plan.threads = 1;
+		if (count == 0) {
+			plan.converged = true;
+			return plan;
+		}
+
+		n = count;
+		points.resize(2 * n);
+		for (size_t i = 0; i < n; ++i) {
+			points[2 * i] = starts[i];
+			points[2 * i + 1] = ends[i];
+		}
+		plan.travelBefore = distance(settings.start, starts[0]);
+		for (size_t i = 1; i < n; ++i) {
+			plan.travelBefore += distance(ends[i - 1], starts[i]);
+		}
+
+		int threads = settings.threads > 0 ? settings.threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+		threads = static_cast<int>(std::max<size_t>(1, std::min<size_t>(threads, n / MIN_WINDOW)));
+		plan.threads = threads;
+		k = static_cast<size_t>(std::max(1, settings.neighbours));
+
+		grid.build(points, !settings.allowReverse);
+		findNeighbours(threads);
+		seedTour();
+		plan.travelSeed = tourLength();
+
+		const auto deadline = began + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(settings.timeBudgetMs));
+		plan.converged = improve(threads, deadline, plan.improvements);
+		plan.travelAfter = tourLength();
+
+		plan.steps.resize(n);
+		for (size_t i = 0; i < n; ++i) {
+			ofxEbbTravelStep & step = plan.steps[i];
+			step.index = order[i];
+			step.reversed = flipped[order[i]] != 0;
+			step.joinsPrevious = i > 0 && settings.joinTolerance >= 0.0
+				&& dist(exitOf(order[i - 1]), entryOf(order[i])) <= settings.joinTolerance;
+			plan.joined += step.joinsPrevious ? 1 : 0;
+		}
+		plan.elapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - began).count();
+		return plan;
+	}
+
+	/**
+	 * Optimize a container of strokes, e.g. std::vector<ofPolyline> or
+	 * std::vector<std::vector<ofxEbbPoint>>. Points need .x and .y.
+	 */
+	template <typename Container>
+	ofxEbbTravelPlan optimize(
+		const Container & strokes) {
+		std::vector<ofxEbbPoint> starts, ends;
+		std::vector<uint32_t> ids;
+		uint32_t index = 0;
+		for (const auto & stroke : strokes) {
+			if (std::begin(stroke) != std::end(stroke)) {
+				const auto & first = *std::begin(stroke);
+				const auto & last = *std::prev(std::end(stroke));
+				starts.push_back({ first.x, first.y });
+				ends.push_back({ last.x, last.y });
+				ids.push_back(index);
+			}
+			++index;
+		}
+		ofxEbbTravelPlan plan = optimize(starts.data(), ends.data(), starts.size());
+		for (auto & step : plan.steps) {
+			step.index = ids[step.index];
+		}
+		return plan;
+	}
+
+	/**
+	 * Walk strokes in planned order, handing each run of joined strokes to
+	 * `draw` as one polyline (std::vector<ofxEbbPoint>, in drawing order).
+	 */
+	template <typename Container, typename F>
+	static void forEachChain(
+		const Container & strokes,
+		const ofxEbbTravelPlan & plan,
+		F && draw) {
+		std::vector<ofxEbbPoint> chain;
+		for (const auto & step : plan.steps) {
+			if (!step.joinsPrevious && !chain.empty()) {
+				draw(static_cast<const std::vector<ofxEbbPoint> &>(chain));
+				chain.clear();
+			}
+			const auto & stroke = *std::next(std::begin(strokes), step.index);
+			// A joined stroke's first point repeats the chain's last one
+			const size_t skip = step.joinsPrevious ? 1 : 0;
+			auto append = [&](auto begin, auto end) {
+				for (auto it = begin; it != end; ++it) {
+					chain.push_back({ it->x, it->y });
+				}
+			};
+			if (step.reversed) {
+				append(std::next(std::make_reverse_iterator(std::end(stroke)), skip), std::make_reverse_iterator(std::begin(stroke)));
+			} else {
+				append(std::next(std::begin(stroke), skip), std::end(stroke));
+			}
+		}
+		if (!chain.empty()) {
+			draw(static_cast<const std::vector<ofxEbbPoint> &>(chain));
+		}
+	}
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// Pseudo endpoint ids: the start position, and "nothing follows"
+	static constexpr uint32_t START = std::numeric_limits<uint32_t>::max() - 1;
+	static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+	static constexpr size_t MIN_WINDOW = 64; // Strokes per thread before threading pays off
+	static constexpr size_t MAX_SEGMENT = 3; // Longest run Or-opt moves
+	static constexpr size_t MAX_REVERSAL = 10000; // Longest run 2-opt reverses, to bound each move's cost
+	static constexpr double EPSILON = 1e-9;
+
+	/**
+	 * Uniform grid over the stroke endpoints, with removal for the
+	 * nearest-neighbour pass.
+	 */
+	class Grid {
+	public:
+		void build(
+			const std::vector<ofxEbbPoint> & pts,
+			bool startsOnly) {
+			double minX = pts[0].x, maxX = pts[0].x, minY = pts[0].y, maxY = pts[0].y;
+			for (const auto & p : pts) {
+				minX = std::min(minX, p.x);
+				maxX = std::max(maxX, p.x);
+				minY = std::min(minY, p.y);
+				maxY = std::max(maxY, p.y);
+			}
+			// About two endpoints per cell
+			const double w = std::max(maxX - minX, 1e-6), h = std::max(maxY - minY, 1e-6);
+			cell = std::max(std::sqrt(2.0 * w * h / pts.size()), std::max(w, h) / pts.size());
+			originX = minX;
+			originY = minY;
+			cols = static_cast<int>(w / cell) + 1;
+			rows = static_cast<int>(h / cell) + 1;
+
+			const size_t cells = static_cast<size_t>(cols) * rows;
+			start.assign(cells + 1, 0);
+			for (size_t e = 0; e < pts.size(); ++e) {
+				++start[cellOf(pts[e]) + 1];
+			}
+			for (size_t c = 0; c < cells; ++c) {
+				start[c + 1] += start[c];
+			}
+			items.resize(pts.size());
+			itemPoints.resize(pts.size());
+			slot.resize(pts.size());
+			std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+			for (size_t e = 0; e < pts.size(); ++e) {
+				const uint32_t at = fill[cellOf(pts[e])]++;
+				items[at] = static_cast<uint32_t>(e);
+				itemPoints[at] = pts[e];
+				slot[e] = at;
+			}
+
+			// Live endpoints are kept at the front of each cell's slice
+			live.assign(cells, 0);
+			for (size_t c = 0; c < cells; ++c) {
+				live[c] = start[c + 1] - start[c];
+			}
+			if (startsOnly) {
+				for (size_t e = 1; e < pts.size(); e += 2) {
+					remove(static_cast<uint32_t>(e), pts[e]);
+				}
+			}
+		}
+
+		/**
+		 * Endpoint at index i in cell order; visiting endpoints in this
+		 * order keeps neighbouring queries in cache.
+		 */
+		uint32_t item(
+			size_t i) const {
+			return items[i];
+		}
+
+		/**
+		 * Visit the endpoints in cells at Chebyshev ring `r` around `p`,
+		 * either all of them or only the live ones.
+		 * @returns False once the ring lies entirely outside the grid.
+		 */
+		template <typename F>
+		bool visitRing(
+			const ofxEbbPoint & p,
+			int r,
+			bool liveOnly,
+			F && visit) const {
+			const int cx = clampCol(p.x), cy = clampRow(p.y);
+			if (cx - r < 0 && cy - r < 0 && cx + r >= cols && cy + r >= rows) {
+				return false;
+			}
+			auto visitCell = [&](int x, int y) {
+				if (x < 0 || y < 0 || x >= cols || y >= rows) {
+					return;
+				}
+				const size_t c = static_cast<size_t>(y) * cols + x;
+				const uint32_t end = liveOnly ? start[c] + live[c] : start[c + 1];
+				for (uint32_t i = start[c]; i < end; ++i) {
+					visit(items[i], itemPoints[i]);
+				}
+			};
+			if (r == 0) {
+				visitCell(cx, cy);
+				return true;
+			}
+			for (int x = cx - r; x <= cx + r; ++x) {
+				visitCell(x, cy - r);
+				visitCell(x, cy + r);
+			}
+			for (int y = cy - r + 1; y <= cy + r - 1; ++y) {
+				visitCell(cx - r, y);
+				visitCell(cx + r, y);
+			}
+			return true;
+		}
+
+		// No point in ring r + 1 or beyond is closer than this
+		double ringClearance(
+			int r) const {
+			return r * cell;
+		}
+
+		void remove(
+			uint32_t e,
+			const ofxEbbPoint & p) {
+			const size_t c = cellOf(p);
+			const uint32_t at = slot[e];
+			if (at >= start[c] + live[c]) {
+				return; // Already removed
+			}
+			const uint32_t lastLive = start[c] + --live[c];
+			std::swap(items[at], items[lastLive]);
+			std::swap(itemPoints[at], itemPoints[lastLive]);
+			slot[items[at]] = at;
+			slot[items[lastLive]] = lastLive;
+		}
+
+	private:
+		int clampCol(
+			double x) const {
+			return std::max(0, std::min(cols - 1, static_cast<int>((x - originX) / cell)));
+		}
+
+		int clampRow(
+			double y) const {
+			return std::max(0, std::min(rows - 1, static_cast<int>((y - originY) / cell)));
+		}
+
+		size_t cellOf(
+			const ofxEbbPoint & p) const {
+			return static_cast<size_t>(clampRow(p.y)) * cols + clampCol(p.x);
+		}
+
+		double cell = 1.0;
+		double originX = 0.0, originY = 0.0;
+		int cols = 1, rows = 1;
+		std::vector<uint32_t> start; // Per cell, into items (CSR)
+		std::vector<uint32_t> live;
+		std::vector<uint32_t> items;
+		std::vector<ofxEbbPoint> itemPoints; // Copy of each item's point, in cell order
+		std::vector<uint32_t> slot; // Position of each endpoint in items
+	};
+
+	//-- Endpoint helpers --------------------------------------------
+
+	static double distance2(
+		const ofxEbbPoint & a,
+		const ofxEbbPoint & b) {
+		const double dx = a.x - b.x, dy = a.y - b.y;
+		return dx * dx + dy * dy;
+	}
+
+	static double distance(
+		const ofxEbbPoint & a,
+		const ofxEbbPoint & b) {
+		return std::sqrt(distance2(a, b));
+	}
+
+	const ofxEbbPoint & pointOf(
+		uint32_t id) const {
+		return id == START ? settings.start : points[id];
+	}
+
+	double dist(
+		uint32_t a,
+		uint32_t b) const {
+		return a == NONE || b == NONE ? 0.0 : distance(pointOf(a), pointOf(b));
+	}
+
+	uint32_t entryOf(
+		uint32_t stroke) const {
+		return 2 * stroke + flipped[stroke];
+	}
+
+	uint32_t exitOf(
+		uint32_t stroke) const {
+		return 2 * stroke + 1 - flipped[stroke];
+	}
+
+	// Endpoint the pen leaves from before tour position i
+	uint32_t before(
+		size_t i) const {
+		return i == 0 ? START : exitOf(order[i - 1]);
+	}
+
+	// Endpoint the pen goes to after tour position i
+	uint32_t after(
+		size_t i) const {
+		return i + 1 >= n ? NONE : entryOf(order[i + 1]);
+	}
+
+	const uint32_t * neighboursOf(
+		uint32_t id) const {
+		return id == START ? startNeighbours.data() : neighbours.data() + static_cast<size_t>(id) * k;
+	}
+
+	double tourLength() const {
+		double total = 0.0;
+		for (size_t i = 0; i < n; ++i) {
+			total += dist(before(i), entryOf(order[i]));
+		}
+		return total;
+	}
+
+	//-- Neighbour lists ---------------------------------------------
+
+	// The k endpoints nearest to p, closest first, other than those of
+	// `exclude`; unused entries are NONE. outDist gets squared distances.
+	void nearest(
+		const ofxEbbPoint & p,
+		uint32_t exclude,
+		uint32_t * out,
+		double * outDist) const {
+		std::fill(out, out + k, NONE);
+		std::fill(outDist, outDist + k, std::numeric_limits<double>::max());
+		for (int r = 0;; ++r) {
+			const bool inside = grid.visitRing(p, r, false, [&](uint32_t e, const ofxEbbPoint & q) {
+				if (e / 2 == exclude) {
+					return;
+				}
+				const double d = distance2(p, q);
+				if (d >= outDist[k - 1]) {
+					return;
+				}
+				size_t at = k - 1;
+				while (at > 0 && outDist[at - 1] > d) {
+					out[at] = out[at - 1];
+					outDist[at] = outDist[at - 1];
+					--at;
+				}
+				out[at] = e;
+				outDist[at] = d;
+			});
+			const double clearance = grid.ringClearance(r);
+			if (!inside || outDist[k - 1] <= clearance * clearance) {
+				return;
+			}
+		}
+	}
+
+	void findNeighbours(
+		int threads) {
+		neighbours.assign(points.size() * k, NONE);
+		startNeighbours.assign(k, NONE);
+		std::vector<double> scratch(k);
+		nearest(settings.start, NONE, startNeighbours.data(), scratch.data());
+
+		parallelFor(threads, points.size(), [this](size_t begin, size_t end) {
+			std::vector<double> d(k);
+			for (size_t i = begin; i < end; ++i) {
+				const uint32_t e = grid.item(i);
+				nearest(points[e], e / 2, neighbours.data() + static_cast<size_t>(e) * k, d.data());
+			}
+		});
+	}
+
+	//-- Nearest-neighbour seed --------------------------------------
+
+	void seedTour() {
+		order.resize(n);
+		flipped.assign(n, 0);
+		position.reset(new std::atomic<uint32_t>[n]);
+
+		ofxEbbPoint at = settings.start;
+		for (size_t i = 0; i < n; ++i) {
+			uint32_t best = NONE;
+			double bestDist = std::numeric_limits<double>::max();
+			for (int r = 0;; ++r) {
+				const bool inside = grid.visitRing(at, r, true, [&](uint32_t e, const ofxEbbPoint & q) {
+					const double d = distance2(at, q);
+					if (d < bestDist) {
+						bestDist = d;
+						best = e;
+					}
+				});
+				const double clearance = grid.ringClearance(r);
+				if (!inside || (best != NONE && bestDist <= clearance * clearance)) {
+					break;
+				}
+			}
+
+			const uint32_t stroke = best / 2;
+			grid.remove(2 * stroke, points[2 * stroke]);
+			grid.remove(2 * stroke + 1, points[2 * stroke + 1]);
+			order[i] = stroke;
+			flipped[stroke] = static_cast<uint8_t>(best & 1);
+			position[stroke].store(static_cast<uint32_t>(i), std::memory_order_relaxed);
+			at = points[exitOf(stroke)];
+		}
+	}
+
+	//-- Improvement -------------------------------------------------
+
+	// Improve the tour in rounds of parallel windows until a round finds
+	// nothing or the deadline passes. Returns true if it converged.
+	bool improve(
+		int threads,
+		Clock::time_point deadline,
+		size_t & applied) {
+		if (threads <= 1) {
+			while (true) {
+				const size_t found = improveWindow(0, n - 1, deadline);
+				applied += found;
+				if (Clock::now() >= deadline) {
+					return false;
+				}
+				if (found == 0) {
+					return true;
+				}
+			}
+		}
+
+		// Each window's neighbours are fixed separators, read but never
+		// moved, so threads never touch the same positions
+		const size_t window = (n + threads - 1) / threads;
+		size_t idleRounds = 0;
+		for (size_t round = 0; idleRounds < 2; ++round) {
+			if (Clock::now() >= deadline) {
+				return false;
+			}
+			const size_t offset = round % 2 == 0 ? window - 1 : window / 2;
+			std::vector<size_t> separators;
+			for (size_t s = offset; s < n; s += window) {
+				separators.push_back(s);
+			}
+
+			std::vector<size_t> found(separators.size() + 1, 0);
+			parallelFor(static_cast<int>(found.size()), found.size(), [&](size_t begin, size_t end) {
+				for (size_t w = begin; w < end; ++w) {
+					const size_t lo = w == 0 ? 0 : separators[w - 1] + 1;
+					const size_t hi = w < separators.size() ? separators[w] : n;
+					if (hi > lo + 1) {
+						found[w] = improveWindow(lo, hi - 1, deadline);
+					}
+				}
+			});
+
+			size_t total = 0;
+			for (size_t f : found) {
+				total += f;
+			}
+			applied += total;
+			idleRounds = total == 0 ? idleRounds + 1 : 0;
+		}
+		return Clock::now() < deadline;
+	}
+
+	// One pass of 2-opt and Or-opt over tour positions [lo, hi]
+	size_t improveWindow(
+		size_t lo,
+		size_t hi,
+		Clock::time_point deadline) {
+		size_t applied = 0;
+		auto inWindow = [&](uint32_t stroke, size_t & at) {
+			at = position[stroke].load(std::memory_order_relaxed);
+			return at >= lo && at <= hi;
+		};
+
+		for (size_t i = lo; i <= hi; ++i) {
+			if ((i & 255) == 0 && Clock::now() >= deadline) {
+				break;
+			}
+
+			// 2-opt: reverse positions i..j so the pen goes from the point
+			// before i straight to a nearby exit at j
+			if (settings.allowReverse) {
+				const uint32_t p = before(i);
+				const double current = dist(p, entryOf(order[i]));
+				const uint32_t * nb = neighboursOf(p);
+				for (size_t c = 0; c < k && nb[c] != NONE; ++c) {
+					const uint32_t e = nb[c];
+					if (dist(p, e) >= current - EPSILON) {
+						break;
+					}
+					size_t j;
+					if (!inWindow(e / 2, j) || j < i || j - i >= MAX_REVERSAL || exitOf(e / 2) != e) {
+						continue;
+					}
+					const uint32_t q = after(j);
+					const double delta = dist(p, e) + dist(entryOf(order[i]), q) - current - dist(e, q);
+					if (delta < -EPSILON) {
+						reverse(i, j);
+						++applied;
+						break;
+					}
+				}
+			}
+
+			// Or-opt: move a run of up to MAX_SEGMENT strokes between two
+			// strokes whose endpoints are close to the run's ends
+			for (size_t length = 1; length <= MAX_SEGMENT && i + length - 1 <= hi; ++length) {
+				if (tryMove(i, i + length - 1, lo, hi, inWindow)) {
+					++applied;
+					break;
+				}
+			}
+		}
+		return applied;
+	}
+
+	template <typename InWindow>
+	bool tryMove(
+		size_t first,
+		size_t last,
+		size_t lo,
+		size_t hi,
+		InWindow && inWindow) {
+		const uint32_t f = entryOf(order[first]);
+		const uint32_t l = exitOf(order[last]);
+		const uint32_t p = before(first);
+		const uint32_t q = after(last);
+		const double gain = dist(p, f) + dist(l, q) - dist(p, q);
+		if (gain <= EPSILON) {
+			return false;
+		}
+
+		// Insert after position `at` (lo - 1 = at the front of the window);
+		// other threads own the tour outside [lo, hi]
+		auto evaluate = [&](size_t at, bool reversed) {
+			if (at + 1 != lo && (at < lo || at > hi)) {
+				return false;
+			}
+			if (at + 1 >= first && at <= last) {
+				return false;
+			}
+			if (reversed && !settings.allowReverse) {
+				return false;
+			}
+			const uint32_t x = at + 1 == lo ? before(lo) : exitOf(order[at]);
+			const uint32_t y = after(at);
+			const double cost = reversed ? dist(x, l) + dist(f, y) - dist(x, y) : dist(x, f) + dist(l, y) - dist(x, y);
+			if (cost - gain < -EPSILON) {
+				move(first, last, at, reversed);
+				return true;
+			}
+			return false;
+		};
+
+		for (const uint32_t end : { f, l }) {
+			const uint32_t * nb = neighboursOf(end);
+			for (size_t c = 0; c < k && nb[c] != NONE; ++c) {
+				const uint32_t e = nb[c];
+				if (dist(end, e) >= gain) {
+					break;
+				}
+				size_t at;
+				if (!inWindow(e / 2, at) || (at >= first && at <= last)) {
+					continue;
+				}
+				const bool isExit = exitOf(e / 2) == e;
+				// Join the run's `end` to e: after e's stroke if e is its
+				// exit, before it if e is its entry (at - 1 wraps when the
+				// window starts the tour; evaluate() and move() expect that)
+				const size_t insertAfter = isExit ? at : at - 1;
+				if (evaluate(insertAfter, (end == f) != isExit)) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// Reverse tour positions i..j, flipping each stroke
+	void reverse(
+		size_t i,
+		size_t j) {
+		std::reverse(order.begin() + i, order.begin() + j + 1);
+		for (size_t p = i; p <= j; ++p) {
+			flipped[order[p]] ^= 1;
+			position[order[p]].store(static_cast<uint32_t>(p), std::memory_order_relaxed);
+		}
+	}
+
+	// Move positions first..last to just after position `at`
+	void move(
+		size_t first,
+		size_t last,
+		size_t at,
+		bool reversed) {
+		if (reversed) {
+			reverse(first, last);
+		}
+		size_t from, to;
+		if (at + 1 < first) {
+			std::rotate(order.begin() + (at + 1), order.begin() + first, order.begin() + last + 1);
+			from = at + 1;
+			to = last;
+		} else {
+			std::rotate(order.begin() + first, order.begin() + last + 1, order.begin() + at + 1);
+			from = first;
+			to = at;
+		}
+		for (size_t p = from; p <= to; ++p) {
+			position[order[p]].store(static_cast<uint32_t>(p), std::memory_order_relaxed);
+		}
+	}
+
+	//-- Threads -----------------------------------------------------
+
+	// Split [0, count) into `threads` ranges and run them in parallel
+	template <typename F>
+	static void parallelFor(
+		int threads,
+		size_t count,
+		F && body) {
+		threads = static_cast<int>(std::max<size_t>(1, std::min<size_t>(threads, count)));
+		if (threads == 1) {
+			body(0, count);
+			return;
+		}
+		std::vector<std::thread> workers;
+		const size_t per = (count + threads - 1) / threads;
+		for (int t = 1; t < threads; ++t) {
+			const size_t begin = std::min(count, t * per);
+			workers.emplace_back([&body, begin, per, count] { body(begin, std::min(count, begin + per)); });
+		}
+		body(0, std::min(count, per));
+		for (auto & w : workers) {
+			w.join();
+		}
+	}
+
+	ofxEbbTravelSettings settings;
+	size_t n = 0;
+	size_t k = 8;
+	std::vector<ofxEbbPoint> points; // 2i = start of stroke i, 2i + 1 = its end
+	std::vector<uint32_t> neighbours; // k per endpoint
+	std::vector<uint32_t> startNeighbours;
+	Grid grid;
+
+	// Tour: strokes in drawing order, whether each is reversed, and where
+	// each is (atomic because threads look up strokes in other windows)
+	std::vector<uint32_t> order;
+	std::vector<uint8_t> flipped;
+	std::unique_ptr<std::atomic<uint32_t>[]> position;
+};
@@ -0,0 +1,73 @@
+// ofLog.h: stand-in for the openFrameworks header, just enough for the
+// addon's headers to build in the headless tests
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+enum ofLogLevel {
+	OF_LOG_VERBOSE,
+	OF_LOG_NOTICE,
+	OF_LOG_WARNING,
+	OF_LOG_ERROR,
+	OF_LOG_FATAL_ERROR,
+	OF_LOG_SILENT
+};
+
+inline ofLogLevel & ofLogLevelSetting() {
+	static ofLogLevel level = OF_LOG_NOTICE;
+	return level;
+}
+
+inline void ofSetLogLevel(
+	ofLogLevel level) {
+	ofLogLevelSetting() = level;
+}
+
+class ofLog {
+public:
+	ofLog(
+		ofLogLevel level,
+		const std::string & module)
+		: level(level) {
+		message << "[" << module << "] ";
+	}
+
+	~ofLog() {
+		if (level >= ofLogLevelSetting()) {
+			std::cerr << message.str() << "\n";
+		}
+	}
+
+	template <class T>
+	ofLog & operator<<(
+		const T & value) {
+		message << value;
+		return *this;
+	}
+
+private:
+	ofLogLevel level;
+	std::ostringstream message;
+};
+
+struct ofLogVerbose : ofLog {
+	explicit ofLogVerbose(const std::string & module = "")
+		: ofLog(OF_LOG_VERBOSE, module) { }
+};
+
+struct ofLogNotice : ofLog {
+	explicit ofLogNotice(const std::string & module = "")
+		: ofLog(OF_LOG_NOTICE, module) { }
+};
+
+struct ofLogWarning : ofLog {
+	explicit ofLogWarning(const std::string & module = "")
+		: ofLog(OF_LOG_WARNING, module) { }
+};
+
+struct ofLogError : ofLog {
+	explicit ofLogError(const std::string & module = "")
+		: ofLog(OF_LOG_ERROR, module) { }
+};
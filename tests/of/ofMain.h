@@ -0,0 +1,6 @@
+// ofMain.h: stand-in for the openFrameworks header (headless tests)
+#pragma once
+
+#include "ofLog.h"
+#include "ofSerial.h"
+#include "ofUtils.h"
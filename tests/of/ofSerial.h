@@ -0,0 +1,54 @@
+// ofSerial.h: stand-in for the openFrameworks header (headless tests).
+// The tests run on ofxEbbSimulatorTransport, so this port never opens.
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct ofSerialDeviceInfo {
+	std::string path;
+
+	std::string getDevicePath() const {
+		return path;
+	}
+};
+
+class ofSerial {
+public:
+	bool setup(
+		const std::string &,
+		int) {
+		return false;
+	}
+
+	void close() { }
+
+	bool isInitialized() const {
+		return bInited;
+	}
+
+	long writeBytes(
+		const unsigned char *,
+		size_t) {
+		return -1;
+	}
+
+	int available() {
+		return 0;
+	}
+
+	long readBytes(
+		unsigned char *,
+		size_t) {
+		return -1;
+	}
+
+	std::vector<ofSerialDeviceInfo> getDeviceList() {
+		return {};
+	}
+
+protected:
+	bool bInited = false;
+	int fd = -1;
+};
@@ -0,0 +1,12 @@
+// ofUtils.h: stand-in for the openFrameworks header (headless tests)
+#pragma once
+
+#include <algorithm>
+
+template <class T>
+T ofClamp(
+	T value,
+	T min,
+	T max) {
+	return std::min(std::max(value, min), max);
+}
@@ -0,0 +1,460 @@
+#include "ofMain.h"
+#include "ofxEbbControl.h"
+#include "ofxEbbSimulator.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+
+// Headless tests: ofxEbbControl driven against ofxEbbSimulatorTransport.
+// Each test is selected by name, so CTest runs them one per process:
+//
+//   ofxEbbControlTests [replies|timeouts|async|job|planner|predictor|state]
+//
+// With no argument every test runs. Exit status is the number of failed
+// checks.
+
+//========================================================================
+// Checks
+
+static int failures = 0;
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+static bool check(
+	bool ok,
+	const char * what,
+	const char * file,
+	int line) {
+	if (!ok) {
+		std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+		++failures;
+	}
+	return ok;
+}
+
+template <class A, class B>
+static bool checkEqual(
+	const A & actual,
+	const B & expected,
+	const char * what,
+	const char * file,
+	int line) {
+	if (actual == expected) {
+		return true;
+	}
+	std::ostringstream out;
+	out << what << " (got " << actual << ", expected " << expected << ")";
+	return check(false, out.str().c_str(), file, line);
+}
+
+#define CHECK_EQ(actual, expected) checkEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)
+
+//========================================================================
+// Simulated board that records the commands it is sent, and can lose the
+// next copy of a command on the way (as a dropped USB packet would)
+
+class RecordingTransport : public ofxEbbSimulatorTransport {
+public:
+	using ofxEbbSimulatorTransport::ofxEbbSimulatorTransport;
+
+	bool write(
+		const ofxEbbTransportBuffer * buffers,
+		size_t count) override {
+		std::string bytes;
+		for (size_t i = 0; i < count; ++i) {
+			bytes.append(buffers[i].data, buffers[i].size);
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!dropNext.empty() && bytes == dropNext + "\r") {
+				dropNext.clear();
+				return true;
+			}
+			size_t start = 0;
+			for (size_t end; (end = bytes.find('\r', start)) != std::string::npos; start = end + 1) {
+				sent.push_back(bytes.substr(start, end - start));
+			}
+		}
+		return ofxEbbSimulatorTransport::write(buffers, count);
+	}
+
+	void drop(
+		const std::string & cmd) {
+		std::lock_guard<std::mutex> lock(mutex);
+		dropNext = cmd;
+	}
+
+	// Commands received so far that start with `prefix`
+	size_t count(
+		const std::string & prefix) {
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t n = 0;
+		for (const auto & cmd : sent) {
+			n += cmd.compare(0, prefix.size(), prefix) == 0;
+		}
+		return n;
+	}
+
+private:
+	std::mutex mutex;
+	std::vector<std::string> sent;
+	std::string dropNext;
+};
+
+// Fast USB, a short FIFO; motion runs at `motionTimeScale` of real time
+static ofxEbbSimulatorSettings simSettings(
+	double motionTimeScale = 0.0) {
+	ofxEbbSimulatorSettings settings;
+	settings.latency = std::chrono::microseconds(200);
+	settings.fifoDepth = 3;
+	settings.motionTimeScale = motionTimeScale;
+	return settings;
+}
+
+// An ofxEbbControl connected to a fresh simulated board
+struct Rig {
+	ofxEbbControl ebb;
+	RecordingTransport * transport = nullptr;
+
+	explicit Rig(
+		ofxEbbSimulatorSettings settings = simSettings()) {
+		auto owned = std::make_unique<RecordingTransport>(settings);
+		transport = owned.get();
+		ebb.setTransport(std::move(owned));
+		CHECK(ebb.setup("simulator"));
+	}
+
+	ofxEbbSimulatedBoard & board() {
+		return transport->getBoard();
+	}
+};
+
+static void checkSteps(
+	const std::array<int64_t, 2> & actual,
+	int64_t motor1,
+	int64_t motor2,
+	const char * file,
+	int line) {
+	checkEqual(actual[0], motor1, "motor 1 steps", file, line);
+	checkEqual(actual[1], motor2, "motor 2 steps", file, line);
+}
+
+#define CHECK_STEPS(actual, motor1, motor2) checkSteps((actual), (motor1), (motor2), __FILE__, __LINE__)
+
+//========================================================================
+// Tests
+
+// Every reply reaches the command that asked for it, whatever its format
+static void testReplies() {
+	Rig rig;
+	const std::vector<std::string> cmds = { "V", "QN", "SN,7", "QN", "QM", "QG", "XX", "QS" };
+	const auto results = rig.ebb.sendPipelined(cmds);
+	if (CHECK_EQ(results.size(), cmds.size())) {
+		for (size_t i = 0; i < cmds.size(); ++i) {
+			CHECK_EQ(results[i].command, cmds[i]);
+		}
+		CHECK(results[0].ok && results[0].response.find("EBB") != std::string::npos);
+		CHECK(results[1].ok && results[1].response == "0");
+		CHECK(results[2].ok);
+		CHECK(results[3].ok && results[3].response == "7");
+		CHECK(results[4].ok && results[4].response.compare(0, 3, "QM,") == 0);
+		CHECK(results[5].ok);
+		CHECK(!results[6].ok && !results[6].error.empty());
+		CHECK(results[7].ok && results[7].response == "0,0");
+	}
+
+	// The blocking API sees the same board
+	CHECK_EQ(rig.ebb.getNodeCount(), 7u);
+	CHECK_EQ(rig.ebb.sendCommand("QN"), "7");
+	CHECK(rig.ebb.getFirmwareVersion().find("2.8.1") != std::string::npos);
+}
+
+// A lost or late reply costs one command, never the ones after it
+static void testTimeouts() {
+	{
+		// Lost query: resynced and sent again
+		Rig rig;
+		rig.ebb.resetStats();
+		rig.transport->drop("QN");
+		CHECK_EQ(rig.ebb.sendCommand("QN"), "0");
+		const auto stats = rig.ebb.getStats();
+		CHECK_EQ(stats.linkResyncs, 1u);
+		CHECK_EQ(stats.retries, 1u);
+	}
+	{
+		// Lost query without auto resync: fails, then resync() recovers
+		Rig rig;
+		rig.ebb.setAutoResync(false);
+		rig.transport->drop("QN");
+		bool threw = false;
+		try {
+			rig.ebb.sendCommand("QN", 1, 50);
+		} catch (const std::runtime_error &) {
+			threw = true;
+		}
+		CHECK(threw);
+		CHECK(rig.ebb.resync());
+		CHECK_EQ(rig.ebb.sendCommand("SN,3"), "OK");
+		CHECK_EQ(rig.ebb.sendCommand("QN"), "3");
+	}
+	{
+		// Late reply: consumed as the abandoned command's, not the next one's
+		auto settings = simSettings();
+		settings.latency = std::chrono::milliseconds(60);
+		Rig rig(settings);
+		rig.ebb.setAutoResync(false);
+		bool threw = false;
+		try {
+			rig.ebb.sendCommand("SN,5", 1, 10);
+		} catch (const std::runtime_error &) {
+			threw = true;
+		}
+		CHECK(threw);
+		CHECK_EQ(rig.ebb.sendCommand("QN", 1, 500), "5");
+		CHECK_EQ(rig.ebb.sendCommand("QS", 1, 500), "0,0");
+	}
+}
+
+// Futures and callbacks on the I/O thread
+static void testAsync() {
+	Rig rig(simSettings(1.0));
+	CHECK(rig.ebb.startThread());
+
+	std::atomic<int> callbacks { 0 };
+	auto count = [&](const ofxEbbControl::CommandResult &) {
+		++callbacks;
+	};
+	// SN queues with motion; the queries after it travel on their own
+	// lane, so wait for it before asking
+	const auto setNode = rig.ebb.sendCommandAsync("SN,4", count).get();
+	CHECK(setNode.ok);
+	auto nodeFuture = rig.ebb.sendCommandAsync("QN", count);
+	auto badFuture = rig.ebb.sendCommandAsync("XX", count);
+	const auto node = nodeFuture.get();
+	const auto bad = badFuture.get();
+	CHECK(node.ok && node.response == "4");
+	CHECK(!bad.ok && !bad.error.empty());
+	CHECK(setNode.id < node.id && node.id < bad.id);
+	// Each callback runs before its future is satisfied
+	CHECK_EQ(callbacks.load(), 3);
+
+	// Motion through the thread, then a query behind it
+	auto move = rig.ebb.moveStepperStepsAsync(50, 100, -100);
+	CHECK(move.get().ok);
+	CHECK(rig.ebb.waitForCompletion(2000));
+	CHECK_EQ(rig.ebb.sendCommand("QS"), "100,-100");
+
+	// A timed-out submission still queued behind motion is never sent
+	rig.ebb.setPipelineDepth(1);
+	for (int i = 0; i < 8; ++i) {
+		rig.ebb.moveStepperStepsAsync(100, 10, 10);
+	}
+	bool cancelled = false;
+	try {
+		rig.ebb.sendCommand("SN,9", 1, 20);
+	} catch (const std::runtime_error & e) {
+		cancelled = std::strstr(e.what(), "cancelled") != nullptr;
+	}
+	CHECK(cancelled);
+	CHECK(rig.ebb.waitForCompletion(3000));
+	CHECK_EQ(rig.ebb.sendCommand("QN"), "4");
+	CHECK_EQ(rig.transport->count("SN,9"), 0u);
+
+	rig.ebb.stopThread();
+	CHECK(!rig.ebb.isThreadRunning());
+}
+
+// A compiled job survives the trip through a file, and runs to where it says
+static void testJob() {
+	ofxEbbJobCompiler compiler;
+	compiler.drawPolyline({ { 10, 10 }, { 30, 10 }, { 30, 25 }, { 10, 25 } }, true);
+	compiler.drawPolyline({ { 40, 5 }, { 55, 20 }, { 42.5, 31.25 } });
+	compiler.moveTo(0, 0);
+	const auto bytes = compiler.getWriter().bytes();
+
+	const auto path = (std::filesystem::temp_directory_path() / "ofxEbbControlTests.ebbjob").string();
+	CHECK(compiler.save(path));
+	ofxEbbJobFile saved, inMemory;
+	CHECK(saved.open(path));
+	CHECK(inMemory.open(bytes));
+	if (!saved.isOpen() || !inMemory.isOpen()) {
+		return;
+	}
+
+	CHECK_EQ(saved.getHeader().records, compiler.getWriter().getRecordCount());
+	CHECK_EQ(saved.getHeader().nodes, 2u);
+	CHECK_EQ(saved.getHeader().durationUs, inMemory.getHeader().durationUs);
+
+	auto a = saved.reader();
+	auto b = inMemory.reader();
+	ofxEbbJobRecord ra, rb;
+	size_t records = 0;
+	std::array<int64_t, 2> total { { 0, 0 } };
+	bool same = true;
+	while (a.next(ra)) {
+		if (!b.next(rb) || ra.op != rb.op || ra.argc != rb.argc || ra.args != rb.args || ra.durationUs != rb.durationUs) {
+			same = false;
+			break;
+		}
+		const auto steps = ra.steps();
+		total[0] += steps[0];
+		total[1] += steps[1];
+		++records;
+	}
+	CHECK(same);
+	CHECK(!a.failed() && !b.next(rb));
+	CHECK_EQ(records, saved.getHeader().records);
+	// The job ends back at the origin
+	CHECK_STEPS(total, 0, 0);
+
+	Rig rig;
+	rig.ebb.runJob(saved);
+	CHECK(rig.ebb.waitForCompletion(2000));
+	CHECK_STEPS(rig.board().getPosition(), 0, 0);
+	CHECK_EQ(rig.ebb.getNodeCount(), 2u);
+	CHECK(!rig.board().isPenDown());
+
+	saved.close();
+	std::filesystem::remove(path);
+}
+
+// Planned moves add up to exactly the displacement asked for
+static void testPlanner() {
+	const std::vector<ofxEbbPoint> points = { { 12.3, 4.56 }, { 50.01, 4.56 }, { 50.01, 40.7 }, { 3.3, 22.2 }, { 0.0, 0.0 }, { 100.0, 0.1 } };
+	ofxEbbMotionLimits limits;
+
+	for (auto kinematics : { ofxEbbKinematics::Direct, ofxEbbKinematics::Mixed }) {
+		ofxEbbPlanner planner(80.0, kinematics);
+		planner.setPosition(0, 0);
+
+		// Leg by leg: each vertex is reached exactly
+		std::vector<ofxEbbLowLevelMove> moves;
+		std::vector<size_t> vertexEnds;
+		planner.plan(points.data(), points.size(), limits, moves, vertexEnds);
+		CHECK_EQ(vertexEnds.size(), points.size());
+		std::array<int64_t, 2> sum { { 0, 0 } };
+		size_t move = 0;
+		for (size_t i = 0; i < points.size() && i < vertexEnds.size(); ++i) {
+			for (; move < vertexEnds[i]; ++move) {
+				sum[0] += moves[move].steps[0];
+				sum[1] += moves[move].steps[1];
+			}
+			const auto target = planner.toSteps(points[i]);
+			CHECK_STEPS(sum, target[0], target[1]);
+		}
+		CHECK_EQ(move, moves.size());
+		const auto end = planner.toSteps(points.back());
+		CHECK_STEPS(planner.getPositionSteps(), end[0], end[1]);
+
+		// Fed in pieces, the same total
+		ofxEbbPlanner pieces(80.0, kinematics);
+		std::vector<ofxEbbLowLevelMove> incremental;
+		for (size_t i = 0; i < points.size(); i += 2) {
+			pieces.planIncremental(points.data() + i, std::min<size_t>(2, points.size() - i), limits, incremental, i + 2 >= points.size());
+		}
+		std::array<int64_t, 2> incrementalSum { { 0, 0 } };
+		for (const auto & m : incremental) {
+			incrementalSum[0] += m.steps[0];
+			incrementalSum[1] += m.steps[1];
+		}
+		CHECK_STEPS(incrementalSum, end[0], end[1]);
+	}
+
+	// And on the board, through ofxEbbControl
+	Rig rig;
+	rig.ebb.drawPolyline(points);
+	rig.ebb.moveTo(7.77, 3.33);
+	CHECK(rig.ebb.waitForCompletion(2000));
+	const auto target = rig.ebb.getPlanner().toSteps({ 7.77, 3.33 });
+	CHECK_STEPS(rig.board().getPosition(), target[0], target[1]);
+	CHECK_STEPS(rig.ebb.getPlanner().getPositionSteps(), target[0], target[1]);
+}
+
+// The predictor follows motion without asking the board
+static void testPredictor() {
+	Rig rig(simSettings(1.0));
+	const auto start = std::chrono::steady_clock::now();
+	CHECK(rig.ebb.moveStepperSteps(200, 400, -300));
+	rig.ebb.setPenState(true, 50);
+
+	const auto during = rig.ebb.predictPosition(start + std::chrono::milliseconds(100));
+	CHECK(during.moving);
+	CHECK(during.steps[0] > 0 && during.steps[0] < 400);
+
+	const auto after = rig.ebb.predictPosition(start + std::chrono::seconds(2));
+	CHECK(!after.moving);
+	CHECK_STEPS(after.steps, 400, -300);
+	CHECK(after.penKnown && after.penDown);
+
+	CHECK(rig.ebb.waitForCompletion(2000));
+	const auto reported = rig.ebb.getStepPositions();
+	CHECK_EQ(reported[0], 400);
+	CHECK_EQ(reported[1], -300);
+	CHECK_STEPS(rig.board().getPosition(), 400, -300);
+	CHECK_STEPS(rig.ebb.predictPosition().steps, 400, -300);
+
+	// A QS reply read elsewhere moves an idle prediction onto it
+	Rig idle;
+	idle.ebb.correctPrediction({ { 10, 20 } });
+	CHECK_STEPS(idle.ebb.predictPosition().steps, 10, 20);
+}
+
+// Redundant pen commands are skipped until the cache is invalidated
+static void testState() {
+	Rig rig;
+	rig.ebb.setPenState(true);
+	rig.ebb.setPenState(true);
+	CHECK_EQ(rig.transport->count("SP,"), 1u);
+	rig.ebb.setPenState(false);
+	rig.ebb.setPenState(false);
+	CHECK_EQ(rig.transport->count("SP,"), 2u);
+
+	rig.ebb.invalidateState();
+	rig.ebb.setPenState(false);
+	CHECK_EQ(rig.transport->count("SP,"), 3u);
+	rig.ebb.setPenState(false);
+	CHECK_EQ(rig.transport->count("SP,"), 3u);
+
+	rig.ebb.setStateCaching(false);
+	rig.ebb.setPenState(false);
+	CHECK_EQ(rig.transport->count("SP,"), 4u);
+	CHECK(rig.ebb.waitForCompletion(2000));
+	CHECK(!rig.board().isPenDown());
+}
+
+//========================================================================
+
+int main(
+	int argc,
+	char ** argv) {
+	ofSetLogLevel(OF_LOG_ERROR);
+
+	const std::pair<const char *, void (*)()> tests[] = {
+		{ "replies", testReplies },
+		{ "timeouts", testTimeouts },
+		{ "async", testAsync },
+		{ "job", testJob },
+		{ "planner", testPlanner },
+		{ "predictor", testPredictor },
+		{ "state", testState },
+	};
+
+	bool found = false;
+	for (const auto & [name, test] : tests) {
+		if (argc > 1 && std::strcmp(argv[1], name) != 0) {
+			continue;
+		}
+		found = true;
+		const int before = failures;
+		test();
+		std::printf("%-10s %s\n", name, failures == before ? "ok" : "FAILED");
+	}
+	if (!found) {
+		std::fprintf(stderr, "Unknown test '%s'\n", argv[1]);
+		return 1;
+	}
+	return failures;
+}